@@ -0,0 +1,243 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <precomputed_atmospheric_scattering/atmosphere/model.h>
+#include <render_util/texture_manager.h>
+#include <render_util/gl_binding/null_interface.h>
+
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace render_util::gl_binding;
+using atmosphere::DensityProfileLayer;
+using atmosphere::Model;
+using render_util::benchmark::BenchmarkGlobals;
+
+
+namespace
+{
+
+
+constexpr unsigned int NUM_SCATTERING_ORDERS = 4;
+
+
+/// owns the model and what it needs - the members are destroyed in reverse order
+struct ModelState
+{
+  BenchmarkGlobals globals;
+  render_util::TextureManager texture_manager { 0 };
+  unique_ptr<Model> model;
+};
+
+
+/**
+ * The model's shaders include the GLSL files of the model, which are only installed
+ * next to them - from the source tree they are copied to output_dir.
+ */
+string getModelShaderDir(const string &shader_dir, const string &output_dir)
+{
+  namespace fs = std::filesystem;
+
+  const string installed_dir = shader_dir + "/atmosphere_precomputed";
+  if (fs::exists(installed_dir + "/functions.glsl"))
+    return installed_dir;
+
+#ifdef RENDER_UTIL_BENCHMARK_ATMOSPHERE_SOURCE_DIR
+  const string staged_dir = output_dir + "/render_util_benchmarks_atmosphere_shaders";
+
+  fs::copy(installed_dir, staged_dir,
+           fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+
+  for (auto name : { "definitions.glsl", "constants.glsl", "functions.glsl" })
+  {
+    fs::copy_file(string(RENDER_UTIL_BENCHMARK_ATMOSPHERE_SOURCE_DIR) + '/' + name,
+                  staged_dir + '/' + name, fs::copy_options::overwrite_existing);
+  }
+
+  return staged_dir;
+#else
+  throw runtime_error("the atmosphere model's GLSL files are missing in " + installed_dir);
+#endif
+}
+
+
+/// a small earth-like atmosphere, precomputed for the RGB wavelengths only
+unique_ptr<ModelState> createModel(const string &shader_dir)
+{
+  const vector<double> wavelengths = { 440, 550, 680 };
+  const vector<double> solar_irradiance(wavelengths.size(), 1.5);
+  const vector<double> rayleigh_scattering = { 33.1e-6, 13.5e-6, 5.8e-6 };
+  const vector<double> mie_scattering(wavelengths.size(), 3.996e-6);
+  const vector<double> mie_extinction(wavelengths.size(), 4.44e-6);
+  const vector<double> absorption_extinction(wavelengths.size(), 0.0);
+  const vector<double> ground_albedo(wavelengths.size(), 0.1);
+
+  const DensityProfileLayer rayleigh_layer(0.0, 1.0, -1.0 / 8000.0, 0.0, 0.0);
+  const DensityProfileLayer mie_layer(0.0, 1.0, -1.0 / 1200.0, 0.0, 0.0);
+  const vector<DensityProfileLayer> ozone_density =
+  {
+    DensityProfileLayer(25000.0, 0.0, 0.0, 1.0 / 15000.0, -2.0 / 3.0),
+    DensityProfileLayer(0.0, 0.0, 0.0, -1.0 / 15000.0, 8.0 / 3.0),
+  };
+
+  auto state = make_unique<ModelState>();
+
+  state->model = make_unique<Model>(
+      glm::dvec3(680.0, 550.0, 440.0),
+      wavelengths, solar_irradiance, 0.00935 / 2.0,
+      6360000.0, 6420000.0,
+      vector<DensityProfileLayer> { rayleigh_layer }, rayleigh_scattering,
+      vector<DensityProfileLayer> { mie_layer }, mie_scattering, mie_extinction, 0.8,
+      ozone_density, absorption_extinction, ground_albedo, glm::radians(102.0),
+      1000.0, 3, false, false, shader_dir,
+      state->texture_manager, false, 0, false);
+
+  return state;
+}
+
+
+/// glGetTextureImage for download, the glTexSubImage* procedures otherwise - in call order
+vector<NullTextureTransfer> getTransfers(bool download)
+{
+  vector<NullTextureTransfer> transfers;
+
+  for (auto &transfer : getNullTextureTransfers())
+  {
+    bool is_download = transfer.proc_name == "glGetTextureImage";
+    bool is_upload = transfer.proc_name.find("glTexSubImage") == 0;
+
+    if (download ? is_download : is_upload)
+      transfers.push_back(transfer);
+  }
+
+  return transfers;
+}
+
+
+/**
+ * Precomputes the textures, saves them to path and loads them into a second model.
+ * The data the null interface returned when the textures were read back for saving
+ * must be the data uploaded when loading.
+ */
+void checkTextureCacheRoundTrip(const string &shader_dir, const string &path)
+{
+  auto previous_interface = GL_Interface::getCurrent();
+  auto recording_interface = createNullInterface();
+  GL_Interface::setCurrent(recording_interface.get());
+  enableNullTextureDataRecording(true);
+
+  string error;
+
+  try
+  {
+    vector<NullTextureTransfer> saved;
+
+    {
+      auto state = createModel(shader_dir);
+      state->model->Init(NUM_SCATTERING_ORDERS);
+
+      resetNullInterfaceStatistics();
+
+      if (state->model->SaveTextures(path, NUM_SCATTERING_ORDERS))
+        saved = getTransfers(true);
+      else
+        error = "failed to write " + path;
+    }
+
+    auto state = createModel(shader_dir);
+
+    if (error.empty() && state->model->LoadTextures(path, NUM_SCATTERING_ORDERS + 1))
+      error = "the cache file was accepted for a different number of scattering orders";
+
+    resetNullInterfaceStatistics();
+
+    if (error.empty() && !state->model->LoadTextures(path, NUM_SCATTERING_ORDERS))
+      error = "failed to load " + path;
+
+    if (error.empty())
+    {
+      // the textures are saved and loaded in the same order
+      auto loaded = getTransfers(false);
+
+      if (saved.empty() || saved.size() != loaded.size())
+        error = "the number of loaded textures differs from the number of saved ones";
+
+      for (size_t i = 0; error.empty() && i < saved.size(); i++)
+      {
+        if (loaded[i].size != saved[i].size || loaded[i].data != saved[i].data)
+          error = "loaded texture " + to_string(i) + " differs from the saved one";
+      }
+    }
+  }
+  catch (std::exception &e)
+  {
+    error = e.what();
+  }
+
+  enableNullTextureDataRecording(false);
+  GL_Interface::setCurrent(previous_interface);
+
+  if (!error.empty())
+    throw runtime_error("atmosphere texture cache: " + error);
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+/**
+ * Loading the precomputed atmosphere textures from the cache file instead of precomputing them.
+ * The setup checks that the textures survive saving and loading.
+ */
+void registerAtmosphereBenchmarks(Suite &suite)
+{
+  const string shader_dir = suite.getOptions().shader_dir;
+  const string output_dir = suite.getOptions().output_dir;
+
+  suite.add(
+  {
+    "atmosphere/texture_cache_load", false, 0, {},
+    [shader_dir, output_dir]
+    {
+      const string model_shader_dir = getModelShaderDir(shader_dir, output_dir);
+      const string path = output_dir + "/render_util_benchmarks_atmosphere_textures.bin";
+
+      checkTextureCacheRoundTrip(model_shader_dir, path);
+
+      shared_ptr<ModelState> state = createModel(model_shader_dir);
+
+      return function<void()>([state, path]
+      {
+        if (!state->model->LoadTextures(path, NUM_SCATTERING_ORDERS))
+          throw runtime_error("failed to load " + path);
+      });
+    }
+  });
+}
+
+
+} // namespace render_util::benchmark
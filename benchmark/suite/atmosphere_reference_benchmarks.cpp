@@ -0,0 +1,142 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <atmosphere/reference/model.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+using namespace atmosphere::reference;
+
+
+namespace
+{
+
+
+constexpr unsigned int NUM_SCATTERING_ORDERS = 2;
+
+
+AtmosphereParameters createEarthAtmosphereParameters()
+{
+  // Same values as in atmosphere/reference/model_test.cc
+  constexpr int kLambdaMin = 360;
+  constexpr int kLambdaMax = 830;
+  constexpr double kSolarIrradiance[48] = {
+    1.11776, 1.14259, 1.01249, 1.14716, 1.72765, 1.73054, 1.6887, 1.61253,
+    1.91198, 2.03474, 2.02042, 2.02212, 1.93377, 1.95809, 1.91686, 1.8298,
+    1.8685, 1.8931, 1.85149, 1.8504, 1.8341, 1.8345, 1.8147, 1.78158, 1.7533,
+    1.6965, 1.68194, 1.64654, 1.6048, 1.52143, 1.55622, 1.5113, 1.474, 1.4482,
+    1.41018, 1.36775, 1.34188, 1.31429, 1.28303, 1.26758, 1.2367, 1.2082,
+    1.18737, 1.14683, 1.12362, 1.1058, 1.07124, 1.04992
+  };
+  constexpr ScatteringCoefficient kRayleigh = 1.24062e-6 / m;
+  constexpr Length kRayleighScaleHeight = 8000.0 * m;
+  constexpr Length kMieScaleHeight = 1200.0 * m;
+  constexpr double kMieAngstromAlpha = 0.0;
+  constexpr double kMieAngstromBeta = 5.328e-3;
+  constexpr double kMieSingleScatteringAlbedo = 0.9;
+  constexpr double kMiePhaseFunctionG = 0.8;
+  constexpr double kOzoneCrossSection[48] = {
+    1.18e-27, 2.182e-28, 2.818e-28, 6.636e-28, 1.527e-27, 2.763e-27, 5.52e-27,
+    8.451e-27, 1.582e-26, 2.316e-26, 3.669e-26, 4.924e-26, 7.752e-26,
+    9.016e-26, 1.48e-25, 1.602e-25, 2.139e-25, 2.755e-25, 3.091e-25, 3.5e-25,
+    4.266e-25, 4.672e-25, 4.398e-25, 4.701e-25, 5.019e-25, 4.305e-25,
+    3.74e-25, 3.215e-25, 2.662e-25, 2.238e-25, 1.852e-25, 1.473e-25,
+    1.209e-25, 9.423e-26, 7.455e-26, 6.566e-26, 5.105e-26, 4.15e-26,
+    4.228e-26, 3.237e-26, 2.451e-26, 2.801e-26, 2.534e-26, 1.624e-26,
+    1.465e-26, 2.078e-26, 1.383e-26, 7.105e-27
+  };
+  constexpr dimensional::Scalar<-2, 0, 0, 0, 0> kDobsonUnit = 2.687e20 / m2;
+  constexpr NumberDensity kMaxOzoneNumberDensity = 300.0 * kDobsonUnit / (15.0 * km);
+
+  vector<SpectralIrradiance> solar_irradiance;
+  vector<ScatteringCoefficient> rayleigh_scattering;
+  vector<ScatteringCoefficient> mie_scattering;
+  vector<ScatteringCoefficient> mie_extinction;
+  vector<ScatteringCoefficient> absorption_extinction;
+  for (int l = kLambdaMin; l <= kLambdaMax; l += 10)
+  {
+    double lambda = static_cast<double>(l) * 1e-3;  // micro-meters
+    ScatteringCoefficient mie = kMieAngstromBeta / kMieScaleHeight * pow(lambda, -kMieAngstromAlpha);
+    solar_irradiance.push_back(kSolarIrradiance[(l - kLambdaMin) / 10] * watt_per_square_meter_per_nm);
+    rayleigh_scattering.push_back(kRayleigh * pow(lambda, -4));
+    mie_scattering.push_back(mie * kMieSingleScatteringAlbedo);
+    mie_extinction.push_back(mie);
+    absorption_extinction.push_back(kMaxOzoneNumberDensity *
+                                    kOzoneCrossSection[(l - kLambdaMin) / 10] * m2);
+  }
+
+  AtmosphereParameters params;
+  params.solar_irradiance = IrradianceSpectrum(kLambdaMin * nm, kLambdaMax * nm, solar_irradiance);
+  params.sun_angular_radius = 0.2678 * deg;
+  params.bottom_radius = 6360.0 * km;
+  params.top_radius = 6420.0 * km;
+  params.rayleigh_density.layers[1] =
+    DensityProfileLayer(0.0 * m, 1.0, -1.0 / kRayleighScaleHeight, 0.0 / m, 0.0);
+  params.rayleigh_scattering = ScatteringSpectrum(kLambdaMin * nm, kLambdaMax * nm, rayleigh_scattering);
+  params.mie_density.layers[1] =
+    DensityProfileLayer(0.0 * m, 1.0, -1.0 / kMieScaleHeight, 0.0 / m, 0.0);
+  params.mie_scattering = ScatteringSpectrum(kLambdaMin * nm, kLambdaMax * nm, mie_scattering);
+  params.mie_extinction = ScatteringSpectrum(kLambdaMin * nm, kLambdaMax * nm, mie_extinction);
+  params.mie_phase_function_g = kMiePhaseFunctionG;
+  params.absorption_density.layers[0] =
+    DensityProfileLayer(25.0 * km, 0.0, 0.0 / km, 1.0 / (15.0 * km), -2.0 / 3.0);
+  params.absorption_density.layers[1] =
+    DensityProfileLayer(0.0 * km, 0.0, 0.0 / km, -1.0 / (15.0 * km), 8.0 / 3.0);
+  params.absorption_extinction =
+    ScatteringSpectrum(kLambdaMin * nm, kLambdaMax * nm, absorption_extinction);
+  params.ground_albedo = DimensionlessSpectrum(0.1);
+  params.mu_s_min = cos(102.0 * deg);
+
+  return params;
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+/// the CPU reference precomputation of the atmosphere textures, with the default thread pool
+void registerAtmosphereReferenceBenchmarks(Suite &suite)
+{
+  suite.add(
+  {
+    "atmosphere/reference_precompute", true, 0, {},
+    []
+    {
+      auto params = make_shared<AtmosphereParameters>(createEarthAtmosphereParameters());
+
+      return function<void()>([params]
+      {
+        // no cache directory - always precompute
+        Model model(*params, "");
+        model.Init(NUM_SCATTERING_ORDERS);
+      });
+    }
+  });
+}
+
+
+} // namespace render_util::benchmark
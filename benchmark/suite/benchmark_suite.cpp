@@ -0,0 +1,397 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <thread_pool.h>
+#include <util.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <exception>
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+#include <glm/glm.hpp>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using Clock = chrono::steady_clock;
+
+/// fast micro benchmarks are timed in batches of calls taking at least this long
+constexpr double MIN_SAMPLE_MS = 1;
+
+/// receives setCounter() - only set while a benchmark runs
+render_util::benchmark::Result *g_running_result = nullptr;
+
+
+template <class F>
+double measureMilliseconds(F run)
+{
+  auto start = Clock::now();
+  run();
+  chrono::duration<double, milli> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+
+string getCompiler()
+{
+#if defined(__clang__)
+  return "clang " __clang_version__;
+#elif defined(__GNUC__)
+  return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+  return "msvc " + to_string(_MSC_VER);
+#else
+  return "unknown";
+#endif
+}
+
+
+string getUTCTime()
+{
+  time_t now = time(nullptr);
+  char buffer[32] {};
+  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  return buffer;
+}
+
+
+void computeStatistics(vector<double> samples_ms, int calls_per_sample,
+                       double items_per_call, render_util::benchmark::Result &result)
+{
+  assert(!samples_ms.empty());
+  assert(calls_per_sample > 0);
+
+  for (auto &sample : samples_ms)
+    sample /= calls_per_sample;
+
+  sort(samples_ms.begin(), samples_ms.end());
+
+  double sum = 0;
+  for (auto sample : samples_ms)
+    sum += sample;
+
+  const size_t num_samples = samples_ms.size();
+  const double mean = sum / num_samples;
+
+  double variance = 0;
+  for (auto sample : samples_ms)
+    variance += (sample - mean) * (sample - mean);
+  if (num_samples > 1)
+    variance /= num_samples - 1;
+
+  double median = samples_ms[num_samples / 2];
+  if (num_samples % 2 == 0)
+    median = (samples_ms[num_samples / 2 - 1] + median) / 2;
+
+  result.num_samples = num_samples;
+  result.calls_per_sample = calls_per_sample;
+  result.min_ms = samples_ms.front();
+  result.max_ms = samples_ms.back();
+  result.mean_ms = mean;
+  result.median_ms = median;
+  result.stddev_ms = sqrt(variance);
+
+  if (items_per_call > 0 && median > 0)
+    result.items_per_s = items_per_call / (median / 1000.0);
+}
+
+
+/// -1 .. 1
+float getLatticeValue(mt19937 &generator)
+{
+  // not uniform_real_distribution - its results differ between standard libraries
+  return float(generator()) / float(mt19937::max()) * 2 - 1;
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+void setCounter(const string &name, double value)
+{
+  assert(g_running_result);
+  if (g_running_result)
+    g_running_result->counters[name] = value;
+}
+
+
+bool Suite::isSelected(const Benchmark &benchmark) const
+{
+  if (benchmark.is_macro && m_options.skip_macro)
+    return false;
+  return benchmark.name.find(m_options.filter) != string::npos;
+}
+
+
+Result Suite::run(const Benchmark &benchmark)
+{
+  Result result;
+  result.name = benchmark.name;
+  result.is_macro = benchmark.is_macro;
+  result.item_name = benchmark.item_name;
+
+  g_running_result = &result;
+
+  try
+  {
+    auto body = benchmark.setup();
+    assert(body);
+
+    vector<double> samples_ms;
+    int calls_per_sample = 1;
+
+    if (benchmark.is_macro)
+    {
+      for (int i = 0; i < m_options.macro_repetitions; i++)
+        samples_ms.push_back(measureMilliseconds(body));
+    }
+    else
+    {
+      // warm-up - also tells how many calls are needed per sample
+      double warm_up_ms = measureMilliseconds(body);
+      if (warm_up_ms < MIN_SAMPLE_MS)
+        calls_per_sample = int(ceil(MIN_SAMPLE_MS / std::max(warm_up_ms, 1e-6)));
+      calls_per_sample = std::min(calls_per_sample, 100000);
+
+      double total_ms = 0;
+      while (samples_ms.size() < size_t(m_options.min_repetitions) ||
+             total_ms < m_options.min_time_s * 1000)
+      {
+        double ms = measureMilliseconds([&]
+        {
+          for (int i = 0; i < calls_per_sample; i++)
+            body();
+        });
+        samples_ms.push_back(ms);
+        total_ms += ms;
+      }
+    }
+
+    computeStatistics(move(samples_ms), calls_per_sample, benchmark.items_per_call, result);
+  }
+  catch (std::exception &e)
+  {
+    result.error = e.what();
+  }
+
+  g_running_result = nullptr;
+
+  return result;
+}
+
+
+vector<Result> Suite::run(ostream &out)
+{
+  vector<Result> results;
+
+  out << left << setw(40) << "benchmark" << right
+      << setw(9) << "samples"
+      << setw(12) << "median ms"
+      << setw(12) << "min ms"
+      << setw(10) << "stddev %"
+      << setw(14) << "items/s" << endl;
+
+  for (auto &benchmark : m_benchmarks)
+  {
+    if (!isSelected(benchmark))
+      continue;
+
+    auto result = run(benchmark);
+
+    out << left << setw(40) << result.name << right;
+    if (result.error.empty())
+    {
+      out << setw(9) << result.num_samples
+          << fixed << setprecision(4)
+          << setw(12) << result.median_ms
+          << setw(12) << result.min_ms
+          << setprecision(1)
+          << setw(10) << (result.mean_ms > 0 ? 100 * result.stddev_ms / result.mean_ms : 0.0);
+      if (result.items_per_s > 0)
+      {
+        out << setw(14) << setprecision(3) << defaultfloat << result.items_per_s
+            << ' ' << result.item_name;
+      }
+      out << endl;
+
+      for (auto &counter : result.counters)
+        out << "  " << counter.first << ": " << setprecision(6) << defaultfloat << counter.second << endl;
+    }
+    else
+    {
+      out << "  failed: " << result.error << endl;
+    }
+
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+
+void Suite::writeJSON(const vector<Result> &results, ostream &out) const
+{
+  auto &o = m_options;
+
+  out << setprecision(9);
+
+  out << "{" << endl;
+  out << "  \"context\": {" << endl;
+  out << "    \"suite\": \"render_util_benchmarks\"," << endl;
+  out << "    \"date\": " << util::quoteJSON(getUTCTime()) << "," << endl;
+  out << "    \"compiler\": " << util::quoteJSON(getCompiler()) << "," << endl;
+#ifdef NDEBUG
+  out << "    \"assertions\": false," << endl;
+#else
+  out << "    \"assertions\": true," << endl;
+#endif
+  out << "    \"num_threads\": " << util::ThreadPool::getDefaultNumThreads() << "," << endl;
+  out << "    \"filter\": " << util::quoteJSON(o.filter) << "," << endl;
+  out << "    \"min_repetitions\": " << o.min_repetitions << "," << endl;
+  out << "    \"min_time_s\": " << o.min_time_s << "," << endl;
+  out << "    \"macro_repetitions\": " << o.macro_repetitions << "," << endl;
+  out << "    \"map_size\": " << o.map_size << endl;
+  out << "  }," << endl;
+
+  out << "  \"benchmarks\": [";
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    auto &r = results[i];
+
+    out << (i ? "," : "") << endl;
+    out << "    {" << endl;
+    out << "      \"name\": " << util::quoteJSON(r.name) << "," << endl;
+    out << "      \"type\": " << (r.is_macro ? "\"macro\"" : "\"micro\"") << "," << endl;
+
+    if (!r.error.empty())
+    {
+      out << "      \"error\": " << util::quoteJSON(r.error) << endl;
+    }
+    else
+    {
+      out << "      \"num_samples\": " << r.num_samples << "," << endl;
+      out << "      \"calls_per_sample\": " << r.calls_per_sample << "," << endl;
+      out << "      \"min_ms\": " << r.min_ms << "," << endl;
+      out << "      \"median_ms\": " << r.median_ms << "," << endl;
+      out << "      \"mean_ms\": " << r.mean_ms << "," << endl;
+      out << "      \"max_ms\": " << r.max_ms << "," << endl;
+      out << "      \"stddev_ms\": " << r.stddev_ms;
+      if (r.items_per_s > 0)
+      {
+        out << "," << endl;
+        out << "      \"items_per_s\": " << r.items_per_s << "," << endl;
+        out << "      \"item_name\": " << util::quoteJSON(r.item_name);
+      }
+      if (!r.counters.empty())
+      {
+        out << "," << endl;
+        out << "      \"counters\": {";
+        for (auto it = r.counters.begin(); it != r.counters.end(); it++)
+        {
+          out << (it != r.counters.begin() ? "," : "") << endl;
+          out << "        " << util::quoteJSON(it->first) << ": " << it->second;
+        }
+        out << endl << "      }";
+      }
+      out << endl;
+    }
+
+    out << "    }";
+  }
+
+  out << endl << "  ]" << endl;
+  out << "}" << endl;
+}
+
+
+ElevationMap::Ptr createSyntheticElevationMap(int size_px, unsigned seed)
+{
+  assert(size_px > 0);
+
+  constexpr int NUM_OCTAVES = 6;
+  constexpr float MAX_HEIGHT = 3000;
+
+  auto map = make_shared<ElevationMap>(glm::ivec2(size_px));
+  map->forEach([] (auto &height) { height = 0; });
+
+  mt19937 generator(seed);
+
+  int cell_size = std::max(2, size_px / 4);
+  float amplitude = 0.5f;
+
+  for (int octave = 0; octave < NUM_OCTAVES && cell_size >= 2; octave++)
+  {
+    const int lattice_size = size_px / cell_size + 2;
+
+    vector<float> lattice(lattice_size * lattice_size);
+    for (auto &value : lattice)
+      value = getLatticeValue(generator);
+
+    for (int y = 0; y < size_px; y++)
+    {
+      const int cell_y = y / cell_size;
+      const float fy = glm::smoothstep(0.f, 1.f, float(y % cell_size) / cell_size);
+
+      for (int x = 0; x < size_px; x++)
+      {
+        const int cell_x = x / cell_size;
+        const float fx = glm::smoothstep(0.f, 1.f, float(x % cell_size) / cell_size);
+
+        auto get = [&] (int x, int y) { return lattice[y * lattice_size + x]; };
+
+        float value = glm::mix(glm::mix(get(cell_x, cell_y), get(cell_x + 1, cell_y), fx),
+                               glm::mix(get(cell_x, cell_y + 1), get(cell_x + 1, cell_y + 1), fx),
+                               fy);
+
+        map->at(x, y) += amplitude * value;
+      }
+    }
+
+    cell_size /= 2;
+    amplitude /= 2;
+  }
+
+  // valleys below sea level are flattened to a sea floor, peaks are sharpened
+  map->forEach([] (auto &height)
+  {
+    float normalized = height + 0.5f;
+    height = normalized > 0 ? MAX_HEIGHT * normalized * normalized : -30.f;
+  });
+
+  return map;
+}
+
+
+} // namespace render_util::benchmark
@@ -0,0 +1,189 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_BENCHMARK_SUITE_H
+#define RENDER_UTIL_BENCHMARK_SUITE_H
+
+#include <render_util/elevation_map.h>
+#include <render_util/globals.h>
+#include <render_util/gl_binding/null_interface.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace render_util::benchmark
+{
+  struct Options
+  {
+    /// only benchmarks whose name contains this are run
+    std::string filter;
+    /// the timed part of a micro benchmark runs at least this often and this long
+    int min_repetitions = 5;
+    double min_time_s = 0.5;
+    /// macro benchmarks run exactly this often
+    int macro_repetitions = 3;
+    bool skip_macro = false;
+    /// size of the synthetic height maps and images
+    int map_size = 1024;
+    /// where macro benchmarks write their output files
+    std::string output_dir = ".";
+    std::string shader_dir;
+  };
+
+
+  /// name -> value of what a benchmark measures besides the time, e.g. a hit rate
+  using Counters = std::map<std::string, double>;
+
+
+  struct Benchmark
+  {
+    /// group/name, e.g. "image/resample_box"
+    std::string name;
+    /// runs a whole tool - timed once per repetition, without warm-up
+    bool is_macro = false;
+    /// work done per call, e.g. the number of pixels - 0 if there is no useful measure
+    double items_per_call = 0;
+    std::string item_name;
+    /**
+     * Creates the input data and returns the timed part, which must be repeatable.
+     * Isn't timed. Throws if the benchmark can't run or the code it measures fails a check,
+     * which makes the suite return non-zero.
+     * Either may call setCounter().
+     */
+    std::function<std::function<void()>()> setup;
+  };
+
+
+  struct Result
+  {
+    std::string name;
+    bool is_macro = false;
+    /// empty if the benchmark ran
+    std::string error;
+    int num_samples = 0;
+    /// calls per sample - fast micro benchmarks are timed in batches
+    int calls_per_sample = 0;
+    /// per call
+    double min_ms = 0;
+    double median_ms = 0;
+    double mean_ms = 0;
+    double max_ms = 0;
+    double stddev_ms = 0;
+    /// based on the median - 0 if the benchmark has no items
+    double items_per_s = 0;
+    std::string item_name;
+    Counters counters;
+  };
+
+
+  class Suite
+  {
+    Options m_options;
+    std::vector<Benchmark> m_benchmarks;
+
+    Result run(const Benchmark&);
+
+  public:
+    explicit Suite(const Options &options) : m_options(options) {}
+
+    const Options &getOptions() const { return m_options; }
+    const std::vector<Benchmark> &getBenchmarks() const { return m_benchmarks; }
+
+    void add(const Benchmark &benchmark) { m_benchmarks.push_back(benchmark); }
+    bool isSelected(const Benchmark&) const;
+
+    /// runs the selected benchmarks in the order they were added and prints a table to out
+    std::vector<Result> run(std::ostream &out);
+
+    /**
+     * One object: "context" describes the build, the machine and the options,
+     * "benchmarks" holds one object per result, with the times in milliseconds per call
+     * and the counters in "counters".
+     */
+    void writeJSON(const std::vector<Result>&, std::ostream&) const;
+  };
+
+
+  /**
+   * Sets a counter of the running benchmark - the last value is reported.
+   * Must be called on the thread which runs the suite.
+   */
+  void setCounter(const std::string &name, double value);
+
+
+  /**
+   * Gives the code under test a GLContext. There can only be one at a time, so it has to be
+   * destroyed before the next benchmark's setup creates one - owning it in the timed part does that.
+   */
+  class BenchmarkGlobals : public Globals
+  {
+    std::shared_ptr<GLContext> m_gl_context = std::make_shared<GLContext>();
+
+  public:
+    std::shared_ptr<GLContext> getCurrentGLContext() override { return m_gl_context; }
+  };
+
+
+  /**
+   * Makes a null interface with the given options current while it lives.
+   * The options stay in effect for the null interface procs until the next one is created.
+   */
+  class ScopedNullInterface
+  {
+    gl_binding::GL_Interface *m_previous = gl_binding::GL_Interface::getCurrent();
+    std::unique_ptr<gl_binding::GL_Interface> m_interface;
+
+  public:
+    explicit ScopedNullInterface(const gl_binding::NullInterfaceOptions &options) :
+      m_interface(gl_binding::createNullInterface(options))
+    {
+      gl_binding::GL_Interface::setCurrent(m_interface.get());
+    }
+
+    ~ScopedNullInterface()
+    {
+      gl_binding::GL_Interface::setCurrent(m_previous);
+    }
+
+    ScopedNullInterface(const ScopedNullInterface&) = delete;
+    ScopedNullInterface &operator=(const ScopedNullInterface&) = delete;
+  };
+
+
+  /**
+   * Rolling hills and mountain ranges from several octaves of value noise.
+   * The same size and seed give the same map on every platform.
+   */
+  ElevationMap::Ptr createSyntheticElevationMap(int size_px, unsigned seed = 1);
+
+
+  void registerImageBenchmarks(Suite&);
+  void registerTerrainBenchmarks(Suite&);
+  void registerShaderBenchmarks(Suite&);
+  void registerToolBenchmarks(Suite&);
+  void registerTextureBenchmarks(Suite&);
+  void registerGLBenchmarks(Suite&);
+  void registerAtmosphereBenchmarks(Suite&);
+  void registerAtmosphereReferenceBenchmarks(Suite&);
+}
+
+#endif
@@ -0,0 +1,991 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <terrain/terrain_layer.h>
+#include <render_util/shader.h>
+#include <render_util/texture_manager.h>
+#include <render_util/texture_util.h>
+#include <render_util/texture_upload_queue.h>
+#include <render_util/stream_buffer.h>
+#include <render_util/gl_context.h>
+#include <render_util/vao.h>
+#include <render_util/uniform_buffer.h>
+#include <render_util/gl_binding/gl_debug.h>
+#include <render_util/gl_binding/null_interface.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using namespace render_util;
+using namespace render_util::gl_binding;
+using render_util::benchmark::BenchmarkGlobals;
+using render_util::benchmark::ScopedNullInterface;
+using render_util::terrain::TerrainLayer;
+using render_util::terrain::TerrainTextureMap;
+
+
+constexpr int NUM_CHECKED_FRAMES = 100;
+
+
+/// GL objects of a type which are alive - the count isn't reset with the statistics
+unsigned long long getNumLiveObjects(NullObjectTypeEnum type)
+{
+  return getNullInterfaceStatistics().objects[type].num_live;
+}
+
+
+namespace uniforms
+{
+
+
+constexpr int NUM_SCALE_LEVELS = 8;
+
+
+struct Scene
+{
+  vector<TerrainLayer> layers;
+  vector<float> scale_levels;
+  glm::ivec2 type_map_size = glm::ivec2(4096);
+};
+
+
+struct SceneUniforms
+{
+  vector<TerrainLayer::Uniforms> layers;
+  UniformHandle<glm::ivec2> type_map_size;
+  UniformHandle<float> max_texture_scale;
+  vector<UniformHandle<float>> scale_levels;
+  UniformHandle<float> cdlod_min_dist;
+  UniformHandle<int> mesh_resolution_m;
+  UniformHandle<int> tile_size_m;
+};
+
+
+/// owns what the draws need - the members are destroyed in reverse order
+struct State
+{
+  TextureManager texture_manager { 0 };
+  ShaderProgram program { "uniform_benchmark", {}, {}, {}, {}, {}, false };
+  Scene scene;
+  SceneUniforms uniforms;
+};
+
+
+TerrainLayer createLayer(const string &prefix, unsigned int first_texunit)
+{
+  TerrainLayer layer;
+  layer.origin_m = glm::vec2(0);
+  layer.size_m = glm::vec2(400e3);
+  layer.uniform_prefix = prefix;
+
+  for (auto &name : { "height_map", "normal_map", "type_map" })
+  {
+    TerrainTextureMap map;
+    map.texunit = first_texunit + layer.texture_maps.size();
+    map.resolution_m = 200;
+    map.size_px = glm::ivec2(2048);
+    map.size_m = glm::vec2(map.size_px * map.resolution_m);
+    map.name = name;
+    layer.texture_maps.push_back(map);
+  }
+
+  return layer;
+}
+
+
+Scene createScene()
+{
+  Scene scene;
+  scene.layers.push_back(createLayer("terrain.detail_layer.", 0));
+  scene.layers.push_back(createLayer("terrain.base_layer.", 3));
+  for (int i = 0; i < NUM_SCALE_LEVELS; i++)
+    scene.scale_levels.push_back(i + 1);
+  return scene;
+}
+
+
+// the uniform code of TerrainCDLOD before uniform handles were introduced
+void setUniformsByName(State &state)
+{
+  auto &program = state.program;
+
+  for (auto &layer : state.scene.layers)
+  {
+    program.setUniform(layer.uniform_prefix + "size_m", layer.size_m);
+    program.setUniform(layer.uniform_prefix + "origin_m", layer.origin_m);
+
+    for (auto &map : layer.texture_maps)
+    {
+      program.setUniformi(layer.uniform_prefix + map.name + ".sampler",
+                          state.texture_manager.getTexUnitNum(map.texunit));
+      program.setUniformi(layer.uniform_prefix + map.name + ".resolution_m", map.resolution_m);
+      program.setUniform(layer.uniform_prefix + map.name + ".size_px", map.size_px);
+      program.setUniform(layer.uniform_prefix + map.name + ".size_m", map.size_m);
+    }
+  }
+
+  program.setUniform("cdlod_min_dist", 10000.f);
+  program.setUniformi("terrain.mesh_resolution_m", 100);
+  program.setUniformi("terrain.tile_size_m", 6400);
+  program.setUniform("typeMapSize", state.scene.type_map_size);
+  program.setUniform("terrain.max_texture_scale", state.scene.scale_levels.back());
+
+  for (size_t i = 0; i < state.scene.scale_levels.size(); i++)
+  {
+    program.setUniform("terrain.land_texture_scale_levels[" + to_string(i) + "]",
+                       state.scene.scale_levels[i]);
+  }
+}
+
+
+SceneUniforms getUniforms(const Scene &scene, ShaderProgram &program)
+{
+  SceneUniforms uniforms;
+
+  for (auto &layer : scene.layers)
+    uniforms.layers.push_back(layer.getUniforms(program));
+
+  uniforms.cdlod_min_dist = program.getUniformHandle<float>("cdlod_min_dist");
+  uniforms.mesh_resolution_m = program.getUniformHandle<int>("terrain.mesh_resolution_m");
+  uniforms.tile_size_m = program.getUniformHandle<int>("terrain.tile_size_m");
+  uniforms.type_map_size = program.getUniformHandle<glm::ivec2>("typeMapSize");
+  uniforms.max_texture_scale = program.getUniformHandle<float>("terrain.max_texture_scale");
+
+  for (size_t i = 0; i < scene.scale_levels.size(); i++)
+  {
+    uniforms.scale_levels.push_back(program.getUniformHandle<float>(
+      "terrain.land_texture_scale_levels[" + to_string(i) + "]"));
+  }
+
+  return uniforms;
+}
+
+
+void setUniformsByHandle(State &state)
+{
+  auto &scene = state.scene;
+  auto &uniforms = state.uniforms;
+  auto &program = state.program;
+
+  for (size_t i = 0; i < scene.layers.size(); i++)
+    scene.layers[i].setUniforms(program, uniforms.layers[i], state.texture_manager);
+
+  program.setUniform(uniforms.cdlod_min_dist, 10000.f);
+  program.setUniform(uniforms.mesh_resolution_m, 100);
+  program.setUniform(uniforms.tile_size_m, 6400);
+  program.setUniform(uniforms.type_map_size, scene.type_map_size);
+  program.setUniform(uniforms.max_texture_scale, scene.scale_levels.back());
+
+  for (size_t i = 0; i < scene.scale_levels.size(); i++)
+    program.setUniform(uniforms.scale_levels[i], scene.scale_levels[i]);
+}
+
+
+shared_ptr<State> createState()
+{
+  auto state = make_shared<State>();
+  state->scene = createScene();
+  state->uniforms = getUniforms(state->scene, state->program);
+  return state;
+}
+
+
+/// GL calls of one draw, after a warm-up draw has filled the location cache
+unsigned long long getNumCallsPerDraw(State &state, void draw(State&))
+{
+  draw(state);
+  resetNullInterfaceStatistics();
+  draw(state);
+  return getNullInterfaceStatistics().getNumCalls();
+}
+
+
+} // namespace uniforms
+
+
+namespace texture_binding
+{
+
+
+constexpr int NUM_TERRAIN_UNITS = 12;
+constexpr int NUM_WATER_UNITS = 5;
+constexpr int NUM_SKY_UNITS = 2;
+constexpr int NUM_WATER_ANIMATION_FRAMES = 8;
+constexpr int NUM_UPLOADS_PER_FRAME = 4;
+
+
+/// owns what the frames need - the members are destroyed in reverse order
+struct State
+{
+  ScopedNullInterface gl_interface;
+  TextureManager texture_manager { 0 };
+  vector<TexturePtr> terrain;
+  vector<TexturePtr> water;
+  vector<TexturePtr> water_animation;
+  vector<TexturePtr> sky;
+  vector<TexturePtr> uploads;
+  int frame = 0;
+
+  explicit State(const NullInterfaceOptions &options) : gl_interface(options) {}
+
+  ~State()
+  {
+    texture_manager.setActive(false);
+  }
+};
+
+
+vector<TexturePtr> createTextures(int count, unsigned int target)
+{
+  vector<TexturePtr> textures;
+  for (int i = 0; i < count; i++)
+    textures.push_back(Texture::create(target));
+  return textures;
+}
+
+
+shared_ptr<State> createState(bool has_direct_state_access)
+{
+  NullInterfaceOptions options;
+  options.has_direct_state_access = has_direct_state_access;
+
+  auto state = make_shared<State>(options);
+  state->terrain = createTextures(NUM_TERRAIN_UNITS, GL_TEXTURE_2D_ARRAY);
+  state->water = createTextures(NUM_WATER_UNITS, GL_TEXTURE_2D);
+  state->water_animation = createTextures(NUM_WATER_ANIMATION_FRAMES, GL_TEXTURE_2D);
+  state->sky = createTextures(NUM_SKY_UNITS, GL_TEXTURE_2D);
+  state->uploads = createTextures(NUM_UPLOADS_PER_FRAME, GL_TEXTURE_2D);
+  state->texture_manager.setActive(true);
+
+  return state;
+}
+
+
+/**
+ * Terrain, water and sky rebinding their textures, water animation switching textures
+ * and streamed uploads using temporary bindings.
+ * Returns the number of TextureManager binds.
+ */
+int drawFrame(State &state)
+{
+  int num_binds = 0;
+  unsigned int unit = 0;
+  const int frame = state.frame++;
+
+  for (auto &texture : state.terrain)
+  {
+    state.texture_manager.bind(unit++, texture);
+    num_binds++;
+  }
+
+  for (size_t i = 0; i < state.water.size(); i++)
+  {
+    // the first two units show the current animation frames
+    auto texture = i < 2 ?
+      state.water_animation[(frame + i) % state.water_animation.size()] : state.water[i];
+    state.texture_manager.bind(unit++, texture);
+    num_binds++;
+  }
+
+  for (auto &texture : state.sky)
+  {
+    state.texture_manager.bind(unit++, texture);
+    num_binds++;
+  }
+
+  for (auto &texture : state.uploads)
+    TemporaryTextureBinding binding(texture);
+
+  return num_binds;
+}
+
+
+unsigned long long getNumBindingCalls()
+{
+  auto stats = getNullInterfaceStatistics();
+  return stats.getNumCalls("glBindTexture") +
+         stats.getNumCalls("glBindTextureUnit") +
+         stats.getNumCalls("glBindTextures") +
+         stats.getNumCalls("glActiveTexture") +
+         stats.getNumCalls("glGetIntegerv");
+}
+
+
+/// compares the binding calls with the calls the former TextureManager issued for the same binds
+void checkBindingCalls(State &state)
+{
+  drawFrame(state);
+
+  resetNullInterfaceStatistics();
+
+  unsigned long long num_manager_binds = 0;
+  for (int i = 0; i < NUM_CHECKED_FRAMES; i++)
+    num_manager_binds += drawFrame(state);
+
+  // GetIntegerv, 2 ActiveTexture and BindTexture per bind,
+  // GetIntegerv and 2 BindTexture per temporary binding
+  auto num_former_calls =
+    num_manager_binds * 4 + NUM_CHECKED_FRAMES * NUM_UPLOADS_PER_FRAME * 3;
+  auto num_calls = getNumBindingCalls();
+
+  if (num_calls > num_former_calls)
+  {
+    throw runtime_error(to_string(num_calls) + " texture binding calls in " +
+                        to_string(NUM_CHECKED_FRAMES) + " frames, the former code issued " +
+                        to_string(num_former_calls));
+  }
+}
+
+
+/**
+ * Code outside render_util (e.g. the viewer's text renderer) binds textures directly -
+ * after invalidateTextureState() the manager must not skip binds because of its shadow copy.
+ */
+void checkInvalidation(State &state)
+{
+  drawFrame(state);
+
+  resetNullInterfaceStatistics();
+  drawFrame(state);
+  auto num_steady_calls = getNumBindingCalls();
+
+  gl::ActiveTexture(GL_TEXTURE0 + NUM_TERRAIN_UNITS + NUM_WATER_UNITS - 1);
+  gl::BindTexture(GL_TEXTURE_2D, 0);
+  invalidateTextureState();
+
+  resetNullInterfaceStatistics();
+  drawFrame(state);
+
+  if (getNumBindingCalls() <= num_steady_calls)
+    throw runtime_error("invalidateTextureState() didn't reach the active TextureManager");
+}
+
+
+} // namespace texture_binding
+
+
+namespace gl_context
+{
+
+
+constexpr int NUM_TERRAIN_PROGRAMS = 2;
+constexpr int NUM_TERRAIN_BATCHES = 8;
+constexpr int NUM_WATER_ANIMATION_FRAMES = 32;
+
+
+/// owns what the frames need - the members are destroyed in reverse order
+struct State
+{
+  BenchmarkGlobals globals;
+  ShaderProgramPtr sky_program;
+  ShaderProgramPtr cirrus_program;
+  ShaderProgramPtr quad_program;
+  vector<ShaderProgramPtr> terrain_programs;
+  unique_ptr<VertexArrayObject> terrain_vao;
+  unique_ptr<VertexArrayObject> cirrus_vao;
+  unique_ptr<UniformBuffer> water_animation;
+  bool invalidate = false;
+  int frame = 0;
+};
+
+
+/// the shaders don't matter - they aren't run
+ShaderProgramPtr createProgram(const string &name, const string &shader_dir)
+{
+  return make_shared<ShaderProgram>(name,
+                                    vector<string>{ "quad_2d" },
+                                    vector<string>{ "quad_2d" },
+                                    vector<string>{},
+                                    vector<string>{},
+                                    vector<string>{ shader_dir });
+}
+
+
+unique_ptr<VertexArrayObject> createVertexArray()
+{
+  const float vertices[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+  const unsigned int indices[] = { 0, 1, 2 };
+  return make_unique<VertexArrayObject>(vertices, sizeof(vertices), indices, sizeof(indices));
+}
+
+
+shared_ptr<State> createState(const string &shader_dir, bool invalidate)
+{
+  auto state = make_shared<State>();
+  state->sky_program = createProgram("sky", shader_dir);
+  state->cirrus_program = createProgram("cirrus", shader_dir);
+  state->quad_program = createProgram("quad_2d", shader_dir);
+  for (int i = 0; i < NUM_TERRAIN_PROGRAMS; i++)
+    state->terrain_programs.push_back(createProgram("terrain_cdlod", shader_dir));
+  state->terrain_vao = createVertexArray();
+  state->cirrus_vao = createVertexArray();
+  state->water_animation = make_unique<UniformBuffer>(16);
+  state->invalidate = invalidate;
+  return state;
+}
+
+
+/**
+ * Sky, terrain batches, cirrus clouds, the water animation uniform block and a text background -
+ * with the bindings invalidated afterwards, like the viewer does after its TextRenderer,
+ * if state.invalidate is set.
+ */
+void drawFrame(State &state)
+{
+  auto &context = *state.globals.getCurrentGLContext();
+
+  context.setCurrentProgram(state.sky_program);
+
+  state.water_animation->set<int>(0, state.frame++ % NUM_WATER_ANIMATION_FRAMES);
+  state.water_animation->upload();
+  state.water_animation->bind(UNIFORM_BLOCK_WATER_ANIMATION);
+
+  {
+    VertexArrayObjectBinding vao_binding(*state.terrain_vao);
+    IndexBufferBinding index_buffer_binding(*state.terrain_vao);
+
+    // the batches of a program are drawn in a row
+    for (int i = 0; i < NUM_TERRAIN_BATCHES; i++)
+      context.setCurrentProgram(state.terrain_programs[i * NUM_TERRAIN_PROGRAMS / NUM_TERRAIN_BATCHES]);
+  }
+
+  context.setCurrentProgram(state.cirrus_program);
+  {
+    VertexArrayObjectBinding vao_binding(*state.cirrus_vao);
+    IndexBufferBinding index_buffer_binding(*state.cirrus_vao);
+  }
+
+  // like Quad2D::draw()
+  auto old_program = context.getCurrentProgram();
+  context.setCurrentProgram(state.quad_program);
+  context.setCurrentProgram(old_program);
+
+  if (state.invalidate)
+    context.invalidate();
+}
+
+
+unsigned long long getNumBindingCalls()
+{
+  auto stats = getNullInterfaceStatistics();
+  return stats.getNumCalls("glUseProgram") +
+         stats.getNumCalls("glBindVertexArray") +
+         stats.getNumCalls("glBindBuffer") +
+         stats.getNumCalls("glBindBufferBase") +
+         stats.getNumCalls("glBindFramebuffer");
+}
+
+
+/// the calls recorded by the null interface have to be the calls GLContext reports
+void checkBindingCalls(State &state)
+{
+  auto &context = *state.globals.getCurrentGLContext();
+
+  // one frame to get past the unknown initial state
+  drawFrame(state);
+
+  // the statistics of all frames are counted as one
+  context.nextFrame();
+  resetNullInterfaceStatistics();
+
+  for (int i = 0; i < NUM_CHECKED_FRAMES; i++)
+    drawFrame(state);
+
+  auto num_calls = getNumBindingCalls();
+  auto num_issued = context.getStatistics().getNumIssued();
+
+  if (num_calls != num_issued)
+  {
+    throw runtime_error(to_string(num_calls) + " binding calls were recorded, GLContext issued " +
+                        to_string(num_issued));
+  }
+}
+
+
+} // namespace gl_context
+
+
+namespace stream_buffer
+{
+
+
+constexpr size_t BYTES_PER_FRAME = 256 * 1024;
+
+
+/// owns what the frames need - the members are destroyed in reverse order
+struct State
+{
+  ScopedNullInterface gl_interface;
+  BenchmarkGlobals globals;
+  StreamBuffer buffer { GL_ARRAY_BUFFER, BYTES_PER_FRAME };
+  int frame = 0;
+
+  explicit State(bool has_buffer_storage) : gl_interface(getOptions(has_buffer_storage)) {}
+
+  static NullInterfaceOptions getOptions(bool has_buffer_storage)
+  {
+    NullInterfaceOptions options;
+    options.has_buffer_storage = has_buffer_storage;
+    return options;
+  }
+};
+
+
+void streamFrame(State &state)
+{
+  size_t offset = 0;
+  auto data = state.buffer.map(BYTES_PER_FRAME, offset);
+  memset(data, state.frame++, BYTES_PER_FRAME);
+  state.buffer.unmap();
+}
+
+
+/// the buffer and its fences have to be deleted with the stream buffer
+void checkObjects(bool has_buffer_storage)
+{
+  const auto num_live_buffers = getNumLiveObjects(NULL_OBJECT_BUFFER);
+  const auto num_live_syncs = getNumLiveObjects(NULL_OBJECT_SYNC);
+
+  {
+    State state(has_buffer_storage);
+    for (int i = 0; i < NUM_CHECKED_FRAMES; i++)
+      streamFrame(state);
+  }
+
+  if (getNumLiveObjects(NULL_OBJECT_BUFFER) != num_live_buffers ||
+      getNumLiveObjects(NULL_OBJECT_SYNC) != num_live_syncs)
+  {
+    throw runtime_error("the stream buffer leaked buffers or fences");
+  }
+}
+
+
+} // namespace stream_buffer
+
+
+namespace gl_debug
+{
+
+
+constexpr auto FRAME_DURATION = chrono::microseconds(1000);
+constexpr int NUM_THREADS = 4;
+constexpr int MESSAGES_PER_THREAD = 10000;
+
+
+/**
+ * Queues messages from several threads, like a driver which reports asynchronously,
+ * while this thread drains the queue once per frame.
+ * Every message has to be either taken or counted as dropped.
+ */
+void runQueue(int num_threads, int messages_per_thread)
+{
+  resetGLDebugStatistics();
+
+  atomic<int> num_running = num_threads;
+  vector<thread> threads;
+
+  for (int t = 0; t < num_threads; t++)
+  {
+    threads.emplace_back([&num_running, messages_per_thread] ()
+    {
+      auto call_site = RENDER_UTIL_GL_CALL_SITE();
+
+      for (int i = 0; i < messages_per_thread; i++)
+      {
+        queueGLDebugMessage(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_ERROR, i, GL_DEBUG_SEVERITY_HIGH,
+                            "GL_INVALID_OPERATION in glDrawElements(no VAO bound)", -1,
+                            call_site);
+      }
+
+      num_running--;
+    });
+  }
+
+  unsigned long long num_taken = 0;
+
+  while (true)
+  {
+    bool finished = num_running == 0;
+
+    GLDebugMessage message;
+    while (takeGLDebugMessage(message))
+      num_taken++;
+
+    if (finished)
+      break;
+
+    this_thread::sleep_for(FRAME_DURATION);
+  }
+
+  for (auto &t : threads)
+    t.join();
+
+  // collects the count of dropped messages - the queue is empty by now
+  processGLDebugMessages();
+
+  auto num_dropped = getGLDebugStatistics().num_dropped;
+  unsigned long long num_queued = (unsigned long long)num_threads * messages_per_thread;
+
+  if (num_taken + num_dropped != num_queued)
+  {
+    throw runtime_error("lost " + to_string(num_queued - num_taken - num_dropped) + " of " +
+                        to_string(num_queued) + " GL debug messages");
+  }
+}
+
+
+} // namespace gl_debug
+
+
+namespace texture_upload
+{
+
+
+constexpr int NUM_TEXTURES = 8;
+
+
+/// "decoding" is generating noise
+ImageRGBA::Ptr decode(int size, int seed)
+{
+  auto image = make_shared<ImageRGBA>(glm::ivec2(size));
+  minstd_rand generator(seed);
+  image->forEach([&] (auto &component) { component = generator(); });
+  return image;
+}
+
+
+vector<TexturePtr> createTextures(int num_textures)
+{
+  vector<TexturePtr> textures;
+  for (int i = 0; i < num_textures; i++)
+    textures.push_back(Texture::create(GL_TEXTURE_2D));
+  return textures;
+}
+
+
+struct State
+{
+  BenchmarkGlobals globals;
+  vector<TexturePtr> textures = createTextures(NUM_TEXTURES);
+};
+
+
+/// returns the bytes uploaded
+unsigned long long uploadSynchronous(const vector<TexturePtr> &textures, int size)
+{
+  resetNullInterfaceStatistics();
+
+  for (size_t i = 0; i < textures.size(); i++)
+    setTextureImage(textures[i], decode(size, i));
+
+  return getNullInterfaceStatistics().texture_bytes_uploaded;
+}
+
+
+/// replaces the images through the queue and drains it, one update() per frame
+void uploadQueued(const vector<TexturePtr> &textures, int size, size_t bytes_per_frame)
+{
+  TextureUploadQueue queue(bytes_per_frame);
+
+  for (size_t i = 0; i < textures.size(); i++)
+    queue.enqueue(textures[i], [size, i] { return makeTextureUploadImage(decode(size, i)); }, true);
+
+  while (!queue.isEmpty())
+    queue.update();
+}
+
+
+/**
+ * The queue has to stay within its per-frame budget, upload as much as the synchronous path,
+ * complete every request and leave no GL objects behind.
+ */
+void checkQueue(int size, int num_textures, size_t bytes_per_frame)
+{
+  const auto num_live_textures = getNumLiveObjects(NULL_OBJECT_TEXTURE);
+  const auto num_live_buffers = getNumLiveObjects(NULL_OBJECT_BUFFER);
+  const auto num_live_syncs = getNumLiveObjects(NULL_OBJECT_SYNC);
+
+  {
+    BenchmarkGlobals globals;
+
+    auto expected_bytes = uploadSynchronous(createTextures(num_textures), size);
+
+    auto textures = createTextures(num_textures);
+    int num_done = 0;
+
+    TextureUploadQueue queue(bytes_per_frame);
+
+    resetNullInterfaceStatistics();
+
+    for (int i = 0; i < num_textures; i++)
+    {
+      queue.enqueue(textures[i], [size, i] { return makeTextureUploadImage(decode(size, i)); },
+                    true, [&num_done] (TexturePtr) { num_done++; });
+    }
+
+    while (!queue.isEmpty())
+    {
+      queue.update();
+
+      // rows larger than the budget are uploaded directly
+      auto bytes_uploaded = queue.getStatistics().bytes_uploaded_last_frame;
+      if (bytes_uploaded > bytes_per_frame &&
+          size_t(size) * ImageRGBA::BYTES_PER_PIXEL <= bytes_per_frame)
+      {
+        throw runtime_error("the upload queue uploaded " + to_string(bytes_uploaded) +
+                            " bytes in a frame, the budget is " + to_string(bytes_per_frame));
+      }
+    }
+
+    auto &stats = queue.getStatistics();
+    auto bytes_uploaded = getNullInterfaceStatistics().texture_bytes_uploaded;
+
+    if (bytes_uploaded != expected_bytes || stats.bytes_uploaded_total != bytes_uploaded)
+    {
+      throw runtime_error("the upload queue uploaded " + to_string(bytes_uploaded) +
+                          " bytes and counted " + to_string(stats.bytes_uploaded_total) +
+                          ", the synchronous path uploaded " + to_string(expected_bytes));
+    }
+
+    if (num_done != num_textures || stats.num_completed != (unsigned long long)num_textures)
+    {
+      throw runtime_error("the upload queue completed " + to_string(stats.num_completed) +
+                          " of " + to_string(num_textures) + " requests");
+    }
+  }
+
+  if (getNumLiveObjects(NULL_OBJECT_TEXTURE) != num_live_textures ||
+      getNumLiveObjects(NULL_OBJECT_BUFFER) != num_live_buffers ||
+      getNumLiveObjects(NULL_OBJECT_SYNC) != num_live_syncs)
+  {
+    throw runtime_error("the upload queue leaked GL objects");
+  }
+}
+
+
+/**
+ * A manager which is destroyed while it is active mustn't be asked to rebind
+ * the textures the queue swaps in afterwards.
+ */
+void checkQueueAfterManagerDestroyed(int size, size_t bytes_per_frame)
+{
+  BenchmarkGlobals globals;
+
+  auto texture = Texture::create(GL_TEXTURE_2D);
+  TextureUploadQueue queue(bytes_per_frame);
+
+  {
+    TextureManager manager(0);
+    manager.setActive(true);
+    manager.bind(0, texture);
+  }
+
+  bool is_done = false;
+  queue.enqueue(texture, [size] { return makeTextureUploadImage(decode(size, 0)); },
+                true, [&is_done] (TexturePtr) { is_done = true; });
+
+  while (!queue.isEmpty())
+    queue.update();
+
+  if (!is_done)
+    throw runtime_error("the upload queue didn't complete a request after a manager was destroyed");
+}
+
+
+} // namespace texture_upload
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+/**
+ * The CPU side of the GL wrappers, with the GL stand-in:
+ * uniforms, streamed buffers, texture and object bindings, the debug message queue and
+ * texture uploads. The setups check the call counts against the former code
+ * and that no GL objects leak.
+ */
+void registerGLBenchmarks(Suite &suite)
+{
+  const string shader_dir = suite.getOptions().shader_dir;
+
+  // per-draw terrain uniforms, by name as TerrainCDLOD used to and with pre-resolved handles
+  suite.add(
+  {
+    "gl/uniforms_by_name", false, 1, "draws",
+    []
+    {
+      shared_ptr<uniforms::State> state = uniforms::createState();
+      return function<void()>([state] { uniforms::setUniformsByName(*state); });
+    }
+  });
+
+  suite.add(
+  {
+    "gl/uniforms_by_handle", false, 1, "draws",
+    []
+    {
+      shared_ptr<uniforms::State> state = uniforms::createState();
+
+      auto by_name = uniforms::getNumCallsPerDraw(*state, uniforms::setUniformsByName);
+      auto by_handle = uniforms::getNumCallsPerDraw(*state, uniforms::setUniformsByHandle);
+      if (by_handle > by_name)
+      {
+        throw runtime_error("setting the uniforms by handle takes " + to_string(by_handle) +
+                            " GL calls, by name " + to_string(by_name));
+      }
+
+      return function<void()>([state] { uniforms::setUniformsByHandle(*state); });
+    }
+  });
+
+  // instance data streamed through a persistent mapping and, for drivers without
+  // ARB_buffer_storage, an unsynchronized one
+  for (bool has_buffer_storage : { true, false })
+  {
+    suite.add(
+    {
+      string("gl/stream_buffer_") + (has_buffer_storage ? "persistent" : "unsynchronized"),
+      false, stream_buffer::BYTES_PER_FRAME, "bytes",
+      [has_buffer_storage]
+      {
+        stream_buffer::checkObjects(has_buffer_storage);
+        auto state = make_shared<stream_buffer::State>(has_buffer_storage);
+        return function<void()>([state] { stream_buffer::streamFrame(*state); });
+      }
+    });
+  }
+
+  // with and without glBindTextureUnit / glBindTextures
+  for (bool has_direct_state_access : { true, false })
+  {
+    suite.add(
+    {
+      string("gl/texture_binding_") + (has_direct_state_access ? "dsa" : "no_dsa"),
+      false, 1, "frames",
+      [has_direct_state_access]
+      {
+        auto state = texture_binding::createState(has_direct_state_access);
+        texture_binding::checkBindingCalls(*state);
+        texture_binding::checkInvalidation(*state);
+        return function<void()>([state] { texture_binding::drawFrame(*state); });
+      }
+    });
+  }
+
+  // program, vertex array and buffer bindings, with and without invalidating them every frame
+  for (bool invalidate : { true, false })
+  {
+    suite.add(
+    {
+      string("gl/context_binding_") + (invalidate ? "invalidated" : "kept"),
+      false, 1, "frames",
+      [shader_dir, invalidate]
+      {
+        auto state = gl_context::createState(shader_dir, invalidate);
+        gl_context::checkBindingCalls(*state);
+        return function<void()>([state] { gl_context::drawFrame(*state); });
+      }
+    });
+  }
+
+  suite.add(
+  {
+    "gl/debug_tag_call_site", false, 1, "calls",
+    []
+    {
+      return function<void()>([] { setGLCallSite(RENDER_UTIL_GL_CALL_SITE()); });
+    }
+  });
+
+  suite.add(
+  {
+    "gl/debug_queue", false, gl_debug::NUM_THREADS * gl_debug::MESSAGES_PER_THREAD, "messages",
+    []
+    {
+      gl_debug::runQueue(1, gl_debug::MESSAGES_PER_THREAD);
+      return function<void()>([]
+      {
+        gl_debug::runQueue(gl_debug::NUM_THREADS, gl_debug::MESSAGES_PER_THREAD);
+      });
+    }
+  });
+
+  // replacing the images of a set of textures on the render thread, decoding included,
+  // and through a TextureUploadQueue - the GL stand-in makes the uploads themselves free
+  {
+    using texture_upload::NUM_TEXTURES;
+
+    const int size = std::max(16, suite.getOptions().map_size / 4);
+    const double num_pixels = double(size) * size * NUM_TEXTURES;
+
+    suite.add(
+    {
+      "gl/texture_upload_synchronous", false, num_pixels, "pixels",
+      [size]
+      {
+        auto state = make_shared<texture_upload::State>();
+        return function<void()>([state, size]
+        {
+          texture_upload::uploadSynchronous(state->textures, size);
+        });
+      }
+    });
+
+    suite.add(
+    {
+      "gl/texture_upload_queue", false, num_pixels, "pixels",
+      [size]
+      {
+        texture_upload::checkQueue(size, NUM_TEXTURES, TextureUploadQueue::DEFAULT_BYTES_PER_FRAME);
+        texture_upload::checkQueueAfterManagerDestroyed(size,
+                                                        TextureUploadQueue::DEFAULT_BYTES_PER_FRAME);
+
+        auto state = make_shared<texture_upload::State>();
+        return function<void()>([state, size]
+        {
+          texture_upload::uploadQueued(state->textures, size,
+                                       TextureUploadQueue::DEFAULT_BYTES_PER_FRAME);
+        });
+      }
+    });
+  }
+}
+
+
+} // namespace render_util::benchmark
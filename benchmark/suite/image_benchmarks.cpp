@@ -0,0 +1,761 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <render_util/image_resample.h>
+#include <render_util/image_util.h>
+#include <render_util/image_kernels.h>
+#include <render_util/image_loader.h>
+#include <render_util/texture_util.h>
+#include <render_util/geometry.h>
+#include <util.h>
+
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using namespace render_util;
+using render_util::benchmark::Benchmark;
+using render_util::benchmark::Suite;
+using render_util::image::kernels::InstructionSet;
+namespace kernels = render_util::image::kernels;
+
+// like TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID
+constexpr float GRID_SCALE = 200;
+
+// between the instruction sets
+constexpr double MAX_INSTRUCTION_SET_ERROR_DEGREES = 0.01;
+// to the serial implementation, which weighs the triangles differently
+constexpr double MAX_MEAN_ERROR_DEGREES = 0.5;
+constexpr double MAX_ERROR_DEGREES = 5;
+
+
+ImageRGBA::ConstPtr createSourceImage(int size)
+{
+  auto image = make_shared<ImageRGBA>(glm::ivec2(size));
+  mt19937 generator(1);
+  image->forEach([&] (auto &component) { component = generator(); });
+  return image;
+}
+
+
+const char *getFilterName(ResampleFilter filter)
+{
+  switch (filter)
+  {
+    case ResampleFilter::BOX:
+      return "box";
+    case ResampleFilter::BILINEAR:
+      return "bilinear";
+    case ResampleFilter::LANCZOS3:
+      return "lanczos3";
+  }
+  abort();
+}
+
+
+vector<InstructionSet> getInstructionSets()
+{
+  vector<InstructionSet> instruction_sets;
+
+  for (auto instruction_set : { InstructionSet::SCALAR, InstructionSet::SSE2, InstructionSet::AVX2 })
+  {
+    if (instruction_set <= kernels::getBestInstructionSet())
+      instruction_sets.push_back(instruction_set);
+  }
+
+  return instruction_sets;
+}
+
+
+string getInstructionSetSuffix(InstructionSet instruction_set)
+{
+  string suffix = kernels::getInstructionSetName(instruction_set);
+  transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+  return suffix;
+}
+
+
+/// the following benchmarks use the best instruction set again
+template <class F>
+auto runWithInstructionSet(InstructionSet instruction_set, F run)
+{
+  kernels::setInstructionSet(instruction_set);
+  auto result = run();
+  kernels::setInstructionSet(kernels::getBestInstructionSet());
+  return result;
+}
+
+
+// the implementations of the image_util.h operations before the row kernels
+
+template <typename T>
+typename T::Ptr createPerPixel(typename T::PixelType color, glm::ivec2 size)
+{
+  auto image = make_shared<T>(size);
+  for (int y = 0; y < image->h(); y++)
+  {
+    for (int x = 0; x < image->w(); x++)
+      image->setPixel(x, y, color);
+  }
+  return image;
+}
+
+
+template <typename T>
+typename T::Ptr flipXPerPixel(typename T::ConstPtr src)
+{
+  auto dst = make_shared<T>(src->size());
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+      dst->setPixel((src->w() - 1) - x, y, src->getPixel(x, y));
+  }
+  return dst;
+}
+
+
+template <typename T>
+typename T::Ptr flipYPerPixel(typename T::ConstPtr src)
+{
+  auto dst = make_shared<T>(src->size());
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+      dst->setPixel(x, (src->h() - 1) - y, src->getPixel(x, y));
+  }
+  return dst;
+}
+
+
+template <typename T>
+typename T::Ptr swapXYPerPixel(typename T::ConstPtr src)
+{
+  auto dst = make_shared<T>(glm::ivec2(src->h(), src->w()));
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+      dst->setPixel(y, x, src->getPixel(x, y));
+  }
+  return dst;
+}
+
+
+template <typename T>
+shared_ptr<Image<typename T::ComponentType>> getChannelPerPixel(typename T::ConstPtr src,
+                                                                int channel)
+{
+  auto dst = make_shared<Image<typename T::ComponentType>>(src->size());
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+      dst->at(x, y) = src->get(x, y, channel);
+  }
+  return dst;
+}
+
+
+template <typename T_dst, typename T>
+shared_ptr<Image<T_dst, T::NUM_COMPONENTS>> convertPerPixel(typename T::ConstPtr src)
+{
+  auto dst = make_shared<Image<T_dst, T::NUM_COMPONENTS>>(src->size());
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+    {
+      for (int i = 0; i < T::NUM_COMPONENTS; i++)
+        dst->at(x, y, i) = src->get(x, y, i);
+    }
+  }
+  return dst;
+}
+
+
+template <typename T>
+typename T::Ptr extendPerPixel(typename T::ConstPtr src, glm::ivec2 new_size,
+                               typename T::PixelType color)
+{
+  auto dst = createPerPixel<T>(color, new_size);
+  for (int y = 0; y < src->h(); y++)
+  {
+    for (int x = 0; x < src->w(); x++)
+      dst->setPixel(x, y, src->getPixel(x, y));
+  }
+  return dst;
+}
+
+
+ImageRGBA::Ptr downSamplePerPixel(ImageRGBA::ConstPtr src, int factor)
+{
+  auto dst = make_shared<ImageRGBA>(src->size() / factor);
+  const int num_samples = factor * factor;
+
+  for (int y = 0; y < dst->h(); y++)
+  {
+    for (int x = 0; x < dst->w(); x++)
+    {
+      for (int i = 0; i < ImageRGBA::NUM_COMPONENTS; i++)
+      {
+        float sum = 0;
+        for (int y_sample = 0; y_sample < factor; y_sample++)
+        {
+          for (int x_sample = 0; x_sample < factor; x_sample++)
+            sum += float(src->get(x * factor + x_sample, y * factor + y_sample, i)) / num_samples;
+        }
+        dst->at(x, y, i) = sum;
+      }
+    }
+  }
+
+  return dst;
+}
+
+
+struct KernelInputs
+{
+  ImageRGBA::ConstPtr rgba;
+  ImageGreyScale::ConstPtr grey;
+  Image<float>::ConstPtr grey_float;
+  RGBA color {{ 10, 20, 30, 255 }};
+};
+
+
+shared_ptr<const KernelInputs> createKernelInputs(int size)
+{
+  auto inputs = make_shared<KernelInputs>();
+
+  auto grey = make_shared<ImageGreyScale>(glm::ivec2(size));
+  mt19937 generator(size);
+  uniform_int_distribution<int> distribution(0, 255);
+  grey->forEach([&] (auto &component) { component = distribution(generator); });
+
+  inputs->rgba = createSourceImage(size);
+  inputs->grey = grey;
+  inputs->grey_float = image::convert<float>(inputs->grey);
+
+  return inputs;
+}
+
+
+/**
+ * Negative, too large and non-finite values must saturate to the same bytes with every
+ * instruction set - the vector paths' packus saturates, assigning a float doesn't.
+ */
+void checkByteConversion(InstructionSet instruction_set)
+{
+  const float values[] =
+  {
+    -1e30f, -256, -1, -0.5f, -0.f, 0, 0.5f, 127.9f, 254.99f, 255, 255.5f, 256, 1000, 65536,
+    3e9f, 1e30f, INFINITY, -INFINITY, NAN,
+  };
+  const unsigned char expected_values[] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 127, 254, 255, 255, 255, 255, 255,
+    255, 255, 255, 0, 0,
+  };
+  static_assert(size(values) == size(expected_values));
+
+  // long enough for the vector loops, with a remainder for the scalar tail
+  vector<float> src(101);
+  vector<unsigned char> expected(src.size());
+  for (size_t i = 0; i < src.size(); i++)
+  {
+    src[i] = values[i % size(values)];
+    expected[i] = expected_values[i % size(values)];
+  }
+
+  auto convert = [&src] (InstructionSet instruction_set)
+  {
+    vector<unsigned char> dst(src.size());
+    return runWithInstructionSet(instruction_set, [&]
+    {
+      kernels::convertRow(src.data(), dst.data(), src.size());
+      return dst;
+    });
+  };
+
+  if (convert(InstructionSet::SCALAR) != expected)
+    throw runtime_error("the scalar float to byte conversion doesn't saturate");
+
+  if (convert(instruction_set) != expected)
+  {
+    throw runtime_error(string("the ") + kernels::getInstructionSetName(instruction_set) +
+                        " float to byte conversion differs from the scalar one");
+  }
+}
+
+
+/**
+ * The per-pixel implementation and the row kernels with each instruction set the CPU supports.
+ * The setup of the latter checks that they produce the same image as the former,
+ * and runs check_kernels if given.
+ */
+template <class PerPixel, class RowKernels>
+void addKernelBenchmarks(Suite &suite, const string &operation,
+                         PerPixel per_pixel, RowKernels row_kernels,
+                         function<void(InstructionSet)> check_kernels = {})
+{
+  const int size = suite.getOptions().map_size;
+  const double num_pixels = double(size) * size;
+
+  suite.add(
+  {
+    "image/" + operation + "_per_pixel", false, num_pixels, "pixels",
+    [size, per_pixel]
+    {
+      auto inputs = createKernelInputs(size);
+      return function<void()>([inputs, per_pixel] { per_pixel(*inputs); });
+    }
+  });
+
+  for (auto instruction_set : getInstructionSets())
+  {
+    suite.add(
+    {
+      "image/" + operation + "_" + getInstructionSetSuffix(instruction_set), false,
+      num_pixels, "pixels",
+      [size, operation, per_pixel, row_kernels, check_kernels, instruction_set]
+      {
+        if (check_kernels)
+          check_kernels(instruction_set);
+
+        auto inputs = createKernelInputs(size);
+
+        auto expected = per_pixel(*inputs);
+        auto result = runWithInstructionSet(instruction_set, [&] { return row_kernels(*inputs); });
+
+        if (result->dataSize() != expected->dataSize() ||
+            !equal(result->data(), result->data() + result->dataSize(), expected->data()))
+        {
+          throw runtime_error(operation + " differs from the per-pixel implementation");
+        }
+
+        return function<void()>([inputs, row_kernels, instruction_set]
+        {
+          runWithInstructionSet(instruction_set, [&] { return row_kernels(*inputs); });
+        });
+      }
+    });
+  }
+}
+
+
+// the former implementation, which renormalized after adding each triangle
+Image<Normal>::Ptr createNormalMapSerial(ElevationMap::ConstPtr elevation_map, float grid_scale)
+{
+  auto normals = make_shared<Image<Normal>>(elevation_map->getSize());
+
+  auto getVertex = [&] (glm::ivec2 coords)
+  {
+    return glm::vec3(coords.x * grid_scale, coords.y * grid_scale,
+                     elevation_map->get(coords.x, coords.y));
+  };
+
+  auto addTriangle = [&] (const glm::ivec2 (&coords)[3])
+  {
+    glm::vec3 vertices[3];
+    for (int i = 0; i < 3; i++)
+      vertices[i] = getVertex(coords[i]);
+
+    glm::vec3 normal = calcNormal(vertices);
+
+    for (int i = 0; i < 3; i++)
+    {
+      auto &n = normals->at(coords[i].x, coords[i].y);
+      auto sum = glm::normalize(n.to_vec3() + normal);
+      n = { sum.x, sum.y, sum.z };
+    }
+  };
+
+  for (int y = 0; y < elevation_map->h() - 1; y++)
+  {
+    for (int x = 0; x < elevation_map->w() - 1; x++)
+    {
+      addTriangle({ glm::ivec2(x+1, y+1), glm::ivec2(x+0, y+0), glm::ivec2(x+1, y+0) });
+      addTriangle({ glm::ivec2(x+1, y+1), glm::ivec2(x+0, y+1), glm::ivec2(x+0, y+0) });
+    }
+  }
+
+  return normals;
+}
+
+
+struct NormalDifference
+{
+  double mean_degrees = 0;
+  double max_degrees = 0;
+};
+
+
+NormalDifference compare(const Image<Normal> &a, const Image<Normal> &b)
+{
+  assert(a.getSize() == b.getSize());
+
+  NormalDifference difference;
+  double sum = 0;
+
+  for (int y = 0; y < a.h(); y++)
+  {
+    for (int x = 0; x < a.w(); x++)
+    {
+      // from the chord - acos() is too imprecise for small angles
+      auto &n0 = a.get(x, y);
+      auto &n1 = b.get(x, y);
+      double dx = double(n0.x) - n1.x;
+      double dy = double(n0.y) - n1.y;
+      double dz = double(n0.z) - n1.z;
+      double chord = sqrt(dx * dx + dy * dy + dz * dz);
+      double degrees = 2 * asin(min(1.0, chord / 2)) * 180 / M_PI;
+      sum += degrees;
+      difference.max_degrees = max(difference.max_degrees, degrees);
+    }
+  }
+
+  difference.mean_degrees = sum / (double(a.w()) * a.h());
+
+  return difference;
+}
+
+
+/**
+ * The instruction sets must agree, and the normals mustn't differ from the serial
+ * implementation by more than the tolerance.
+ */
+void checkNormalMap(ElevationMap::ConstPtr map)
+{
+  auto reference = createNormalMapSerial(map, GRID_SCALE);
+
+  Image<Normal>::Ptr first_result;
+
+  for (auto instruction_set : getInstructionSets())
+  {
+    auto normals = runWithInstructionSet(instruction_set, [&]
+    {
+      return createNormalMap(map, GRID_SCALE);
+    });
+
+    auto error = compare(*normals, *reference);
+    if (error.mean_degrees > MAX_MEAN_ERROR_DEGREES || error.max_degrees > MAX_ERROR_DEGREES)
+    {
+      throw runtime_error(string("the ") + kernels::getInstructionSetName(instruction_set) +
+                          " normals differ from the serial implementation by " +
+                          to_string(error.mean_degrees) + " degrees on average, " +
+                          to_string(error.max_degrees) + " degrees max");
+    }
+
+    if (first_result)
+    {
+      auto difference = compare(*normals, *first_result);
+      if (difference.max_degrees > MAX_INSTRUCTION_SET_ERROR_DEGREES)
+      {
+        throw runtime_error(string("the ") + kernels::getInstructionSetName(instruction_set) +
+                            " normals differ from the scalar ones by up to " +
+                            to_string(difference.max_degrees) + " degrees");
+      }
+    }
+    else
+    {
+      first_result = normals;
+    }
+  }
+}
+
+
+/// reads the file into memory and copies the decoded pixels, as loadImageFromFile() did
+ImageRGBA::Ptr loadImageCopying(const string &path)
+{
+  vector<char> file_data;
+  if (!util::readFile(path, file_data))
+    return {};
+
+  vector<unsigned char> image_data;
+  int width = 0, height = 0;
+  if (!loadImageFromMemory(file_data, ImageRGBA::BYTES_PER_PIXEL, image_data, width, height))
+    return {};
+
+  return make_shared<ImageRGBA>(glm::ivec2(width, height), std::move(image_data));
+}
+
+
+/// a size from /proc/self/status, e.g. "VmHWM:" - 0 if unavailable, which it is except on Linux
+size_t getProcessStatusBytes(const string &field)
+{
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line))
+  {
+    if (line.compare(0, field.size(), field) == 0)
+    {
+      istringstream value(line.substr(field.size()));
+      size_t kilobytes = 0;
+      value >> kilobytes;
+      return kilobytes * 1024;
+    }
+  }
+  return 0;
+}
+
+
+/// sets the peak resident size (VmHWM) to the current one - needs Linux 4.0
+bool resetPeakResidentBytes()
+{
+  ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5" << flush;
+  return bool(clear_refs);
+}
+
+
+/**
+ * Reports how much the peak resident size grew while loading, including the image it returns.
+ * The counters are left out where the peak isn't available.
+ */
+template <class F>
+ImageRGBA::Ptr loadMeasuringPeakMemory(F load)
+{
+  const bool can_reset = resetPeakResidentBytes();
+  const size_t resident = getProcessStatusBytes("VmRSS:");
+
+  auto image = load();
+
+  const size_t peak = getProcessStatusBytes("VmHWM:");
+
+  if (can_reset && resident && peak >= resident)
+  {
+    render_util::benchmark::setCounter("peak_rss_increase_bytes", peak - resident);
+    render_util::benchmark::setCounter("peak_rss_increase_per_decoded_byte",
+                                       double(peak - resident) / image->dataSize());
+  }
+
+  return image;
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+void registerImageBenchmarks(Suite &suite)
+{
+  const int size = suite.getOptions().map_size;
+  const double num_pixels = double(size) * size;
+  const string output_dir = suite.getOptions().output_dir;
+
+  suite.add(
+  {
+    "image/convert_rgba_to_float", false, num_pixels, "pixels",
+    [size]
+    {
+      auto src = createSourceImage(size);
+      return function<void()>([src] { image::convert<float>(src); });
+    }
+  });
+
+  addKernelBenchmarks(suite, "fill_rgba8",
+    [] (const KernelInputs &in) { return createPerPixel<ImageRGBA>(in.color, in.rgba->size()); },
+    [] (const KernelInputs &in) { return image::create(in.color, in.rgba->size()); });
+  addKernelBenchmarks(suite, "flip_x_rgba8",
+    [] (const KernelInputs &in) { return flipXPerPixel<ImageRGBA>(in.rgba); },
+    [] (const KernelInputs &in) { return image::flipX<ImageRGBA>(in.rgba); });
+  addKernelBenchmarks(suite, "flip_x_r8",
+    [] (const KernelInputs &in) { return flipXPerPixel<ImageGreyScale>(in.grey); },
+    [] (const KernelInputs &in) { return image::flipX<ImageGreyScale>(in.grey); });
+  addKernelBenchmarks(suite, "flip_y_rgba8",
+    [] (const KernelInputs &in) { return flipYPerPixel<ImageRGBA>(in.rgba); },
+    [] (const KernelInputs &in) { return image::flipY(in.rgba); });
+  addKernelBenchmarks(suite, "swap_xy_rgba8",
+    [] (const KernelInputs &in) { return swapXYPerPixel<ImageRGBA>(in.rgba); },
+    [] (const KernelInputs &in) { return image::swapXY<ImageRGBA>(in.rgba); });
+  addKernelBenchmarks(suite, "swap_xy_r8",
+    [] (const KernelInputs &in) { return swapXYPerPixel<ImageGreyScale>(in.grey); },
+    [] (const KernelInputs &in) { return image::swapXY<ImageGreyScale>(in.grey); });
+  addKernelBenchmarks(suite, "get_channel_rgba8",
+    [] (const KernelInputs &in) { return getChannelPerPixel<ImageRGBA>(in.rgba, 2); },
+    [] (const KernelInputs &in) { return image::getChannel(in.rgba, 2); });
+  addKernelBenchmarks(suite, "convert_r8_to_r32f",
+    [] (const KernelInputs &in) { return convertPerPixel<float, ImageGreyScale>(in.grey); },
+    [] (const KernelInputs &in) { return image::convert<float>(in.grey); });
+  addKernelBenchmarks(suite, "convert_r32f_to_r8",
+    [] (const KernelInputs &in) { return convertPerPixel<unsigned char, Image<float>>(in.grey_float); },
+    [] (const KernelInputs &in) { return image::convert<unsigned char>(in.grey_float); },
+    checkByteConversion);
+  addKernelBenchmarks(suite, "extend_rgba8",
+    [] (const KernelInputs &in)
+    {
+      return extendPerPixel<ImageRGBA>(in.rgba, in.rgba->size() + 64, in.color);
+    },
+    [] (const KernelInputs &in)
+    {
+      return image::extend(in.rgba, in.rgba->size() + 64, in.color, image::BOTTOM_RIGHT);
+    });
+
+  for (auto filter : { ResampleFilter::BOX, ResampleFilter::BILINEAR, ResampleFilter::LANCZOS3 })
+  {
+    suite.add(
+    {
+      string("image/resample_half_") + getFilterName(filter), false, num_pixels, "src pixels",
+      [size, filter]
+      {
+        auto src = createSourceImage(size);
+        return function<void()>([src, filter]
+        {
+          resample(src, src->size() / 2, filter, ResampleEdgeMode::WRAP);
+        });
+      }
+    });
+  }
+
+  // what downSample() did before the separable resampler
+  suite.add(
+  {
+    "image/resample_half_box_per_pixel", false, num_pixels, "src pixels",
+    [size]
+    {
+      auto src = createSourceImage(size);
+      return function<void()>([src] { downSamplePerPixel(src, 2); });
+    }
+  });
+
+  suite.add(
+  {
+    "image/resample_three_quarters_lanczos3", false, num_pixels, "src pixels",
+    [size]
+    {
+      auto src = createSourceImage(size);
+      return function<void()>([src]
+      {
+        resample(src, src->size() * 3 / 4, ResampleFilter::LANCZOS3, ResampleEdgeMode::CLAMP);
+      });
+    }
+  });
+
+  suite.add(
+  {
+    "image/resample_double_lanczos3", false, num_pixels, "src pixels",
+    [size]
+    {
+      auto src = createSourceImage(size);
+      return function<void()>([src]
+      {
+        resample(src, src->size() * 2, ResampleFilter::LANCZOS3, ResampleEdgeMode::CLAMP);
+      });
+    }
+  });
+
+  suite.add(
+  {
+    "image/normal_map", false, num_pixels, "pixels",
+    [size]
+    {
+      ElevationMap::ConstPtr map = createSyntheticElevationMap(size);
+      checkNormalMap(map);
+      return function<void()>([map] { createNormalMap(map, GRID_SCALE); });
+    }
+  });
+
+  suite.add(
+  {
+    "image/normal_map_serial", false, num_pixels, "pixels",
+    [size]
+    {
+      ElevationMap::ConstPtr map = createSyntheticElevationMap(size);
+      return function<void()>([map] { createNormalMapSerial(map, GRID_SCALE); });
+    }
+  });
+
+  // decoding from a mapping of the file and adopting the decoder's buffer, or copying both -
+  // also reports the growth of the peak memory use
+  for (bool mapped : { true, false })
+  {
+    suite.add(
+    {
+      string("image/load_tga_") + (mapped ? "mapped" : "copying"), false, num_pixels, "pixels",
+      [size, output_dir, mapped]
+      {
+        const string path = output_dir + "/render_util_benchmarks_image.tga";
+
+        auto image = createSourceImage(size);
+        if (!saveImage(path, image->numComponents(), image->w(), image->h(),
+                       image->data(), image->dataSize()))
+        {
+          throw runtime_error("failed to write " + path);
+        }
+
+        auto load = [path, mapped]
+        {
+          auto loaded = mapped ? loadImageFromFile<ImageRGBA>(path) : loadImageCopying(path);
+          if (!loaded)
+            throw runtime_error("failed to load " + path);
+          return loaded;
+        };
+
+        // the first load - no freed buffers of an earlier one can be reused
+        auto loaded = loadMeasuringPeakMemory(load);
+        if (loaded->getSize() != image->getSize() ||
+            !equal(loaded->data(), loaded->data() + loaded->dataSize(), image->data()))
+        {
+          throw runtime_error(path + " was loaded with different pixels");
+        }
+
+        return function<void()>(load);
+      }
+    });
+  }
+
+  // the block compression of the layers and their mipmaps - the GL stand-in discards the upload
+  {
+    const int num_layers = 4;
+    const int layer_size = std::max(4, size / 2);
+
+    suite.add(
+    {
+      "image/compressed_texture_array", false,
+      double(num_layers) * layer_size * layer_size, "pixels",
+      [num_layers, layer_size]
+      {
+        vector<ImageRGBA::ConstPtr> layers;
+        for (int i = 0; i < num_layers; i++)
+          layers.push_back(createSourceImage(layer_size));
+
+        return function<void()>([layers]
+        {
+          createCompressedTextureArray<ImageRGBA>(layers, TextureCompression::COLOR);
+        });
+      }
+    });
+  }
+}
+
+
+} // namespace render_util::benchmark
@@ -0,0 +1,180 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Runs the micro benchmarks of the image, terrain, shader, texture, GL and atmosphere code
+ * and the macro benchmarks of the map generator tools and the atmosphere precomputation,
+ * and writes the results as JSON for comparing builds.
+ * Besides the times, benchmarks report counters such as the tile cache hit rate,
+ * the instances per frame or the peak memory of the image loaders.
+ *
+ * usage: render_util_benchmarks [options]
+ *
+ *   --list                 print the benchmark names and exit
+ *   --filter <substring>   only run the benchmarks whose name contains substring
+ *   --output <file>        where to write the JSON, default render_util_benchmarks.json
+ *   --min-time <s>         minimum time per micro benchmark, default 0.5
+ *   --repetitions <n>      minimum samples per micro benchmark, default 5
+ *   --macro-repetitions <n>  default 3
+ *   --no-macro             skip the macro benchmarks
+ *   --map-size <px>        size of the synthetic height maps and images, default 1024
+ *   --output-dir <dir>     where the macro benchmarks write their files, default .
+ *   --shader-dir <dir>     default is the shaders directory of the source tree
+ *
+ * All input is generated with fixed seeds. No GL context is needed -
+ * GL calls go to the null interface.
+ * Benchmarks check the code they measure before timing it - the suite returns non-zero
+ * if a benchmark failed or one of these checks did, so it runs as the regression tests too.
+ */
+
+#include "benchmark_suite.h"
+#include <render_util/gl_binding/null_interface.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+using namespace std;
+using namespace render_util::gl_binding;
+using namespace render_util::benchmark;
+
+
+namespace
+{
+
+
+void printUsage(const char *program)
+{
+  cerr << "usage: " << program << " [--list] [--filter <substring>] [--output <file>]"
+       << " [--min-time <s>] [--repetitions <n>] [--macro-repetitions <n>] [--no-macro]"
+       << " [--map-size <px>] [--output-dir <dir>] [--shader-dir <dir>]" << endl;
+}
+
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+  Options options;
+#ifdef RENDER_UTIL_BENCHMARK_SHADER_DIR
+  options.shader_dir = RENDER_UTIL_BENCHMARK_SHADER_DIR;
+#else
+  options.shader_dir = RENDER_UTIL_SHADER_DIR;
+#endif
+
+  string output_path = "render_util_benchmarks.json";
+  bool list = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const string arg = argv[i];
+
+    auto getValue = [&] () -> string
+    {
+      if (i + 1 >= argc)
+      {
+        printUsage(argv[0]);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--list")
+      list = true;
+    else if (arg == "--filter")
+      options.filter = getValue();
+    else if (arg == "--output")
+      output_path = getValue();
+    else if (arg == "--min-time")
+      options.min_time_s = atof(getValue().c_str());
+    else if (arg == "--repetitions")
+      options.min_repetitions = atoi(getValue().c_str());
+    else if (arg == "--macro-repetitions")
+      options.macro_repetitions = atoi(getValue().c_str());
+    else if (arg == "--no-macro")
+      options.skip_macro = true;
+    else if (arg == "--map-size")
+      options.map_size = atoi(getValue().c_str());
+    else if (arg == "--output-dir")
+      options.output_dir = getValue();
+    else if (arg == "--shader-dir")
+      options.shader_dir = getValue();
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (options.min_time_s < 0 || options.min_repetitions < 1 ||
+      options.macro_repetitions < 1 || options.map_size < 16)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  Suite suite(options);
+
+  registerImageBenchmarks(suite);
+  registerTerrainBenchmarks(suite);
+  registerShaderBenchmarks(suite);
+  registerToolBenchmarks(suite);
+  registerTextureBenchmarks(suite);
+  registerGLBenchmarks(suite);
+  registerAtmosphereBenchmarks(suite);
+  registerAtmosphereReferenceBenchmarks(suite);
+
+  if (list)
+  {
+    for (auto &benchmark : suite.getBenchmarks())
+    {
+      if (suite.isSelected(benchmark))
+        cout << benchmark.name << (benchmark.is_macro ? " (macro)" : "") << endl;
+    }
+    return 0;
+  }
+
+  auto gl_interface = createNullInterface();
+  GL_Interface::setCurrent(gl_interface.get());
+
+  auto results = suite.run(cout);
+
+  GL_Interface::setCurrent(nullptr);
+
+  {
+    ofstream out(output_path);
+    suite.writeJSON(results, out);
+    if (!out)
+    {
+      cerr << "failed to write " << output_path << endl;
+      return 1;
+    }
+  }
+
+  cout << endl << "results written to " << output_path << endl;
+
+  for (auto &result : results)
+  {
+    if (!result.error.empty())
+      return 1;
+  }
+
+  return 0;
+}
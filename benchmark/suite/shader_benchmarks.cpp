@@ -0,0 +1,123 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <render_util/shader.h>
+#include <util.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using render_util::Shader;
+using render_util::ShaderParameters;
+
+
+struct ShaderSource
+{
+  string name;
+  /// "vert" or "frag"
+  string extension;
+  unsigned int type = 0;
+  ShaderParameters parameters;
+};
+
+
+vector<ShaderSource> getShaderSources()
+{
+  // the parameters which have no default in the terrain shaders
+  ShaderParameters parameters;
+  parameters.set("enable_base_map", 1);
+  parameters.set("num_land_texture_scale_levels", 4);
+
+  return
+  {
+    { "terrain_cdlod", "vert", GL_VERTEX_SHADER, parameters },
+    { "terrain", "frag", GL_FRAGMENT_SHADER, parameters },
+  };
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+void registerShaderBenchmarks(Suite &suite)
+{
+  const string shader_dir = suite.getOptions().shader_dir;
+
+  for (auto &source : getShaderSources())
+  {
+    const string suffix = source.name + "_" + source.extension;
+
+    // the preprocessor alone, as on a cache miss - the file is only read once
+    suite.add(
+    {
+      "shader/preprocess_" + suffix, false, 1, "shaders",
+      [shader_dir, source]
+      {
+        const string path = shader_dir + '/' + source.name + '.' + source.extension;
+
+        auto data = make_shared<vector<char>>();
+        if (!util::readFile(path, *data, true))
+          throw runtime_error("failed to read " + path);
+
+        auto shader = make_shared<Shader>(source.name, vector<string> { shader_dir },
+                                          source.type, source.parameters);
+        if (shader->getPreprocessedSource().empty())
+          throw runtime_error("failed to preprocess " + path);
+
+        return function<void()>([shader, data, source, shader_dir]
+        {
+          shader->preProcess(*data, source.parameters, { shader_dir });
+        });
+      }
+    });
+
+    // the source cache is keyed by name, paths and parameters - all calls after the first hit it
+    suite.add(
+    {
+      "shader/create_cached_" + suffix, false, 1, "shaders",
+      [shader_dir, source]
+      {
+        return function<void()>([shader_dir, source]
+        {
+          Shader shader(source.name, { shader_dir }, source.type, source.parameters);
+          if (shader.getPreprocessedSource().empty())
+            throw runtime_error("failed to read shader " + source.name);
+        });
+      }
+    });
+  }
+}
+
+
+} // namespace render_util::benchmark
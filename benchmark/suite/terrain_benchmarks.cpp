@@ -0,0 +1,918 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <terrain/cdlod_quad_tree.h>
+#include <terrain/terrain_tile_cache.h>
+#include <render_util/tiled_height_map.h>
+#include <render_util/texture_util.h>
+#include <render_util/camera.h>
+#include <render_util/frustum.h>
+#include <render_util/geometry.h>
+#include <render_util/gl_binding/null_interface.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+namespace
+{
+
+
+using render_util::Box;
+using render_util::Camera;
+using render_util::ElevationMap;
+using render_util::Frustum;
+using render_util::Plane;
+using render_util::TiledHeightMap;
+using render_util::TerrainCDLODBase;
+using render_util::terrain::CDLODQuadTree;
+using render_util::terrain::HeightRangePyramid;
+using render_util::terrain::TerrainTileCache;
+using namespace render_util::gl_binding;
+
+constexpr int NUM_FRAMES = 32;
+constexpr int MAX_SPLIT_DEPTH = 4;
+
+constexpr int FRUSTUM_TREE_DEPTH = 8;
+constexpr float FRUSTUM_MAP_SIZE_M = 200000;
+/// boxes closer to a plane than this may be classified differently by the tests
+constexpr double BOUNDARY_TOLERANCE_M = 0.05;
+
+// the tile normals are computed like createNormalMap()
+constexpr float MAX_TILE_NORMAL_DIFFERENCE = 1e-4f;
+
+
+/// a low diagonal flight across the map, then a high one looking down
+vector<Camera> createCameras(float map_size_m)
+{
+  vector<Camera> cameras(NUM_FRAMES);
+
+  for (int i = 0; i < NUM_FRAMES; i++)
+  {
+    auto &camera = cameras[i];
+    camera.setViewportSize(1920, 1080);
+    camera.setFov(60);
+
+    const bool is_high = i >= NUM_FRAMES / 2;
+    const float t = float(i % (NUM_FRAMES / 2)) / (NUM_FRAMES / 2 - 1);
+    const float pos = map_size_m * glm::mix(0.05f, 0.95f, t);
+
+    if (is_high)
+      camera.setTransform(pos, map_size_m - pos, 12000, 135, -45, 0);
+    else
+      camera.setTransform(pos, pos, 500, 45, -5, 0);
+  }
+
+  return cameras;
+}
+
+
+struct SelectionData
+{
+  shared_ptr<const HeightRangePyramid> height_ranges;
+  CDLODQuadTree tree;
+  vector<Camera> cameras;
+  CDLODQuadTree::Selection selection;
+};
+
+
+/// without height ranges the nodes have the fixed height of TerrainCDLOD's original bounding boxes
+shared_ptr<SelectionData> createSelectionData(int map_size_px, bool use_height_ranges = true)
+{
+  auto map = render_util::benchmark::createSyntheticElevationMap(map_size_px);
+
+  auto data = make_shared<SelectionData>();
+  if (use_height_ranges)
+    data->height_ranges = CDLODQuadTree::createHeightRanges(*map, nullptr);
+  data->tree.build(data->height_ranges, nullptr);
+  data->cameras = createCameras(map_size_px * TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID);
+
+  return data;
+}
+
+
+/// pairs of instances sharing an edge whose levels of detail differ by more than one
+size_t countLodGaps(const CDLODQuadTree::Selection &selection)
+{
+  size_t num_gaps = 0;
+
+  for (size_t i = 0; i < selection.nodes.size(); i++)
+  {
+    auto &a = selection.nodes[i];
+    const ivec2 a_begin = ivec2(a.pos_grid);
+    const ivec2 a_end = a_begin + ivec2(TerrainCDLODBase::MESH_GRID_SIZE << a.lod_level);
+
+    for (size_t j = i + 1; j < selection.nodes.size(); j++)
+    {
+      auto &b = selection.nodes[j];
+      if (abs(a.lod_level - b.lod_level) <= 1)
+        continue;
+
+      const ivec2 b_begin = ivec2(b.pos_grid);
+      const ivec2 b_end = b_begin + ivec2(TerrainCDLODBase::MESH_GRID_SIZE << b.lod_level);
+
+      const ivec2 overlap = min(a_end, b_end) - max(a_begin, b_begin);
+
+      bool touch_x = (a_end.x == b_begin.x || b_end.x == a_begin.x) && overlap.y > 0;
+      bool touch_y = (a_end.y == b_begin.y || b_end.y == a_begin.y) && overlap.x > 0;
+
+      if (touch_x || touch_y)
+        num_gaps++;
+    }
+  }
+
+  return num_gaps;
+}
+
+
+/// neighbouring instances whose levels of detail differ by more than one leave cracks
+void checkLodGaps(SelectionData &data)
+{
+  size_t num_gaps = 0;
+
+  for (auto &camera : data.cameras)
+  {
+    data.selection.clear();
+    data.tree.select(camera, 0, data.selection);
+    num_gaps += countLodGaps(data.selection);
+  }
+
+  if (num_gaps)
+  {
+    throw runtime_error(to_string(num_gaps) +
+                        " neighbouring instances differ by more than one LOD level");
+  }
+}
+
+
+/// every instance must intersect the frustum - tested against all planes, not the narrowed masks
+void checkCulling(SelectionData &data)
+{
+  size_t num_outside = 0;
+
+  for (auto &camera : data.cameras)
+  {
+    data.selection.clear();
+    data.tree.select(camera, 0, data.selection);
+
+    for (auto &selected : data.selection.nodes)
+    {
+      const float size = TerrainCDLODBase::getNodeSize(selected.lod_level);
+      const vec2 pos = selected.pos_grid * float(TerrainCDLODBase::METERS_PER_GRID);
+
+      Box box;
+      box.set(vec3(pos, selected.node->min_height),
+              vec3(size, size, selected.node->max_height - selected.node->min_height));
+
+      Frustum::PlaneMask planes = Frustum::ALL_PLANES;
+      if (camera.testVisibility(box, planes) == Frustum::Visibility::OUTSIDE)
+        num_outside++;
+    }
+  }
+
+  if (num_outside)
+    throw runtime_error(to_string(num_outside) + " selected instances are outside the frustum");
+}
+
+
+/// the nodes and instances per frame along the camera paths and the size of the tree they need
+/// the nodes must contain the heights displaced by terrain_base_map_height and terrain_height_offset
+void checkHeightOffsets(const ElevationMap &map)
+{
+  const float base_map_height = 1000;
+  const float height_offset = 10;
+
+  auto base_map = render_util::benchmark::createSyntheticElevationMap(map.w() / 4, 2);
+
+  auto getRange = [] (const ElevationMap &map)
+  {
+    vec2 range(map.get(0, 0));
+    for (int y = 0; y < map.h(); y++)
+    {
+      for (int x = 0; x < map.w(); x++)
+      {
+        const float height = map.get(x, y);
+        range = vec2(std::min(range.x, height), std::max(range.y, height));
+      }
+    }
+    return range;
+  };
+
+  const vec2 range = getRange(map);
+  const vec2 base_range = getRange(*base_map) + vec2(base_map_height);
+  const vec2 expected = vec2(std::min(range.x, base_range.x), std::max(range.y, base_range.y)) +
+                        vec2(height_offset);
+
+  CDLODQuadTree tree;
+  tree.build(CDLODQuadTree::createHeightRanges(map, base_map.get()), nullptr);
+  tree.setHeightOffsets(base_map_height, height_offset);
+
+  auto root = tree.getRoot();
+  if (root->min_height > expected.x || root->max_height < expected.y)
+  {
+    throw runtime_error("the root node spans " + to_string(root->min_height) + " to " +
+                        to_string(root->max_height) + " instead of " + to_string(expected.x) +
+                        " to " + to_string(expected.y));
+  }
+}
+
+
+void reportSelectionCounters(SelectionData &data)
+{
+  using render_util::benchmark::setCounter;
+
+  size_t num_visited = 0;
+  size_t num_culled = 0;
+  size_t num_instances = 0;
+  size_t max_instances = 0;
+
+  for (auto &camera : data.cameras)
+  {
+    data.selection.clear();
+    data.tree.select(camera, 0, data.selection);
+
+    num_visited += data.selection.num_nodes_visited;
+    num_culled += data.selection.num_nodes_culled;
+    num_instances += data.selection.nodes.size();
+    max_instances = std::max(max_instances, data.selection.nodes.size());
+  }
+
+  const double num_frames = data.cameras.size();
+
+  setCounter("nodes_visited_per_frame", num_visited / num_frames);
+  setCounter("nodes_culled_per_frame", num_culled / num_frames);
+  setCounter("instances_per_frame", num_instances / num_frames);
+  setCounter("max_instances_per_frame", max_instances);
+  setCounter("nodes", data.tree.getNumNodes());
+  setCounter("tree_bytes", data.tree.getMemoryUsage());
+}
+
+
+void checkParallelSelection(SelectionData &data, int split_depth)
+{
+  CDLODQuadTree::Selection serial_selection;
+  size_t num_mismatches = 0;
+
+  for (auto &camera : data.cameras)
+  {
+    data.selection.clear();
+    data.tree.select(camera, 0, data.selection, split_depth);
+
+    serial_selection.clear();
+    data.tree.select(camera, 0, serial_selection);
+
+    auto &selection = data.selection;
+
+    bool is_equal = selection.nodes.size() == serial_selection.nodes.size() &&
+                    selection.num_nodes_visited == serial_selection.num_nodes_visited &&
+                    selection.num_nodes_culled == serial_selection.num_nodes_culled;
+
+    for (size_t i = 0; is_equal && i < selection.nodes.size(); i++)
+    {
+      is_equal = selection.nodes[i].node == serial_selection.nodes[i].node &&
+                 selection.nodes[i].lod_level == serial_selection.nodes[i].lod_level &&
+                 selection.nodes[i].pos_grid == serial_selection.nodes[i].pos_grid;
+    }
+
+    if (!is_equal)
+      num_mismatches++;
+  }
+
+  if (num_mismatches)
+  {
+    throw runtime_error("the parallel selection differs from the serial one in " +
+                        to_string(num_mismatches) + " frames");
+  }
+}
+
+
+struct TileCacheData
+{
+  shared_ptr<const TiledHeightMap> tiled_map;
+  CDLODQuadTree tree;
+  /// one per camera
+  vector<CDLODQuadTree::Selection> selections;
+  unique_ptr<TerrainTileCache> cache;
+};
+
+
+void checkTiledHeightMap(const TiledHeightMap &tiled_map, const ElevationMap &map,
+                         const HeightRangePyramid &tiled_ranges, const HeightRangePyramid &ranges)
+{
+  auto level_0 = tiled_map.readLevel(0);
+
+  for (int y = 0; y < map.h(); y++)
+  {
+    for (int x = 0; x < map.w(); x++)
+    {
+      if (level_0->get(x, y) != map.get(x, y))
+        throw runtime_error("level 0 of the tiled height map differs from the map");
+    }
+  }
+
+  if (tiled_ranges.getNumLevels() != ranges.getNumLevels())
+    throw runtime_error("the height ranges of the tiles have a different number of levels");
+
+  for (int level = 0; level < ranges.getNumLevels(); level++)
+  {
+    const int num_cells_per_side = 1 << (ranges.getNumLevels() - 1 - level);
+
+    for (int y = 0; y < num_cells_per_side; y++)
+    {
+      for (int x = 0; x < num_cells_per_side; x++)
+      {
+        auto exact = ranges.get(level, ivec2(x, y));
+        auto tiled = tiled_ranges.get(level, ivec2(x, y));
+
+        if (tiled.x > exact.x || tiled.y < exact.y)
+          throw runtime_error("a height range of the tiles doesn't contain the map's range");
+      }
+    }
+  }
+}
+
+
+/// the center tile of each level against createNormalMap() of the level
+void checkTileNormals(const TiledHeightMap &tiled_map)
+{
+  const int size = tiled_map.getTileSizeWithBorder();
+  const int tile_size = tiled_map.getTileSize();
+
+  size_t num_compared = 0;
+  float max_difference = 0;
+
+  for (int level = 0; level < tiled_map.getNumLevels(); level++)
+  {
+    const float grid_scale = float(TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID) * (1 << level);
+
+    auto level_map = tiled_map.readLevel(level);
+    auto reference = render_util::createNormalMap(level_map, grid_scale);
+
+    const ivec2 tile = tiled_map.getNumTiles(level) / 2;
+
+    vector<float> heights;
+    vector<float> normals;
+    TerrainTileCache::loadTile(tiled_map, level, tile, heights, normals);
+
+    for (int j = 0; j < size; j++)
+    {
+      for (int i = 0; i < size; i++)
+      {
+        const ivec2 terrain_pos = tile * tile_size - ivec2(TiledHeightMap::TILE_BORDER) + ivec2(i, j);
+        const ivec2 image_pos = ivec2(terrain_pos.x, level_map->h() - 1 - terrain_pos.y);
+
+        // the edges of either are extrapolated
+        if (i == 0 || j == 0 || i == size - 1 || j == size - 1 ||
+            any(lessThan(image_pos, ivec2(1))) ||
+            any(greaterThanEqual(image_pos, level_map->getSize() - ivec2(1))))
+        {
+          continue;
+        }
+
+        const float *normal = &normals[(j * size + i) * 3];
+        const vec3 expected = reference->get(image_pos.x, image_pos.y).to_vec3();
+
+        max_difference = std::max(max_difference,
+                                  distance(vec3(normal[0], normal[1], normal[2]), expected));
+        num_compared++;
+      }
+    }
+  }
+
+  if (!num_compared || max_difference >= MAX_TILE_NORMAL_DIFFERENCE)
+  {
+    throw runtime_error("the tile normals differ from createNormalMap() by up to " +
+                        to_string(max_difference));
+  }
+}
+
+
+/// the tiles of a frame - returns the number of nodes their tile doesn't cover
+size_t drawFrame(TerrainTileCache &cache, const TiledHeightMap &tiled_map,
+                 const CDLODQuadTree::Selection &selection)
+{
+  const int size = tiled_map.getTileSizeWithBorder();
+
+  size_t num_uncovered = 0;
+
+  for (auto &selected : selection.nodes)
+  {
+    auto tile = cache.getTile(selected.pos_grid, selected.lod_level);
+
+    const ivec2 node_begin = ivec2(selected.pos_grid);
+    const ivec2 node_end = node_begin + ivec2(TerrainCDLODBase::MESH_GRID_SIZE << selected.lod_level);
+
+    const vec2 tile_begin = vec2(tile.y, tile.z);
+    const vec2 tile_end = tile_begin + float(size - 1) * tile.w;
+
+    // only the part of the node inside the map needs to be covered
+    const ivec2 covered_begin = max(node_begin, ivec2(0));
+    const ivec2 covered_end = min(node_end, tiled_map.getSize());
+
+    if (any(greaterThanEqual(covered_begin, covered_end)))
+      continue;
+
+    if (any(lessThan(vec2(covered_begin), tile_begin)) ||
+        any(greaterThan(vec2(covered_end), tile_end)))
+    {
+      num_uncovered++;
+    }
+  }
+
+  cache.update();
+
+  return num_uncovered;
+}
+
+
+/// a flight over the map starting with an empty cache
+void reportTileCacheCounters(const TerrainTileCache::Statistics &stats)
+{
+  using render_util::benchmark::setCounter;
+
+  setCounter("hit_rate", stats.getHitRate());
+  setCounter("page_ins", stats.num_page_ins);
+  setCounter("evictions", stats.num_evictions);
+  setCounter("average_page_in_ms", stats.average_page_in_ms);
+  setCounter("max_page_in_ms", stats.max_page_in_ms);
+  setCounter("bytes_uploaded", stats.bytes_uploaded_total);
+  setCounter("gpu_bytes", stats.gpu_memory);
+  setCounter("cpu_bytes", stats.cpu_memory);
+}
+
+
+/**
+ * Converts the synthetic map to a TiledHeightMap file in output_dir and checks the file,
+ * then flies the cameras over it with a cache of its own,
+ * which mustn't give a node a tile that doesn't cover it or leak its textures.
+ * The statistics of that cache are reported as counters.
+ */
+shared_ptr<TileCacheData> createTileCacheData(int map_size_px, const string &output_dir)
+{
+  const string path = output_dir + "/render_util_benchmarks_tiled_height_map";
+
+  ElevationMap::ConstPtr map = render_util::benchmark::createSyntheticElevationMap(map_size_px);
+
+  if (!render_util::writeTiledHeightMap(path, *map))
+    throw runtime_error("failed to write " + path);
+
+  auto data = make_shared<TileCacheData>();
+
+  data->tiled_map = TiledHeightMap::open(path);
+  if (!data->tiled_map)
+    throw runtime_error("failed to open " + path);
+
+  shared_ptr<const HeightRangePyramid> height_ranges =
+    CDLODQuadTree::createHeightRanges(*data->tiled_map, nullptr);
+
+  checkTiledHeightMap(*data->tiled_map, *map, *height_ranges,
+                      *CDLODQuadTree::createHeightRanges(*map, nullptr));
+  checkTileNormals(*data->tiled_map);
+
+  data->tree.build(height_ranges, nullptr);
+
+  for (auto &camera : createCameras(map_size_px * TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID))
+  {
+    data->selections.emplace_back();
+    data->tree.select(camera, 0, data->selections.back());
+  }
+
+  const auto num_live_textures = getNullInterfaceStatistics().objects[NULL_OBJECT_TEXTURE].num_live;
+
+  {
+    TerrainTileCache cache(data->tiled_map);
+
+    size_t num_uncovered = 0;
+    for (auto &selection : data->selections)
+      num_uncovered += drawFrame(cache, *data->tiled_map, selection);
+
+    if (num_uncovered)
+      throw runtime_error(to_string(num_uncovered) + " nodes were given a tile not covering them");
+
+    reportTileCacheCounters(cache.getStatistics());
+  }
+
+  if (getNullInterfaceStatistics().objects[NULL_OBJECT_TEXTURE].num_live != num_live_textures)
+    throw runtime_error("the tile cache leaks textures");
+
+  data->cache = make_unique<TerrainTileCache>(data->tiled_map);
+
+  return data;
+}
+
+
+struct FrustumNode
+{
+  Box box;
+  /// index of the first of four children, 0 for leaves
+  size_t first_child = 0;
+};
+
+
+struct FrustumData
+{
+  /// breadth first, the root at index 0
+  vector<FrustumNode> nodes;
+  vector<Camera> cameras;
+  vector<bool> outside;
+};
+
+
+float getFrustumTestHeight(vec2 pos)
+{
+  vec2 rel = pos / FRUSTUM_MAP_SIZE_M;
+  return 1500 + 1500 * sin(rel.x * 17.f) * cos(rel.y * 11.f);
+}
+
+
+/// a complete quad tree - every box contains its children's
+vector<FrustumNode> createFrustumTestTree(int depth)
+{
+  vector<FrustumNode> nodes(1);
+
+  struct Level
+  {
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  Level level { 0, 1 };
+
+  nodes[0].box.set(vec3(0), vec3(FRUSTUM_MAP_SIZE_M, FRUSTUM_MAP_SIZE_M, 0));
+
+  for (int i = 0; i < depth; i++)
+  {
+    Level next { nodes.size(), nodes.size() + (level.end - level.begin) * 4 };
+    nodes.resize(next.end);
+
+    for (size_t parent = level.begin; parent < level.end; parent++)
+    {
+      nodes[parent].first_child = next.begin + (parent - level.begin) * 4;
+
+      vec2 origin = vec2(nodes[parent].box.getOrigin());
+      vec2 child_size = vec2(nodes[parent].box.getExtent()) / 2.f;
+
+      for (int child = 0; child < 4; child++)
+      {
+        vec2 child_origin = origin + child_size * vec2(child % 2, child / 2);
+        nodes[nodes[parent].first_child + child].box.set(vec3(child_origin, 0),
+                                                         vec3(child_size, 0));
+      }
+    }
+
+    level = next;
+  }
+
+  // vertical extent from the leaves up
+  for (size_t i = nodes.size(); i-- > 0;)
+  {
+    auto &node = nodes[i];
+    vec2 origin = vec2(node.box.getOrigin());
+    vec2 size = vec2(node.box.getExtent());
+
+    float min_height = 0;
+    float max_height = 0;
+
+    if (node.first_child)
+    {
+      min_height = nodes[node.first_child].box.getOrigin().z;
+      max_height = min_height;
+      for (size_t child = node.first_child; child < node.first_child + 4; child++)
+      {
+        auto &child_box = nodes[child].box;
+        min_height = std::min(min_height, child_box.getOrigin().z);
+        max_height = std::max(max_height, child_box.getOrigin().z + child_box.getExtent().z);
+      }
+    }
+    else
+    {
+      float heights[] =
+      {
+        getFrustumTestHeight(origin), getFrustumTestHeight(origin + size),
+        getFrustumTestHeight(origin + vec2(size.x, 0)), getFrustumTestHeight(origin + vec2(0, size.y)),
+        getFrustumTestHeight(origin + size / 2.f),
+      };
+      min_height = heights[0];
+      max_height = heights[0];
+      for (auto h : heights)
+      {
+        min_height = std::min(min_height, h);
+        max_height = std::max(max_height, h);
+      }
+    }
+
+    node.box.set(vec3(origin, min_height), vec3(size, max_height - min_height));
+  }
+
+  return nodes;
+}
+
+
+/// an orbit around the center, climbing and descending
+vector<Camera> createFrustumTestCameras()
+{
+  vector<Camera> cameras(NUM_FRAMES);
+
+  for (int i = 0; i < NUM_FRAMES; i++)
+  {
+    auto &camera = cameras[i];
+    camera.setViewportSize(1920, 1080);
+    camera.setProjection(60, 1.2, 500000);
+
+    const float t = float(i) / float(NUM_FRAMES - 1);
+    const float angle = t * 360.f;
+    const vec2 pos = vec2(FRUSTUM_MAP_SIZE_M / 2) +
+                     FRUSTUM_MAP_SIZE_M * 0.3f * vec2(cos(radians(angle)), sin(radians(angle)));
+    const float altitude = mix(500.f, 20000.f, 0.5f + 0.5f * sin(radians(angle * 3)));
+    const float pitch = mix(-5.f, -60.f, 0.5f + 0.5f * cos(radians(angle * 2)));
+
+    camera.setTransform(pos.x, pos.y, altitude, angle + 90, pitch, 0);
+  }
+
+  return cameras;
+}
+
+
+/// the 8 corners of the box against every plane - the test Camera::cull() used
+void cullCorners(FrustumData &data, const Camera &camera)
+{
+  auto &frustum = camera.getFrustum();
+
+  vector<Plane> planes;
+  for (int i = 0; i < Frustum::NUM_PLANES; i++)
+    planes.push_back(frustum.getPlane(i));
+
+  for (size_t i = 0; i < data.nodes.size(); i++)
+  {
+    bool outside = false;
+    for (auto &plane : planes)
+    {
+      if (plane.cull(data.nodes[i].box))
+      {
+        outside = true;
+        break;
+      }
+    }
+    data.outside[i] = outside;
+  }
+}
+
+
+/// Frustum::test() for every box against all planes
+void cullSoA(FrustumData &data, const Camera &camera)
+{
+  auto &frustum = camera.getFrustum();
+
+  for (size_t i = 0; i < data.nodes.size(); i++)
+  {
+    Frustum::PlaneMask planes = Frustum::ALL_PLANES;
+    data.outside[i] = frustum.test(data.nodes[i].box, planes) == Frustum::Visibility::OUTSIDE;
+  }
+}
+
+
+/**
+ * Descends from the root, skipping culled subtrees and the planes a parent is entirely
+ * inside of, as CDLODQuadTree::select() does - only the boxes reached are classified.
+ */
+void cullHierarchical(FrustumData &data, size_t index, const Frustum &frustum,
+                      Frustum::PlaneMask planes)
+{
+  auto &node = data.nodes[index];
+
+  if (planes && frustum.test(node.box, planes) == Frustum::Visibility::OUTSIDE)
+  {
+    data.outside[index] = true;
+    return;
+  }
+
+  if (node.first_child)
+  {
+    for (size_t child = node.first_child; child < node.first_child + 4; child++)
+      cullHierarchical(data, child, frustum, planes);
+  }
+}
+
+
+void cullHierarchical(FrustumData &data, const Camera &camera)
+{
+  fill(data.outside.begin(), data.outside.end(), false);
+  cullHierarchical(data, 0, camera.getFrustum(), Frustum::ALL_PLANES);
+}
+
+
+/// the distance of the box's corner furthest in front of the nearest plane
+double getOutsideMargin(const Frustum &frustum, const Box &box)
+{
+  double margin = INFINITY;
+  for (int i = 0; i < Frustum::NUM_PLANES; i++)
+  {
+    auto plane = frustum.getPlane(i);
+    double max_distance = -INFINITY;
+    for (auto &corner : box.getCornerPoints())
+    {
+      dvec3 to_corner = dvec3(corner) - dvec3(plane.point);
+      max_distance = std::max(max_distance, dot(dvec3(plane.normal), to_corner));
+    }
+    margin = std::min(margin, std::abs(max_distance));
+  }
+  return margin;
+}
+
+
+/// the tests must agree on which boxes are outside, except for boxes touching a plane
+void checkFrustumCulling(FrustumData &data)
+{
+  vector<bool> corners_outside;
+  vector<bool> soa_outside;
+  size_t num_mismatches = 0;
+
+  for (auto &camera : data.cameras)
+  {
+    cullCorners(data, camera);
+    corners_outside = data.outside;
+    cullSoA(data, camera);
+    soa_outside = data.outside;
+    cullHierarchical(data, camera);
+
+    for (size_t i = 0; i < data.nodes.size(); i++)
+    {
+      bool mismatch = corners_outside[i] != soa_outside[i];
+
+      // the hierarchical test only reaches the boxes whose ancestors are visible
+      if (data.outside[i] && !soa_outside[i])
+        mismatch = true;
+
+      if (mismatch && getOutsideMargin(camera.getFrustum(), data.nodes[i].box) >= BOUNDARY_TOLERANCE_M)
+        num_mismatches++;
+    }
+  }
+
+  if (num_mismatches)
+    throw runtime_error(to_string(num_mismatches) + " boxes were classified differently");
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+void registerTerrainBenchmarks(Suite &suite)
+{
+  const int size = suite.getOptions().map_size;
+  const double num_pixels = double(size) * size;
+  const string output_dir = suite.getOptions().output_dir;
+
+  suite.add(
+  {
+    "terrain/cdlod_height_ranges", false, num_pixels, "pixels",
+    [size]
+    {
+      ElevationMap::ConstPtr map = createSyntheticElevationMap(size);
+      checkHeightOffsets(*map);
+      setCounter("bytes", CDLODQuadTree::createHeightRanges(*map, nullptr)->getMemoryUsage());
+      return function<void()>([map] { CDLODQuadTree::createHeightRanges(*map, nullptr); });
+    }
+  });
+
+  // the nodes are created lazily, so this includes creating the ones the path reaches
+  suite.add(
+  {
+    "terrain/cdlod_build_and_select", false, NUM_FRAMES, "frames",
+    [size]
+    {
+      auto data = createSelectionData(size);
+      return function<void()>([data]
+      {
+        data->tree.clear();
+        data->tree.build(data->height_ranges, nullptr);
+        for (auto &camera : data->cameras)
+        {
+          data->selection.clear();
+          data->tree.select(camera, 0, data->selection);
+        }
+      });
+    }
+  });
+
+  for (bool use_height_ranges : { false, true })
+  {
+    for (int split_depth = 0; split_depth <= (use_height_ranges ? MAX_SPLIT_DEPTH : 0); split_depth++)
+    {
+      string name = split_depth ? "terrain/cdlod_select_parallel_depth_" + to_string(split_depth)
+                                : "terrain/cdlod_select_serial";
+      if (!use_height_ranges)
+        name += "_fixed_height";
+
+      suite.add(
+      {
+        name, false, NUM_FRAMES, "frames",
+        [size, split_depth, use_height_ranges]
+        {
+          auto data = createSelectionData(size, use_height_ranges);
+
+          // also creates the nodes, so only the selection is timed
+          if (split_depth)
+            checkParallelSelection(*data, split_depth);
+          else
+          {
+            checkLodGaps(*data);
+            checkCulling(*data);
+            reportSelectionCounters(*data);
+          }
+
+          return function<void()>([data, split_depth]
+          {
+            for (auto &camera : data->cameras)
+            {
+              data->selection.clear();
+              data->tree.select(camera, 0, data->selection, split_depth);
+            }
+          });
+        }
+      });
+    }
+  }
+
+  // the render thread's part - the tiles are read and get their normals on the thread pool
+  suite.add(
+  {
+    "terrain/tile_cache", false, NUM_FRAMES, "frames",
+    [size, output_dir]
+    {
+      auto data = createTileCacheData(size, output_dir);
+      return function<void()>([data]
+      {
+        for (auto &selection : data->selections)
+          drawFrame(*data->cache, *data->tiled_map, selection);
+      });
+    }
+  });
+
+  {
+    using CullFunction = void(*)(FrustumData&, const Camera&);
+
+    const pair<const char*, CullFunction> tests[] =
+    {
+      { "corners", cullCorners },
+      { "soa", cullSoA },
+      { "hierarchical", cullHierarchical },
+    };
+
+    // the number of nodes of a complete quad tree
+    const double num_boxes = double((1 << (2 * (FRUSTUM_TREE_DEPTH + 1))) - 1) / 3;
+
+    for (auto &test : tests)
+    {
+      suite.add(
+      {
+        string("terrain/frustum_cull_") + test.first, false, num_boxes * NUM_FRAMES, "boxes",
+        [cull = test.second]
+        {
+          auto data = make_shared<FrustumData>();
+          data->nodes = createFrustumTestTree(FRUSTUM_TREE_DEPTH);
+          data->cameras = createFrustumTestCameras();
+          data->outside.resize(data->nodes.size());
+
+          checkFrustumCulling(*data);
+
+          return function<void()>([data, cull]
+          {
+            for (auto &camera : data->cameras)
+              cull(*data, camera);
+          });
+        }
+      });
+    }
+  }
+}
+
+
+} // namespace render_util::benchmark
@@ -0,0 +1,719 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <render_util/texture_container.h>
+#include <render_util/texture_compression.h>
+#include <render_util/texture_util.h>
+#include <render_util/image_loader.h>
+#include <render_util/image_resample.h>
+#include <render_util/gl_binding/null_interface.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using namespace render_util;
+using namespace render_util::gl_binding;
+
+
+struct ContainerVariant
+{
+  /// empty for a TGA file, which gets its mipmaps from glGenerateMipmap
+  string name;
+  ImageFileFormat format = ImageFileFormat::UNKNOWN;
+  unsigned int internal_format = 0;
+};
+
+
+struct FormatCheck
+{
+  BlockFormat format;
+  int num_checked_components;
+  double min_psnr;
+};
+
+
+const ContainerVariant CONTAINER_VARIANTS[] =
+{
+  { "tga", ImageFileFormat::UNKNOWN, 0 },
+  { "dds_rgba8", ImageFileFormat::DDS, GL_RGBA8 },
+  { "ktx2_rgba8", ImageFileFormat::KTX2, GL_RGBA8 },
+  { "dds_bc1", ImageFileFormat::DDS, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT },
+  { "ktx2_bc3", ImageFileFormat::KTX2, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT },
+};
+
+
+// BC1 has 5:6:5 endpoints, BC4 8 bit endpoints and 8 interpolated values
+const FormatCheck FORMAT_CHECKS[] =
+{
+  { BlockFormat::BC1, 3, 35 },
+  { BlockFormat::BC3, 4, 35 },
+  { BlockFormat::BC4, 1, 45 },
+  { BlockFormat::BC5, 2, 45 },
+};
+
+
+/// gradients with some structure, so the file isn't all noise
+ImageRGBA::Ptr createContainerImage(int size)
+{
+  auto image = make_shared<ImageRGBA>(glm::ivec2(size));
+  mt19937 generator(1);
+
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      image->at(x, y, 0) = x * 255 / size;
+      image->at(x, y, 1) = y * 255 / size;
+      image->at(x, y, 2) = (x ^ y) & 0xff;
+      image->at(x, y, 3) = 128 + generator() % 16;
+    }
+  }
+
+  return image;
+}
+
+
+vector<vector<unsigned char>> createMipChain(ImageRGBA::ConstPtr image)
+{
+  vector<vector<unsigned char>> levels;
+
+  while (true)
+  {
+    levels.emplace_back(image->data(), image->data() + image->dataSize());
+    if (image->w() == 1 && image->h() == 1)
+      break;
+    image = resample(image, glm::max(glm::ivec2(1), image->size() / 2), ResampleFilter::BOX);
+  }
+
+  return levels;
+}
+
+
+/// only the size of block-compressed levels matters here
+vector<vector<unsigned char>> createRandomBlocks(unsigned int internal_format, int size)
+{
+  vector<vector<unsigned char>> levels;
+  mt19937 generator(1);
+
+  for (int level = 0; (size >> level) > 0; level++)
+  {
+    levels.emplace_back(getTextureLevelSize(internal_format, glm::ivec2(size >> level)));
+    for (auto &byte : levels.back())
+      byte = generator();
+  }
+
+  return levels;
+}
+
+
+/// decodes the image and lets glGenerateMipmap create the mipmaps
+TexturePtr loadTGA(const string &path)
+{
+  util::NormalFile file(path);
+  auto image = loadImage(file, ImageRGBA::BYTES_PER_PIXEL);
+  if (!image)
+    return {};
+  return createTexture(image->data(), image->w(), image->h(), image->numComponents(), true);
+}
+
+
+/// maps the file and uploads the baked mipmaps level by level
+TexturePtr loadContainer(const string &path)
+{
+  auto container = TextureContainer::load(path);
+  if (!container)
+    return {};
+  return createTexture(*container);
+}
+
+
+/**
+ * Writes the variant's file and checks that loading it uploads all of its levels,
+ * and that only the TGA file leaves the mipmaps to glGenerateMipmap.
+ * Returns the path.
+ */
+string writeContainer(const ContainerVariant &variant, int size, const string &output_dir)
+{
+  const bool is_tga = variant.format == ImageFileFormat::UNKNOWN;
+  const string path = output_dir + "/render_util_benchmarks_texture_" + variant.name +
+                      (is_tga ? ".tga" : variant.format == ImageFileFormat::DDS ? ".dds" : ".ktx2");
+
+  auto image = createContainerImage(size);
+
+  vector<vector<unsigned char>> levels;
+  if (is_tga)
+    levels.emplace_back(image->data(), image->data() + image->dataSize());
+  else if (variant.internal_format == GL_RGBA8)
+    levels = createMipChain(image);
+  else
+    levels = createRandomBlocks(variant.internal_format, size);
+
+  bool saved = is_tga ?
+    saveImage(path, image->numComponents(), image->w(), image->h(), image->data(), image->dataSize()) :
+    saveTextureContainer(path, variant.format, variant.internal_format, image->size(), 1, levels);
+
+  if (!saved)
+    throw runtime_error("failed to write " + path);
+
+  unsigned long long expected_bytes = 0;
+  for (auto &level : levels)
+    expected_bytes += level.size();
+
+  resetNullInterfaceStatistics();
+
+  if (!(is_tga ? loadTGA(path) : loadContainer(path)))
+    throw runtime_error("failed to load " + path);
+
+  auto stats = getNullInterfaceStatistics();
+
+  if (stats.texture_bytes_uploaded != expected_bytes)
+  {
+    throw runtime_error(path + ": " + to_string(stats.texture_bytes_uploaded) +
+                        " bytes uploaded instead of " + to_string(expected_bytes));
+  }
+
+  if (stats.getNumCalls("glGenerateMipmap") != (is_tga ? 1 : 0))
+    throw runtime_error(path + ": the mipmaps of a container were generated");
+
+  return path;
+}
+
+
+/**
+ * Checks that containers whose header claims more data than the file holds are rejected -
+ * a level offset near 2^64 and a layer count near 2^31 mustn't wrap the bounds checks.
+ */
+void checkMalformedContainers(ImageFileFormat format)
+{
+  // the offsets are those of the KTX2 header and level index and of the DX10 array size
+  const size_t layer_count_offset = format == ImageFileFormat::KTX2 ? 32 : 4 + 124 + 12;
+  const size_t level0_offset = 80;
+
+  vector<vector<unsigned char>> levels = { vector<unsigned char>(16 * 16 * 4) };
+  auto valid = writeTextureContainer(format, GL_RGBA8, glm::ivec2(16), 1, levels);
+
+  auto expectRejected = [&] (const char *what, size_t offset, auto value)
+  {
+    auto data = valid;
+    memcpy(data.data() + offset, &value, sizeof(value));
+    if (TextureContainer::create(make_unique<VectorImageStorage>(move(data))))
+      throw runtime_error(string("a container with ") + what + " was accepted");
+  };
+
+  if (!TextureContainer::create(make_unique<VectorImageStorage>(vector<unsigned char>(valid))))
+    throw runtime_error("a valid container was rejected");
+
+  expectRejected("a huge layer count", layer_count_offset, uint32_t(0x7fffffff));
+
+  if (format == ImageFileFormat::KTX2)
+    expectRejected("a wrapping level offset", level0_offset, uint64_t(-16));
+}
+
+
+vector<unsigned char> createCompressionImage(int size)
+{
+  vector<unsigned char> pixels(size_t(size) * size * 4);
+  mt19937 generator(1);
+  uniform_int_distribution<int> noise(-4, 4);
+
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      unsigned char *pixel = &pixels[(size_t(y) * size + x) * 4];
+      int values[4] =
+      {
+        x * 255 / size,
+        y * 255 / size,
+        int(127.5 + 127.5 * sin(x * 0.05) * cos(y * 0.03)),
+        int(127.5 + 127.5 * sin((x + y) * 0.02)),
+      };
+      for (int i = 0; i < 4; i++)
+        pixel[i] = clamp(values[i] + noise(generator), 0, 255);
+    }
+  }
+
+  return pixels;
+}
+
+
+double getPSNR(const vector<unsigned char> &original,
+               const vector<unsigned char> &decoded,
+               int num_components)
+{
+  assert(original.size() == decoded.size());
+
+  double sum = 0;
+  size_t count = 0;
+  for (size_t i = 0; i < original.size(); i += 4)
+  {
+    for (int c = 0; c < num_components; c++)
+    {
+      double error = double(original[i + c]) - decoded[i + c];
+      sum += error * error;
+      count++;
+    }
+  }
+
+  double mse = sum / count;
+  if (mse == 0)
+    return INFINITY;
+
+  return 10 * log10(255.0 * 255.0 / mse);
+}
+
+
+/// the 5:6:5 endpoints of BC1, and choosing an interpolated color over an endpoint
+constexpr int MAX_TWO_COLOR_ERROR = 8;
+
+
+/// where the parts of a block are
+struct BlockLayout
+{
+  /// offset of the BC1 color block, -1 if there is none
+  int color_offset = -1;
+  /// offset and component of each BC4 block
+  vector<pair<int, int>> channels;
+};
+
+
+BlockLayout getBlockLayout(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+      return { 0, {} };
+    case BlockFormat::BC3:
+      return { 8, { { 0, 3 } } };
+    case BlockFormat::BC4:
+      return { -1, { { 0, 0 } } };
+    case BlockFormat::BC5:
+      return { -1, { { 0, 0 }, { 8, 1 } } };
+  }
+  abort();
+}
+
+
+/// color0 <= color1 would select the three color mode - equal endpoints only with all indices 0
+bool hasFourColorEndpoints(const unsigned char *block)
+{
+  uint16_t c0 = 0, c1 = 0;
+  uint32_t indices = 0;
+  memcpy(&c0, block, 2);
+  memcpy(&c1, block + 2, 2);
+  memcpy(&indices, block + 4, 4);
+  return c0 > c1 || (c0 == c1 && indices == 0);
+}
+
+
+/// red0 <= red1 would select the six value mode - equal endpoints only with all indices 0
+bool hasEightValueEndpoints(const unsigned char *block)
+{
+  uint64_t indices = 0;
+  memcpy(&indices, block + 2, 6);
+  return block[0] > block[1] || (block[0] == block[1] && indices == 0);
+}
+
+
+/**
+ * Encodes and decodes the block. The endpoints must select the four color and eight value modes,
+ * BC1 mustn't decode a pixel transparent, the colors must be within max_color_error
+ * and each BC4 channel within half a step of its range.
+ */
+void checkRoundTrip(BlockFormat format, const unsigned char rgba[16 * 4], int max_color_error)
+{
+  const auto layout = getBlockLayout(format);
+  const string name = getBlockFormatName(format);
+
+  unsigned char block[16] {};
+  unsigned char decoded[16 * 4] {};
+  encodeBlock(format, rgba, block);
+  decodeBlock(format, block, decoded);
+
+  if (layout.color_offset >= 0)
+  {
+    if (!hasFourColorEndpoints(block + layout.color_offset))
+      throw runtime_error(name + ": the color endpoints select the three color mode");
+
+    for (int i = 0; i < 16; i++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        if (abs(rgba[i * 4 + c] - decoded[i * 4 + c]) > max_color_error)
+        {
+          throw runtime_error(name + ": a color differs by " +
+                              to_string(abs(rgba[i * 4 + c] - decoded[i * 4 + c])) +
+                              ", the maximum is " + to_string(max_color_error));
+        }
+      }
+
+      if (format == BlockFormat::BC1 && decoded[i * 4 + 3] != 255)
+        throw runtime_error(name + ": an opaque pixel was decoded transparent");
+    }
+  }
+
+  for (auto &channel : layout.channels)
+  {
+    const int c = channel.second;
+
+    if (!hasEightValueEndpoints(block + channel.first))
+      throw runtime_error(name + ": the endpoints select the six value mode");
+
+    int min_value = 255;
+    int max_value = 0;
+    for (int i = 0; i < 16; i++)
+    {
+      min_value = std::min<int>(min_value, rgba[i * 4 + c]);
+      max_value = std::max<int>(max_value, rgba[i * 4 + c]);
+    }
+
+    // half a step of the seven steps, and the rounding of the palette
+    const int max_error = max_value == min_value ? 0 : (max_value - min_value) / 14 + 1;
+
+    for (int i = 0; i < 16; i++)
+    {
+      if (abs(rgba[i * 4 + c] - decoded[i * 4 + c]) > max_error)
+      {
+        throw runtime_error(name + ": component " + to_string(c) + " differs by " +
+                            to_string(abs(rgba[i * 4 + c] - decoded[i * 4 + c])) +
+                            ", the maximum is " + to_string(max_error));
+      }
+    }
+  }
+}
+
+
+/**
+ * Blocks written by other encoders may use the three color and six value modes -
+ * each palette entry is decoded and compared with the value the formats define.
+ */
+void checkDecoderModes(BlockFormat format)
+{
+  const auto layout = getBlockLayout(format);
+  const string name = getBlockFormatName(format);
+
+  unsigned char decoded[16 * 4] {};
+
+  if (layout.color_offset >= 0)
+  {
+    // black and white, pixel i has index i
+    unsigned char block[16] {};
+    const uint16_t c0 = 0x0000;
+    const uint16_t c1 = 0xffff;
+    const uint32_t indices = 0 | (1 << 2) | (2 << 4) | (3 << 6);
+    memcpy(block + layout.color_offset, &c0, 2);
+    memcpy(block + layout.color_offset + 2, &c1, 2);
+    memcpy(block + layout.color_offset + 4, &indices, 4);
+
+    decodeBlock(format, block, decoded);
+
+    // BC3 always decodes its colors in four color mode
+    const bool is_bc1 = format == BlockFormat::BC1;
+    const int expected_colors[4] = { 0, 255, is_bc1 ? 127 : 85, is_bc1 ? 0 : 170 };
+
+    for (int i = 0; i < 4; i++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        if (decoded[i * 4 + c] != expected_colors[i])
+          throw runtime_error(name + ": color index " + to_string(i) + " was decoded wrong");
+      }
+    }
+
+    if (is_bc1 && (decoded[2 * 4 + 3] != 255 || decoded[3 * 4 + 3] != 0))
+      throw runtime_error(name + ": the three color mode doesn't decode index 3 transparent");
+  }
+
+  struct ChannelMode
+  {
+    unsigned char endpoints[2];
+    int palette[8];
+  };
+
+  const ChannelMode modes[] =
+  {
+    { { 200, 10 }, { 200, 10, 173, 146, 119, 91, 64, 37 } },
+    { { 10, 200 }, { 10, 200, 48, 86, 124, 162, 0, 255 } },
+  };
+
+  for (auto &channel : layout.channels)
+  {
+    for (auto &mode : modes)
+    {
+      // pixel i has index i % 8
+      unsigned char block[16] {};
+      uint64_t indices = 0;
+      for (int i = 0; i < 16; i++)
+        indices |= uint64_t(i % 8) << (3 * i);
+
+      block[channel.first] = mode.endpoints[0];
+      block[channel.first + 1] = mode.endpoints[1];
+      memcpy(block + channel.first + 2, &indices, 6);
+
+      decodeBlock(format, block, decoded);
+
+      for (int i = 0; i < 16; i++)
+      {
+        if (decoded[i * 4 + channel.second] != mode.palette[i % 8])
+        {
+          throw runtime_error(name + ": index " + to_string(i % 8) + " of the " +
+                              (mode.endpoints[0] > mode.endpoints[1] ? "eight" : "six") +
+                              " value mode was decoded wrong");
+        }
+      }
+    }
+  }
+}
+
+
+/// round trips of single color, two color and noise blocks, and the decoder's modes
+void checkBlockEncoder(BlockFormat format)
+{
+  mt19937 generator(1);
+  unsigned char rgba[16 * 4];
+
+  auto randomColor = [&generator] (unsigned char color[4])
+  {
+    for (int c = 0; c < 4; c++)
+      color[c] = generator();
+  };
+
+  // single colors, with black and white - the error is that of the 5:6:5 endpoints
+  for (int n = 0; n < 64; n++)
+  {
+    unsigned char color[4];
+    randomColor(color);
+    if (n < 2)
+      fill(color, color + 4, n ? 255 : 0);
+
+    for (int i = 0; i < 16; i++)
+      copy(color, color + 4, rgba + i * 4);
+
+    checkRoundTrip(format, rgba, MAX_TWO_COLOR_ERROR / 2);
+  }
+
+  // two colors, with red and green, whose difference is orthogonal to grey
+  for (int n = 0; n < 64; n++)
+  {
+    unsigned char colors[2][4];
+    randomColor(colors[0]);
+    randomColor(colors[1]);
+    if (n == 0)
+    {
+      const unsigned char red[4] = { 255, 0, 0, 255 };
+      const unsigned char green[4] = { 0, 255, 0, 255 };
+      copy(red, red + 4, colors[0]);
+      copy(green, green + 4, colors[1]);
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+      auto &color = colors[generator() % 2];
+      copy(color, color + 4, rgba + i * 4);
+    }
+
+    checkRoundTrip(format, rgba, MAX_TWO_COLOR_ERROR);
+  }
+
+  // noise - only the BC4 channels have a bound
+  for (int n = 0; n < 256; n++)
+  {
+    for (auto &component : rgba)
+      component = generator();
+    checkRoundTrip(format, rgba, 255);
+  }
+
+  checkDecoderModes(format);
+}
+
+
+/**
+ * Checks that texture arrays are only block compressed if the context has S3TC and RGTC -
+ * otherwise the layers are uploaded as they are.
+ */
+void checkCompressionFallback(TextureCompression compression)
+{
+  const int size = 16;
+  const int num_components = compression == TextureCompression::NORMAL_MAP ? 3 : 4;
+  const vector<unsigned char> pixels(size * size * num_components, 128);
+
+  // the default options come last, so they are still in effect afterwards
+  for (bool has_texture_compression : { false, true })
+  {
+    NullInterfaceOptions options;
+    options.has_texture_compression = has_texture_compression;
+    benchmark::ScopedNullInterface gl_interface(options);
+
+    if (isTextureCompressionSupported(compression) != has_texture_compression)
+      throw runtime_error("the texture compression support wasn't detected");
+
+    resetNullInterfaceStatistics();
+
+    createCompressedTextureArray({ pixels.data() }, size, num_components, compression, {});
+
+    auto stats = getNullInterfaceStatistics();
+    const bool is_compressed = stats.getNumCalls("glCompressedTexImage3D") ||
+                               stats.getNumCalls("glCompressedTexSubImage3D");
+
+    if (is_compressed != has_texture_compression)
+    {
+      throw runtime_error(has_texture_compression ?
+                            "the texture array wasn't compressed" :
+                            "the texture array was compressed without S3TC and RGTC");
+    }
+  }
+}
+
+
+string toLower(string s)
+{
+  transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s;
+}
+
+
+} // namespace
+
+
+namespace render_util::benchmark
+{
+
+
+/**
+ * From file to texture with the GL stand-in, so the upload and glGenerateMipmap cost nothing,
+ * and the block compression encoder and its cache.
+ */
+void registerTextureBenchmarks(Suite &suite)
+{
+  const int size = suite.getOptions().map_size;
+  const double num_pixels = double(size) * size;
+  const string output_dir = suite.getOptions().output_dir;
+
+  for (auto &variant : CONTAINER_VARIANTS)
+  {
+    suite.add(
+    {
+      "texture/load_" + variant.name, false, 1, "textures",
+      [variant, size, output_dir]
+      {
+        const string path = writeContainer(variant, size, output_dir);
+        const bool is_tga = variant.format == ImageFileFormat::UNKNOWN;
+
+        if (!is_tga)
+          checkMalformedContainers(variant.format);
+
+        return function<void()>([path, is_tga]
+        {
+          if (!(is_tga ? loadTGA(path) : loadContainer(path)))
+            throw runtime_error("failed to load " + path);
+        });
+      }
+    });
+  }
+
+  // the encoder is checked block by block, and its error against a minimum PSNR per format
+  for (auto &check : FORMAT_CHECKS)
+  {
+    suite.add(
+    {
+      "texture/compress_" + toLower(getBlockFormatName(check.format)), false, num_pixels, "pixels",
+      [check, size]
+      {
+        checkBlockEncoder(check.format);
+
+        auto pixels = make_shared<vector<unsigned char>>(createCompressionImage(size));
+
+        auto blocks = compressImage(check.format, pixels->data(), glm::ivec2(size), 4);
+        auto decoded = decompressImage(check.format, blocks.data(), glm::ivec2(size));
+
+        double psnr = getPSNR(*pixels, decoded, check.num_checked_components);
+        if (psnr < check.min_psnr)
+        {
+          throw runtime_error(string("the PSNR of ") + getBlockFormatName(check.format) +
+                              " is " + to_string(psnr) + ", below " + to_string(check.min_psnr));
+        }
+
+        return function<void()>([check, pixels, size]
+        {
+          compressImage(check.format, pixels->data(), glm::ivec2(size), 4);
+        });
+      }
+    });
+  }
+
+  // all loads after the first, encoding one come from the cache -
+  // and without S3TC / RGTC nothing is compressed
+  for (auto compression : { TextureCompression::COLOR, TextureCompression::NORMAL_MAP })
+  {
+    const auto format =
+      compression == TextureCompression::NORMAL_MAP ? BlockFormat::BC5 : BlockFormat::BC3;
+
+    suite.add(
+    {
+      "texture/compressed_cache_load_" + toLower(getBlockFormatName(format)), false,
+      num_pixels, "pixels",
+      [format, compression, size, output_dir]
+      {
+        checkCompressionFallback(compression);
+
+        auto pixels = make_shared<vector<unsigned char>>(createCompressionImage(size));
+
+        auto load = [format, compression, size, output_dir, pixels]
+        {
+          TextureCompressionStatistics statistics;
+          auto texture = getCompressedTexture(format, compression, pixels->data(),
+                                              glm::ivec2(size), 4, output_dir, statistics);
+          if (!texture)
+            throw runtime_error("failed to compress the texture");
+          return statistics;
+        };
+
+        load();
+
+        auto statistics = load();
+        if (!statistics.num_cache_hits || statistics.encoded_pixels)
+          throw runtime_error("the compressed texture wasn't loaded from the cache");
+
+        return function<void()>(load);
+      }
+    });
+  }
+}
+
+
+} // namespace render_util::benchmark
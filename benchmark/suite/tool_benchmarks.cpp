@@ -0,0 +1,67 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark_suite.h"
+#include <render_util/render_util.h>
+
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+
+namespace render_util::benchmark
+{
+
+
+/// the generators behind create_atmosphere_map and create_curvature_map, including the write
+void registerToolBenchmarks(Suite &suite)
+{
+  const string output_dir = suite.getOptions().output_dir;
+
+  suite.add(
+  {
+    "tools/atmosphere_map", true, 0, {},
+    [output_dir]
+    {
+      const string path = output_dir + "/render_util_benchmarks_atmosphere_map";
+      return function<void()>([path]
+      {
+        if (!createAtmosphereMap(path.c_str()))
+          throw runtime_error("failed to write " + path);
+      });
+    }
+  });
+
+  suite.add(
+  {
+    "tools/curvature_map", true, 0, {},
+    [output_dir]
+    {
+      const string path = output_dir + "/render_util_benchmarks_curvature_map";
+      return function<void()>([path]
+      {
+        if (!createCurvatureMap(path.c_str()))
+          throw runtime_error("failed to write " + path);
+      });
+    }
+  });
+}
+
+
+} // namespace render_util::benchmark
@@ -0,0 +1,309 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/gl_binding/gl_debug.h>
+#include <render_util/gl_binding/gl_binding.h>
+#include <render_util/gl_binding/gl_interface.h>
+#include <log.h>
+
+#include <array>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+
+namespace render_util::gl_binding::detail
+{
+  std::atomic<const GLCallSite*> g_current_gl_call_site = nullptr;
+}
+
+
+using namespace render_util::gl_binding;
+
+
+namespace
+{
+
+
+/**
+ * Bounded multi-producer single-consumer queue.
+ * Each slot has a sequence number telling whether it is free for the producer
+ * which claimed the position, or filled for the consumer.
+ */
+class MessageQueue
+{
+  static constexpr size_t CAPACITY = 256;
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0);
+
+  struct Slot
+  {
+    std::atomic<size_t> sequence = 0;
+    GLDebugMessage message;
+  };
+
+  std::array<Slot, CAPACITY> m_slots;
+  std::atomic<size_t> m_push_pos = 0;
+  size_t m_pop_pos = 0;
+  std::atomic<unsigned long long> m_num_dropped = 0;
+
+public:
+  MessageQueue()
+  {
+    for (size_t i = 0; i < CAPACITY; i++)
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  template <typename F>
+  void push(F fill_message)
+  {
+    auto pos = m_push_pos.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      auto &slot = m_slots[pos % CAPACITY];
+      auto sequence = slot.sequence.load(std::memory_order_acquire);
+
+      if (sequence == pos)
+      {
+        if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          fill_message(slot.message);
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return;
+        }
+      }
+      else if (sequence < pos)
+      {
+        // the consumer hasn't freed this slot yet
+        m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      else
+      {
+        pos = m_push_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(GLDebugMessage &message)
+  {
+    auto &slot = m_slots[m_pop_pos % CAPACITY];
+
+    if (slot.sequence.load(std::memory_order_acquire) != m_pop_pos + 1)
+      return false;
+
+    message = slot.message;
+    slot.sequence.store(m_pop_pos + CAPACITY, std::memory_order_release);
+    m_pop_pos++;
+
+    return true;
+  }
+
+  unsigned long long takeNumDropped()
+  {
+    return m_num_dropped.exchange(0, std::memory_order_relaxed);
+  }
+};
+
+
+MessageQueue g_queue;
+GLDebugStatistics g_statistics;
+
+
+const char *getTypeName(unsigned int type)
+{
+  switch (type)
+  {
+    case GL_DEBUG_TYPE_ERROR:
+      return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+      return "deprecated behavior";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+      return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY:
+      return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:
+      return "performance";
+    default:
+      return "message";
+  }
+}
+
+
+bool isRepeat(const GLDebugMessage &a, const GLDebugMessage &b)
+{
+  return a.source == b.source &&
+         a.type == b.type &&
+         a.id == b.id &&
+         a.call_site == b.call_site &&
+         strcmp(a.text, b.text) == 0;
+}
+
+
+void logMessage(const GLDebugMessage &message, unsigned int num_repeats)
+{
+  std::ostringstream text;
+  text << "GL " << getTypeName(message.type) << " (id " << message.id << ")"
+       << (message.isExpectedError() ? " (expected)" : "")
+       << " after " << (message.call_site ? message.call_site->location : "the start")
+       << ": " << message.text;
+  if (num_repeats)
+    text << " (repeated " << num_repeats << " times)";
+
+  if (message.isError() && !message.isExpectedError())
+    LOG_ERROR << text.str() << std::endl;
+  else
+    LOG_WARNING << text.str() << std::endl;
+}
+
+
+} // namespace
+
+
+namespace render_util::gl_binding
+{
+  bool GLDebugMessage::isError() const
+  {
+    return type == GL_DEBUG_TYPE_ERROR || type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR;
+  }
+
+
+  void queueGLDebugMessage(unsigned int source,
+                           unsigned int type,
+                           unsigned int id,
+                           unsigned int severity,
+                           const char *text,
+                           int length,
+                           const GLCallSite *call_site)
+  {
+    g_queue.push([&] (GLDebugMessage &message)
+    {
+      message.source = source;
+      message.type = type;
+      message.id = id;
+      message.severity = severity;
+      message.call_site = call_site;
+
+      // a negative length means the text is null terminated
+      size_t text_length = length < 0 ? strlen(text) : length;
+      text_length = std::min(text_length, GLDebugMessage::MAX_TEXT_LENGTH - 1);
+      memcpy(message.text, text, text_length);
+      message.text[text_length] = '\0';
+    });
+  }
+
+
+  bool takeGLDebugMessage(GLDebugMessage &message)
+  {
+    return g_queue.pop(message);
+  }
+
+
+  unsigned int processGLDebugMessages()
+  {
+    unsigned int num_errors = 0;
+
+    GLDebugMessage previous;
+    GLDebugMessage message;
+    bool has_previous = false;
+    unsigned int num_repeats = 0;
+
+    while (g_queue.pop(message))
+    {
+      g_statistics.num_messages++;
+
+      if (message.isExpectedError())
+      {
+        g_statistics.num_expected_errors++;
+      }
+      else if (message.isError())
+      {
+        g_statistics.num_errors++;
+        num_errors++;
+      }
+
+      if (has_previous && isRepeat(previous, message))
+      {
+        num_repeats++;
+        continue;
+      }
+
+      if (has_previous)
+        logMessage(previous, num_repeats);
+
+      previous = message;
+      has_previous = true;
+      num_repeats = 0;
+    }
+
+    if (has_previous)
+      logMessage(previous, num_repeats);
+
+    auto num_dropped = g_queue.takeNumDropped();
+    if (num_dropped)
+    {
+      LOG_WARNING << num_dropped << " GL debug messages were dropped" << std::endl;
+      g_statistics.num_dropped += num_dropped;
+    }
+
+    if (auto iface = GL_Interface::getCurrent())
+    {
+      // the flag is sticky - without this an old error would fail the next explicit glGetError() check
+      bool has_flag_error = false;
+      for (int i = 0; i < MAX_GL_ERROR_FLAGS; i++)
+      {
+        auto err = iface->GetError();
+        if (err == GL_NO_ERROR)
+          break;
+
+        has_flag_error = true;
+        // already reported if there was an error message
+        if (!num_errors)
+        {
+          auto call_site = getGLCallSite();
+          LOG_ERROR << "GL error " << getGLErrorString(err) << " after "
+                    << (call_site ? call_site->location : "the start") << std::endl;
+        }
+      }
+
+      if (has_flag_error && !num_errors)
+      {
+        g_statistics.num_errors++;
+        num_errors++;
+      }
+
+      iface->clearError();
+    }
+
+    return num_errors;
+  }
+
+
+  GLDebugStatistics getGLDebugStatistics()
+  {
+    return g_statistics;
+  }
+
+
+  void resetGLDebugStatistics()
+  {
+    g_statistics = {};
+  }
+}
@@ -18,6 +18,7 @@
 
 
 #include <render_util/gl_binding/gl_binding.h>
+#include <render_util/gl_binding/gl_debug.h>
 #include <log.h>
 
 #include <stdexcept>
@@ -44,11 +45,20 @@ namespace render_util::gl_binding
       return addr;
     };
 
+    auto get_optional_proc_address = [getProcAddress] (const char *name)
+    {
+      auto addr = getProcAddress(name);
+
+      if (!addr)
+        LOG_INFO << "Optional GL procedure is missing: " << name << std::endl;
+
+      return addr;
+    };
+
     #include "gl_binding/_generated/gl_p_proc_init.inc"
 
     auto check_error = [this] ()
     {
-      this->Finish();
       auto err = this->GetError();
       if (err != GL_NO_ERROR)
       {
@@ -65,7 +75,11 @@ namespace render_util::gl_binding
     this->DebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, false);
     this->DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, nullptr, true);
     this->DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR, GL_DONT_CARE, 0, nullptr, true);
+    #if ENABLE_GL_DEBUG_OUTPUT_SYNCHRONOUS
+    // messages are reported during the call which caused them - exact, but threaded drivers
+    // have to finish every call before returning
     this->Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    #endif
     this->Enable(GL_DEBUG_OUTPUT);
     check_error();
     #endif
@@ -86,16 +100,17 @@ namespace render_util::gl_binding
     const GLchar* message,
     const void* userParam)
   {
-    if (type == GL_DEBUG_TYPE_ERROR || type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR)
-    {
-      LOG_ERROR << message << std::endl;
+    // this may be called from a driver thread - queue the message for processGLDebugMessages()
+    auto call_site = getGLCallSite();
+    queueGLDebugMessage(source, type, id, severity, message, length, call_site);
 
-      auto iface = (GL_Interface*)userParam;
-      iface->has_error = true;
-    }
-    else
+    if (type == GL_DEBUG_TYPE_ERROR || type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR)
     {
-      LOG_WARNING << message << std::endl;
+      if (!call_site || !call_site->errors_expected)
+      {
+        auto iface = (GL_Interface*)userParam;
+        iface->has_error = true;
+      }
     }
   }
   #endif
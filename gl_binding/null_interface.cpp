@@ -0,0 +1,1042 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/gl_binding/null_interface.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+
+namespace render_util::gl_binding
+{
+
+
+namespace
+{
+
+
+struct NullProc
+{
+  const char *name;
+  void *address;
+};
+
+
+void recordCall(int proc_index);
+
+
+// procedures which do nothing but being recorded
+#include "gl_binding/_generated/gl_null_procs.inc"
+
+
+constexpr size_t NUM_PROCS = std::size(g_null_procs);
+
+
+/// level 0 of a texture, kept while texture data is recorded
+struct TextureImage
+{
+  std::array<GLsizei, 3> size {};
+  size_t pixel_size = 0;
+  std::vector<char> data;
+};
+
+
+struct State
+{
+  NullInterfaceOptions options;
+  NullInterfaceStatistics statistics;
+  std::vector<unsigned long long> num_calls = std::vector<unsigned long long>(NUM_PROCS, 0);
+
+  GLuint next_name = 1;
+  GLint next_uniform_location = 0;
+  // locations are unique per name - the program is ignored
+  std::unordered_map<std::string, GLint> uniform_locations;
+  std::array<std::unordered_set<uintptr_t>, NULL_OBJECT_TYPE_NUM> live_objects;
+  std::unordered_map<GLenum, GLuint> bound_buffers;
+  std::unordered_map<GLuint, std::vector<char>> buffer_storage;
+
+  GLuint active_texture_unit = 0;
+  /// per unit and target
+  std::map<std::pair<GLuint, GLenum>, GLuint> bound_textures;
+  /// the target a texture was created with or first bound to
+  std::unordered_map<GLuint, GLenum> texture_targets;
+
+  bool record_texture_data = false;
+  std::unordered_map<GLuint, TextureImage> texture_images;
+  std::vector<NullTextureTransfer> texture_transfers;
+};
+
+
+const char * const g_object_type_names[NULL_OBJECT_TYPE_NUM] =
+{
+  "buffer",
+  "texture",
+  "vertex array",
+  "framebuffer",
+  "shader",
+  "program",
+  "sync",
+};
+
+
+State &getState()
+{
+  static State state;
+  return state;
+}
+
+
+void recordCall(int proc_index)
+{
+  assert(proc_index >= 0);
+  assert(proc_index < (int)NUM_PROCS);
+  getState().num_calls[proc_index]++;
+}
+
+
+int getProcIndex(const char *name)
+{
+  for (size_t i = 0; i < NUM_PROCS; i++)
+  {
+    if (strcmp(g_null_procs[i].name, name) == 0)
+      return (int)i;
+  }
+  return -1;
+}
+
+
+// for the overrides below - a procedure is only called if it is enabled, so it has an index
+#define RECORD_CALL(name) \
+  { static const int index = getProcIndex(name); recordCall(index); }
+
+
+uintptr_t createObject(NullObjectTypeEnum type)
+{
+  auto &state = getState();
+
+  uintptr_t name = state.next_name++;
+  state.live_objects[type].insert(name);
+
+  auto &objects = state.statistics.objects[type];
+  objects.num_created++;
+  objects.num_live++;
+
+  return name;
+}
+
+
+void deleteObject(NullObjectTypeEnum type, uintptr_t name)
+{
+  auto &state = getState();
+
+  // like GL, ignore 0 and unused names
+  if (!state.live_objects[type].erase(name))
+    return;
+
+  auto &objects = state.statistics.objects[type];
+  objects.num_deleted++;
+  assert(objects.num_live);
+  objects.num_live--;
+
+  if (type == NULL_OBJECT_BUFFER)
+    state.buffer_storage.erase(name);
+
+  if (type == NULL_OBJECT_TEXTURE)
+  {
+    state.texture_targets.erase(name);
+    state.texture_images.erase(name);
+  }
+}
+
+
+void genObjects(NullObjectTypeEnum type, GLsizei n, GLuint *names)
+{
+  for (GLsizei i = 0; i < n; i++)
+    names[i] = createObject(type);
+}
+
+
+void deleteObjects(NullObjectTypeEnum type, GLsizei n, const GLuint *names)
+{
+  for (GLsizei i = 0; i < n; i++)
+    deleteObject(type, names[i]);
+}
+
+
+GLuint getBoundBuffer(GLenum target)
+{
+  auto &state = getState();
+  auto it = state.bound_buffers.find(target);
+  return it != state.bound_buffers.end() ? it->second : 0;
+}
+
+
+std::vector<char> &getBoundBufferStorage(GLenum target)
+{
+  auto buffer = getBoundBuffer(target);
+  assert(buffer);
+  return getState().buffer_storage[buffer];
+}
+
+
+int getNumComponents(GLenum format)
+{
+  switch (format)
+  {
+    case GL_RED:
+    case GL_GREEN:
+    case GL_BLUE:
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+    case GL_RED_INTEGER:
+    case GL_DEPTH_COMPONENT:
+      return 1;
+    case GL_RG:
+    case GL_LUMINANCE_ALPHA:
+    case GL_RG_INTEGER:
+      return 2;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+      return 3;
+    default:
+      return 4;
+  }
+}
+
+
+// ignores the unpack alignment
+size_t getImageSize(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth)
+{
+  size_t pixel_size = 0;
+
+  switch (type)
+  {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+      pixel_size = getNumComponents(format);
+      break;
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+      pixel_size = 2 * getNumComponents(format);
+      break;
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+      pixel_size = 2;
+      break;
+    case GL_UNSIGNED_INT_8_8_8_8:
+    case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+      pixel_size = 4;
+      break;
+    default:
+      pixel_size = 4 * getNumComponents(format);
+  }
+
+  return pixel_size * width * height * depth;
+}
+
+
+GLuint getBoundTexture(GLenum target)
+{
+  if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+    target = GL_TEXTURE_CUBE_MAP;
+
+  auto &state = getState();
+  auto it = state.bound_textures.find({ state.active_texture_unit, target });
+  return it != state.bound_textures.end() ? it->second : 0;
+}
+
+
+/// the client memory pixels points to, or the unpack buffer memory if one is bound
+const char *getUnpackData(const void *pixels)
+{
+  if (getBoundBuffer(GL_PIXEL_UNPACK_BUFFER))
+    return getBoundBufferStorage(GL_PIXEL_UNPACK_BUFFER).data() + uintptr_t(pixels);
+  else
+    return static_cast<const char*>(pixels);
+}
+
+
+void recordTextureUpload(GLenum format, GLenum type,
+                         GLsizei width, GLsizei height, GLsizei depth,
+                         const void *pixels)
+{
+  // with an unpack buffer pixels is an offset, so null is valid
+  if (!pixels && !getBoundBuffer(GL_PIXEL_UNPACK_BUFFER))
+    return;
+
+  getState().statistics.texture_bytes_uploaded +=
+    getImageSize(format, type, width, height, depth);
+}
+
+
+void recordTextureTransfer(const char *proc_name, GLuint texture, GLint level,
+                           GLenum format, GLenum type,
+                           std::array<GLint, 3> offset, std::array<GLsizei, 3> size,
+                           const char *data)
+{
+  NullTextureTransfer transfer;
+  transfer.proc_name = proc_name;
+  transfer.texture = texture;
+  transfer.level = level;
+  transfer.format = format;
+  transfer.type = type;
+  transfer.offset = offset;
+  transfer.size = size;
+  transfer.data.assign(data, data + getImageSize(format, type, size[0], size[1], size[2]));
+
+  getState().texture_transfers.push_back(std::move(transfer));
+}
+
+
+void setTextureImage(const char *proc_name, GLenum target, GLint level,
+                     GLsizei width, GLsizei height, GLsizei depth,
+                     GLenum format, GLenum type, const void *pixels)
+{
+  recordTextureUpload(format, type, width, height, depth, pixels);
+
+  auto &state = getState();
+  if (!state.record_texture_data)
+    return;
+
+  auto texture = getBoundTexture(target);
+  bool has_data = pixels || getBoundBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  if (has_data)
+  {
+    recordTextureTransfer(proc_name, texture, level, format, type,
+                          {}, { width, height, depth }, getUnpackData(pixels));
+  }
+
+  // the faces of cube maps aren't kept
+  if (!texture || level != 0 || target != state.texture_targets[texture])
+    return;
+
+  auto &image = state.texture_images[texture];
+  image.size = { width, height, depth };
+  image.pixel_size = getImageSize(format, type, 1, 1, 1);
+  image.data.resize(getImageSize(format, type, width, height, depth));
+
+  if (has_data)
+  {
+    auto data = getUnpackData(pixels);
+    std::copy(data, data + image.data.size(), image.data.begin());
+  }
+  else
+  {
+    for (size_t i = 0; i < image.data.size(); i++)
+      image.data[i] = char(texture * 131 + i * 7);
+  }
+}
+
+
+void setTextureSubImage(const char *proc_name, GLenum target, GLint level,
+                        GLint x, GLint y, GLint z,
+                        GLsizei width, GLsizei height, GLsizei depth,
+                        GLenum format, GLenum type, const void *pixels)
+{
+  recordTextureUpload(format, type, width, height, depth, pixels);
+
+  auto &state = getState();
+  if (!state.record_texture_data)
+    return;
+
+  auto texture = getBoundTexture(target);
+  auto data = getUnpackData(pixels);
+  assert(data);
+
+  recordTextureTransfer(proc_name, texture, level, format, type,
+                        { x, y, z }, { width, height, depth }, data);
+
+  auto it = state.texture_images.find(texture);
+  if (level != 0 || it == state.texture_images.end())
+    return;
+
+  auto &image = it->second;
+
+  // a different pixel format would need a conversion
+  auto pixel_size = getImageSize(format, type, 1, 1, 1);
+  if (pixel_size != image.pixel_size ||
+      x + width > image.size[0] || y + height > image.size[1] || z + depth > image.size[2])
+  {
+    return;
+  }
+
+  const size_t row_size = pixel_size * width;
+
+  for (GLsizei layer = 0; layer < depth; layer++)
+  {
+    for (GLsizei row = 0; row < height; row++)
+    {
+      size_t dst_pixel = (size_t(z + layer) * image.size[1] + (y + row)) * image.size[0] + x;
+      const char *src = data + (size_t(layer) * height + row) * row_size;
+      std::copy(src, src + row_size, image.data.begin() + dst_pixel * pixel_size);
+    }
+  }
+}
+
+
+void recordCompressedTextureUpload(GLsizei image_size, const void *data)
+{
+  if (!data && !getBoundBuffer(GL_PIXEL_UNPACK_BUFFER))
+    return;
+
+  getState().statistics.texture_bytes_uploaded += image_size;
+}
+
+
+GLuint GLAPIENTRY createProgram()
+{
+  RECORD_CALL("glCreateProgram");
+  return createObject(NULL_OBJECT_PROGRAM);
+}
+
+
+void GLAPIENTRY deleteProgram(GLuint program)
+{
+  RECORD_CALL("glDeleteProgram");
+  deleteObject(NULL_OBJECT_PROGRAM, program);
+}
+
+
+GLuint GLAPIENTRY createShader(GLenum)
+{
+  RECORD_CALL("glCreateShader");
+  return createObject(NULL_OBJECT_SHADER);
+}
+
+
+void GLAPIENTRY deleteShader(GLuint shader)
+{
+  RECORD_CALL("glDeleteShader");
+  deleteObject(NULL_OBJECT_SHADER, shader);
+}
+
+
+void GLAPIENTRY genBuffers(GLsizei n, GLuint *names)
+{
+  RECORD_CALL("glGenBuffers");
+  genObjects(NULL_OBJECT_BUFFER, n, names);
+}
+
+
+void GLAPIENTRY deleteBuffers(GLsizei n, const GLuint *names)
+{
+  RECORD_CALL("glDeleteBuffers");
+  deleteObjects(NULL_OBJECT_BUFFER, n, names);
+}
+
+
+void GLAPIENTRY genTextures(GLsizei n, GLuint *names)
+{
+  RECORD_CALL("glGenTextures");
+  genObjects(NULL_OBJECT_TEXTURE, n, names);
+}
+
+
+void GLAPIENTRY createTextures(GLenum target, GLsizei n, GLuint *names)
+{
+  RECORD_CALL("glCreateTextures");
+  genObjects(NULL_OBJECT_TEXTURE, n, names);
+
+  for (GLsizei i = 0; i < n; i++)
+    getState().texture_targets[names[i]] = target;
+}
+
+
+void GLAPIENTRY deleteTextures(GLsizei n, const GLuint *names)
+{
+  RECORD_CALL("glDeleteTextures");
+  deleteObjects(NULL_OBJECT_TEXTURE, n, names);
+}
+
+
+void GLAPIENTRY genVertexArrays(GLsizei n, GLuint *names)
+{
+  RECORD_CALL("glGenVertexArrays");
+  genObjects(NULL_OBJECT_VERTEX_ARRAY, n, names);
+}
+
+
+void GLAPIENTRY deleteVertexArrays(GLsizei n, const GLuint *names)
+{
+  RECORD_CALL("glDeleteVertexArrays");
+  deleteObjects(NULL_OBJECT_VERTEX_ARRAY, n, names);
+}
+
+
+void GLAPIENTRY genFramebuffers(GLsizei n, GLuint *names)
+{
+  RECORD_CALL("glGenFramebuffers");
+  genObjects(NULL_OBJECT_FRAMEBUFFER, n, names);
+}
+
+
+void GLAPIENTRY deleteFramebuffers(GLsizei n, const GLuint *names)
+{
+  RECORD_CALL("glDeleteFramebuffers");
+  deleteObjects(NULL_OBJECT_FRAMEBUFFER, n, names);
+}
+
+
+GLenum GLAPIENTRY checkFramebufferStatus(GLenum)
+{
+  RECORD_CALL("glCheckFramebufferStatus");
+  return GL_FRAMEBUFFER_COMPLETE;
+}
+
+
+GLsync GLAPIENTRY fenceSync(GLenum, GLbitfield)
+{
+  RECORD_CALL("glFenceSync");
+  return reinterpret_cast<GLsync>(createObject(NULL_OBJECT_SYNC));
+}
+
+
+void GLAPIENTRY deleteSync(GLsync sync)
+{
+  RECORD_CALL("glDeleteSync");
+  deleteObject(NULL_OBJECT_SYNC, reinterpret_cast<uintptr_t>(sync));
+}
+
+
+GLenum GLAPIENTRY clientWaitSync(GLsync sync, GLbitfield, GLuint64)
+{
+  RECORD_CALL("glClientWaitSync");
+  if (!getState().live_objects[NULL_OBJECT_SYNC].count(reinterpret_cast<uintptr_t>(sync)))
+    return GL_WAIT_FAILED;
+  return GL_ALREADY_SIGNALED;
+}
+
+
+void GLAPIENTRY getShaderiv(GLuint, GLenum pname, GLint *params)
+{
+  RECORD_CALL("glGetShaderiv");
+  *params = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0;
+}
+
+
+void GLAPIENTRY getProgramiv(GLuint, GLenum pname, GLint *params)
+{
+  RECORD_CALL("glGetProgramiv");
+  *params = (pname == GL_LINK_STATUS || pname == GL_VALIDATE_STATUS) ? GL_TRUE : 0;
+}
+
+
+GLint GLAPIENTRY getUniformLocation(GLuint, const GLchar *name)
+{
+  RECORD_CALL("glGetUniformLocation");
+
+  auto &state = getState();
+
+  auto it = state.uniform_locations.find(name);
+  if (it != state.uniform_locations.end())
+    return it->second;
+
+  auto location = state.next_uniform_location++;
+  state.uniform_locations[name] = location;
+  return location;
+}
+
+
+GLuint GLAPIENTRY getUniformBlockIndex(GLuint, const GLchar*)
+{
+  RECORD_CALL("glGetUniformBlockIndex");
+  return 0;
+}
+
+
+/// GL_MAJOR_VERSION is 0, so RGTC has to be advertised too
+const char * const g_extensions[] =
+{
+  "GL_EXT_texture_compression_s3tc",
+  "GL_ARB_texture_compression_rgtc",
+};
+
+
+void GLAPIENTRY getIntegerv(GLenum pname, GLint *data)
+{
+  RECORD_CALL("glGetIntegerv");
+
+  switch (pname)
+  {
+    case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+      data[0] = 192;
+      break;
+    case GL_MAX_ARRAY_TEXTURE_LAYERS:
+      data[0] = 2048;
+      break;
+    case GL_UNPACK_ALIGNMENT:
+      data[0] = 4;
+      break;
+    case GL_ACTIVE_TEXTURE:
+      data[0] = GL_TEXTURE0 + getState().active_texture_unit;
+      break;
+    case GL_VIEWPORT:
+      std::fill(data, data + 4, 0);
+      break;
+    case GL_NUM_EXTENSIONS:
+      data[0] = getState().options.has_texture_compression ? std::size(g_extensions) : 0;
+      break;
+    default:
+      data[0] = 0;
+  }
+}
+
+
+const GLubyte * GLAPIENTRY getStringi(GLenum name, GLuint index)
+{
+  RECORD_CALL("glGetStringi");
+
+  if (name != GL_EXTENSIONS || index >= std::size(g_extensions))
+    return nullptr;
+
+  return reinterpret_cast<const GLubyte*>(g_extensions[index]);
+}
+
+
+void GLAPIENTRY getFloatv(GLenum, GLfloat *data)
+{
+  RECORD_CALL("glGetFloatv");
+  data[0] = 0;
+}
+
+
+void GLAPIENTRY bindBuffer(GLenum target, GLuint buffer)
+{
+  RECORD_CALL("glBindBuffer");
+  getState().bound_buffers[target] = buffer;
+}
+
+
+void GLAPIENTRY bindBufferBase(GLenum target, GLuint, GLuint buffer)
+{
+  RECORD_CALL("glBindBufferBase");
+  // binds the generic binding point as well
+  getState().bound_buffers[target] = buffer;
+}
+
+
+void setBufferData(GLenum target, GLsizeiptr size, const void *data)
+{
+  auto &storage = getBoundBufferStorage(target);
+  storage.assign(size, 0);
+  if (data)
+  {
+    memcpy(storage.data(), data, size);
+    getState().statistics.buffer_bytes_uploaded += size;
+  }
+}
+
+
+void GLAPIENTRY bufferData(GLenum target, GLsizeiptr size, const void *data, GLenum)
+{
+  RECORD_CALL("glBufferData");
+  setBufferData(target, size, data);
+}
+
+
+void GLAPIENTRY bufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield)
+{
+  RECORD_CALL("glBufferStorage");
+  setBufferData(target, size, data);
+}
+
+
+void GLAPIENTRY bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+  RECORD_CALL("glBufferSubData");
+
+  auto &storage = getBoundBufferStorage(target);
+  assert(offset + size <= (GLintptr)storage.size());
+  memcpy(storage.data() + offset, data, size);
+
+  getState().statistics.buffer_bytes_uploaded += size;
+}
+
+
+void *GLAPIENTRY mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                                GLbitfield access)
+{
+  RECORD_CALL("glMapBufferRange");
+
+  auto &storage = getBoundBufferStorage(target);
+  assert(offset + length <= (GLintptr)storage.size());
+
+  if (access & GL_MAP_WRITE_BIT)
+    getState().statistics.buffer_bytes_mapped += length;
+
+  return storage.data() + offset;
+}
+
+
+GLboolean GLAPIENTRY unmapBuffer(GLenum)
+{
+  RECORD_CALL("glUnmapBuffer");
+  return GL_TRUE;
+}
+
+
+void GLAPIENTRY activeTexture(GLenum texture)
+{
+  RECORD_CALL("glActiveTexture");
+  getState().active_texture_unit = texture - GL_TEXTURE0;
+}
+
+
+void bindTextureToUnit(GLuint unit, GLenum target, GLuint texture)
+{
+  auto &state = getState();
+
+  if (texture)
+  {
+    auto it = state.texture_targets.find(texture);
+    if (it == state.texture_targets.end())
+      state.texture_targets[texture] = target;
+  }
+
+  state.bound_textures[{ unit, target }] = texture;
+}
+
+
+/// binds texture to the target it was created with - 0 unbinds all targets
+void bindTextureToUnit(GLuint unit, GLuint texture)
+{
+  auto &state = getState();
+
+  if (!texture)
+  {
+    for (auto &it : state.bound_textures)
+    {
+      if (it.first.first == unit)
+        it.second = 0;
+    }
+    return;
+  }
+
+  auto it = state.texture_targets.find(texture);
+  if (it != state.texture_targets.end())
+    state.bound_textures[{ unit, it->second }] = texture;
+}
+
+
+void GLAPIENTRY bindTexture(GLenum target, GLuint texture)
+{
+  RECORD_CALL("glBindTexture");
+  bindTextureToUnit(getState().active_texture_unit, target, texture);
+}
+
+
+void GLAPIENTRY bindTextureUnit(GLuint unit, GLuint texture)
+{
+  RECORD_CALL("glBindTextureUnit");
+  bindTextureToUnit(unit, texture);
+}
+
+
+void GLAPIENTRY bindTextures(GLuint first, GLsizei count, const GLuint *textures)
+{
+  RECORD_CALL("glBindTextures");
+  for (GLsizei i = 0; i < count; i++)
+    bindTextureToUnit(first + i, textures ? textures[i] : 0);
+}
+
+
+void GLAPIENTRY getTextureImage(GLuint texture, GLint level, GLenum format, GLenum type,
+                                GLsizei buffer_size, void *pixels)
+{
+  RECORD_CALL("glGetTextureImage");
+
+  auto &state = getState();
+  if (!state.record_texture_data)
+    return;
+
+  auto it = state.texture_images.find(texture);
+  if (level != 0 || it == state.texture_images.end())
+    return;
+
+  auto &image = it->second;
+
+  char *dst = static_cast<char*>(pixels);
+  if (getBoundBuffer(GL_PIXEL_PACK_BUFFER))
+    dst = getBoundBufferStorage(GL_PIXEL_PACK_BUFFER).data() + uintptr_t(pixels);
+
+  auto size = getImageSize(format, type, image.size[0], image.size[1], image.size[2]);
+  if (size > size_t(buffer_size))
+    return;
+
+  // a different pixel format would need a conversion - read back zeros instead
+  if (getImageSize(format, type, 1, 1, 1) == image.pixel_size)
+    std::copy(image.data.begin(), image.data.end(), dst);
+  else
+    std::fill(dst, dst + size, 0);
+
+  recordTextureTransfer("glGetTextureImage", texture, level, format, type,
+                        {}, image.size, dst);
+}
+
+
+void GLAPIENTRY texImage1D(GLenum target, GLint level, GLint, GLsizei width, GLint,
+                           GLenum format, GLenum type, const void *pixels)
+{
+  RECORD_CALL("glTexImage1D");
+  setTextureImage("glTexImage1D", target, level, width, 1, 1, format, type, pixels);
+}
+
+
+void GLAPIENTRY texImage2D(GLenum target, GLint level, GLint, GLsizei width, GLsizei height,
+                           GLint, GLenum format, GLenum type, const void *pixels)
+{
+  RECORD_CALL("glTexImage2D");
+  setTextureImage("glTexImage2D", target, level, width, height, 1, format, type, pixels);
+}
+
+
+void GLAPIENTRY texImage3D(GLenum target, GLint level, GLint,
+                           GLsizei width, GLsizei height, GLsizei depth,
+                           GLint, GLenum format, GLenum type, const void *pixels)
+{
+  RECORD_CALL("glTexImage3D");
+  setTextureImage("glTexImage3D", target, level, width, height, depth, format, type, pixels);
+}
+
+
+void GLAPIENTRY texSubImage2D(GLenum target, GLint level, GLint x, GLint y,
+                              GLsizei width, GLsizei height,
+                              GLenum format, GLenum type, const void *pixels)
+{
+  RECORD_CALL("glTexSubImage2D");
+  setTextureSubImage("glTexSubImage2D", target, level, x, y, 0, width, height, 1,
+                     format, type, pixels);
+}
+
+
+void GLAPIENTRY texSubImage3D(GLenum target, GLint level, GLint x, GLint y, GLint z,
+                              GLsizei width, GLsizei height, GLsizei depth,
+                              GLenum format, GLenum type, const void *pixels)
+{
+  RECORD_CALL("glTexSubImage3D");
+  setTextureSubImage("glTexSubImage3D", target, level, x, y, z, width, height, depth,
+                     format, type, pixels);
+}
+
+
+void GLAPIENTRY compressedTexImage2D(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint,
+                                     GLsizei image_size, const void *data)
+{
+  RECORD_CALL("glCompressedTexImage2D");
+  recordCompressedTextureUpload(image_size, data);
+}
+
+
+void GLAPIENTRY compressedTexImage3D(GLenum, GLint, GLenum, GLsizei, GLsizei, GLsizei, GLint,
+                                     GLsizei image_size, const void *data)
+{
+  RECORD_CALL("glCompressedTexImage3D");
+  recordCompressedTextureUpload(image_size, data);
+}
+
+
+void GLAPIENTRY compressedTexSubImage3D(GLenum, GLint, GLint, GLint, GLint,
+                                        GLsizei, GLsizei, GLsizei, GLenum,
+                                        GLsizei image_size, const void *data)
+{
+  RECORD_CALL("glCompressedTexSubImage3D");
+  recordCompressedTextureUpload(image_size, data);
+}
+
+
+// procedures with results or side effects the renderer depends on
+const NullProc g_overrides[] =
+{
+  { "glCreateProgram", (void*) &createProgram },
+  { "glDeleteProgram", (void*) &deleteProgram },
+  { "glCreateShader", (void*) &createShader },
+  { "glDeleteShader", (void*) &deleteShader },
+  { "glGenBuffers", (void*) &genBuffers },
+  { "glDeleteBuffers", (void*) &deleteBuffers },
+  { "glGenTextures", (void*) &genTextures },
+  { "glCreateTextures", (void*) &createTextures },
+  { "glDeleteTextures", (void*) &deleteTextures },
+  { "glGenVertexArrays", (void*) &genVertexArrays },
+  { "glDeleteVertexArrays", (void*) &deleteVertexArrays },
+  { "glGenFramebuffers", (void*) &genFramebuffers },
+  { "glDeleteFramebuffers", (void*) &deleteFramebuffers },
+  { "glCheckFramebufferStatus", (void*) &checkFramebufferStatus },
+  { "glFenceSync", (void*) &fenceSync },
+  { "glDeleteSync", (void*) &deleteSync },
+  { "glClientWaitSync", (void*) &clientWaitSync },
+  { "glGetShaderiv", (void*) &getShaderiv },
+  { "glGetProgramiv", (void*) &getProgramiv },
+  { "glGetUniformLocation", (void*) &getUniformLocation },
+  { "glGetUniformBlockIndex", (void*) &getUniformBlockIndex },
+  { "glGetIntegerv", (void*) &getIntegerv },
+  { "glGetFloatv", (void*) &getFloatv },
+  { "glGetStringi", (void*) &getStringi },
+  { "glBindBuffer", (void*) &bindBuffer },
+  { "glBindBufferBase", (void*) &bindBufferBase },
+  { "glBufferData", (void*) &bufferData },
+  { "glBufferStorage", (void*) &bufferStorage },
+  { "glBufferSubData", (void*) &bufferSubData },
+  { "glMapBufferRange", (void*) &mapBufferRange },
+  { "glUnmapBuffer", (void*) &unmapBuffer },
+  { "glActiveTexture", (void*) &activeTexture },
+  { "glBindTexture", (void*) &bindTexture },
+  { "glBindTextureUnit", (void*) &bindTextureUnit },
+  { "glBindTextures", (void*) &bindTextures },
+  { "glGetTextureImage", (void*) &getTextureImage },
+  { "glTexImage1D", (void*) &texImage1D },
+  { "glTexImage2D", (void*) &texImage2D },
+  { "glTexImage3D", (void*) &texImage3D },
+  { "glTexSubImage2D", (void*) &texSubImage2D },
+  { "glTexSubImage3D", (void*) &texSubImage3D },
+  { "glCompressedTexImage2D", (void*) &compressedTexImage2D },
+  { "glCompressedTexImage3D", (void*) &compressedTexImage3D },
+  { "glCompressedTexSubImage3D", (void*) &compressedTexSubImage3D },
+};
+
+
+template <size_t N>
+void *findProc(const NullProc (&procs)[N], const char *name)
+{
+  for (auto &proc : procs)
+  {
+    if (strcmp(proc.name, name) == 0)
+      return proc.address;
+  }
+  return nullptr;
+}
+
+
+void *getProcAddress(const char *name)
+{
+  auto &options = getState().options;
+
+  if (!options.has_buffer_storage && strcmp(name, "glBufferStorage") == 0)
+    return nullptr;
+
+  if (!options.has_direct_state_access &&
+      (strcmp(name, "glCreateTextures") == 0 ||
+       strcmp(name, "glBindTextureUnit") == 0 ||
+       strcmp(name, "glBindTextures") == 0))
+  {
+    return nullptr;
+  }
+
+  auto addr = findProc(g_overrides, name);
+  if (!addr)
+    addr = findProc(g_null_procs, name);
+  return addr;
+}
+
+
+} // namespace
+
+
+const char *getNullObjectTypeName(unsigned int type)
+{
+  assert(type < NULL_OBJECT_TYPE_NUM);
+  return g_object_type_names[type];
+}
+
+
+unsigned long long NullInterfaceStatistics::getNumCalls() const
+{
+  unsigned long long num = 0;
+  for (auto &it : num_calls)
+    num += it.second;
+  return num;
+}
+
+
+unsigned long long NullInterfaceStatistics::getNumCalls(const std::string &proc_name) const
+{
+  auto it = num_calls.find(proc_name);
+  return it != num_calls.end() ? it->second : 0;
+}
+
+
+std::unique_ptr<GL_Interface> createNullInterface(const NullInterfaceOptions &options)
+{
+  getState().options = options;
+  return std::make_unique<GL_Interface>(&getProcAddress);
+}
+
+
+NullInterfaceStatistics getNullInterfaceStatistics()
+{
+  auto &state = getState();
+
+  auto statistics = state.statistics;
+  for (size_t i = 0; i < NUM_PROCS; i++)
+  {
+    if (state.num_calls[i])
+      statistics.num_calls[g_null_procs[i].name] = state.num_calls[i];
+  }
+
+  return statistics;
+}
+
+
+void resetNullInterfaceStatistics()
+{
+  auto &state = getState();
+
+  std::fill(state.num_calls.begin(), state.num_calls.end(), 0);
+  state.texture_transfers.clear();
+
+  auto objects = state.statistics.objects;
+  state.statistics = {};
+  for (size_t i = 0; i < objects.size(); i++)
+    state.statistics.objects[i].num_live = objects[i].num_live;
+}
+
+
+void enableNullTextureDataRecording(bool enable)
+{
+  auto &state = getState();
+
+  state.record_texture_data = enable;
+  if (!enable)
+  {
+    state.texture_images.clear();
+    state.texture_transfers.clear();
+  }
+}
+
+
+std::vector<NullTextureTransfer> getNullTextureTransfers()
+{
+  return getState().texture_transfers;
+}
+
+
+} // namespace render_util::gl_binding
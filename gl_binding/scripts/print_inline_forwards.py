@@ -43,9 +43,6 @@ for func in api.functionIterateByOffset():
 
     print ret_assignment + "iface->" + ep_name + "(" + getArgs(func, ep) + ");"
 
-    print "  if (iface->hasError())"
-    print "    throw GLError();"
-
     if func.return_type != "void":
       print "  return ret;"
 
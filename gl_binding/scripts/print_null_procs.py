@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+
+import sys
+import os
+import parser
+import gl_XML
+import enabled_procs
+
+api = parser.parseAPI()
+
+entries = []
+
+for func in api.functionIterateByOffset():
+  if func.desktop != True:
+    continue
+
+  for ep in func.entry_points:
+    if not enabled_procs.isProcEnabled(ep):
+      continue
+
+    ep_params = func.entry_point_parameters[ep]
+
+    # parameters are unnamed - the stubs ignore them
+    print "static " + func.return_type + " GLAPIENTRY null_" + ep + "(" + gl_XML.create_parameter_string(ep_params, 0)  + ")"
+    print "{"
+    print "  recordCall(" + str(len(entries)) + ");"
+    if func.return_type != "void":
+      print "  return {};"
+    print "}"
+    print
+
+    entries.append(ep)
+
+print "const NullProc g_null_procs[] ="
+print "{"
+for ep in entries:
+  print "  { \"gl" + ep + "\", (void*) &null_" + ep + " },"
+print "};"
@@ -18,4 +18,8 @@ for func in api.functionIterateByOffset():
     ep_name = ep
     ep_params = func.entry_point_parameters[ep]
     ep_type = func.return_type + " GLAPIENTRY (*) (" + gl_XML.create_parameter_string(ep_params, 0)  + ")"
-    print ep_name + " = (" + ep_type + ") get_proc_address(\"gl" + ep + "\");"
+    if enabled_procs.isProcOptional(ep):
+      getter = "get_optional_proc_address"
+    else:
+      getter = "get_proc_address"
+    print ep_name + " = (" + ep_type + ") " + getter + "(\"gl" + ep + "\");"
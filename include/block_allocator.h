@@ -69,6 +69,12 @@ public:
     m_containers = {};
   }
 
+  /// number of elements that fit into the allocated blocks
+  size_t getCapacity() const
+  {
+    return m_containers.size() * N;
+  }
+
 };
 
 
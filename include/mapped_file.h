@@ -0,0 +1,59 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTIL_MAPPED_FILE_H
+#define UTIL_MAPPED_FILE_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace util
+{
+
+
+/**
+ * Private mapping of a whole file.
+ * The pages are loaded on demand and shared with the page cache until they are written to -
+ * writes are copy-on-write and never reach the file.
+ */
+class MappedFile
+{
+  unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+
+  MappedFile() {}
+
+public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
+
+  unsigned char *getData() { return m_data; }
+  const unsigned char *getData() const { return m_data; }
+  size_t getSize() const { return m_size; }
+
+  /// returns null on failure
+  static std::shared_ptr<MappedFile> open(const std::string &path, bool quiet = false);
+};
+
+
+}
+
+#endif
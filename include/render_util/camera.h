@@ -20,6 +20,7 @@
 #define RENDER_UTIL_CAMERA_H
 
 #include <render_util/geometry.h>
+#include <render_util/frustum.h>
 
 #include <memory>
 
@@ -56,6 +57,9 @@ namespace render_util
     const glm::ivec2 &getViewportSize() const;
     const glm::vec2 &getNDCToView() const;
     bool cull(const Box &box) const;
+    /// see Frustum::test()
+    Frustum::Visibility testVisibility(const Box &box, Frustum::PlaneMask &mask) const;
+    const Frustum &getFrustum() const;
     Unit getFov() const;
     Unit getZNear() const;
     Unit getZFar() const;
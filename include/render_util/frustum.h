@@ -0,0 +1,80 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_FRUSTUM_H
+#define RENDER_UTIL_FRUSTUM_H
+
+#include <render_util/geometry.h>
+
+#include <glm/glm.hpp>
+
+namespace render_util
+{
+
+
+/**
+ * The planes of a view frustum, stored as arrays of their components
+ * so a box is tested against four planes at once.
+ * Plane i contains the points p with dot(normal[i], p) + distance[i] = 0,
+ * its normal points to the inside.
+ */
+class Frustum
+{
+public:
+  static constexpr int NUM_PLANES = 6;
+
+  /// bit i set: boxes still have to be tested against plane i
+  using PlaneMask = unsigned int;
+  static constexpr PlaneMask ALL_PLANES = (1u << NUM_PLANES) - 1;
+
+  enum class Visibility
+  {
+    OUTSIDE,
+    INTERSECTING,
+    INSIDE,
+  };
+
+  void setPlane(int index, const Plane &plane);
+  Plane getPlane(int index) const;
+
+  /**
+   * Tests an axis aligned box against the planes in mask.
+   * The planes the box is entirely inside of are removed from mask, so children of the box
+   * which are passed the mask skip them. The box is INSIDE once mask is 0.
+   */
+  Visibility test(const glm::vec3 &center, const glm::vec3 &half_extent, PlaneMask &mask) const;
+
+  Visibility test(const Box &box, PlaneMask &mask) const
+  {
+    return test(box.getCenter(), box.getSize() / 2.f, mask);
+  }
+
+private:
+  /// two vectors of four - the unused planes are never tested
+  static constexpr int NUM_PADDED_PLANES = 8;
+
+  alignas(16) float m_normal_x[NUM_PADDED_PLANES] {};
+  alignas(16) float m_normal_y[NUM_PADDED_PLANES] {};
+  alignas(16) float m_normal_z[NUM_PADDED_PLANES] {};
+  alignas(16) float m_distance[NUM_PADDED_PLANES] {};
+};
+
+
+} // namespace render_util
+
+#endif
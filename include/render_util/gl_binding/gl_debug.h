@@ -0,0 +1,175 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_GL_BINDING_GL_DEBUG_H
+#define RENDER_UTIL_GL_BINDING_GL_DEBUG_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Reporting of the messages the GL debug callback receives.
+ *
+ * The callback only queues the message - it doesn't log, lock or allocate.
+ * Nothing waits for the GPU: the queue is drained once per frame by processGLDebugMessages(),
+ * which also clears the GL error flag.
+ *
+ * Clients must call processGLDebugMessages() every frame - errors are not reported otherwise.
+ * Only debug builds fail fast: CHECK_GL_ERROR() throws GLError after an unexpected error.
+ * The callback is enabled in debug builds and with enable_gl_debug_callback.
+ *
+ * Each message is attributed to the call site which was tagged last when it arrived -
+ * CHECK_GL_ERROR() tags its call site, or use RENDER_UTIL_GL_CALL_SITE() and setGLCallSite().
+ * With synchronous debug output (debug builds or enable_gl_debug_output_synchronous)
+ * the message was caused by a call after that call site on the thread which renders.
+ *
+ * Otherwise debug output is asynchronous, so threaded drivers keep running ahead.
+ * The message may then arrive later - the call which caused it is at or before the site it is
+ * attributed to, not necessarily after it. An error from a scope which expects errors
+ * may also be reported as unexpected if the scope has ended when the message arrives.
+ */
+
+namespace render_util::gl_binding
+{
+  /**
+   * Upper bound for loops which call glGetError() until it returns GL_NO_ERROR.
+   * There is one flag per error type, but after a context loss GL_CONTEXT_LOST is returned forever.
+   */
+  constexpr int MAX_GL_ERROR_FLAGS = 16;
+
+
+  struct GLCallSite
+  {
+    /// "file:line"
+    const char *location = nullptr;
+    /// errors after this call site are checked for by the caller - they are only counted
+    bool errors_expected = false;
+  };
+
+
+  struct GLDebugMessage
+  {
+    static constexpr size_t MAX_TEXT_LENGTH = 256;
+
+    unsigned int source = 0;
+    unsigned int type = 0;
+    unsigned int id = 0;
+    unsigned int severity = 0;
+    const GLCallSite *call_site = nullptr;
+    /// truncated to MAX_TEXT_LENGTH - 1 characters
+    char text[MAX_TEXT_LENGTH] {};
+
+    bool isError() const;
+    bool isExpectedError() const { return isError() && call_site && call_site->errors_expected; }
+  };
+
+
+  struct GLDebugStatistics
+  {
+    unsigned long long num_messages = 0;
+    unsigned long long num_errors = 0;
+    unsigned long long num_expected_errors = 0;
+    /// messages which didn't fit in the queue
+    unsigned long long num_dropped = 0;
+  };
+
+
+  namespace detail
+  {
+    extern std::atomic<const GLCallSite*> g_current_gl_call_site;
+  }
+
+
+  /// A relaxed store - cheap enough to tag every check.
+  inline void setGLCallSite(const GLCallSite *call_site)
+  {
+    detail::g_current_gl_call_site.store(call_site, std::memory_order_relaxed);
+  }
+
+  inline const GLCallSite *getGLCallSite()
+  {
+    return detail::g_current_gl_call_site.load(std::memory_order_relaxed);
+  }
+
+
+  /// Tags a call site and restores the previous one when it goes out of scope.
+  class ScopedGLCallSite
+  {
+    const GLCallSite *m_previous = nullptr;
+
+  public:
+    ScopedGLCallSite(const GLCallSite *call_site) : m_previous(getGLCallSite())
+    {
+      setGLCallSite(call_site);
+    }
+
+    ~ScopedGLCallSite()
+    {
+      setGLCallSite(m_previous);
+    }
+
+    ScopedGLCallSite(const ScopedGLCallSite&) = delete;
+    ScopedGLCallSite &operator=(const ScopedGLCallSite&) = delete;
+  };
+
+
+  /**
+   * Called by the debug callback, possibly from a driver thread.
+   * Doesn't lock or allocate - if the queue is full the message is dropped and counted.
+   */
+  void queueGLDebugMessage(unsigned int source,
+                           unsigned int type,
+                           unsigned int id,
+                           unsigned int severity,
+                           const char *text,
+                           int length,
+                           const GLCallSite *call_site);
+
+  /// Removes the oldest queued message - must not be called from more than one thread at a time.
+  bool takeGLDebugMessage(GLDebugMessage &message);
+
+  /**
+   * Logs and removes the queued messages, repeats of the same message are logged once.
+   * Errors which are only in the GL error flag (e.g. without debug output) are logged and cleared as well.
+   * Meant to be called once per frame by the thread which renders.
+   * Returns the number of errors which weren't expected.
+   */
+  unsigned int processGLDebugMessages();
+
+  GLDebugStatistics getGLDebugStatistics();
+  void resetGLDebugStatistics();
+}
+
+
+#define RENDER_UTIL_GL_STRINGIFY_(x) #x
+#define RENDER_UTIL_GL_STRINGIFY(x) RENDER_UTIL_GL_STRINGIFY_(x)
+
+#define RENDER_UTIL_GL_CALL_SITE_(errors_expected) \
+  ([] () -> const render_util::gl_binding::GLCallSite* \
+  { \
+    static constexpr render_util::gl_binding::GLCallSite site \
+      { __FILE__ ":" RENDER_UTIL_GL_STRINGIFY(__LINE__), errors_expected }; \
+    return &site; \
+  }())
+
+/// A pointer to a GLCallSite for the current line - no code runs to create it.
+#define RENDER_UTIL_GL_CALL_SITE() RENDER_UTIL_GL_CALL_SITE_(false)
+/// Like RENDER_UTIL_GL_CALL_SITE(), for calls which may fail and are checked anyway.
+#define RENDER_UTIL_GL_CALL_SITE_EXPECTING_ERRORS() RENDER_UTIL_GL_CALL_SITE_(true)
+
+#endif
@@ -25,6 +25,7 @@
 
 #include <render_util/gl_binding/gl_interface.h>
 #include <render_util/gl_binding/gl_binding.h>
+#include <render_util/gl_binding/gl_debug.h>
 
 
 namespace render_util::gl_binding
@@ -47,18 +48,58 @@ namespace render_util::gl_binding::gl
   #include <gl_binding/_generated/gl_inline_forwards.inc>
 }
 
-#define FORCE_CHECK_GL_ERROR() \
-{ \
-  render_util::gl_binding::gl::Finish(); \
-  auto err = render_util::gl_binding::gl::GetError(); \
-  if (err != GL_NO_ERROR) \
-  { \
-    printf("gl error: %s\n", render_util::gl_binding::getGLErrorString(err)); \
-  } \
-  assert(err == GL_NO_ERROR); \
+namespace render_util::gl_binding
+{
+  /**
+   * With the debug callback this only tags the call site, the errors are reported by
+   * processGLDebugMessages() - except in debug builds, where an error since the previous check
+   * is reported right away and GLError is thrown.
+   * Without the callback glGetError() is called - it doesn't wait for the GPU like glFinish(),
+   * but may still have to wait for a driver thread.
+   */
+  inline void checkGLError(const GLCallSite *call_site)
+  {
+  #if ENABLE_GL_DEBUG_CALLBACK
+    setGLCallSite(call_site);
+    #if RENDER_UTIL_ENABLE_DEBUG
+    if (getCurrentInterface()->hasError())
+    {
+      processGLDebugMessages();
+      printf("gl error before %s\n", call_site->location);
+      throw GLError();
+    }
+    #endif
+  #else
+    auto err = gl::GetError();
+    if (err != GL_NO_ERROR)
+    {
+      printf("gl error: %s at %s\n", getGLErrorString(err), call_site->location);
+    }
+    assert(err == GL_NO_ERROR);
+  #endif
+  }
+
+  /**
+   * Clears the sticky error flag before an explicit glGetError() check, so an earlier error doesn't fail it.
+   * With the debug callback the flag is otherwise only cleared by processGLDebugMessages().
+   */
+  inline void clearGLError(const GLCallSite *call_site)
+  {
+    for (int i = 0; i < MAX_GL_ERROR_FLAGS; i++)
+    {
+      auto err = gl::GetError();
+      if (err == GL_NO_ERROR)
+        break;
+      printf("gl error: %s before %s\n", getGLErrorString(err), call_site->location);
+    }
+  }
 }
 
-#if RENDER_UTIL_ENABLE_DEBUG
+#define FORCE_CHECK_GL_ERROR() \
+  render_util::gl_binding::checkGLError(RENDER_UTIL_GL_CALL_SITE())
+
+// with the debug callback a check is only a store, so it's kept in release builds
+#if RENDER_UTIL_ENABLE_DEBUG || ENABLE_GL_DEBUG_CALLBACK
   #define CHECK_GL_ERROR() FORCE_CHECK_GL_ERROR()
 #else
   #define CHECK_GL_ERROR() {}
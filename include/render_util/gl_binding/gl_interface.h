@@ -40,6 +40,7 @@ namespace render_util::gl_binding
     GL_Interface(GetProcAddressFunc *getProcAddress);
 
   #if ENABLE_GL_DEBUG_CALLBACK
+    /// whether the debug callback received an error which wasn't expected - see gl_debug.h
     bool hasError() { return has_error; }
     void clearError() { has_error = false; }
   #else
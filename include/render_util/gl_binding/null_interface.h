@@ -0,0 +1,134 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_GL_BINDING_NULL_INTERFACE_H
+#define RENDER_UTIL_GL_BINDING_NULL_INTERFACE_H
+
+#include <render_util/gl_binding/gl_interface.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace render_util::gl_binding
+{
+  enum NullObjectTypeEnum
+  {
+    NULL_OBJECT_BUFFER,
+    NULL_OBJECT_TEXTURE,
+    NULL_OBJECT_VERTEX_ARRAY,
+    NULL_OBJECT_FRAMEBUFFER,
+    NULL_OBJECT_SHADER,
+    NULL_OBJECT_PROGRAM,
+    NULL_OBJECT_SYNC,
+    NULL_OBJECT_TYPE_NUM
+  };
+
+  const char *getNullObjectTypeName(unsigned int type);
+
+
+  struct NullInterfaceOptions
+  {
+    /// if false glBufferStorage is missing, like on drivers without ARB_buffer_storage
+    bool has_buffer_storage = true;
+    /// if false glCreateTextures, glBindTextureUnit and glBindTextures are missing, like before GL 4.5
+    bool has_direct_state_access = true;
+    /// if false no extensions are reported, so S3TC and RGTC look unsupported
+    bool has_texture_compression = true;
+  };
+
+
+  /// What the null interface has seen since it was created or the statistics were reset.
+  struct NullInterfaceStatistics
+  {
+    struct Objects
+    {
+      unsigned long long num_created = 0;
+      unsigned long long num_deleted = 0;
+      /// not affected by resetting the statistics
+      unsigned long long num_live = 0;
+    };
+
+    /// per procedure name, e.g. "glDrawElements" - procedures which weren't called are left out
+    std::map<std::string, unsigned long long> num_calls;
+    std::array<Objects, NULL_OBJECT_TYPE_NUM> objects {};
+
+    /// data passed to glBufferData, glBufferStorage and glBufferSubData
+    unsigned long long buffer_bytes_uploaded = 0;
+    /**
+     * Size of buffer ranges mapped for writing.
+     * Writes to a persistent mapping can't be seen - the range is counted once when it's mapped.
+     */
+    unsigned long long buffer_bytes_mapped = 0;
+    /**
+     * Data passed to glTexImage*, glTexSubImage* and glCompressedTex*,
+     * from client memory or an unpack buffer.
+     */
+    unsigned long long texture_bytes_uploaded = 0;
+
+    unsigned long long getNumCalls() const;
+    unsigned long long getNumCalls(const std::string &proc_name) const;
+  };
+
+
+  /**
+   * Creates a GL_Interface which needs no context and does no rendering.
+   * Every call is recorded, and object names, uniform locations, buffer storage and fences
+   * behave plausibly enough to run the CPU side of the renderer -
+   * e.g. in benchmarks or to check call counts and upload volume.
+   * All null interfaces share one global state, so they must be used from a single thread.
+   */
+  std::unique_ptr<GL_Interface> createNullInterface(const NullInterfaceOptions &options = {});
+
+  NullInterfaceStatistics getNullInterfaceStatistics();
+  /// also drops the recorded texture transfers
+  void resetNullInterfaceStatistics();
+
+
+  /// a texture upload or read-back seen while texture data is recorded
+  struct NullTextureTransfer
+  {
+    /// e.g. "glTexSubImage3D"
+    std::string proc_name;
+    /// 0 if no texture was bound to the target
+    unsigned int texture = 0;
+    int level = 0;
+    unsigned int format = 0;
+    unsigned int type = 0;
+    std::array<int, 3> offset {};
+    std::array<int, 3> size {};
+    std::vector<char> data;
+  };
+
+  /**
+   * While enabled, the null interface keeps level 0 of the textures uploaded to,
+   * so glGetTextureImage returns what was uploaded, and records the data of every transfer.
+   * Textures allocated without data are filled with a pattern derived from their name,
+   * so a read-back can be told apart from a blank texture.
+   * Pixel formats aren't converted - reading back a different pixel size returns zeros.
+   * Disabling drops the texture contents and the transfers.
+   */
+  void enableNullTextureDataRecording(bool enable);
+
+  /// since recording was enabled or the statistics were reset
+  std::vector<NullTextureTransfer> getNullTextureTransfers();
+}
+
+#endif
@@ -21,17 +21,97 @@
 
 #include <render_util/shader.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace render_util
 {
 
 
-class GLContext
+/// Binding calls issued and left out by a GLContext during one frame.
+struct GLBindingStatistics
 {
-  ShaderProgramPtr m_current_program;
+  struct Counts
+  {
+    unsigned long long num_issued = 0;
+    /// the object was known to be bound already
+    unsigned long long num_elided = 0;
+  };
+
+  Counts programs;
+  Counts vertex_arrays;
+  Counts array_buffers;
+  Counts element_array_buffers;
+  /// glBindBuffer and glBindBufferBase with GL_UNIFORM_BUFFER
+  Counts uniform_buffers;
+  Counts framebuffers;
+
+  unsigned long long getNumIssued() const;
+  unsigned long long getNumElided() const;
+};
 
+
+/**
+ * Keeps a shadow copy of the current program and of the vertex array, buffer and
+ * framebuffer bindings, so binds of objects which are bound already are left out.
+ * The element array buffer is tracked per vertex array, like GL does.
+ * Bindings are unknown until the first bind, so nothing is assumed about the state GL starts with.
+ *
+ * Objects have to be passed to the forget*() functions when they are deleted,
+ * because GL unbinds them and reuses their names.
+ * Code outside render_util which binds any of these directly has to call invalidate() afterwards.
+ */
+class GLContext
+{
 public:
+  static constexpr unsigned int UNKNOWN = ~0u;
+
   ShaderProgramPtr getCurrentProgram() { return m_current_program; }
   void setCurrentProgram(ShaderProgramPtr);
+
+  void bindVertexArray(unsigned int id);
+
+  /// targets other than GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER and GL_UNIFORM_BUFFER are passed through
+  void bindBuffer(unsigned int target, unsigned int id);
+  /// only GL_UNIFORM_BUFFER binding points are tracked
+  void bindBufferBase(unsigned int target, unsigned int index, unsigned int id);
+
+  /// GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER
+  void bindFramebuffer(unsigned int target, unsigned int id);
+
+  /// the bound object or UNKNOWN
+  unsigned int getVertexArrayBinding() const { return m_vertex_array; }
+  unsigned int getBufferBinding(unsigned int target) const;
+  unsigned int getFramebufferBinding(unsigned int target) const;
+
+  void forgetVertexArray(unsigned int id);
+  void forgetBuffer(unsigned int id);
+  void forgetFramebuffer(unsigned int id);
+
+  /// all bindings become unknown
+  void invalidate();
+
+  /// Starts counting the binding calls of the next frame.
+  void nextFrame();
+
+  /// binding calls of the current frame so far
+  const GLBindingStatistics &getStatistics() const { return m_statistics; }
+  const GLBindingStatistics &getLastFrameStatistics() const { return m_last_frame_statistics; }
+
+private:
+  ShaderProgramPtr m_current_program;
+  unsigned int m_program = UNKNOWN;
+  unsigned int m_vertex_array = UNKNOWN;
+  unsigned int m_array_buffer = UNKNOWN;
+  unsigned int m_uniform_buffer = UNKNOWN;
+  unsigned int m_draw_framebuffer = UNKNOWN;
+  unsigned int m_read_framebuffer = UNKNOWN;
+  /// per vertex array - missing entries are unknown
+  std::unordered_map<unsigned int, unsigned int> m_element_array_buffers;
+  std::vector<unsigned int> m_uniform_buffer_bindings;
+
+  GLBindingStatistics m_statistics;
+  GLBindingStatistics m_last_frame_statistics;
 };
 
 
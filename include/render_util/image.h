@@ -23,10 +23,14 @@
 #include <memory>
 #include <vector>
 #include <cstring>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <render_util/image_storage.h>
+
 namespace render_util
 {
 
@@ -167,13 +171,23 @@ public:
 protected:
   int _w = 0;
   int _h = 0;
-  std::vector<unsigned char> _data;
+  std::unique_ptr<ImageStorage> _storage;
+  unsigned char *_data = nullptr; // _storage->getData()
 
   unsigned numPixels() const {
     return _w * _h;
   }
-  unsigned sizeBytes() const {
-    return numPixels() * BYTES_PER_COMPONENT * Base::numComponents();
+  size_t sizeBytes() const {
+    return size_t(numPixels()) * BYTES_PER_COMPONENT * Base::numComponents();
+  }
+
+  void setStorage(std::unique_ptr<ImageStorage> storage)
+  {
+    assert(storage);
+    assert(storage->getSize() == sizeBytes());
+    _storage = std::move(storage);
+    _data = _storage->getData();
+    assert(reinterpret_cast<uintptr_t>(_data) % alignof(ComponentType) == 0);
   }
 
   unsigned getPixelOffset(int x, int y) const {
@@ -183,13 +197,13 @@ protected:
   ComponentType *getPixel(int x, int y)
   {
     auto offset = getPixelOffset(x, y);
-    return reinterpret_cast<ComponentType*>(_data.data() + offset);
+    return reinterpret_cast<ComponentType*>(_data + offset);
   }
 
   const ComponentType *getPixel(int x, int y) const
   {
     auto offset = getPixelOffset(x, y);
-    return reinterpret_cast<const ComponentType*>(_data.data() + offset);
+    return reinterpret_cast<const ComponentType*>(_data + offset);
   }
 
 public:
@@ -198,17 +212,25 @@ public:
   {
     _w = size.x;
     _h = size.y;
-    _data.resize(sizeBytes());
+    setStorage(std::make_unique<VectorImageStorage>(sizeBytes()));
   }
 
   template <typename...Args>
   ImageBase(glm::ivec2 size, std::vector<unsigned char> &&data, Args...args) :
-    Base(args...),
-    _data(std::move(data))
+    Base(args...)
+  {
+    _w = size.x;
+    _h = size.y;
+    setStorage(std::make_unique<VectorImageStorage>(std::move(data)));
+  }
+
+  template <typename...Args>
+  ImageBase(glm::ivec2 size, std::unique_ptr<ImageStorage> &&storage, Args...args) :
+    Base(args...)
   {
     _w = size.x;
     _h = size.y;
-    assert(_data.size() == sizeBytes());
+    setStorage(std::move(storage));
   }
 
   template <typename...Args>
@@ -217,13 +239,38 @@ public:
   {
     _w = size.x;
     _h = size.y;
-    _data.resize(sizeBytes());
+    setStorage(std::make_unique<VectorImageStorage>(sizeBytes()));
+
+    assert(sizeBytes() == data.size() * sizeof(ComponentType));
+    memcpy(reinterpret_cast<void*>(_data),
+           reinterpret_cast<const void*>(data.data()), sizeBytes());
+  }
+
+  // copies always own their pixels
+  ImageBase(const ImageBase &other) : Base(other)
+  {
+    _w = other._w;
+    _h = other._h;
+    setStorage(std::make_unique<VectorImageStorage>(
+      std::vector<unsigned char>(other._data, other._data + other.sizeBytes())));
+  }
 
-    assert(_data.size() == data.size() * sizeof(ComponentType));
-    memcpy(reinterpret_cast<void*>(_data.data()),
-           reinterpret_cast<const void*>(data.data()), _data.size());
+  ImageBase &operator=(const ImageBase &other)
+  {
+    if (this != &other)
+    {
+      Base::operator=(other);
+      _w = other._w;
+      _h = other._h;
+      setStorage(std::make_unique<VectorImageStorage>(
+        std::vector<unsigned char>(other._data, other._data + other.sizeBytes())));
+    }
+    return *this;
   }
 
+  ImageBase(ImageBase&&) = default;
+  ImageBase &operator=(ImageBase&&) = default;
+
   ComponentType &at(int x, int y, size_t component = 0)
   {
     assert(x >= 0);
@@ -290,11 +337,29 @@ public:
   int getHeight() const {
     return h();
   }
-  const unsigned char *getData() const { return _data.data(); }
+  const unsigned char *getData() const { return _data; }
   const unsigned char *data() const { return getData(); }
-  unsigned getDataSize() const { return _data.size(); }
-  unsigned dataSize() const { return _data.size(); }
-  const std::vector<unsigned char> &getDataContainer() const { return _data; }
+  unsigned getDataSize() const { return sizeBytes(); }
+  unsigned dataSize() const { return sizeBytes(); }
+  const ImageStorage &getStorage() const { return *_storage; }
+
+  // rows are stored contiguously, without padding
+  size_t getPixelSize() const { return BYTES_PER_COMPONENT * Base::numComponents(); }
+  size_t getRowSize() const { return getPixelSize() * _w; }
+
+  unsigned char *getRow(int y)
+  {
+    assert(y >= 0);
+    assert(y < _h);
+    return _data + getPixelOffset(0, y);
+  }
+
+  const unsigned char *getRow(int y) const
+  {
+    assert(y >= 0);
+    assert(y < _h);
+    return _data + getPixelOffset(0, y);
+  }
 
   glm::ivec2 size() const { return glm::ivec2(_w, _h); }
   glm::ivec2 getSize() const { return size(); }
@@ -317,6 +382,7 @@ public:
 
   Image(glm::ivec2 size) : Base(size) {}
   Image(glm::ivec2 size, std::vector<unsigned char> &&data) : Base(size, std::move(data)) {}
+  Image(glm::ivec2 size, std::unique_ptr<ImageStorage> &&storage) : Base(size, std::move(storage)) {}
   Image(glm::ivec2 size, const std::vector<T> &data) : Base(size, data) {}
 
   const PixelType &getPixel(const glm::ivec2 pos) const
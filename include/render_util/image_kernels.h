@@ -0,0 +1,88 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_IMAGE_KERNELS_H
+#define RENDER_UTIL_IMAGE_KERNELS_H
+
+#include <cstddef>
+
+/**
+ * Row kernels behind the templates in image_util.h.
+ * Pixels are handled as opaque blocks of pixel_size bytes,
+ * so the kernels work for every image type - common layouts have vectorized versions.
+ */
+
+namespace render_util::image::kernels
+{
+
+
+enum class InstructionSet
+{
+  SCALAR,
+  SSE2,
+  AVX2
+};
+
+
+/// the best instruction set supported by both the build and the CPU
+InstructionSet getBestInstructionSet();
+InstructionSet getInstructionSet();
+/// e.g. to compare the paths in a benchmark - must not exceed getBestInstructionSet()
+void setInstructionSet(InstructionSet);
+const char *getInstructionSetName(InstructionSet);
+
+
+/// sets num_pixels pixels to pixel
+void fillRow(unsigned char *dst, const void *pixel, size_t pixel_size, size_t num_pixels);
+
+/// copies num_pixels pixels in reverse order - src and dst must not overlap
+void reverseRow(const unsigned char *src, unsigned char *dst,
+                size_t pixel_size, size_t num_pixels);
+
+/// copies one component of each pixel to a single component row
+void extractComponent(const unsigned char *src, unsigned char *dst,
+                      size_t component_size, size_t num_components, size_t component,
+                      size_t num_pixels);
+
+void convertRow(const unsigned char *src, float *dst, size_t num_values);
+/// floats are truncated and saturated to [0, 255] - NaN gives 0
+void convertRow(const float *src, unsigned char *dst, size_t num_values);
+
+/**
+ * dst(y, x) = src(x, y) for a w x h source.
+ * Strides are in bytes. The image is processed in tiles to stay in the cache.
+ */
+void transpose(const unsigned char *src, size_t src_stride,
+               unsigned char *dst, size_t dst_stride,
+               size_t pixel_size, int w, int h);
+
+/**
+ * Vertex normals of a height map row, for a grid whose cells are split from (x, y)
+ * to (x + 1, y + 1): the normalized sum of the cross products of the six adjacent triangles,
+ * so larger triangles weigh more. grid_scale is the distance between the vertices.
+ * The normal of row[i] reads row[i - 1], row[i + 1], previous_row[i - 1], previous_row[i],
+ * next_row[i] and next_row[i + 1], so the row must not touch the edges of the map.
+ * dst receives x, y and z of each normal.
+ */
+void calcNormalRow(const float *previous_row, const float *row, const float *next_row,
+                   float *dst, size_t num_pixels, float grid_scale);
+
+
+} // namespace render_util::image::kernels
+
+#endif
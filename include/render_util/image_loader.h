@@ -21,7 +21,9 @@
 
 #include <util.h>
 #include <file.h>
+#include <mapped_file.h>
 #include <render_util/image.h>
+#include <render_util/image_storage.h>
 
 #include <glm/glm.hpp>
 #include <string>
@@ -38,6 +40,30 @@ namespace render_util
   };
 
 
+  enum class ImageFileFormat
+  {
+    UNKNOWN,
+    /// any format the decoder understands - the pixels have to be decoded
+    ENCODED,
+    DDS,
+    KTX2
+  };
+
+
+  struct ImageInfo
+  {
+    ImageFileFormat file_format = ImageFileFormat::UNKNOWN;
+    glm::ivec2 size = glm::ivec2(0);
+    int num_components = 0;
+    /// number of stored mip levels - encoded images have only level 0
+    int num_levels = 1;
+    int num_layers = 1;
+    /// GL internal format of the stored data - 0 if the image has to be decoded first
+    unsigned int internal_format = 0;
+    bool compressed = false;
+  };
+
+
   bool loadImage(util::File &file,
                  std::vector<unsigned char> &data_out,
                  int &width,
@@ -69,49 +95,83 @@ namespace render_util
 
   std::unique_ptr<GenericImage> loadImage(util::File &file, int force_channels);
 
+  /**
+   * Decodes an encoded image.
+   * The decoder's buffer is adopted by the returned storage, so the pixels aren't copied.
+   * force_channels = 0 keeps the number of channels in the file.
+   */
+  std::unique_ptr<ImageStorage> decodeImage(const unsigned char *data,
+                                            size_t data_size,
+                                            int force_channels,
+                                            glm::ivec2 &size,
+                                            int &num_channels);
+
+  /// maps size bytes of raw pixel data at offset - returns null on failure
+  std::unique_ptr<ImageStorage> mapImageFile(const std::string &file_path,
+                                             size_t offset,
+                                             size_t size,
+                                             bool quiet = false);
+
   template <typename T>
-  std::shared_ptr<T> loadImageFromMemory(const std::vector<char> &data)
+  std::shared_ptr<T> loadImageFromMemory(const unsigned char *data, size_t data_size)
   {
     static_assert(sizeof(typename T::ComponentType) == sizeof(unsigned char));
 
-    std::vector<unsigned char> image_data;
-    int width = 0, height = 0;
-    if (loadImageFromMemory(data, T::BYTES_PER_PIXEL, image_data, width, height))
-    {
-      return std::make_shared<T>(glm::ivec2(width, height), std::move(image_data));
-    }
+    glm::ivec2 size(0);
+    int num_channels = 0;
+    auto storage = decodeImage(data, data_size, T::BYTES_PER_PIXEL, size, num_channels);
+    if (storage)
+      return std::make_shared<T>(size, std::move(storage));
     else
-    {
       return {};
-    }
   }
 
-  inline std::shared_ptr<GenericImage> loadGenericImageFromMemory(const std::vector<char> &data)
+  template <>
+  inline std::shared_ptr<GenericImage> loadImageFromMemory<GenericImage>(const unsigned char *data,
+                                                                        size_t data_size)
   {
-    std::vector<unsigned char> image_data;
-    int width = 0, height = 0, num_channels = 0;
-    if (loadImageFromMemory(data, image_data, width, height, num_channels))
-    {
-      return std::make_shared<GenericImage>(glm::ivec2(width, height), std::move(image_data), num_channels);
-    }
+    glm::ivec2 size(0);
+    int num_channels = 0;
+    auto storage = decodeImage(data, data_size, 0, size, num_channels);
+    if (storage)
+      return std::make_shared<GenericImage>(size, std::move(storage), num_channels);
     else
-    {
       return {};
-    }
   }
 
-  template <>
-  inline std::shared_ptr<GenericImage> loadImageFromMemory<GenericImage>(const std::vector<char> &data)
+  template <typename T>
+  std::shared_ptr<T> loadImageFromMemory(const std::vector<char> &data)
   {
-    return loadGenericImageFromMemory(data);
+    return loadImageFromMemory<T>(reinterpret_cast<const unsigned char*>(data.data()),
+                                  data.size());
   }
 
+  inline std::shared_ptr<GenericImage> loadGenericImageFromMemory(const std::vector<char> &data)
+  {
+    return loadImageFromMemory<GenericImage>(data);
+  }
+
+  /// the file is decoded straight from a mapping instead of being read into memory first
   template <typename T>
   std::shared_ptr<T> loadImageFromFile(const std::string &file_path)
   {
-    std::vector<char> data;
-    if (util::readFile(file_path, data))
-      return loadImageFromMemory<T>(data);
+    auto file = util::MappedFile::open(file_path);
+    if (file)
+      return loadImageFromMemory<T>(file->getData(), file->getSize());
+    else
+      return {};
+  }
+
+  /// raw pixel data without a header - the image uses the mapped file as storage
+  template <typename T>
+  std::shared_ptr<T> loadRawImageFromFile(const std::string &file_path,
+                                          glm::ivec2 size,
+                                          bool quiet = false)
+  {
+    auto storage = mapImageFile(file_path, 0, size_t(size.x) * size.y * T::BYTES_PER_PIXEL,
+                                quiet);
+    if (storage)
+      return std::make_shared<T>(size, std::move(storage));
     else
       return {};
   }
@@ -130,6 +190,9 @@ namespace render_util
 
   void getImageInfo(util::File&, glm::ivec2 &size, int &num_components);
 
+  /// also recognizes texture containers (DDS, KTX2) - returns false if the format is unknown
+  bool getImageInfo(util::File&, ImageInfo&);
+
 
 }
 
@@ -21,11 +21,194 @@
 
 #include <render_util/image.h>
 #include <render_util/image_util.h>
+#include <thread_pool.h>
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
 
 namespace render_util
 {
 
 
+enum class ResampleFilter
+{
+  BOX, ///< nearest neighbour when magnifying, area average when minifying
+  BILINEAR,
+  LANCZOS3
+};
+
+
+enum class ResampleEdgeMode
+{
+  CLAMP,
+  WRAP
+};
+
+
+/**
+ * The taps of a one-dimensional resampling pass.
+ * Every destination pixel has num_taps taps, padded with zero weights.
+ */
+struct ResampleWeights
+{
+  int src_size = 0;
+  int dst_size = 0;
+  int num_taps = 0;
+  std::vector<int> indices;
+  std::vector<float> weights;
+};
+
+
+ResampleWeights createResampleWeights(int src_size, int dst_size,
+                                      ResampleFilter filter, ResampleEdgeMode edge_mode);
+
+/// resamples a row of src_size pixels to dst_size pixels
+void resampleRow(const float *src, float *dst, int num_components,
+                 const ResampleWeights &weights);
+
+/// dst += weight * src
+void accumulateRow(const float *src, float weight, float *dst, size_t num_values);
+
+
+/**
+ * Separable resampling to an arbitrary size, rows are processed in parallel.
+ * Rows are filtered vertically before horizontally when minifying vertically,
+ * so no intermediate image is needed in that case -
+ * otherwise the horizontal pass goes to an intermediate float image of src->h() rows.
+ */
+template <typename T>
+std::shared_ptr<typename image::TypeFromPtr<T>::Type>
+resample(T src,
+         glm::ivec2 new_size,
+         ResampleFilter filter,
+         ResampleEdgeMode edge_mode = ResampleEdgeMode::CLAMP,
+         util::ThreadPool &thread_pool = util::ThreadPool::getDefault())
+{
+  using ImageType = typename image::TypeFromPtr<T>::Type;
+  using ComponentType = typename ImageType::ComponentType;
+
+  // rows per parallelFor item - each item allocates its own row buffers
+  constexpr int ROWS_PER_CHUNK = 16;
+
+  assert(new_size.x > 0);
+  assert(new_size.y > 0);
+
+  auto dst = std::make_shared<ImageType>(new_size);
+  if (!src->w() || !src->h())
+    return dst;
+
+  const int num_components = src->numComponents();
+  const size_t src_row_values = size_t(src->w()) * num_components;
+  const size_t dst_row_values = size_t(dst->w()) * num_components;
+
+  auto weights_x = createResampleWeights(src->w(), dst->w(), filter, edge_mode);
+  auto weights_y = createResampleWeights(src->h(), dst->h(), filter, edge_mode);
+
+  auto load_row = [&] (int y, float *row)
+  {
+    image::convertRow(reinterpret_cast<const ComponentType*>(src->getRow(y)),
+                      row, src_row_values);
+  };
+
+  auto store_row = [&] (float *row, int y)
+  {
+    if constexpr (std::is_unsigned_v<ComponentType>)
+    {
+      // rounded by the truncating conversion
+      constexpr float max = std::numeric_limits<ComponentType>::max();
+      for (size_t i = 0; i < dst_row_values; i++)
+        row[i] = std::clamp(row[i] + 0.5f, 0.f, max);
+    }
+    else if constexpr (std::is_integral_v<ComponentType>)
+    {
+      constexpr float min = std::numeric_limits<ComponentType>::lowest();
+      constexpr float max = std::numeric_limits<ComponentType>::max();
+      for (size_t i = 0; i < dst_row_values; i++)
+        row[i] = std::clamp(std::round(row[i]), min, max);
+    }
+    image::convertRow(row, reinterpret_cast<ComponentType*>(dst->getRow(y)), dst_row_values);
+  };
+
+  auto for_each_chunk = [&] (int num_rows, auto process_rows)
+  {
+    int num_chunks = (num_rows + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+    thread_pool.parallelFor(num_chunks, [&] (int chunk)
+    {
+      int begin = chunk * ROWS_PER_CHUNK;
+      process_rows(begin, std::min(begin + ROWS_PER_CHUNK, num_rows));
+    });
+  };
+
+  if (dst->h() <= src->h())
+  {
+    for_each_chunk(dst->h(), [&] (int begin, int end)
+    {
+      std::vector<float> src_row(src_row_values);
+      std::vector<float> column_sum(src_row_values);
+      std::vector<float> dst_row(dst_row_values);
+
+      for (int y = begin; y < end; y++)
+      {
+        std::fill(column_sum.begin(), column_sum.end(), 0.f);
+
+        for (int tap = 0; tap < weights_y.num_taps; tap++)
+        {
+          auto weight = weights_y.weights[y * weights_y.num_taps + tap];
+          if (weight == 0.f)
+            continue;
+          load_row(weights_y.indices[y * weights_y.num_taps + tap], src_row.data());
+          accumulateRow(src_row.data(), weight, column_sum.data(), src_row_values);
+        }
+
+        resampleRow(column_sum.data(), dst_row.data(), num_components, weights_x);
+        store_row(dst_row.data(), y);
+      }
+    });
+  }
+  else
+  {
+    std::vector<float> resampled_rows(src->h() * dst_row_values);
+
+    for_each_chunk(src->h(), [&] (int begin, int end)
+    {
+      std::vector<float> src_row(src_row_values);
+      for (int y = begin; y < end; y++)
+      {
+        load_row(y, src_row.data());
+        resampleRow(src_row.data(), resampled_rows.data() + y * dst_row_values,
+                    num_components, weights_x);
+      }
+    });
+
+    for_each_chunk(dst->h(), [&] (int begin, int end)
+    {
+      std::vector<float> dst_row(dst_row_values);
+      for (int y = begin; y < end; y++)
+      {
+        std::fill(dst_row.begin(), dst_row.end(), 0.f);
+
+        for (int tap = 0; tap < weights_y.num_taps; tap++)
+        {
+          auto weight = weights_y.weights[y * weights_y.num_taps + tap];
+          if (weight == 0.f)
+            continue;
+          auto row = weights_y.indices[y * weights_y.num_taps + tap];
+          accumulateRow(resampled_rows.data() + row * dst_row_values, weight,
+                        dst_row.data(), dst_row_values);
+        }
+
+        store_row(dst_row.data(), y);
+      }
+    });
+  }
+
+  return dst;
+}
+
+
 template <typename T>
 class Sampler
 {
@@ -187,51 +370,10 @@ template <typename T>
 std::shared_ptr<T>
 downSample(std::shared_ptr<const T> src, int factor)
 {
-  using namespace glm;
-  using namespace std;
-  
-  assert(factor % 2 == 0);
-  if (src->size() % 2 != ivec2(0))
-  {
-    cout<<src->size().x<<","<<src->size().y<<endl;
-    cout<<src->size().x % 2<<","<<src->size().y % 2<<endl;
-  }
-  assert(src->size() % 2 == ivec2(0));
-
-  auto dst = std::make_shared<T>(src->size() / factor);
+  assert(factor > 0);
+  assert(src->size() % factor == glm::ivec2(0));
 
-  const int sampling_area_size = factor;
-  const int num_snamples = sampling_area_size * sampling_area_size;
-
-  for (int y = 0; y < dst->h(); y++)
-  {
-    for (int x = 0; x < dst->w(); x++)
-    {
-      for (int i = 0; i < T::NUM_COMPONENTS; i++)
-      {
-        float sum = 0;
-
-        for (int y_sample = 0; y_sample < sampling_area_size; y_sample++)
-        {
-          int y_src = y * factor + y_sample;
-          
-          for (int x_sample = 0; x_sample < sampling_area_size; x_sample++)
-          {
-            int x_src = x * factor + x_sample;
-
-            float src_color = src->get(x_src, y_src, i);
-
-            sum += src_color / num_snamples;
-          }
-
-        }
-
-        dst->at(x, y, i) = sum;
-      }
-    }
-  }
-
-  return dst;
+  return resample(src, src->size() / factor, ResampleFilter::BOX);
 }
 
 template <typename T>
@@ -246,29 +388,9 @@ template <typename T>
 std::shared_ptr<typename image::TypeFromPtr<T>::Type>
 upSample(T src, int factor)
 {
-  using ImageType = typename image::TypeFromPtr<T>::Type;
-  using namespace glm;
-
-  assert(factor % 2 == 0);
-  assert(src->size() % 2 == ivec2(0));
-
-  auto dst = std::make_shared<ImageType>(src->size() * factor);
+  assert(factor > 0);
 
-  Surface<ImageType> surface(src);
-  surface.setSize(dst->size());
-
-  for (int y = 0; y < dst->h(); y++)
-  {
-    for (int x = 0; x < dst->w(); x++)
-    {
-      for (int i = 0; i < ImageType::NUM_COMPONENTS; i++)
-      {
-        dst->at(x,y,i) = surface.get(ivec2(x,y), i);
-      }
-    }
-  }
-
-  return dst;
+  return resample(src, src->size() * factor, ResampleFilter::BILINEAR, ResampleEdgeMode::WRAP);
 }
 
 
@@ -291,9 +413,15 @@ resampleImages(const std::vector<T> &images, int new_width)
   for (auto image : images)
   {
     if (image->w() < new_width)
-      image = upSample(image, new_width / image->w());
+    {
+      image = resample(image, glm::ivec2(new_width),
+                       ResampleFilter::BILINEAR, ResampleEdgeMode::WRAP);
+    }
     else if (image->w() > new_width)
-      image = downSample(image, image->w() / new_width);
+    {
+      image = resample(image, glm::ivec2(new_width),
+                       ResampleFilter::BOX, ResampleEdgeMode::WRAP);
+    }
     assert(image->size() == glm::ivec2(new_width));
 
     resampled.push_back(image);
@@ -0,0 +1,112 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_IMAGE_STORAGE_H
+#define RENDER_UTIL_IMAGE_STORAGE_H
+
+#include <mapped_file.h>
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <cassert>
+
+namespace render_util
+{
+
+
+/// the pixel memory of an image
+class ImageStorage
+{
+public:
+  virtual ~ImageStorage() {}
+  virtual unsigned char *getData() = 0;
+  virtual size_t getSize() const = 0;
+};
+
+
+class VectorImageStorage : public ImageStorage
+{
+  std::vector<unsigned char> m_data;
+
+public:
+  VectorImageStorage(size_t size) : m_data(size) {}
+  VectorImageStorage(std::vector<unsigned char> &&data) : m_data(std::move(data)) {}
+
+  unsigned char *getData() override { return m_data.data(); }
+  size_t getSize() const override { return m_data.size(); }
+};
+
+
+/// a buffer allocated elsewhere, e.g. by a decoder, which is released by the deleter
+class AdoptedImageStorage : public ImageStorage
+{
+public:
+  using Deleter = std::function<void(unsigned char*)>;
+
+private:
+  unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+  Deleter m_deleter;
+
+public:
+  AdoptedImageStorage(unsigned char *data, size_t size, Deleter deleter) :
+    m_data(data), m_size(size), m_deleter(std::move(deleter))
+  {
+  }
+
+  ~AdoptedImageStorage() override
+  {
+    if (m_deleter)
+      m_deleter(m_data);
+  }
+
+  AdoptedImageStorage(const AdoptedImageStorage&) = delete;
+  AdoptedImageStorage &operator=(const AdoptedImageStorage&) = delete;
+
+  unsigned char *getData() override { return m_data; }
+  size_t getSize() const override { return m_size; }
+};
+
+
+/**
+ * A range of a mapped file - several images may share the mapping.
+ * Pixels are only copied when they are modified.
+ */
+class MappedImageStorage : public ImageStorage
+{
+  std::shared_ptr<util::MappedFile> m_file;
+  size_t m_offset = 0;
+  size_t m_size = 0;
+
+public:
+  MappedImageStorage(std::shared_ptr<util::MappedFile> file, size_t offset, size_t size) :
+    m_file(std::move(file)), m_offset(offset), m_size(size)
+  {
+    assert(m_offset + m_size <= m_file->getSize());
+  }
+
+  unsigned char *getData() override { return m_file->getData() + m_offset; }
+  size_t getSize() const override { return m_size; }
+};
+
+
+}
+
+#endif
@@ -20,6 +20,11 @@
 #define RENDER_UTIL_IMAGE_UTIL_H
 
 #include <render_util/image.h>
+#include <render_util/image_kernels.h>
+
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
 
 namespace render_util::image
 {
@@ -48,8 +53,8 @@ template <typename T>
 typename TypeFromPtr<T>::Type::Ptr
 clone(T image)
 {
-  return std::make_shared<typename TypeFromPtr<T>::Type>(image->getSize(),
-                                                         image->getDataContainer());
+  std::vector<unsigned char> data(image->data(), image->data() + image->dataSize());
+  return std::make_shared<typename TypeFromPtr<T>::Type>(image->getSize(), std::move(data));
 }
 
 
@@ -59,15 +64,15 @@ getChannel(T image, int channel)
 {
   assert(channel < image->numComponents());
 
-  auto channel_image =
-    std::make_shared<Image<typename TypeFromPtr<T>::Type::ComponentType>>(image->getSize());
+  using ComponentType = typename TypeFromPtr<T>::Type::ComponentType;
+
+  auto channel_image = std::make_shared<Image<ComponentType>>(image->getSize());
 
   for (int y = 0; y < channel_image->h(); y++)
   {
-    for (int x = 0; x < channel_image->w(); x++)
-    {
-      channel_image->at(x,y) = image->get(x, y, channel);
-    }
+    kernels::extractComponent(image->getRow(y), channel_image->getRow(y),
+                              sizeof(ComponentType), image->numComponents(), channel,
+                              image->w());
   }
 
   return channel_image;
@@ -108,13 +113,13 @@ template <typename T>
 void
 fill(T image, typename TypeFromPtr<T>::Type::PixelType color)
 {
-  for (int y = 0; y < image->h(); y++)
-  {
-    for (int x = 0; x < image->w(); x++)
-    {
-      image->setPixel(x, y, color);
-    }
-  }
+  if (!image->h())
+    return;
+
+  kernels::fillRow(image->getRow(0), &color, image->getPixelSize(), image->w());
+
+  for (int y = 1; y < image->h(); y++)
+    memcpy(image->getRow(y), image->getRow(0), image->getRowSize());
 }
 
 
@@ -123,15 +128,7 @@ void
 clear(T image)
 {
   for (int y = 0; y < image->h(); y++)
-  {
-    for (int x = 0; x < image->w(); x++)
-    {
-      for (int c = 0; c < image->numComponents(); c++)
-      {
-        image->at(x, y, c) = 0;
-      }
-    }
-  }
+    memset(image->getRow(y), 0, image->getRowSize());
 }
 
 
@@ -140,13 +137,7 @@ std::shared_ptr<Image<T,N>>
 create(Pixel<T,N> color, glm::ivec2 size)
 {
   auto image = std::make_shared<Image<T,N>>(size);
-  for (int y = 0; y < image->h(); y++)
-  {
-    for (int x = 0; x < image->w(); x++)
-    {
-      image->setPixel(x, y, color);
-    }
-  }
+  fill(image, color);
   return image;
 }
 
@@ -155,34 +146,45 @@ std::shared_ptr<Image<T,1>>
 create(const T &color, glm::ivec2 size)
 {
   auto image = std::make_shared<Image<T,1>>(size);
-  for (int y = 0; y < image->h(); y++)
+  fill(image, color);
+  return image;
+}
+
+
+template <typename T_dst, typename T_src>
+void convertRow(const T_src *src, T_dst *dst, size_t num_values)
+{
+  if constexpr (std::is_same_v<T_src, T_dst>)
   {
-    for (int x = 0; x < image->w(); x++)
-    {
-      image->at(x,y) = color;
-    }
+    memcpy(dst, src, num_values * sizeof(T_src));
+  }
+  else if constexpr ((std::is_same_v<T_src, unsigned char> && std::is_same_v<T_dst, float>) ||
+                     (std::is_same_v<T_src, float> && std::is_same_v<T_dst, unsigned char>))
+  {
+    kernels::convertRow(src, dst, num_values);
+  }
+  else
+  {
+    for (size_t i = 0; i < num_values; i++)
+      dst[i] = src[i];
   }
-  return image;
 }
 
 
 template<class T_pixel_dst, class T_ptr_src>
-std::shared_ptr<Image<T_pixel_dst>>
+std::shared_ptr<Image<T_pixel_dst, TypeFromPtr<T_ptr_src>::Type::NUM_COMPONENTS>>
 convert(T_ptr_src src)
 {
   using T_src = typename TypeFromPtr<T_ptr_src>::Type;
+  using T_pixel_src = typename T_src::ComponentType;
 
   auto dst = std::make_shared<Image<T_pixel_dst, T_src::NUM_COMPONENTS>>(src->size());
 
   for (int y = 0; y < src->h(); y++)
   {
-    for (int x = 0; x < src->w(); x++)
-    {
-      for (int i = 0; i < T_src::NUM_COMPONENTS; i++)
-      {
-        dst->at(x,y,i) = src->get(x,y,i);
-      }
-    }
+    convertRow(reinterpret_cast<const T_pixel_src*>(src->getRow(y)),
+               reinterpret_cast<T_pixel_dst*>(dst->getRow(y)),
+               src->w() * T_src::NUM_COMPONENTS);
   }
 
   return dst;
@@ -196,13 +198,7 @@ flipX(typename T::ConstPtr src)
   typename T::Ptr dst(new T(src->size()));
 
   for (int y = 0; y < src->h(); y++)
-  {
-    for (int x = 0; x < src->w(); x++)
-    {
-      int new_x = (src->w() - 1) - x;
-      dst->setPixel(new_x, y, src->getPixel(x, y));
-    }
-  }
+    kernels::reverseRow(src->getRow(y), dst->getRow(y), src->getPixelSize(), src->w());
 
   return dst;
 }
@@ -217,13 +213,7 @@ flipY(T src)
   auto dst = std::make_shared<ImageType>(src->size());
 
   for (int y = 0; y < src->h(); y++)
-  {
-    for (int x = 0; x < src->w(); x++)
-    {
-      int new_y = (src->h() - 1) - y;
-      dst->setPixel(x, new_y, src->getPixel(x, y));
-    }
-  }
+    memcpy(dst->getRow((src->h() - 1) - y), src->getRow(y), src->getRowSize());
 
   return dst;
 }
@@ -237,15 +227,8 @@ void flipYInPlace(T &image)
 
   while (start < end)
   {
-    for (int x = 0; x < image->w(); x++)
-    {
-      for (int c = 0; c < image->getNumComponents(); c++)
-      {
-        auto tmp = image->at(x, start, c);
-        image->at(x, start, c) = image->get(x, end, c);
-        image->at(x, end, c) = tmp;
-      }
-    }
+    auto start_row = image->getRow(start);
+    std::swap_ranges(start_row, start_row + image->getRowSize(), image->getRow(end));
 
     start++;
     end--;
@@ -257,16 +240,13 @@ template <typename T>
 typename T::Ptr
 swapXY(typename T::ConstPtr src)
 {
-  assert(src->w() == src->h());
-
-  typename T::Ptr dst(new T(src->size()));
+  typename T::Ptr dst(new T(glm::ivec2(src->h(), src->w())));
 
-  for (int y = 0; y < src->h(); y++)
+  if (src->w() && src->h())
   {
-    for (int x = 0; x < src->w(); x++)
-    {
-      dst->setPixel(y, x, src->getPixel(x, y));
-    }
+    kernels::transpose(src->getRow(0), src->getRowSize(),
+                       dst->getRow(0), dst->getRowSize(),
+                       src->getPixelSize(), src->w(), src->h());
   }
 
   return dst;
@@ -287,10 +267,9 @@ subImage(const T *src, int x_src, int y_src, int w, int h)
 
   for (int y = 0; y < h; y++)
   {
-    for (int x = 0; x < w; x++)
-    {
-      dst->setPixel(x, y, src->getPixel(x_src + x, y_src + y));
-    }
+    memcpy(dst->getRow(y),
+           src->getRow(y_src + y) + x_src * src->getPixelSize(),
+           dst->getRowSize());
   }
 
   return dst;
@@ -315,12 +294,9 @@ blit(const T *src, T *dst, glm::ivec2 pos)
 
   for (int y = 0; y < src->h(); y++)
   {
-    for (int x = 0; x < src->w(); x++)
-    {
-      int dst_x = pos.x + x;
-      int dst_y = pos.y + y;
-      dst->setPixel(dst_x, dst_y, src->getPixel(x, y));
-    }
+    memcpy(dst->getRow(pos.y + y) + pos.x * dst->getPixelSize(),
+           src->getRow(y),
+           src->getRowSize());
   }
 }
 
@@ -0,0 +1,237 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_PROFILER_H
+#define RENDER_UTIL_PROFILER_H
+
+#include <thread_pool.h>
+
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+
+namespace render_util
+{
+
+
+/**
+ * Collects the durations of nested CPU scopes and of GPU scopes, which are measured
+ * with GL timestamp queries.
+ * The last durations of each scope are kept for percentiles, the scopes of the last frames
+ * for a trace in the Chrome trace event format (chrome://tracing, Perfetto).
+ *
+ * CPU scopes may be used on any thread, GPU scopes only on the thread the GL context is
+ * current on. Without timer queries - e.g. with the null GL interface - GPU scopes are
+ * timed on the CPU only.
+ * The profiler is disabled by default. A disabled profiler only costs a flag test per scope.
+ */
+class Profiler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// durations kept per scope
+  static constexpr size_t NUM_SAMPLES = 300;
+  /// frames kept for the trace
+  static constexpr size_t NUM_TRACE_FRAMES = 300;
+
+  struct ScopeStatistics
+  {
+    std::string name;
+    bool is_gpu = false;
+    /// at most NUM_SAMPLES
+    size_t num_samples = 0;
+    double mean_ms = 0;
+    double median_ms = 0;
+    double p95_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+  };
+
+  /// used by ProfilerScope
+  struct GPUScope
+  {
+    unsigned int begin_query = 0;
+    unsigned int end_query = 0;
+  };
+
+private:
+  struct Samples
+  {
+    std::vector<float> durations_ms;
+    size_t next = 0;
+
+    void add(float duration_ms);
+  };
+
+  struct TraceEvent
+  {
+    const char *name = nullptr;
+    /// 0 is the GPU
+    int thread = 0;
+    /// since m_epoch
+    int64_t begin_ns = 0;
+    int64_t duration_ns = 0;
+    uint64_t frame = 0;
+  };
+
+  struct PendingGPUScope
+  {
+    const char *name = nullptr;
+    GPUScope scope;
+    uint64_t frame = 0;
+  };
+
+  enum class TimerState
+  {
+    UNKNOWN,
+    AVAILABLE,
+    UNAVAILABLE,
+  };
+
+  std::atomic<bool> m_enabled { false };
+
+  mutable util::Mutex m_mutex;
+  Clock::time_point m_epoch = Clock::now();
+  Clock::time_point m_frame_begin = Clock::now();
+  uint64_t m_frame = 0;
+  /// key: name, is_gpu
+  std::map<std::pair<std::string, bool>, Samples> m_samples;
+  std::deque<TraceEvent> m_trace;
+  std::unordered_map<util::ThreadID, int> m_threads;
+
+  // only used on the GL thread
+  TimerState m_timer_state = TimerState::UNKNOWN;
+  std::vector<unsigned int> m_free_queries;
+  std::deque<PendingGPUScope> m_pending_gpu_scopes;
+  /// GPU timestamp + offset = time since m_epoch
+  int64_t m_gpu_clock_offset_ns = 0;
+
+  int getThread();
+  int64_t getNanoseconds(Clock::time_point) const;
+  void addSample(const char *name, bool is_gpu, int64_t begin_ns, int64_t duration_ns,
+                 int thread, uint64_t frame);
+  bool checkTimerQueries();
+  unsigned int allocQuery();
+  void syncGPUClock();
+  void collectGPUScopes();
+
+public:
+  static Profiler &get();
+
+  Profiler() = default;
+
+  Profiler(const Profiler&) = delete;
+  Profiler &operator=(const Profiler&) = delete;
+
+  void setEnabled(bool enabled) { m_enabled = enabled; }
+  bool isEnabled() const { return m_enabled; }
+
+  /// whether GPU scopes are measured on the GPU - only known after the first GPU scope
+  bool hasGPUTimers() const { return m_timer_state == TimerState::AVAILABLE; }
+
+  /**
+   * Ends the current frame and begins the next one.
+   * Call once per frame on the GL thread, e.g. after swapping buffers.
+   * Collects the GPU durations which have become available - they lag a few frames behind.
+   */
+  void nextFrame();
+
+  /**
+   * Discards everything collected and deletes the queries.
+   * Call while the context is still current, before it is destroyed.
+   */
+  void reset();
+
+  /// sorted by name, CPU before GPU
+  std::vector<ScopeStatistics> getStatistics() const;
+
+  void writeChromeTrace(std::ostream&) const;
+  bool saveChromeTrace(const std::string &path) const;
+
+  // used by ProfilerScope
+  void addCPUScope(const char *name, Clock::time_point begin, Clock::time_point end);
+  GPUScope beginGPUScope();
+  void endGPUScope(const char *name, GPUScope&);
+};
+
+
+/**
+ * Measures the time until it is destroyed.
+ * With is_gpu the time spent on the GPU is measured as well.
+ * name must stay valid - it is meant to be a string literal.
+ */
+class ProfilerScope
+{
+  const char *m_name = nullptr;
+  bool m_is_gpu = false;
+  Profiler::Clock::time_point m_begin;
+  Profiler::GPUScope m_gpu_scope;
+
+public:
+  explicit ProfilerScope(const char *name, bool is_gpu = false)
+  {
+    auto &profiler = Profiler::get();
+    if (!profiler.isEnabled())
+      return;
+
+    m_name = name;
+    m_is_gpu = is_gpu;
+    m_begin = Profiler::Clock::now();
+
+    if (is_gpu)
+      m_gpu_scope = profiler.beginGPUScope();
+  }
+
+  ~ProfilerScope()
+  {
+    if (!m_name)
+      return;
+
+    auto &profiler = Profiler::get();
+
+    profiler.addCPUScope(m_name, m_begin, Profiler::Clock::now());
+
+    if (m_is_gpu)
+      profiler.endGPUScope(m_name, m_gpu_scope);
+  }
+
+  ProfilerScope(const ProfilerScope&) = delete;
+  ProfilerScope &operator=(const ProfilerScope&) = delete;
+};
+
+
+} // namespace render_util
+
+
+#define RENDER_UTIL_PROFILER_CONCAT_(a, b) a##b
+#define RENDER_UTIL_PROFILER_CONCAT(a, b) RENDER_UTIL_PROFILER_CONCAT_(a, b)
+
+#define RENDER_UTIL_PROFILE_SCOPE(name) \
+  ::render_util::ProfilerScope RENDER_UTIL_PROFILER_CONCAT(profiler_scope_, __LINE__)(name)
+
+#define RENDER_UTIL_PROFILE_GPU_SCOPE(name) \
+  ::render_util::ProfilerScope RENDER_UTIL_PROFILER_CONCAT(profiler_scope_, __LINE__)(name, true)
+
+#endif
@@ -51,6 +51,9 @@ namespace render_util
     const std::string &get(const std::string &name) const;
     void set(const std::string &name, const std::string &value);
 
+    /// all parameters sorted by name - e.g. for cache keys
+    std::string toString() const;
+
     template <typename T>
     void set(const std::string &name, const T &value)
     {
@@ -80,8 +83,47 @@ namespace render_util
                         const std::vector<std::string> &paths);
     void compile();
     unsigned int getID() { return m_id; }
+    unsigned int getType() { return m_type; }
     const std::string &getName() { return m_name; }
     const std::string &getFileName() { return m_filename; }
+    const std::string &getPreprocessedSource() { return m_preprocessed_source; }
+  };
+
+
+  /**
+   * Hits and misses of the preprocessed source cache, which lives as long as the process,
+   * and of the program binary cache in the cache directory.
+   */
+  struct ShaderCacheStatistics
+  {
+    unsigned long long num_source_hits = 0;
+    unsigned long long num_source_misses = 0;
+    unsigned long long num_binary_hits = 0;
+    unsigned long long num_binary_misses = 0;
+    /// binaries which were found but rejected by the driver
+    unsigned long long num_binary_rejected = 0;
+  };
+
+  ShaderCacheStatistics getShaderCacheStatistics();
+
+
+  /**
+   * A uniform location resolved once, so setting the uniform involves no name lookup.
+   * Only valid for the program it was obtained from.
+   */
+  template <typename T>
+  class UniformHandle
+  {
+    int m_location = -1;
+
+  public:
+    using ValueType = T;
+
+    UniformHandle() {}
+    explicit UniformHandle(int location) : m_location(location) {}
+
+    int getLocation() const { return m_location; }
+    bool isValid() const { return m_location != -1; }
   };
 
 
@@ -145,6 +187,33 @@ namespace render_util
     }
 
 
+    template <typename T>
+    UniformHandle<T> getUniformHandle(const std::string &name)
+    {
+      int location = getUniformLocation(name);
+      if (location == -1 && error_fail)
+      {
+        printf("uniform not found: %s - program: %s\n", name.c_str(), this->name.c_str());
+        exit(1);
+      }
+      return UniformHandle<T>(location);
+    }
+
+    template <typename T>
+    void setUniform(const UniformHandle<T> &handle,
+                    const typename UniformHandle<T>::ValueType &value)
+    {
+      if (handle.isValid())
+        setUniform(handle.getLocation(), value);
+    }
+
+    /**
+     * Assigns the uniform block block_name to binding_point.
+     * Returns false if the program has no such block.
+     * Blocks listed in uniform_buffer.h are bound when the program is created.
+     */
+    bool bindUniformBlock(const std::string &block_name, unsigned int binding_point);
+
     bool error_fail = false;
 
     bool isValid() { return is_valid; }
@@ -171,7 +240,10 @@ namespace render_util
 
     void link();
     void create();
+    void compileAndLink(bool save_binary, const std::string &binary_key);
+    std::string getBinaryCacheKey();
     void assertIsValid();
+    void markUniformAsSet(int location);
     void setUniformi(int location, int);
     void setUniform(int location, const int&);
     void setUniform(int location, const bool&);
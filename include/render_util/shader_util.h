@@ -31,6 +31,14 @@ namespace render_util
     const ShaderSearchPath &search_path,
     const std::map<unsigned int, std::string> &attribute_locations = {},
     const ShaderParameters &params = {});
+
+  /**
+   * The preprocessed sources of all shaders of the program, in the order they are attached.
+   * Creates no GL objects - meant for the keys of caches of data the program computes.
+   */
+  std::string getShaderProgramSource(const std::string &definition,
+                                     const ShaderSearchPath &search_path,
+                                     const ShaderParameters &params = {});
 }
 
 #endif
@@ -0,0 +1,78 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_STREAM_BUFFER_H
+#define RENDER_UTIL_STREAM_BUFFER_H
+
+#include <cstddef>
+
+namespace render_util
+{
+
+
+/**
+ * Buffer for data which is rewritten every frame.
+ * The buffer is divided into NUM_REGIONS regions of equal size which are used in turn,
+ * so the region written in one frame is not in use by the GPU.
+ * If ARB_buffer_storage is available the buffer is persistently mapped,
+ * otherwise the current region is mapped unsynchronized for each frame.
+ * Reuse of a region is guarded by a fence which is inserted when the next frame starts.
+ */
+class StreamBuffer
+{
+public:
+  static constexpr int NUM_REGIONS = 3;
+
+  StreamBuffer(unsigned int target, size_t region_size);
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer &operator=(const StreamBuffer&) = delete;
+
+  /**
+   * Starts a new frame and returns a pointer to size bytes of writable memory.
+   * Everything issued before this call may still use the previous frame's data.
+   * The offset of the memory from the start of the buffer is returned in offset.
+   */
+  void *map(size_t size, size_t &offset);
+  void unmap();
+
+  unsigned int getID() const { return m_id; }
+  unsigned int getTarget() const { return m_target; }
+  size_t getRegionSize() const { return m_region_size; }
+  bool isPersistent() const { return m_persistent_mapping != nullptr; }
+
+  size_t getBytesUploadedLastFrame() const { return m_bytes_uploaded_last_frame; }
+  size_t getBytesUploadedTotal() const { return m_bytes_uploaded_total; }
+
+private:
+  unsigned int m_target = 0;
+  unsigned int m_id = 0;
+  size_t m_region_size = 0;
+  int m_current_region = -1;
+  void *m_fences[NUM_REGIONS] {};
+  unsigned char *m_persistent_mapping = nullptr;
+  bool m_is_mapped = false;
+  size_t m_bytes_uploaded_last_frame = 0;
+  size_t m_bytes_uploaded_total = 0;
+};
+
+
+} // namespace render_util
+
+#endif
@@ -22,6 +22,7 @@
 #include <render_util/shader.h>
 #include <render_util/camera.h>
 #include <render_util/elevation_map.h>
+#include <render_util/tiled_height_map.h>
 #include <render_util/texture_manager.h>
 #include <factory.h>
 
@@ -64,6 +65,27 @@ namespace render_util
       std::vector<ImageRGB::Ptr> &textures_nm;
       const std::vector<float> &texture_scale;
       const ShaderParameters &shader_parameters;
+      /**
+       * If set, the terrain heights are streamed from this map and map may be null.
+       * Only a coarse level of it stays resident.
+       */
+      std::shared_ptr<const TiledHeightMap> tiled_map {};
+    };
+
+    struct Statistics
+    {
+      size_t num_nodes = 0;
+      size_t num_nodes_visited = 0;
+      size_t num_nodes_culled = 0;
+      size_t num_instances = 0;
+      size_t instance_bytes_uploaded = 0;
+      /// only used with a tiled map
+      size_t num_tile_requests = 0;
+      size_t num_tile_hits = 0;
+      size_t num_tile_page_ins = 0;
+      size_t tile_cache_memory = 0;
+      double average_tile_page_in_ms = 0;
+      double max_tile_page_in_ms = 0;
     };
 
     virtual ~TerrainBase() {}
@@ -73,10 +95,22 @@ namespace render_util
     virtual void draw(Client *client = nullptr) = 0;
     virtual void update(const Camera &camera, bool low_detail) {}
     virtual void setDrawDistance(float dist) {}
+    /**
+     * The subtrees this many levels below the root are selected in parallel.
+     * 0 selects all nodes on the calling thread.
+     */
+    virtual void setSelectionSplitDepth(int depth) {}
     virtual std::vector<glm::vec3> getNormals() { return {}; }
     virtual TexturePtr getNormalMapTexture() { return nullptr; }
     virtual void setProgramName(std::string) {}
     virtual void setBaseMapOrigin(glm::vec2 origin) {}
+    /**
+     * Must match the terrain_base_map_height and terrain_height_offset uniforms of the programs
+     * the terrain is drawn with - the culling uses them from the next update() on.
+     */
+    virtual void setBaseMapHeight(float height) {}
+    virtual void setHeightOffset(float offset) {}
+    virtual Statistics getStatistics() { return {}; }
   };
 
   using TerrainFactory = util::Factory<TerrainBase, TextureManager&, const ShaderSearchPath&>;
@@ -0,0 +1,128 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TEXTURE_COMPRESSION_H
+#define RENDER_UTIL_TEXTURE_COMPRESSION_H
+
+#include <render_util/texture_container.h>
+#include <thread_pool.h>
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/**
+ * BC1/BC3/BC4/BC5 encoder for textures which are compressed at load time.
+ * Endpoints come from the principal axis of the block and are refined once by least squares -
+ * slower than a bounding box fit, but still fast enough to encode all terrain textures
+ * of a map on first load. The results are cached on disk.
+ */
+
+namespace render_util
+{
+
+
+enum class BlockFormat
+{
+  BC1,
+  BC3,
+  BC4,
+  BC5
+};
+
+
+/// how a texture is compressed
+enum class TextureCompression
+{
+  /// BC1, or BC3 if the alpha isn't opaque everywhere
+  COLOR,
+  /// BC4 of the first component
+  GREY,
+  /**
+   * BC5 of x and y of a tangent space normal map, stored like in an RGB image.
+   * The normals are renormalized on every mip level - z has to be reconstructed when sampling.
+   */
+  NORMAL_MAP
+};
+
+
+unsigned int getInternalFormat(BlockFormat);
+int getBlockBytes(BlockFormat);
+const char *getBlockFormatName(BlockFormat);
+
+
+/**
+ * Encodes a 4x4 block of RGBA pixels, row by row.
+ * BC1 is always in four color mode, so alpha is ignored.
+ * BC4 encodes red, BC5 red and green.
+ */
+void encodeBlock(BlockFormat, const unsigned char rgba[16 * 4], unsigned char *out);
+void decodeBlock(BlockFormat, const unsigned char *block, unsigned char rgba[16 * 4]);
+
+/**
+ * Encodes an image with num_components components per pixel - missing components are
+ * taken as 0, missing alpha as 255. Rows of blocks are encoded in parallel.
+ */
+std::vector<unsigned char> compressImage(BlockFormat,
+                                         const unsigned char *pixels,
+                                         glm::ivec2 size,
+                                         int num_components,
+                                         util::ThreadPool &thread_pool =
+                                           util::ThreadPool::getDefault());
+
+/// returns RGBA pixels
+std::vector<unsigned char> decompressImage(BlockFormat,
+                                           const unsigned char *blocks,
+                                           glm::ivec2 size);
+
+
+struct TextureCompressionStatistics
+{
+  int num_layers = 0;
+  int num_cache_hits = 0;
+  /// with mipmaps, as uploaded without compression
+  size_t uncompressed_bytes = 0;
+  size_t compressed_bytes = 0;
+  /// pixels of all levels encoded - cache hits aren't counted
+  size_t encoded_pixels = 0;
+  double encode_seconds = 0;
+};
+
+
+std::string getDefaultCompressedTextureCacheDir();
+
+
+/**
+ * Returns the compressed image with a complete mip chain.
+ * With a non-empty cache_dir the result is stored there, named by a hash of the pixels
+ * and the format, and loaded from there next time.
+ */
+std::unique_ptr<TextureContainer> getCompressedTexture(BlockFormat,
+                                                       TextureCompression,
+                                                       const unsigned char *pixels,
+                                                       glm::ivec2 size,
+                                                       int num_components,
+                                                       const std::string &cache_dir,
+                                                       TextureCompressionStatistics &statistics);
+
+
+} // namespace render_util
+
+#endif
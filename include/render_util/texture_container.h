@@ -0,0 +1,121 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TEXTURE_CONTAINER_H
+#define RENDER_UTIL_TEXTURE_CONTAINER_H
+
+#include <render_util/image_loader.h>
+#include <render_util/image_storage.h>
+#include <file.h>
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace render_util
+{
+
+
+/**
+ * A texture baked offline into a DDS or KTX2 file, with its mip chain and in the format
+ * it is uploaded in - block compressed (BC1-BC5, BC7) or plain 8/16/32 bit per component.
+ * The levels are used in place, so a mapped file is uploaded without a copy.
+ *
+ * Only 2D textures and arrays are supported - no cube maps, volumes
+ * or KTX2 supercompression.
+ */
+class TextureContainer
+{
+  ImageInfo m_info;
+  unsigned int m_format = 0;
+  unsigned int m_type = 0;
+  std::unique_ptr<ImageStorage> m_storage;
+  /// per level and layer
+  std::vector<size_t> m_offsets;
+  std::vector<size_t> m_level_sizes;
+
+  TextureContainer() {}
+
+public:
+  /// parses the container in storage - returns null on failure
+  static std::unique_ptr<TextureContainer> create(std::unique_ptr<ImageStorage> &&storage);
+
+  /// the file is mapped - returns null on failure
+  static std::unique_ptr<TextureContainer> load(const std::string &file_path,
+                                                bool quiet = false);
+  static std::unique_ptr<TextureContainer> load(util::File&);
+
+  const ImageInfo &getInfo() const { return m_info; }
+
+  glm::ivec2 getSize(int level = 0) const
+  {
+    return glm::max(glm::ivec2(1), glm::ivec2(m_info.size.x >> level, m_info.size.y >> level));
+  }
+
+  int getNumLevels() const { return m_info.num_levels; }
+  int getNumLayers() const { return m_info.num_layers; }
+  bool isCompressed() const { return m_info.compressed; }
+
+  unsigned int getInternalFormat() const { return m_info.internal_format; }
+  /// pixel transfer format and type - 0 for compressed formats
+  unsigned int getFormat() const { return m_format; }
+  unsigned int getType() const { return m_type; }
+
+  const unsigned char *getData(int level, int layer = 0) const;
+  /// size of one layer of the level
+  size_t getDataSize(int level) const;
+};
+
+
+bool isTextureContainer(const unsigned char *data, size_t data_size);
+
+/**
+ * Reads the header of a texture container.
+ * data only needs to hold the header, e.g. the first few hundred bytes of the file.
+ */
+bool getTextureContainerInfo(const unsigned char *data, size_t data_size, ImageInfo&);
+
+/// returns 0 if internal_format can't be stored in a texture container
+size_t getTextureLevelSize(unsigned int internal_format, glm::ivec2 size);
+
+/**
+ * Creates the file contents of a texture container.
+ * Each level holds the data of all layers, one after the other.
+ * file_format is either DDS or KTX2.
+ * Returns an empty vector if internal_format can't be stored.
+ */
+std::vector<unsigned char>
+writeTextureContainer(ImageFileFormat file_format,
+                      unsigned int internal_format,
+                      glm::ivec2 size,
+                      int num_layers,
+                      const std::vector<std::vector<unsigned char>> &levels);
+
+bool saveTextureContainer(const std::string &file_path,
+                          ImageFileFormat file_format,
+                          unsigned int internal_format,
+                          glm::ivec2 size,
+                          int num_layers,
+                          const std::vector<std::vector<unsigned char>> &levels);
+
+
+}
+
+#endif
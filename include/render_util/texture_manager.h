@@ -32,6 +32,48 @@ class Texture;
 typedef std::shared_ptr<Texture> TexturePtr;
 
 
+/**
+ * Texture binding calls issued and avoided by Texture, TemporaryTextureBinding and TextureManager,
+ * since the start or the last reset.
+ */
+struct TextureBindingStatistics
+{
+  /// glBindTexture and glBindTextureUnit calls, and textures bound by glBindTextures
+  unsigned long long num_binds = 0;
+  /// the texture was known to be bound already
+  unsigned long long num_redundant_binds_avoided = 0;
+  /// glBindTextures calls
+  unsigned long long num_multi_binds = 0;
+  unsigned long long num_active_texture_calls = 0;
+  unsigned long long num_redundant_active_texture_calls_avoided = 0;
+  /// binding state read back with glGetIntegerv
+  unsigned long long num_queries = 0;
+  unsigned long long num_queries_avoided = 0;
+};
+
+TextureBindingStatistics getTextureBindingStatistics();
+void resetTextureBindingStatistics();
+
+/// TextureManager::rebind() on the active manager, if there is one
+void rebindTexture(TexturePtr texture);
+
+/**
+ * Forgets what the active TextureManager knows about unit's bindings -
+ * for code which binds textures on one of its units directly, e.g. with glBindTexture.
+ */
+void invalidateTextureUnit(unsigned int unit);
+
+/**
+ * TextureManager::invalidateState() on the active manager, if there is one -
+ * for code which may bind textures on any unit directly, e.g. a third-party library.
+ */
+void invalidateTextureState();
+
+
+/**
+ * Binds texture until destroyed, on the given or the active unit.
+ * The previous binding is only queried if no TextureManager tracks the unit.
+ */
 class TemporaryTextureBinding
 {
   TexturePtr m_texture;
@@ -58,6 +100,12 @@ public:
   unsigned int getTarget() { return m_target; }
   void bind();
 
+  /**
+   * Exchanges the GL textures of this and other, which must have the same target.
+   * Texture units still have the previous name bound - bindings have to be renewed.
+   */
+  void swap(Texture &other);
+
   static std::shared_ptr<Texture> create(unsigned int target);
 };
 
@@ -91,6 +139,15 @@ public:
 };
 
 
+/**
+ * While active, the manager keeps a shadow copy of the active texture unit and of the bindings
+ * of its units, so redundant binds and queries of the binding state are left out.
+ * Units are bound with glBindTextureUnit and glBindTextures if available,
+ * which leaves the active unit alone.
+ * Code outside render_util which changes that state while the manager is active
+ * has to call invalidateState() before render_util binds textures again.
+ * Only one manager can be active at a time.
+ */
 class TextureManager
 {
   struct Private;
@@ -101,7 +158,11 @@ public:
   ~TextureManager();
 
   void setActive(bool);
+  /// forgets the shadow copy - the next binds and queries go to GL
+  void invalidateState();
   void bind(unsigned int unit, TexturePtr texture);
+  /// binds texture again on the units it is bound to - after its name changed, e.g. by Texture::swap()
+  void rebind(TexturePtr texture);
   void unbind(unsigned int unit, unsigned int target);
   int getTexUnitNum(unsigned int unit) const;
   int getLowestUnit() const;
@@ -0,0 +1,189 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TEXTURE_UPLOAD_QUEUE_H
+#define RENDER_UTIL_TEXTURE_UPLOAD_QUEUE_H
+
+#include <render_util/texture_manager.h>
+#include <render_util/stream_buffer.h>
+#include <render_util/image.h>
+#include <render_util/image_util.h>
+#include <thread_pool.h>
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <type_traits>
+#include <cstddef>
+
+namespace render_util
+{
+
+
+/// 8 bit pixels with 1 to 4 components, rows without padding
+struct TextureUploadImage
+{
+  /// keeps data alive until it is uploaded
+  std::shared_ptr<const void> owner;
+  const unsigned char *data = nullptr;
+  glm::ivec2 size = glm::ivec2(0);
+  int bytes_per_pixel = 0;
+
+  size_t getRowSize() const { return size_t(size.x) * bytes_per_pixel; }
+  size_t getDataSize() const { return getRowSize() * size.y; }
+};
+
+
+template <typename T>
+TextureUploadImage makeTextureUploadImage(T image)
+{
+  using ImageType = typename image::TypeFromPtr<T>::Type;
+  static_assert(std::is_same<typename ImageType::ComponentType, unsigned char>::value);
+
+  TextureUploadImage upload_image;
+  upload_image.owner = image;
+  upload_image.data = image->getData();
+  upload_image.size = image->getSize();
+  upload_image.bytes_per_pixel = ImageType::BYTES_PER_PIXEL;
+  return upload_image;
+}
+
+
+/**
+ * Replaces the images of 2D textures without stalling the render thread.
+ *
+ * Images are decoded on the thread pool. update(), called once per frame, copies
+ * at most the per-frame budget of decoded rows into a StreamBuffer bound as pixel unpack
+ * buffer and issues glTexSubImage2D() from there into a staging texture - an image larger
+ * than the budget is spread over several frames.
+ * When the fence after the last rows of an image has signaled, the staging texture is
+ * swapped with the requested texture (see Texture::swap()). Its bindings made through the active
+ * TextureManager are renewed, then the done function is called - it has to renew bindings of the
+ * texture made in any other way.
+ *
+ * Enqueueing a texture again drops requests for it which haven't started uploading.
+ * All functions except the decode functions must be called on the thread of the GL context.
+ */
+class TextureUploadQueue
+{
+public:
+  using DecodeFunction = std::function<TextureUploadImage()>;
+  using DoneFunction = std::function<void(TexturePtr)>;
+
+  struct Statistics
+  {
+    /// requests which haven't been swapped in yet
+    int queue_depth = 0;
+    int num_decoding = 0;
+    /// decoded, waiting for upload budget - including partially uploaded images
+    int num_waiting = 0;
+    /// completely uploaded, waiting for their fence
+    int num_in_flight = 0;
+
+    unsigned long long num_completed = 0;
+    unsigned long long num_superseded = 0;
+    unsigned long long num_failed = 0;
+
+    size_t bytes_uploaded_last_frame = 0;
+    unsigned long long bytes_uploaded_total = 0;
+
+    /// from enqueue() to the swap
+    double last_latency_ms = 0;
+    double max_latency_ms = 0;
+    double average_latency_ms = 0;
+  };
+
+  static constexpr size_t DEFAULT_BYTES_PER_FRAME = 4 * 1024 * 1024;
+
+  TextureUploadQueue(size_t bytes_per_frame = DEFAULT_BYTES_PER_FRAME,
+                     util::ThreadPool &thread_pool = util::ThreadPool::getDefault());
+  /// waits for running decode functions - the GL context has to be current
+  ~TextureUploadQueue();
+
+  TextureUploadQueue(const TextureUploadQueue&) = delete;
+  TextureUploadQueue &operator=(const TextureUploadQueue&) = delete;
+
+  /// texture must be a GL_TEXTURE_2D
+  void enqueue(TexturePtr texture, DecodeFunction decode, bool mipmaps, DoneFunction done = {});
+
+  /// the image must not be modified until it has been uploaded
+  template <typename T>
+  void enqueueImage(TexturePtr texture, T image, bool mipmaps = true, DoneFunction done = {})
+  {
+    auto upload_image = makeTextureUploadImage(image);
+    enqueue(texture, [upload_image] { return upload_image; }, mipmaps, done);
+  }
+
+  /// uploads within the budget and swaps in finished textures - call once per frame
+  void update();
+
+  /// blocks until the queue is empty, ignoring the budget
+  void finish();
+
+  bool isEmpty() const;
+  size_t getBytesPerFrame() const { return m_bytes_per_frame; }
+  const Statistics &getStatistics() const { return m_statistics; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request
+  {
+    TexturePtr texture;
+    bool mipmaps = false;
+    DoneFunction done;
+    Clock::time_point enqueue_time;
+    util::Future<TextureUploadImage> decoded;
+    TextureUploadImage image;
+    TexturePtr staging_texture;
+    int num_rows_uploaded = 0;
+    bool superseded = false;
+  };
+
+  using RequestPtr = std::shared_ptr<Request>;
+
+  struct Batch
+  {
+    void *fence = nullptr;
+    std::vector<RequestPtr> requests;
+  };
+
+  size_t m_bytes_per_frame = 0;
+  util::ThreadPool &m_thread_pool;
+  std::unique_ptr<StreamBuffer> m_staging_buffer;
+  std::deque<RequestPtr> m_decoding;
+  std::deque<RequestPtr> m_waiting;
+  std::deque<Batch> m_in_flight;
+  Statistics m_statistics;
+
+  void collectDecoded(bool wait);
+  void upload(size_t budget);
+  void createStagingTexture(Request&);
+  void uploadRows(Request&, int first_row, int num_rows, const void *data);
+  void finishUpload(Request&);
+  void swapCompleted(bool wait);
+  void updateStatistics();
+};
+
+
+} // namespace render_util
+
+#endif
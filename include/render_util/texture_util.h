@@ -24,6 +24,8 @@
 #include <render_util/texture_manager.h>
 #include <render_util/render_util.h>
 #include <render_util/elevation_map.h>
+#include <render_util/texture_container.h>
+#include <render_util/texture_compression.h>
 
 #include <half.hpp>
 #include <vector>
@@ -83,6 +85,34 @@ namespace render_util
   TexturePtr createTextureArray(const std::vector<const unsigned char*> &textures,
                                   int mipmap_levels, int texture_width, int bytes_per_pixel);
 
+  /// uploads the stored levels as they are - nothing is decoded and no mipmaps are generated
+  TexturePtr createTexture(const TextureContainer&);
+
+  /**
+   * All layers of all containers, in order.
+   * The containers must have the same format, size and number of levels.
+   */
+  TexturePtr createTextureArray(const std::vector<const TextureContainer*>&);
+
+  /**
+   * Whether the current context can sample the block format used for the compression -
+   * S3TC for COLOR, RGTC for GREY and NORMAL_MAP.
+   * Always false if the library was built with enable_texture_compression=0.
+   */
+  bool isTextureCompressionSupported(TextureCompression);
+
+  /**
+   * Like createTextureArray(), but the layers and their mipmaps are block compressed.
+   * With a non-empty cache_dir each compressed layer is cached there.
+   * Without isTextureCompressionSupported() the layers are uploaded uncompressed.
+   * NORMAL_MAP layers keep their z component then.
+   */
+  TexturePtr createCompressedTextureArray(const std::vector<const unsigned char*> &textures,
+                                          int texture_width,
+                                          int num_components,
+                                          TextureCompression compression,
+                                          const std::string &cache_dir);
+
   void setTextureImage(TexturePtr texture,
                       const unsigned char *data,
                       int w,
@@ -129,6 +159,31 @@ namespace render_util
     return createTextureArray(texture_data, mipmap_levels, texture_width, T::BYTES_PER_PIXEL);
   }
 
+  template <typename T>
+  TexturePtr createCompressedTextureArray(const std::vector<typename T::ConstPtr> &textures,
+                                          TextureCompression compression,
+                                          const std::string &cache_dir = {})
+  {
+    static_assert(std::is_same<typename T::ComponentType, unsigned char>::value);
+
+    assert(!textures.empty());
+
+    assert(textures[0]);
+    const int texture_width = textures[0]->w();
+
+    std::vector<const unsigned char*> texture_data(textures.size());
+    for (unsigned i = 0; i < textures.size(); i++)
+    {
+      assert(textures[i]);
+      assert(textures[i]->w() == texture_width);
+      assert(textures[i]->h() == texture_width);
+      texture_data[i] = textures[i]->data();
+    }
+
+    return createCompressedTextureArray(texture_data, texture_width, T::NUM_COMPONENTS,
+                                        compression, cache_dir);
+  }
+
   template <typename T>
   TexturePtr createTexture(T image, bool mipmaps = true)
   {
@@ -195,7 +250,14 @@ namespace render_util
 
   ImageGreyScale::Ptr createTerrainLightMap(const ElevationMap&);
 
-  Image<Normal>::Ptr createNormalMap(ElevationMap::ConstPtr elevation_map, float grid_scale);
+  /**
+   * Area weighted vertex normals of the terrain grid.
+   * Bands of rows are processed in parallel, the interior with the row kernel
+   * (see image::kernels::calcNormalRow()).
+   */
+  Image<Normal>::Ptr createNormalMap(ElevationMap::ConstPtr elevation_map, float grid_scale,
+                                     util::ThreadPool &thread_pool =
+                                       util::ThreadPool::getDefault());
   ImageRGB::Ptr createNormalMap(ImageGreyScale::ConstPtr height_map,
                                 float max_height_m,
                                 float height_map_width_m);
@@ -0,0 +1,136 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TILED_HEIGHT_MAP_H
+#define RENDER_UTIL_TILED_HEIGHT_MAP_H
+
+#include <render_util/elevation_map.h>
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <cstddef>
+
+namespace util
+{
+  class MappedFile;
+}
+
+namespace render_util
+{
+
+
+/**
+ * Height map split into square tiles, stored in a file together with a mip pyramid
+ * that goes down to a single tile. The file is memory mapped, so tiles are only read
+ * from disk when they are accessed.
+ *
+ * Tiles use terrain coordinates: sample (x, y) of level 0 is pixel (x, h - 1 - y)
+ * of the source image, and sample (x, y) of level n is sample (x * 2^n, y * 2^n) of level 0.
+ * Tile (x, y) of a level has the samples from (x, y) * tile_size - TILE_BORDER
+ * to (x, y) * tile_size + tile_size + TILE_BORDER inclusive, row by row from the lowest y -
+ * so the mesh of a tile has all its vertices and their neighbours.
+ * Samples outside the map are 0.
+ */
+class TiledHeightMap
+{
+public:
+  /// file layout - see tiled_height_map.cpp
+  struct Header;
+  struct TileIndexEntry;
+
+private:
+  std::shared_ptr<util::MappedFile> m_file;
+  const Header *m_header = nullptr;
+  const TileIndexEntry *m_index = nullptr;
+  int m_tile_size = 0;
+  int m_num_levels = 0;
+  glm::ivec2 m_size = glm::ivec2(0);
+
+  TiledHeightMap() {}
+
+  size_t getTileIndex(int level, glm::ivec2 tile) const;
+
+public:
+  static constexpr int DEFAULT_TILE_SIZE = 64;
+  static constexpr int TILE_BORDER = 1;
+
+  /// returns null on failure
+  static std::shared_ptr<TiledHeightMap> open(const std::string &path, bool quiet = false);
+
+  static int getNumLevels(glm::ivec2 size, int tile_size);
+  static glm::ivec2 getLevelSize(glm::ivec2 size, int level);
+
+  int getNumLevels() const { return m_num_levels; }
+  int getTileSize() const { return m_tile_size; }
+  /// samples per side of a stored tile
+  int getTileSizeWithBorder() const { return m_tile_size + 1 + 2 * TILE_BORDER; }
+  size_t getTileDataSize() const;
+
+  glm::ivec2 getSize(int level = 0) const { return getLevelSize(m_size, level); }
+  glm::ivec2 getNumTiles(int level) const;
+  bool hasTile(int level, glm::ivec2 tile) const;
+
+  /**
+   * Points into the mapping - the first access to a tile reads it from disk.
+   * Safe to call from any thread.
+   */
+  const float *getTile(int level, glm::ivec2 tile) const;
+
+  /// vec2(min, max) of all samples of the tile, border included - doesn't access the tile
+  glm::vec2 getHeightRange(int level, glm::ivec2 tile) const;
+
+  /// a whole level, in the orientation of the source image
+  ElevationMap::Ptr readLevel(int level) const;
+
+  size_t getFileSize() const;
+};
+
+
+/**
+ * Creates a TiledHeightMap file from a height map that is streamed row by row,
+ * so the map doesn't have to fit into memory - only tile_size + 3 rows of each level are kept.
+ */
+class TiledHeightMapWriter
+{
+  struct Private;
+  Private *p = nullptr;
+
+public:
+  TiledHeightMapWriter(const std::string &path, glm::ivec2 size,
+                       int tile_size = TiledHeightMap::DEFAULT_TILE_SIZE);
+  ~TiledHeightMapWriter();
+
+  TiledHeightMapWriter(const TiledHeightMapWriter&) = delete;
+  TiledHeightMapWriter &operator=(const TiledHeightMapWriter&) = delete;
+
+  /// rows are added from the top, in the order of an ElevationMap's rows
+  void addRow(const float *row);
+
+  /// must be called after the last row - returns false if writing the file failed
+  bool finish();
+};
+
+
+bool writeTiledHeightMap(const std::string &path, const ElevationMap &map,
+                         int tile_size = TiledHeightMap::DEFAULT_TILE_SIZE);
+
+
+} // namespace render_util
+
+#endif
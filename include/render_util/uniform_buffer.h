@@ -0,0 +1,175 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_UNIFORM_BUFFER_H
+#define RENDER_UTIL_UNIFORM_BUFFER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <glm/glm.hpp>
+
+namespace render_util
+{
+
+
+/**
+ * Binding points of the uniform blocks shared between programs.
+ * ShaderProgram assigns a block with the name returned by getUniformBlockName()
+ * to the respective binding point when the program is created.
+ */
+enum UniformBlockEnum : unsigned int
+{
+  UNIFORM_BLOCK_WATER_ANIMATION,
+  UNIFORM_BLOCK_NUM
+};
+
+const char *getUniformBlockName(unsigned int block);
+
+
+template <typename T>
+struct Std140Traits;
+
+template <>
+struct Std140Traits<float> { enum { ALIGNMENT = 4, SIZE = 4 }; };
+
+template <>
+struct Std140Traits<int> { enum { ALIGNMENT = 4, SIZE = 4 }; };
+
+template <>
+struct Std140Traits<unsigned int> { enum { ALIGNMENT = 4, SIZE = 4 }; };
+
+template <>
+struct Std140Traits<glm::vec2> { enum { ALIGNMENT = 8, SIZE = 8 }; };
+
+template <>
+struct Std140Traits<glm::ivec2> { enum { ALIGNMENT = 8, SIZE = 8 }; };
+
+template <>
+struct Std140Traits<glm::vec3> { enum { ALIGNMENT = 16, SIZE = 12 }; };
+
+template <>
+struct Std140Traits<glm::vec4> { enum { ALIGNMENT = 16, SIZE = 16 }; };
+
+template <>
+struct Std140Traits<glm::ivec4> { enum { ALIGNMENT = 16, SIZE = 16 }; };
+
+template <>
+struct Std140Traits<glm::mat4> { enum { ALIGNMENT = 16, SIZE = 64 }; };
+
+
+/**
+ * Computes member offsets according to the std140 layout rules.
+ * Members have to be added in the order of their declaration in the block.
+ */
+class Std140Layout
+{
+  size_t m_size = 0;
+
+  static size_t alignTo(size_t offset, size_t alignment)
+  {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+public:
+  static constexpr size_t VEC4_ALIGNMENT = 16;
+
+  template <typename T>
+  size_t add()
+  {
+    m_size = alignTo(m_size, Std140Traits<T>::ALIGNMENT);
+    size_t offset = m_size;
+    m_size += Std140Traits<T>::SIZE;
+    return offset;
+  }
+
+  /// returns the offset of the first element - the array stride is getArrayStride<T>()
+  template <typename T>
+  size_t addArray(size_t num_elements)
+  {
+    m_size = alignTo(m_size, VEC4_ALIGNMENT);
+    size_t offset = m_size;
+    m_size += num_elements * getArrayStride<T>();
+    return offset;
+  }
+
+  template <typename T>
+  static constexpr size_t getArrayStride()
+  {
+    return (Std140Traits<T>::SIZE + VEC4_ALIGNMENT - 1) / VEC4_ALIGNMENT * VEC4_ALIGNMENT;
+  }
+
+  /// structs (and arrays of structs) start and end at a vec4 boundary
+  size_t beginStruct()
+  {
+    m_size = alignTo(m_size, VEC4_ALIGNMENT);
+    return m_size;
+  }
+
+  void endStruct()
+  {
+    m_size = alignTo(m_size, VEC4_ALIGNMENT);
+  }
+
+  size_t getSize() const { return alignTo(m_size, VEC4_ALIGNMENT); }
+};
+
+
+/**
+ * Buffer backing a std140 uniform block.
+ * Values are written to a CPU side copy - upload() transfers it if anything changed.
+ */
+class UniformBuffer
+{
+  unsigned int m_id = 0;
+  std::vector<unsigned char> m_data;
+  bool m_is_dirty = true;
+
+public:
+  UniformBuffer(size_t size);
+  ~UniformBuffer();
+
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer &operator=(const UniformBuffer&) = delete;
+
+  template <typename T>
+  void set(size_t offset, const T &value)
+  {
+    static_assert(sizeof(T) == Std140Traits<T>::SIZE);
+    assert(offset % Std140Traits<T>::ALIGNMENT == 0);
+    assert(offset + sizeof(T) <= m_data.size());
+
+    if (memcmp(m_data.data() + offset, &value, sizeof(T)) != 0)
+    {
+      memcpy(m_data.data() + offset, &value, sizeof(T));
+      m_is_dirty = true;
+    }
+  }
+
+  void upload();
+  void bind(unsigned int binding_point);
+
+  unsigned int getID() const { return m_id; }
+  size_t getSize() const { return m_data.size(); }
+};
+
+
+} // namespace render_util
+
+#endif
@@ -57,16 +57,26 @@ private:
 };
 
 
+/// Binds vao until destroyed - then the previous binding is restored, or 0 if it isn't known.
 class VertexArrayObjectBinding
 {
+  unsigned int m_previous_binding = 0;
+
 public:
   VertexArrayObjectBinding(VertexArrayObject &vao);
   ~VertexArrayObjectBinding();
 };
 
 
+/**
+ * Binds the index buffer of vao to the bound vertex array until destroyed.
+ * The index buffer is attached to vao when it is created, so with vao bound this is left out.
+ * If the previous binding isn't known, the index buffer stays bound.
+ */
 class IndexBufferBinding
 {
+  unsigned int m_previous_binding = 0;
+
 public:
   IndexBufferBinding(VertexArrayObject &vao);
   ~IndexBufferBinding();
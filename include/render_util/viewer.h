@@ -23,6 +23,7 @@
 #include <render_util/map_base.h>
 #include <render_util/image.h>
 #include <render_util/terrain_base.h>
+#include <render_util/tiled_height_map.h>
 #include <render_util/shader.h>
 #include <render_util/texture_manager.h>
 #include <factory.h>
@@ -50,6 +51,11 @@ namespace render_util::viewer
 
     virtual void createMapTextures(MapBase*) const = 0;
     virtual ElevationMap::Ptr createElevationMap() const = 0;
+    /**
+     * If this returns a map (e.g. written by convert_height_map), the terrain heights are streamed
+     * from it and createElevationMap() isn't called.
+     */
+    virtual std::shared_ptr<const TiledHeightMap> createTiledElevationMap() const { return {}; }
     virtual void createLandTextures(LandTextures&) const = 0;
     virtual int getHeightMapMetersPerPixel() const = 0;
 
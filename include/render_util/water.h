@@ -40,7 +40,12 @@ namespace render_util
                         const std::vector<ImageRGBA::ConstPtr> &normal_maps,
                         const std::vector<ImageGreyScale::ConstPtr> &foam_masks);
 
-    void updateUniforms(ShaderProgramPtr program);
+    /**
+     * The animation parameters are shared by all programs through the WaterAnimation
+     * uniform block - this only updates and binds the uniform buffer, so calling it
+     * for several programs in a frame costs next to nothing.
+     */
+    void updateUniforms(ShaderProgramPtr program = {});
 
     void update();
     bool isEmpty();
@@ -0,0 +1,160 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTIL_SERIAL_THREAD_POOL_H
+#define UTIL_SERIAL_THREAD_POOL_H
+
+#include <functional>
+#include <memory>
+#include <exception>
+#include <utility>
+#include <cassert>
+
+namespace util
+{
+
+
+/// The result of a task, which already ran when it was submitted.
+template <typename T>
+class Future
+{
+  std::unique_ptr<T> m_value;
+  std::exception_ptr m_error;
+  bool m_valid = false;
+
+public:
+  Future() = default;
+
+  template <typename F>
+  explicit Future(F &f) : m_valid(true)
+  {
+    try
+    {
+      m_value = std::make_unique<T>(f());
+    }
+    catch (...)
+    {
+      m_error = std::current_exception();
+    }
+  }
+
+  bool valid() const { return m_valid; }
+
+  T get()
+  {
+    assert(m_valid);
+    m_valid = false;
+
+    if (m_error)
+      std::rethrow_exception(m_error);
+
+    return std::move(*m_value);
+  }
+};
+
+
+template <typename T>
+bool isReady(const Future<T>&)
+{
+  return true;
+}
+
+
+/// there is only one thread, so there is nothing to lock
+struct Mutex
+{
+  void lock() {}
+  void unlock() {}
+};
+
+
+struct LockGuard
+{
+  explicit LockGuard(Mutex&) {}
+};
+
+
+using ThreadID = int;
+
+inline ThreadID getCurrentThreadID()
+{
+  return 0;
+}
+
+
+/**
+ * Stand-in for the ThreadPool in thread_pool.h where std::thread is unavailable (NO_STD_THREAD).
+ * Everything runs on the calling thread - tasks when they are submitted.
+ */
+class ThreadPool
+{
+public:
+  typedef std::function<void()> Task;
+  typedef std::function<void(int)> ItemFunction;
+  typedef std::function<void(int num_done, int num_items)> ProgressFunction;
+
+  ThreadPool(int = getDefaultNumThreads()) {}
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool &operator=(const ThreadPool&) = delete;
+
+  int getNumThreads() const { return 1; }
+
+  template <typename F>
+  auto submit(F f) -> Future<decltype(f())>
+  {
+    return Future<decltype(f())>(f);
+  }
+
+  void parallelFor(int num_items, ItemFunction do_work, int grain_size = 1,
+                   ProgressFunction progress_func = {})
+  {
+    assert(num_items >= 0);
+    assert(grain_size > 0);
+
+    int reported_percent = -1;
+
+    for (int i = 0; i < num_items; i++)
+    {
+      do_work(i);
+
+      int percent = (int) ((long long) (i + 1) * 100 / num_items);
+      if (progress_func && percent > reported_percent)
+      {
+        reported_percent = percent;
+        progress_func(i + 1, num_items);
+      }
+    }
+  }
+
+  static int getDefaultNumThreads()
+  {
+    return 1;
+  }
+
+  static ThreadPool &getDefault()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+};
+
+
+} // namespace util
+
+#endif
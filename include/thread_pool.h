@@ -0,0 +1,350 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTIL_THREAD_POOL_H
+#define UTIL_THREAD_POOL_H
+
+#ifdef NO_STD_THREAD
+  #include "serial_thread_pool.h"
+#else
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <cassert>
+
+namespace util
+{
+
+
+/// what ThreadPool::submit() returns
+template <typename T>
+using Future = std::future<T>;
+
+template <typename T>
+bool isReady(const Future<T> &future)
+{
+  return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+// serial_thread_pool.h has no-op versions of these
+using Mutex = std::mutex;
+using LockGuard = std::lock_guard<Mutex>;
+using ThreadID = std::thread::id;
+
+inline ThreadID getCurrentThreadID()
+{
+  return std::this_thread::get_id();
+}
+
+
+/**
+ * Work-stealing thread pool.
+ * Each worker owns a task queue and pops from its back; idle workers steal from the front
+ * of the other queues. Tasks submitted from a worker thread go to that worker's queue,
+ * tasks submitted from elsewhere are distributed round-robin.
+ */
+class ThreadPool
+{
+public:
+  typedef std::function<void()> Task;
+  typedef std::function<void(int)> ItemFunction;
+  typedef std::function<void(int num_done, int num_items)> ProgressFunction;
+
+private:
+  typedef std::unique_lock<std::mutex> Lock;
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  struct ParallelForJob
+  {
+    ItemFunction do_work;
+    ProgressFunction progress_func;
+    int num_items = 0;
+    int grain_size = 1;
+    int num_chunks = 0;
+    std::atomic<int> next_chunk { 0 };
+    std::atomic<int> num_done_chunks { 0 };
+    std::atomic<int> num_done_items { 0 };
+    std::atomic<int> reported_percent { -1 };
+    std::atomic<bool> failed { false };
+    std::exception_ptr error;
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+
+    // returns false when there are no chunks left to claim
+    bool runChunk()
+    {
+      int chunk = next_chunk.fetch_add(1);
+      if (chunk >= num_chunks)
+        return false;
+
+      int start = chunk * grain_size;
+      int end = std::min(start + grain_size, num_items);
+
+      if (!failed)
+      {
+        try
+        {
+          for (int i = start; i < end; i++)
+            do_work(i);
+        }
+        catch (...)
+        {
+          Lock lock(done_mutex);
+          if (!error)
+            error = std::current_exception();
+          failed = true;
+        }
+      }
+
+      int done = num_done_items.fetch_add(end - start) + (end - start);
+      if (progress_func)
+        reportProgress(done);
+
+      if (num_done_chunks.fetch_add(1) + 1 == num_chunks)
+      {
+        Lock lock(done_mutex);
+        done_cond.notify_all();
+      }
+
+      return true;
+    }
+
+    void reportProgress(int done)
+    {
+      int percent = (int) ((long long) done * 100 / num_items);
+      int reported = reported_percent.load();
+      while (percent > reported)
+      {
+        if (reported_percent.compare_exchange_weak(reported, percent))
+        {
+          progress_func(done, num_items);
+          break;
+        }
+      }
+    }
+
+    void wait()
+    {
+      Lock lock(done_mutex);
+      done_cond.wait(lock, [this] { return num_done_chunks == num_chunks; });
+    }
+  };
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_sleep_cond;
+  std::atomic<int> m_num_pending { 0 };
+  std::atomic<unsigned> m_next_queue { 0 };
+  bool m_quit = false;
+
+
+  static int &currentWorkerIndex()
+  {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  static const ThreadPool *&currentPool()
+  {
+    static thread_local const ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  int getCurrentWorker() const
+  {
+    return currentPool() == this ? currentWorkerIndex() : -1;
+  }
+
+  void push(Task task)
+  {
+    int index = getCurrentWorker();
+    if (index < 0)
+      index = m_next_queue.fetch_add(1) % m_queues.size();
+
+    {
+      Lock lock(m_queues[index]->mutex);
+      m_queues[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+      Lock lock(m_sleep_mutex);
+      m_num_pending++;
+    }
+    m_sleep_cond.notify_one();
+  }
+
+  bool pop(int index, Task &task)
+  {
+    {
+      Queue &own = *m_queues[index];
+      Lock lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        m_num_pending--;
+        return true;
+      }
+    }
+
+    for (size_t i = 1; i < m_queues.size(); i++)
+    {
+      Queue &victim = *m_queues[(index + i) % m_queues.size()];
+      Lock lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        m_num_pending--;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void threadMain(int index)
+  {
+    currentPool() = this;
+    currentWorkerIndex() = index;
+
+    while (true)
+    {
+      Task task;
+      if (pop(index, task))
+      {
+        task();
+        continue;
+      }
+
+      Lock lock(m_sleep_mutex);
+      m_sleep_cond.wait(lock, [this] { return m_quit || m_num_pending > 0; });
+      if (m_quit && m_num_pending == 0)
+        break;
+    }
+  }
+
+public:
+  ThreadPool(int num_threads = getDefaultNumThreads())
+  {
+    num_threads = std::max(1, num_threads);
+
+    for (int i = 0; i < num_threads; i++)
+      m_queues.push_back(std::make_unique<Queue>());
+
+    for (int i = 0; i < num_threads; i++)
+      m_threads.emplace_back(&ThreadPool::threadMain, this, i);
+  }
+
+  ~ThreadPool()
+  {
+    {
+      Lock lock(m_sleep_mutex);
+      m_quit = true;
+    }
+    m_sleep_cond.notify_all();
+
+    for (auto &t : m_threads)
+      t.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool &operator=(const ThreadPool&) = delete;
+
+  int getNumThreads() const { return m_threads.size(); }
+
+  template <typename F>
+  auto submit(F f) -> Future<decltype(f())>
+  {
+    typedef decltype(f()) Result;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(f));
+    auto future = task->get_future();
+    push([task] { (*task)(); });
+    return future;
+  }
+
+  /**
+   * Calls do_work(i) for every i in [0, num_items) and blocks until all items are done.
+   * Items are claimed in chunks of grain_size; the calling thread takes part in the work,
+   * so this may be called from within a task.
+   * progress_func is called from the worker threads, at most once per percent.
+   * An exception thrown by do_work is rethrown here after the remaining items are skipped.
+   */
+  void parallelFor(int num_items, ItemFunction do_work, int grain_size = 1,
+                   ProgressFunction progress_func = {})
+  {
+    assert(num_items >= 0);
+    assert(grain_size > 0);
+
+    if (num_items == 0)
+      return;
+
+    auto job = std::make_shared<ParallelForJob>();
+    job->do_work = std::move(do_work);
+    job->progress_func = std::move(progress_func);
+    job->num_items = num_items;
+    job->grain_size = grain_size;
+    job->num_chunks = (num_items + grain_size - 1) / grain_size;
+
+    int num_helpers = std::min(job->num_chunks - 1, getNumThreads());
+    for (int i = 0; i < num_helpers; i++)
+      push([job] { while (job->runChunk()) {} });
+
+    while (job->runChunk()) {}
+
+    job->wait();
+
+    if (job->error)
+      std::rethrow_exception(job->error);
+  }
+
+  static int getDefaultNumThreads()
+  {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  static ThreadPool &getDefault()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+};
+
+
+} // namespace util
+
+#endif // NO_STD_THREAD
+
+#endif
@@ -26,7 +26,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <cstdio>
+#include <cstdint>
 #include <cmath>
 #include <cassert>
 
@@ -140,6 +142,86 @@ inline std::string makeLowercase(const std::string &input)
 }
 
 
+constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+
+
+/**
+ * 64 bit FNV-1a - unlike std::hash the result is the same for every build.
+ * Pass the result as hash to continue hashing with more data.
+ */
+inline uint64_t hashFNV1a(const void *data, size_t size, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+  auto bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+
+inline uint64_t hashFNV1a(const std::string &data)
+{
+  return hashFNV1a(data.data(), data.size());
+}
+
+
+/// hash of data as 16 hex digits, e.g. for naming cache files
+inline std::string makeHashString(const std::string &data)
+{
+  std::ostringstream out;
+  out << std::hex << std::setw(16) << std::setfill('0') << hashFNV1a(data);
+  return out.str();
+}
+
+
+/// escapes quotes, backslashes and control characters for use in a JSON string
+inline std::string escapeJSON(const std::string &in)
+{
+  std::string out;
+
+  for (char c : in)
+  {
+    switch (c)
+    {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+          out += escaped;
+        }
+        else
+        {
+          out += c;
+        }
+    }
+  }
+
+  return out;
+}
+
+
+/// a JSON string with the contents of in
+inline std::string quoteJSON(const std::string &in)
+{
+  return '"' + escapeJSON(in) + '"';
+}
+
+
 inline std::string getDirFromPath(const std::string &path)
 {
   std::string dir;
@@ -47,13 +47,22 @@ of the following C++ code.
 #include "constants.h"
 #include <render_util/config.h>
 #include <render_util/shader_util.h>
+#include <render_util/globals.h>
 #include <render_util/image_loader.h>
 
 #include <glm/gtc/type_ptr.hpp>
+#include <log.h>
+
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 #include <render_util/gl_binding/gl_functions.h>
 
@@ -168,7 +177,7 @@ void bindTexture3D(unsigned int unit, unsigned int texture)
 
 void useProgram(render_util::ShaderProgramPtr program, bool assert_uniforms_are_set = true)
 {
-  gl::UseProgram(program->getId());
+  render_util::getCurrentGLContext()->setCurrentProgram(program);
   if (assert_uniforms_are_set)
     program->assertUniformsAreSet();
 }
@@ -228,7 +237,7 @@ formats, but not for the RGB ones):
 bool IsFramebufferRgbFormatSupported(bool half_precision) {
   GLuint test_fbo = 0;
   gl::GenFramebuffers(1, &test_fbo);
-  gl::BindFramebuffer(GL_FRAMEBUFFER, test_fbo);
+  render_util::getCurrentGLContext()->bindFramebuffer(GL_FRAMEBUFFER, test_fbo);
   GLuint test_texture = 0;
   gl::GenTextures(1, &test_texture);
   gl::BindTexture(GL_TEXTURE_2D, test_texture);
@@ -241,6 +250,7 @@ bool IsFramebufferRgbFormatSupported(bool half_precision) {
       gl::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
   gl::DeleteTextures(1, &test_texture);
   gl::DeleteFramebuffers(1, &test_fbo);
+  render_util::getCurrentGLContext()->forgetFramebuffer(test_fbo);
   return rgb_format_supported;
 }
 
@@ -256,9 +266,11 @@ void DrawQuad(const std::vector<bool>& enable_blend, GLuint quad_vao) {
     }
   }
 
-  gl::BindVertexArray(quad_vao);
+  auto context = render_util::getCurrentGLContext();
+
+  context->bindVertexArray(quad_vao);
   gl::DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  gl::BindVertexArray(0);
+  context->bindVertexArray(0);
 
   for (unsigned int i = 0; i < enable_blend.size(); ++i) {
     gl::Disablei(GL_BLEND, i);
@@ -359,6 +371,106 @@ void ComputeSpectralRadianceToLuminanceFactors(
   *k_b *= MAX_LUMINOUS_EFFICACY * dlambda;
 }
 
+/*
+<p>and functions to save the precomputed textures to a file and to load them
+back, so that the precomputations can be skipped on later runs:
+*/
+
+constexpr char kTextureCacheMagic[8] = {'A', 'T', 'M', 'O', 'S', 'T', 'E', 'X'};
+// Must be incremented whenever the file format or the way the textures are
+// computed on the CPU side changes. The sources of the precomputation shaders
+// are part of the cache key.
+constexpr uint32_t kTextureCacheVersion = 1;
+
+// The programs used by Model::Precompute().
+const char* const kPrecomputePrograms[] = {
+  "compute_transmittance",
+  "compute_direct_irradiance",
+  "compute_single_scattering",
+  "compute_scattering_density",
+  "compute_indirect_irradiance",
+  "compute_multiple_scattering",
+};
+
+struct TextureCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_textures;
+  uint64_t key;
+};
+
+struct TextureCacheEntryHeader {
+  int32_t width;
+  int32_t height;
+  int32_t depth;
+  int32_t channels;
+};
+
+// 64 bit FNV-1a
+uint64_t HashString(const std::string& s) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t ComputeCacheKey(const std::string& parameters_description,
+    unsigned int num_scattering_orders) {
+  return HashString(parameters_description +
+                    std::to_string(num_scattering_orders) + ';' +
+                    std::to_string(kTextureCacheVersion));
+}
+
+GLenum GetPixelFormat(int channels) {
+  assert(channels == 3 || channels == 4);
+  return channels == 4 ? GL_RGBA : GL_RGB;
+}
+
+void WriteTexture(std::ostream& out, GLuint texture,
+    int width, int height, int depth, int channels) {
+  TextureCacheEntryHeader header { width, height, depth, channels };
+  std::vector<float> data(size_t(width) * height * depth * channels);
+
+  gl::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  gl::GetTextureImage(texture, 0, GetPixelFormat(channels), GL_FLOAT,
+      data.size() * sizeof(float), data.data());
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+}
+
+bool ReadTexture(std::istream& in, GLuint texture, GLenum target,
+    int width, int height, int depth, int channels) {
+  TextureCacheEntryHeader header {};
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in.good() || header.width != width || header.height != height ||
+      header.depth != depth || header.channels != channels) {
+    return false;
+  }
+
+  std::vector<float> data(size_t(width) * height * depth * channels);
+  in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+  if (!in.good())
+    return false;
+
+  gl::ActiveTexture(GL_TEXTURE0);
+  gl::BindTexture(target, texture);
+  gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (target == GL_TEXTURE_3D) {
+    gl::TexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, width, height, depth,
+        GetPixelFormat(channels), GL_FLOAT, data.data());
+  } else {
+    assert(depth == 1);
+    gl::TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+        GetPixelFormat(channels), GL_FLOAT, data.data());
+  }
+  gl::BindTexture(target, 0);
+
+  return true;
+}
+
 }  // anonymous namespace
 
 /*<h3 id="implementation">Model implementation</h3>
@@ -410,6 +522,44 @@ Model::Model(
   m_shader_search_path.push_back(shader_dir + "/internal");
   m_shader_search_path.push_back(shader_dir);
 
+  {
+    // Everything the precomputed textures depend on, used as cache key.
+    std::ostringstream desc;
+    desc << std::hexfloat;
+    auto describe_vector = [&desc](const std::vector<double>& v) {
+      desc << v.size() << ':';
+      for (double value : v)
+        desc << value << ',';
+      desc << ';';
+    };
+    auto describe_layers = [&desc](const std::vector<DensityProfileLayer>& layers) {
+      desc << layers.size() << ':';
+      for (auto& layer : layers) {
+        desc << layer.width << ',' << layer.exp_term << ',' << layer.exp_scale << ','
+             << layer.linear_term << ',' << layer.constant_term << ',';
+      }
+      desc << ';';
+    };
+    desc << rgb_lambdas.r << ',' << rgb_lambdas.g << ',' << rgb_lambdas.b << ';';
+    describe_vector(wavelengths);
+    describe_vector(solar_irradiance);
+    desc << sun_angular_radius << ';' << bottom_radius << ';' << top_radius << ';';
+    describe_layers(rayleigh_density);
+    describe_vector(rayleigh_scattering);
+    describe_layers(mie_density);
+    describe_vector(mie_scattering);
+    describe_vector(mie_extinction);
+    desc << mie_phase_function_g << ';';
+    describe_layers(absorption_density);
+    describe_vector(absorption_extinction);
+    describe_vector(ground_albedo);
+    desc << max_sun_zenith_angle << ';' << length_unit_in_meters << ';'
+         << num_precomputed_wavelengths << ';' << combine_scattering_textures << ';'
+         << half_precision << ';' << realtime_single_scattering << ';'
+         << realtime_single_scattering_steps << ';' << single_mie_horizon_hack << ';';
+    parameters_description_ = desc.str();
+  }
+
   auto to_string = [wavelengths](const std::vector<double>& v,
       const vec3& lambdas, double scale) {
     double r = Interpolate(wavelengths, v, lambdas[0]) * scale;
@@ -464,13 +614,18 @@ Model::Model(
 
 
   // Allocate the precomputed textures, but don't precompute them yet.
+  scattering_texture_channels_ =
+      combine_scattering_textures || !rgb_format_supported_ ? 4 : 3;
+  optional_single_mie_scattering_texture_channels_ =
+      combine_scattering_textures ? 0 : (rgb_format_supported_ ? 3 : 4);
+
   transmittance_texture_ = NewTexture2d(
       TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
   scattering_texture_ = NewTexture3d(
       SCATTERING_TEXTURE_WIDTH,
       SCATTERING_TEXTURE_HEIGHT,
       SCATTERING_TEXTURE_DEPTH,
-      combine_scattering_textures || !rgb_format_supported_ ? GL_RGBA : GL_RGB,
+      GetPixelFormat(scattering_texture_channels_),
       half_precision);
   if (combine_scattering_textures) {
     optional_single_mie_scattering_texture_ = 0;
@@ -479,7 +634,7 @@ Model::Model(
         SCATTERING_TEXTURE_WIDTH,
         SCATTERING_TEXTURE_HEIGHT,
         SCATTERING_TEXTURE_DEPTH,
-        rgb_format_supported_ ? GL_RGB : GL_RGBA,
+        GetPixelFormat(optional_single_mie_scattering_texture_channels_),
         half_precision);
   }
   irradiance_texture_ = NewTexture2d(
@@ -490,10 +645,11 @@ Model::Model(
 //   FORCE_CHECK_GL_ERROR();
 
   // Create a full screen quad vertex array and vertex buffer objects.
+  auto context = render_util::getCurrentGLContext();
   gl::GenVertexArrays(1, &full_screen_quad_vao_);
-  gl::BindVertexArray(full_screen_quad_vao_);
+  context->bindVertexArray(full_screen_quad_vao_);
   gl::GenBuffers(1, &full_screen_quad_vbo_);
-  gl::BindBuffer(GL_ARRAY_BUFFER, full_screen_quad_vbo_);
+  context->bindBuffer(GL_ARRAY_BUFFER, full_screen_quad_vbo_);
   const GLfloat vertices[] = {
     -1.0, -1.0,
     +1.0, -1.0,
@@ -505,8 +661,8 @@ Model::Model(
   constexpr GLuint kAttribIndex = 0;
   gl::VertexAttribPointer(kAttribIndex, kCoordsPerVertex, GL_FLOAT, false, 0, 0);
   gl::EnableVertexAttribArray(kAttribIndex);
-  gl::BindVertexArray(0);
-  gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+  context->bindVertexArray(0);
+  context->bindBuffer(GL_ARRAY_BUFFER, 0);
 
 //   gl::BindVertexArray(prev_vertex_array_binding);
 
@@ -570,6 +726,14 @@ Model::Model(
 
   m_shader_params = m_shader_parameter_factory(lambdas);
 
+  {
+    // The textures also depend on the precomputation shaders.
+    std::string sources;
+    for (auto name : kPrecomputePrograms)
+      sources += render_util::getShaderProgramSource(name, m_shader_search_path, m_shader_params);
+    parameters_description_ += "shaders:" + std::to_string(HashString(sources)) + ';';
+  }
+
 #if ENABLE_ATMOSPHERE_PRECOMPUTED_PLOT_PARAMETERISATION
   plotScatteringTextureParameterisation("plot_parameterisation");
   plotScatteringTextureParameterisation("plot_inverse_parameterisation");
@@ -582,8 +746,11 @@ Model::Model(
 */
 
 Model::~Model() {
+  auto context = render_util::getCurrentGLContext();
   gl::DeleteBuffers(1, &full_screen_quad_vbo_);
+  context->forgetBuffer(full_screen_quad_vbo_);
   gl::DeleteVertexArrays(1, &full_screen_quad_vao_);
+  context->forgetVertexArray(full_screen_quad_vao_);
   gl::DeleteTextures(1, &transmittance_texture_);
   gl::DeleteTextures(1, &scattering_texture_);
   if (optional_single_mie_scattering_texture_ != 0) {
@@ -682,7 +849,7 @@ void Model::Init(unsigned int num_scattering_orders) {
   // here (and destroyed at the end of this method).
   GLuint fbo;
   gl::GenFramebuffers(1, &fbo);
-  gl::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+  render_util::getCurrentGLContext()->bindFramebuffer(GL_FRAMEBUFFER, fbo);
 
   // The actual precomputations depend on whether we want to store precomputed
   // irradiance or illuminance values.
@@ -748,9 +915,10 @@ void Model::Init(unsigned int num_scattering_orders) {
   }
 
   // Delete the temporary resources allocated at the begining of this method.
-  gl::UseProgram(0);
-  gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+  render_util::getCurrentGLContext()->setCurrentProgram(nullptr);
+  render_util::getCurrentGLContext()->bindFramebuffer(GL_FRAMEBUFFER, 0);
   gl::DeleteFramebuffers(1, &fbo);
+  render_util::getCurrentGLContext()->forgetFramebuffer(fbo);
   gl::DeleteTextures(1, &delta_scattering_density_texture);
   gl::DeleteTextures(1, &delta_mie_scattering_texture);
   gl::DeleteTextures(1, &delta_rayleigh_scattering_texture);
@@ -803,6 +971,119 @@ void Model::SetProgramUniforms(
   gl::ActiveTexture(active_unit_save);
 }
 
+/*
+<p>The precomputed textures can be saved to a file and loaded back with the
+following methods. The file starts with a header containing the cache key, so
+that a file written for a different set of parameters is never used:
+*/
+
+std::string Model::GetCacheKey(unsigned int num_scattering_orders) const {
+  std::ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0')
+      << ComputeCacheKey(parameters_description_, num_scattering_orders);
+  return key.str();
+}
+
+bool Model::LoadTextures(const std::string& path,
+    unsigned int num_scattering_orders) {
+  std::ifstream in(path, std::ios_base::binary);
+  if (!in.good())
+    return false;
+
+  TextureCacheHeader header {};
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  auto expected_key = ComputeCacheKey(parameters_description_, num_scattering_orders);
+  uint32_t num_textures = optional_single_mie_scattering_texture_ ? 4 : 3;
+
+  if (!in.good() ||
+      !std::equal(header.magic, header.magic + sizeof(header.magic), kTextureCacheMagic) ||
+      header.version != kTextureCacheVersion ||
+      header.num_textures != num_textures ||
+      header.key != expected_key) {
+    LOG_INFO << "Ignoring stale atmosphere texture cache " << path << std::endl;
+    return false;
+  }
+
+  bool success =
+    ReadTexture(in, transmittance_texture_, GL_TEXTURE_2D,
+        TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1, 4) &&
+    ReadTexture(in, scattering_texture_, GL_TEXTURE_3D,
+        SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+        scattering_texture_channels_) &&
+    ReadTexture(in, irradiance_texture_, GL_TEXTURE_2D,
+        IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1, 4);
+
+  if (success && optional_single_mie_scattering_texture_) {
+    success = ReadTexture(in, optional_single_mie_scattering_texture_, GL_TEXTURE_3D,
+        SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+        optional_single_mie_scattering_texture_channels_);
+  }
+
+  FORCE_CHECK_GL_ERROR();
+
+  if (success)
+    LOG_INFO << "Loaded atmosphere textures from " << path << std::endl;
+  else
+    LOG_ERROR << "Failed to read atmosphere texture cache " << path << std::endl;
+
+  return success;
+}
+
+bool Model::SaveTextures(const std::string& path,
+    unsigned int num_scattering_orders) const {
+  // Write to a temporary file first, so that an interrupted write never
+  // leaves a truncated cache file behind.
+  auto tmp_path = path + ".tmp";
+
+  {
+    std::ofstream out(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+    if (!out.good()) {
+      LOG_ERROR << "Can't open output file " << tmp_path << std::endl;
+      return false;
+    }
+
+    TextureCacheHeader header {};
+    std::copy(kTextureCacheMagic, kTextureCacheMagic + sizeof(kTextureCacheMagic),
+              header.magic);
+    header.version = kTextureCacheVersion;
+    header.num_textures = optional_single_mie_scattering_texture_ ? 4 : 3;
+    header.key = ComputeCacheKey(parameters_description_, num_scattering_orders);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    WriteTexture(out, transmittance_texture_,
+        TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1, 4);
+    WriteTexture(out, scattering_texture_,
+        SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+        scattering_texture_channels_);
+    WriteTexture(out, irradiance_texture_,
+        IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1, 4);
+    if (optional_single_mie_scattering_texture_) {
+      WriteTexture(out, optional_single_mie_scattering_texture_,
+          SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+          optional_single_mie_scattering_texture_channels_);
+    }
+
+    FORCE_CHECK_GL_ERROR();
+
+    if (!out.good()) {
+      LOG_ERROR << "Error during writing to output file " << tmp_path << std::endl;
+      return false;
+    }
+  }
+
+  std::remove(path.c_str());
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERROR << "Failed to rename " << tmp_path << " to " << path << std::endl;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+
+  LOG_INFO << "Saved atmosphere textures to " << path << std::endl;
+
+  return true;
+}
+
 /*
 <p>The utility method <code>ConvertSpectrumToLinearSrgb</code> is implemented
 with a simple numerical integration of the given function, times the CIE color
@@ -294,6 +294,17 @@ class Model {
 
   void Init(unsigned int num_scattering_orders = 4);
 
+  // Returns a hash of all constructor parameters, the sources of the
+  // precomputation shaders and the number of scattering orders, suitable for
+  // naming a cache file of the precomputed textures.
+  std::string GetCacheKey(unsigned int num_scattering_orders) const;
+
+  // Loads the precomputed textures from a file written by SaveTextures(), so
+  // that Init() can be skipped. Returns false if the file doesn't exist or
+  // doesn't match this model.
+  bool LoadTextures(const std::string &path, unsigned int num_scattering_orders);
+  bool SaveTextures(const std::string &path, unsigned int num_scattering_orders) const;
+
   render_util::ShaderParameters getShaderParameters();
 
   void SetProgramUniforms(
@@ -339,6 +350,9 @@ class Model {
   unsigned int num_precomputed_wavelengths_;
   bool half_precision_;
   bool rgb_format_supported_;
+  int scattering_texture_channels_;
+  int optional_single_mie_scattering_texture_channels_;
+  std::string parameters_description_;
   GLuint transmittance_texture_;
   GLuint scattering_texture_;
   GLuint optional_single_mie_scattering_texture_;
@@ -45,7 +45,13 @@ This is the role of the following code.
 #include "atmosphere/reference/model.h"
 
 #include "atmosphere/reference/functions.h"
-#include "util/progress_bar.h"
+
+#include <thread_pool.h>
+#include <log.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
 
 /*
 <p>The constructor of the <code>Model</code> class allocates the precomputed
@@ -71,16 +77,18 @@ the textures from disk, if they have already been precomputed.
 */
 
 void Model::Init(unsigned int num_scattering_orders) {
-  std::ifstream file;
-  file.open(cache_directory_ + "transmittance.dat");
-  if (file.good()) {
-    file.close();
-    transmittance_texture_->Load(cache_directory_ + "transmittance.dat");
-    scattering_texture_->Load(cache_directory_ + "scattering.dat");
-    single_mie_scattering_texture_->Load(
-        cache_directory_ + "single_mie_scattering.dat");
-    irradiance_texture_->Load(cache_directory_ + "irradiance.dat");
-    return;
+  if (!cache_directory_.empty()) {
+    std::ifstream file;
+    file.open(cache_directory_ + "transmittance.dat");
+    if (file.good()) {
+      file.close();
+      transmittance_texture_->Load(cache_directory_ + "transmittance.dat");
+      scattering_texture_->Load(cache_directory_ + "scattering.dat");
+      single_mie_scattering_texture_->Load(
+          cache_directory_ + "single_mie_scattering.dat");
+      irradiance_texture_->Load(cache_directory_ + "irradiance.dat");
+      return;
+    }
   }
 
 /*
@@ -104,79 +112,77 @@ destroyed at the end of this method).
       delta_multiple_scattering_texture(new ScatteringTexture());
 
 /*
-<p>Since the computation phase takes several minutes, we show a progress bar to
-provide feedback to the user. The following constants roughly represent the
-relative duration of each computation phase, and are used to display a progress
-value which is roughly proportional to the elapsed time.
+<p>The remaining code of this method implements Algorithm 4.1 of our paper.
+Each phase computes all the texels of one texture in parallel: the texels are
+distributed in small batches over the threads of a thread pool, which keeps all
+the cores busy even though the cost per texel varies a lot within a texture.
+The time spent in each phase is recorded in <code>timings_</code>.
 */
 
-  constexpr unsigned int kTransmittanceProgress = 1;
-  constexpr unsigned int kDirectIrradianceProgress = 1;
-  constexpr unsigned int kSingleScatteringProgress = 10;
-  constexpr unsigned int kScatteringDensityProgress = 100;
-  constexpr unsigned int kIndirectIrradianceProgress = 10;
-  constexpr unsigned int kMultipleScatteringProgress = 10;
-  const unsigned int kTotalProgress =
-      TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT *
-          kTransmittanceProgress +
-      IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT * (
-          kDirectIrradianceProgress +
-          kIndirectIrradianceProgress * (num_scattering_orders - 1)) +
-      SCATTERING_TEXTURE_WIDTH * SCATTERING_TEXTURE_HEIGHT *
-          SCATTERING_TEXTURE_DEPTH * (
-              kSingleScatteringProgress +
-              (kScatteringDensityProgress + kMultipleScatteringProgress) *
-                  (num_scattering_orders - 1));
-
-  ProgressBar progress_bar(kTotalProgress);
+  util::ThreadPool& pool =
+      thread_pool_ ? *thread_pool_ : util::ThreadPool::getDefault();
+  timings_.clear();
 
-/*
-<p>The remaining code of this method implements Algorithm 4.1 of our paper,
-using several threads to speed up computations (by computing several texels of
-a texture in parallel).
-*/
+  constexpr int kTexelsPerBatch = 16;
+
+  auto for_each_texel_2d = [&](const char* phase, unsigned int order,
+      unsigned int width, unsigned int height,
+      const std::function<void(unsigned int, unsigned int)>& job) {
+    auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(width * height, [&](int index) {
+      job(index % width, index / width);
+    }, kTexelsPerBatch);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    timings_.push_back({phase, order, width * height, elapsed.count()});
+    LOG_DEBUG << phase << " (order " << order << "): "
+              << elapsed.count() << " s" << std::endl;
+  };
+
+  auto for_each_texel_3d = [&](const char* phase, unsigned int order,
+      const std::function<void(unsigned int, unsigned int, unsigned int)>& job) {
+    for_each_texel_2d(phase, order, SCATTERING_TEXTURE_WIDTH,
+        SCATTERING_TEXTURE_HEIGHT * SCATTERING_TEXTURE_DEPTH,
+        [&](unsigned int i, unsigned int jk) {
+          job(i, jk % SCATTERING_TEXTURE_HEIGHT, jk / SCATTERING_TEXTURE_HEIGHT);
+        });
+  };
 
   // Compute the transmittance, and store it in transmittance_texture_.
-  RunJobs([&](unsigned int j) {
-    for (unsigned int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
-      transmittance_texture_->Set(i, j,
-          ComputeTransmittanceToTopAtmosphereBoundaryTexture(
-              atmosphere_, vec2(i + 0.5, j + 0.5)));
-      progress_bar.Increment(kTransmittanceProgress);
-    }
-  }, TRANSMITTANCE_TEXTURE_HEIGHT);
+  for_each_texel_2d("transmittance", 1,
+      TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT,
+      [&](unsigned int i, unsigned int j) {
+    transmittance_texture_->Set(i, j,
+        ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+            atmosphere_, vec2(i + 0.5, j + 0.5)));
+  });
 
   // Compute the direct irradiance, store it in delta_irradiance_texture, and
   // initialize irradiance_texture_ with zeros (we don't want the direct
   // irradiance in irradiance_texture_, but only the irradiance from the sky).
-  RunJobs([&](unsigned int j) {
-    for (unsigned int i = 0; i < IRRADIANCE_TEXTURE_WIDTH; ++i) {
-      delta_irradiance_texture->Set(i, j,
-          ComputeDirectIrradianceTexture(
-              atmosphere_, *transmittance_texture_, vec2(i + 0.5, j + 0.5)));
-      irradiance_texture_->Set(
-          i, j, IrradianceSpectrum(0.0 * watt_per_square_meter_per_nm));
-      progress_bar.Increment(kDirectIrradianceProgress);
-    }
-  }, IRRADIANCE_TEXTURE_HEIGHT);
+  for_each_texel_2d("direct_irradiance", 1,
+      IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT,
+      [&](unsigned int i, unsigned int j) {
+    delta_irradiance_texture->Set(i, j,
+        ComputeDirectIrradianceTexture(
+            atmosphere_, *transmittance_texture_, vec2(i + 0.5, j + 0.5)));
+    irradiance_texture_->Set(
+        i, j, IrradianceSpectrum(0.0 * watt_per_square_meter_per_nm));
+  });
 
   // Compute the rayleigh and mie single scattering, and store them in
   // delta_rayleigh_scattering_texture and delta_mie_scattering_texture, as well
   // as in scattering_texture.
-  RunJobs([&](unsigned int k) {
-    for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
-      for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
-        IrradianceSpectrum rayleigh;
-        IrradianceSpectrum mie;
-        ComputeSingleScatteringTexture(atmosphere_, *transmittance_texture_,
-            vec3(i + 0.5, j + 0.5, k + 0.5), rayleigh, mie);
-        delta_rayleigh_scattering_texture->Set(i, j, k, rayleigh);
-        delta_mie_scattering_texture->Set(i, j, k, mie);
-        scattering_texture_->Set(i, j, k, rayleigh);
-        progress_bar.Increment(kSingleScatteringProgress);
-      }
-    }
-  }, SCATTERING_TEXTURE_DEPTH);
+  for_each_texel_3d("single_scattering", 1,
+      [&](unsigned int i, unsigned int j, unsigned int k) {
+    IrradianceSpectrum rayleigh;
+    IrradianceSpectrum mie;
+    ComputeSingleScatteringTexture(atmosphere_, *transmittance_texture_,
+        vec3(i + 0.5, j + 0.5, k + 0.5), rayleigh, mie);
+    delta_rayleigh_scattering_texture->Set(i, j, k, rayleigh);
+    delta_mie_scattering_texture->Set(i, j, k, mie);
+    scattering_texture_->Set(i, j, k, rayleigh);
+  });
 
   // Compute the 2nd, 3rd and 4th order of scattering, in sequence.
   for (unsigned int scattering_order = 2;
@@ -184,64 +190,117 @@ a texture in parallel).
        ++scattering_order) {
     // Compute the scattering density, and store it in
     // delta_scattering_density_texture.
-    RunJobs([&](unsigned int k) {
-      for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
-        for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
-          RadianceDensitySpectrum scattering_density;
-          scattering_density = ComputeScatteringDensityTexture(atmosphere_,
-              *transmittance_texture_, *delta_rayleigh_scattering_texture,
-              *delta_mie_scattering_texture,
-              *delta_multiple_scattering_texture, *delta_irradiance_texture,
-              vec3(i + 0.5, j + 0.5, k + 0.5), scattering_order);
-          delta_scattering_density_texture->Set(i, j, k, scattering_density);
-          progress_bar.Increment(kScatteringDensityProgress);
-        }
-      }
-    }, SCATTERING_TEXTURE_DEPTH);
+    for_each_texel_3d("scattering_density", scattering_order,
+        [&](unsigned int i, unsigned int j, unsigned int k) {
+      RadianceDensitySpectrum scattering_density;
+      scattering_density = ComputeScatteringDensityTexture(atmosphere_,
+          *transmittance_texture_, *delta_rayleigh_scattering_texture,
+          *delta_mie_scattering_texture,
+          *delta_multiple_scattering_texture, *delta_irradiance_texture,
+          vec3(i + 0.5, j + 0.5, k + 0.5), scattering_order);
+      delta_scattering_density_texture->Set(i, j, k, scattering_density);
+    });
 
     // Compute the indirect irradiance, store it in delta_irradiance_texture and
     // accumulate it in irradiance_texture_.
-    RunJobs([&](unsigned int j) {
-      for (unsigned int i = 0; i < IRRADIANCE_TEXTURE_WIDTH; ++i) {
-        IrradianceSpectrum delta_irradiance;
-        delta_irradiance = ComputeIndirectIrradianceTexture(
-            atmosphere_, *delta_rayleigh_scattering_texture,
-            *delta_mie_scattering_texture, *delta_multiple_scattering_texture,
-            vec2(i + 0.5, j + 0.5), scattering_order - 1);
-        delta_irradiance_texture->Set(i, j, delta_irradiance);
-        progress_bar.Increment(kIndirectIrradianceProgress);
-      }
-    }, IRRADIANCE_TEXTURE_HEIGHT);
+    for_each_texel_2d("indirect_irradiance", scattering_order,
+        IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT,
+        [&](unsigned int i, unsigned int j) {
+      IrradianceSpectrum delta_irradiance;
+      delta_irradiance = ComputeIndirectIrradianceTexture(
+          atmosphere_, *delta_rayleigh_scattering_texture,
+          *delta_mie_scattering_texture, *delta_multiple_scattering_texture,
+          vec2(i + 0.5, j + 0.5), scattering_order - 1);
+      delta_irradiance_texture->Set(i, j, delta_irradiance);
+    });
     (*irradiance_texture_) += *delta_irradiance_texture;
 
     // Compute the multiple scattering, store it in
     // delta_multiple_scattering_texture, and accumulate it in
     // scattering_texture_.
-    RunJobs([&](unsigned int k) {
-      for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
-        for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
-          RadianceSpectrum delta_multiple_scattering;
-          Number nu;
-          delta_multiple_scattering = ComputeMultipleScatteringTexture(
-              atmosphere_, *transmittance_texture_,
-              *delta_scattering_density_texture,
-              vec3(i + 0.5, j + 0.5, k + 0.5), nu);
-          delta_multiple_scattering_texture->Set(
-              i, j, k, delta_multiple_scattering);
-          scattering_texture_->Set(i, j, k,
-              scattering_texture_->Get(i, j, k) +
-              delta_multiple_scattering * (1.0 / RayleighPhaseFunction(nu)));
-          progress_bar.Increment(kMultipleScatteringProgress);
+    for_each_texel_3d("multiple_scattering", scattering_order,
+        [&](unsigned int i, unsigned int j, unsigned int k) {
+      RadianceSpectrum delta_multiple_scattering;
+      Number nu;
+      delta_multiple_scattering = ComputeMultipleScatteringTexture(
+          atmosphere_, *transmittance_texture_,
+          *delta_scattering_density_texture,
+          vec3(i + 0.5, j + 0.5, k + 0.5), nu);
+      delta_multiple_scattering_texture->Set(
+          i, j, k, delta_multiple_scattering);
+      scattering_texture_->Set(i, j, k,
+          scattering_texture_->Get(i, j, k) +
+          delta_multiple_scattering * (1.0 / RayleighPhaseFunction(nu)));
+    });
+  }
+
+  if (!cache_directory_.empty()) {
+    transmittance_texture_->Save(cache_directory_ + "transmittance.dat");
+    scattering_texture_->Save(cache_directory_ + "scattering.dat");
+    single_mie_scattering_texture_->Save(
+        cache_directory_ + "single_mie_scattering.dat");
+    irradiance_texture_->Save(cache_directory_ + "irradiance.dat");
+  }
+}
+
+/*
+<p>The precomputed textures can also be converted to the format of the GPU
+textures of <code>atmosphere::Model</code>, by evaluating the spectra at 3
+wavelengths:
+*/
+
+void Model::GetTextureData(Wavelength lambda_r, Wavelength lambda_g,
+    Wavelength lambda_b, TextureData* data) const {
+  const Wavelength lambdas[3] = { lambda_r, lambda_g, lambda_b };
+
+  data->transmittance.resize(
+      TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT * 4);
+  for (unsigned int j = 0; j < TRANSMITTANCE_TEXTURE_HEIGHT; ++j) {
+    for (unsigned int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
+      const DimensionlessSpectrum& value = transmittance_texture_->Get(i, j);
+      float* texel =
+          &data->transmittance[(j * TRANSMITTANCE_TEXTURE_WIDTH + i) * 4];
+      for (int c = 0; c < 3; ++c)
+        texel[c] = value(lambdas[c])();
+      texel[3] = 0.0;
+    }
+  }
+
+  data->irradiance.resize(
+      IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT * 4);
+  for (unsigned int j = 0; j < IRRADIANCE_TEXTURE_HEIGHT; ++j) {
+    for (unsigned int i = 0; i < IRRADIANCE_TEXTURE_WIDTH; ++i) {
+      const IrradianceSpectrum& value = irradiance_texture_->Get(i, j);
+      float* texel = &data->irradiance[(j * IRRADIANCE_TEXTURE_WIDTH + i) * 4];
+      for (int c = 0; c < 3; ++c)
+        texel[c] = value(lambdas[c]).to(watt_per_square_meter_per_nm);
+      texel[3] = 0.0;
+    }
+  }
+
+  const unsigned int num_scattering_texels = SCATTERING_TEXTURE_WIDTH *
+      SCATTERING_TEXTURE_HEIGHT * SCATTERING_TEXTURE_DEPTH;
+  data->scattering.resize(num_scattering_texels * 4);
+  data->single_mie_scattering.resize(num_scattering_texels * 4);
+  for (unsigned int k = 0; k < SCATTERING_TEXTURE_DEPTH; ++k) {
+    for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
+      for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
+        const IrradianceSpectrum& scattering = scattering_texture_->Get(i, j, k);
+        const IrradianceSpectrum& mie =
+            single_mie_scattering_texture_->Get(i, j, k);
+        unsigned int index = ((k * SCATTERING_TEXTURE_HEIGHT + j) *
+            SCATTERING_TEXTURE_WIDTH + i) * 4;
+        for (int c = 0; c < 3; ++c) {
+          data->scattering[index + c] =
+              scattering(lambdas[c]).to(watt_per_square_meter_per_nm);
+          data->single_mie_scattering[index + c] =
+              mie(lambdas[c]).to(watt_per_square_meter_per_nm);
         }
+        data->scattering[index + 3] = data->single_mie_scattering[index];
+        data->single_mie_scattering[index + 3] = 0.0;
       }
-    }, SCATTERING_TEXTURE_DEPTH);
+    }
   }
-
-  transmittance_texture_->Save(cache_directory_ + "transmittance.dat");
-  scattering_texture_->Save(cache_directory_ + "scattering.dat");
-  single_mie_scattering_texture_->Save(
-      cache_directory_ + "single_mie_scattering.dat");
-  irradiance_texture_->Save(cache_directory_ + "irradiance.dat");
 }
 
 /*
@@ -53,16 +53,52 @@ deletes the precomputed textures from memory).</li>
 
 #include "atmosphere/reference/definitions.h"
 
+namespace util {
+class ThreadPool;
+}  // namespace util
+
 namespace atmosphere {
 namespace reference {
 
 class Model {
  public:
+  // The wall clock time spent on one precomputation phase.
+  struct Timing {
+    std::string phase;
+    // 1 for the phases which are not part of a scattering order.
+    unsigned int scattering_order;
+    unsigned int num_texels;
+    double seconds;
+  };
+
+  // The precomputed textures, in the layout used by atmosphere::Model with
+  // combined scattering textures: RGBA floats with the values at 3 wavelengths
+  // in the RGB components and, for the scattering texture, the red component of
+  // the single Mie scattering in the alpha component.
+  struct TextureData {
+    std::vector<float> transmittance;
+    std::vector<float> scattering;
+    std::vector<float> single_mie_scattering;
+    std::vector<float> irradiance;
+  };
+
+  // An empty cache_directory disables loading and saving of the textures.
   Model(const AtmosphereParameters& atmosphere,
         const std::string& cache_directory);
 
+  // The pool on which the texels are computed. Defaults to
+  // util::ThreadPool::getDefault().
+  void SetThreadPool(util::ThreadPool* thread_pool) {
+    thread_pool_ = thread_pool;
+  }
+
   void Init(unsigned int num_scattering_orders = 4);
 
+  const std::vector<Timing>& GetTimings() const { return timings_; }
+
+  void GetTextureData(Wavelength lambda_r, Wavelength lambda_g,
+      Wavelength lambda_b, TextureData* data) const;
+
   RadianceSpectrum GetSolarRadiance() const;
 
   RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
@@ -83,6 +119,8 @@ class Model {
   std::unique_ptr<ReducedScatteringTexture> scattering_texture_;
   std::unique_ptr<ReducedScatteringTexture> single_mie_scattering_texture_;
   std::unique_ptr<IrradianceTexture> irradiance_texture_;
+  util::ThreadPool* thread_pool_ = nullptr;
+  std::vector<Timing> timings_;
 };
 
 }  // namespace reference
@@ -31,8 +31,12 @@
 
 #define ENABLE_BASE_MAP @enable_base_map@
 #define ENABLE_CURVATURE @enable_curvature:1@
+#define ENABLE_TERRAIN_TILE_CACHE @enable_terrain_tile_cache:0@
 
 attribute vec4 attrib_pos;
+#if ENABLE_TERRAIN_TILE_CACHE
+attribute vec4 attrib_tile;
+#endif
 
 uniform sampler2D sampler_curvature_map;
 
@@ -62,6 +66,9 @@ varying vec3 passLight;
 varying vec3 passNormal;
 varying vec2 pass_texcoord;
 varying vec2 pass_type_map_coord;
+#if ENABLE_TERRAIN_TILE_CACHE
+flat out vec4 pass_terrain_tile;
+#endif
 
 
 vec2 getDiff(float dist, float height)
@@ -76,6 +83,10 @@ vec2 getDiff(float dist, float height)
 
 float getHeight(vec2 world_coord, float approx_dist)
 {
+#if ENABLE_TERRAIN_TILE_CACHE
+  // the vertices are on the texel centers of the node's tile, so there is nothing to smooth
+  float detail = sampleTerrainTileHeight(attrib_tile, world_coord);
+#else
   vec2 height_map_texture_coord = getHeightMapTextureCoords(terrain.detail_layer, world_coord);
 
   ivec2 height_map_texture_coord_px =
@@ -86,6 +97,7 @@ float getHeight(vec2 world_coord, float approx_dist)
 
   float detail = mix(hm_raw, hm_smoothed,
     smoothstep(cdlod_min_dist / 4.0, cdlod_min_dist / 2.0, approx_dist));
+#endif
 
 #if ENABLE_BASE_MAP
   vec2 base_height_map_texture_coord = getHeightMapTextureCoords(terrain.base_layer, world_coord);
@@ -196,4 +208,8 @@ void main(void)
   gl_Position = projectionMatrixFar * gl_Position;
 
   passNormal = gl_Normal.xyz;
+
+#if ENABLE_TERRAIN_TILE_CACHE
+  pass_terrain_tile = attrib_tile;
+#endif
 }
@@ -56,6 +56,31 @@ vec3 sampleTerrainNormalMap(in TerrainLayer layer, vec2 pos_m)
 }
 
 
+#if @enable_terrain_tile_cache:0@
+// tile: layer, position of the first texel and grid units per texel (see TerrainTileCache)
+vec3 getTerrainTileCoords(vec4 tile, vec2 pos_m)
+{
+  vec2 texel = (pos_m / terrain.tile_cache.resolution_m - tile.yz) / tile.w;
+  vec2 coords = (texel + 0.5) / vec2(textureSize(terrain.tile_cache.height_tiles, 0).xy);
+  return vec3(coords, tile.x);
+}
+
+
+float sampleTerrainTileHeight(vec4 tile, vec2 pos_m)
+{
+  return texture(terrain.tile_cache.height_tiles, getTerrainTileCoords(tile, pos_m)).x;
+}
+
+
+vec3 sampleTerrainTileNormal(vec4 tile, vec2 pos_m)
+{
+  vec3 normal = texture(terrain.tile_cache.normal_tiles, getTerrainTileCoords(tile, pos_m)).xyz;
+  normal.y *= -1;
+  return normal;
+}
+#endif
+
+
 float getTerrainHeight(vec2 pos_m)
 {
   vec2 height_map_texture_coords = getHeightMapTextureCoords(terrain.detail_layer, pos_m);
@@ -3,3 +3,8 @@ vec2 getNormalMapCoords(in TerrainLayer layer, vec2 pos_m);
 vec3 sampleTerrainNormalMap(in TerrainLayer layer, vec2 pos_m);
 float getDetailMapBlend(vec2 pos_m);
 float getTerrainHeight(vec2 pos_m);
+#if @enable_terrain_tile_cache:0@
+vec3 getTerrainTileCoords(vec4 tile, vec2 pos_m);
+float sampleTerrainTileHeight(vec4 tile, vec2 pos_m);
+vec3 sampleTerrainTileNormal(vec4 tile, vec2 pos_m);
+#endif
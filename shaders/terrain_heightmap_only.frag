@@ -30,13 +30,20 @@ uniform Terrain terrain;
 
 varying float vertexHorizontalDist;
 varying vec3 passObjectPosFlat;
+#if @enable_terrain_tile_cache:0@
+flat in vec4 pass_terrain_tile;
+#endif
 
 
 void main(void)
 {
   float detail_blend = getDetailMapBlend(passObjectPosFlat.xy);
 
+#if @enable_terrain_tile_cache:0@
+  vec3 normal = sampleTerrainTileNormal(pass_terrain_tile, passObjectPosFlat.xy);
+#else
   vec3 normal = sampleTerrainNormalMap(terrain.detail_layer, passObjectPosFlat.xy);
+#endif
   vec3 base_normal = sampleTerrainNormalMap(terrain.base_layer, passObjectPosFlat.xy);
 
   normal = mix(base_normal, normal, detail_blend);
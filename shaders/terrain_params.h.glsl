@@ -32,6 +32,15 @@ struct TerrainLayer
   TerrainTextureMap normal_map;
 };
 
+#if @enable_terrain_tile_cache:0@
+struct TerrainTileCache
+{
+  sampler2DArray height_tiles;
+  sampler2DArray normal_tiles;
+  int resolution_m;
+};
+#endif
+
 struct Terrain
 {
   int mesh_resolution_m;
@@ -40,6 +49,9 @@ struct Terrain
   TerrainLayer detail_layer;
 #if @enable_base_map@
   TerrainLayer base_layer;
+#endif
+#if @enable_terrain_tile_cache:0@
+  TerrainTileCache tile_cache;
 #endif
   float land_texture_scale_levels[@num_land_texture_scale_levels@];
 };
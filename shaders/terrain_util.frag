@@ -25,6 +25,7 @@
 #define ENABLE_FAR_FOREST 0
 #define DETAILED_FOREST false
 #define ENABLE_TERRAIN_NORMAL_MAP 1
+#define ENABLE_TERRAIN_TILE_CACHE @enable_terrain_tile_cache:0@
 
 #define NUM_LAND_TEXTURE_SCALE_LEVELS uint(@num_land_texture_scale_levels@)
 
@@ -36,6 +37,8 @@
 #define ENABLE_FOREST @enable_forest:0@
 #define ENABLE_TYPE_MAP @enable_type_map:0@
 #define ENABLE_TERRAIN_DETAIL_NM !LOW_DETAIL && @enable_terrain_detail_nm:0@
+// only x and y are stored (BC5)
+#define TERRAIN_DETAIL_NM_XY @terrain_detail_nm_xy:0@
 #define ENABLE_UNLIT_OUTPUT @enable_unlit_output:0@
 
 #define ENABLE_TERRAIN0 @enable_terrain0:0@
@@ -93,6 +96,9 @@ uniform sampler2DArray sampler_terrain_detail_nm3;
 
 varying vec2 pass_texcoord;
 varying vec2 pass_type_map_coord;
+#if ENABLE_TERRAIN_TILE_CACHE
+flat in vec4 pass_terrain_tile;
+#endif
 
 
 struct ImplicitDerivatives
@@ -207,6 +213,9 @@ vec3 sampleTerrainDetailNormal(vec3 type, in ImplicitDerivatives d[NUM_LAND_TEXT
   }
 
   vec3 normal = color.xyz * 2 - 1;
+#if TERRAIN_DETAIL_NM_XY
+  normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
+#endif
   normal.y *= -1;
 
   if (sampler_nr == 255)
@@ -430,7 +439,11 @@ vec3 getTerrainColor(vec3 pos_curved, vec3 pos_flat)
 #endif
 
 #if ENABLE_TERRAIN_NORMAL_MAP
+#if ENABLE_TERRAIN_TILE_CACHE
+  vec3 normal = sampleTerrainTileNormal(pass_terrain_tile, pos_flat.xy);
+#else
   vec3 normal = sampleTerrainNormalMap(terrain.detail_layer, pos_flat.xy);
+#endif
 
 #if ENABLE_BASE_MAP
   {
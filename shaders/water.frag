@@ -25,6 +25,8 @@
 
 #version 130
 
+#extension GL_ARB_uniform_buffer_object : require
+
 #define LOW_DETAIL !@detailed_water:1@
 #define ENABLE_WAVES !LOW_DETAIL
 #define ENABLE_WAVE_INTERPOLATION 1
@@ -94,9 +96,13 @@ struct WaterAnimationParameters
   int pos;
 };
 
-uniform WaterAnimationParameters water_animation_params[2];
+// updated by render_util::WaterAnimation
+layout(std140) uniform WaterAnimation
+{
+  WaterAnimationParameters water_animation_params[2];
+  int water_animation_num_frames;
+};
 
-uniform int water_animation_num_frames = 0;
 uniform vec2 water_map_shift = vec2(0);
 uniform vec2 water_map_scale = vec2(1);
 uniform ivec2 water_map_table_size;
@@ -32,6 +32,7 @@
 
 #include <render_util/texunits.h>
 #include <render_util/physics.h>
+#include <render_util/profiler.h>
 #include <util.h>
 
 using namespace atmosphere;
@@ -96,6 +97,7 @@ constexpr bool use_combined_textures_ = true;
 constexpr bool do_white_balance_ = true;
 constexpr double MAX_MIE_ANGSTROM_BETA_FACTOR = 10;
 constexpr auto TONE_MAPPING_OPERATOR_TYPE = ToneMappingOperatorType::DEFAULT;
+constexpr unsigned int NUM_SCATTERING_ORDERS = 6;
 
 // calculated using CIECAM02 according to http://www.magnetkern.de/spektrum.html
 constexpr auto RGB_LAMBDAS = glm::dvec3(630.0, 542.0, 454.0);
@@ -231,7 +233,22 @@ AtmospherePrecomputed::AtmospherePrecomputed(render_util::TextureManager &tex_mg
       use_combined_textures_, use_half_precision_, shader_dir + "/" + getShaderPath(),
       tex_mgr, false, 0, params.single_mie_horizon_hack));
 
-  m_model->Init(6);
+  {
+    RENDER_UTIL_PROFILE_GPU_SCOPE("AtmospherePrecomputed: textures");
+
+    auto cache_dir = std::string(RENDER_UTIL_CACHE_DIR) + "/atmosphere_precomputed";
+    auto cache_path = cache_dir + "/" + m_model->GetCacheKey(NUM_SCATTERING_ORDERS) + ".bin";
+
+    if (!m_model->LoadTextures(cache_path, NUM_SCATTERING_ORDERS))
+    {
+      m_model->Init(NUM_SCATTERING_ORDERS);
+
+      if (util::mkdir(cache_dir, true))
+        m_model->SaveTextures(cache_path, NUM_SCATTERING_ORDERS);
+      else
+        LOG_ERROR << "Failed to create directory " << cache_dir << std::endl;
+    }
+  }
 
   {
     using namespace render_util;
@@ -282,6 +299,12 @@ void AtmospherePrecomputed::setUniforms(ShaderProgramPtr program)
     m_irradiance_texture_unit,
     m_single_mie_scattering_texture_unit);
 
+  // the model binds its textures directly
+  render_util::invalidateTextureUnit(m_transmittance_texture_unit);
+  render_util::invalidateTextureUnit(m_scattering_texture_unit);
+  render_util::invalidateTextureUnit(m_irradiance_texture_unit);
+  render_util::invalidateTextureUnit(m_single_mie_scattering_texture_unit);
+
   program->setUniform<float>("exposure",
                              m_use_luminance != Luminance::NONE ? m_exposure * 1e-5 : m_exposure);
 
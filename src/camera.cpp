@@ -26,7 +26,6 @@
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtx/vec_swizzle.hpp>
 #include <iostream>
-#include <vector>
 
 
 using namespace glm;
@@ -57,7 +56,7 @@ namespace render_util
     Unit m_z_far = 2300000;
     Unit m_fov = 90;
 
-    std::vector<Plane> frustum_planes;
+    Frustum frustum_planes;
 
     Private();
     Private(const Private &other);
@@ -117,8 +116,6 @@ namespace render_util
 
   void Camera::Private::calcFrustumPlanes()
   {
-    frustum_planes.clear();
-
     const auto aspect = (Unit)viewport_size.x / (Unit)viewport_size.y;
 
     auto right = m_z_near * tan(radians(m_fov)/2.0);
@@ -142,12 +139,12 @@ namespace render_util
     far_plane.move(m_z_far - m_z_near);
     far_plane.flip();
 
-    frustum_planes.push_back(left_plane);
-    frustum_planes.push_back(right_plane);
-    frustum_planes.push_back(top_plane);
-    frustum_planes.push_back(bottom_plane);
-    frustum_planes.push_back(near_plane);
-    frustum_planes.push_back(far_plane);
+    frustum_planes.setPlane(0, left_plane);
+    frustum_planes.setPlane(1, right_plane);
+    frustum_planes.setPlane(2, top_plane);
+    frustum_planes.setPlane(3, bottom_plane);
+    frustum_planes.setPlane(4, near_plane);
+    frustum_planes.setPlane(5, far_plane);
   }
 
 
@@ -255,12 +252,20 @@ namespace render_util
 
   bool Camera::cull(const Box &box) const
   {
-    for (auto &plane : p->frustum_planes)
-    {
-      if (plane.cull(box))
-        return true;
-    }
-    return false;
+    Frustum::PlaneMask mask = Frustum::ALL_PLANES;
+    return p->frustum_planes.test(box, mask) == Frustum::Visibility::OUTSIDE;
+  }
+
+
+  Frustum::Visibility Camera::testVisibility(const Box &box, Frustum::PlaneMask &mask) const
+  {
+    return p->frustum_planes.test(box, mask);
+  }
+
+
+  const Frustum &Camera::getFrustum() const
+  {
+    return p->frustum_planes;
   }
 
 
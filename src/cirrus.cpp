@@ -29,6 +29,7 @@
 #include <render_util/geometry.h>
 #include <render_util/globals.h>
 #include <render_util/state.h>
+#include <render_util/profiler.h>
 
 #include <iostream>
 #include <vector>
@@ -122,6 +123,8 @@ CirrusClouds::~CirrusClouds() {}
 
 void CirrusClouds::draw(const StateModifier &prev_state, const Camera &camera)
 {
+  RENDER_UTIL_PROFILE_GPU_SCOPE("CirrusClouds::draw");
+
   StateModifier state(prev_state);
 
   state.setFrontFace(GL_CW);
@@ -0,0 +1,130 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/frustum.h>
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+  #define RENDER_UTIL_FRUSTUM_SSE 1
+  #include <emmintrin.h>
+#else
+  #define RENDER_UTIL_FRUSTUM_SSE 0
+#endif
+
+using namespace glm;
+
+
+namespace render_util
+{
+
+
+void Frustum::setPlane(int index, const Plane &plane)
+{
+  assert(index >= 0 && index < NUM_PLANES);
+
+  m_normal_x[index] = plane.normal.x;
+  m_normal_y[index] = plane.normal.y;
+  m_normal_z[index] = plane.normal.z;
+  m_distance[index] = -dot(plane.normal, plane.point);
+}
+
+
+Plane Frustum::getPlane(int index) const
+{
+  assert(index >= 0 && index < NUM_PLANES);
+
+  const vec3 normal(m_normal_x[index], m_normal_y[index], m_normal_z[index]);
+  return Plane(normal * -m_distance[index] / dot(normal, normal), normal);
+}
+
+
+Frustum::Visibility Frustum::test(const vec3 &center, const vec3 &half_extent,
+                                  PlaneMask &mask) const
+{
+  if (!mask)
+    return Visibility::INSIDE;
+
+  // The box is outside of a plane if even its corner furthest along the normal is behind it,
+  // and inside if the corner furthest against the normal isn't.
+  PlaneMask outside = 0;
+  PlaneMask inside = 0;
+
+#if RENDER_UTIL_FRUSTUM_SSE
+  const __m128 center_x = _mm_set1_ps(center.x);
+  const __m128 center_y = _mm_set1_ps(center.y);
+  const __m128 center_z = _mm_set1_ps(center.z);
+  const __m128 half_extent_x = _mm_set1_ps(std::abs(half_extent.x));
+  const __m128 half_extent_y = _mm_set1_ps(std::abs(half_extent.y));
+  const __m128 half_extent_z = _mm_set1_ps(std::abs(half_extent.z));
+  const __m128 sign_bit = _mm_set1_ps(-0.f);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (int i = 0; i < NUM_PADDED_PLANES; i += 4)
+  {
+    if (!(mask & (0xFu << i)))
+      continue;
+
+    const __m128 normal_x = _mm_load_ps(m_normal_x + i);
+    const __m128 normal_y = _mm_load_ps(m_normal_y + i);
+    const __m128 normal_z = _mm_load_ps(m_normal_z + i);
+
+    __m128 distance = _mm_load_ps(m_distance + i);
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_x, center_x));
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_y, center_y));
+    distance = _mm_add_ps(distance, _mm_mul_ps(normal_z, center_z));
+
+    __m128 radius = _mm_mul_ps(_mm_andnot_ps(sign_bit, normal_x), half_extent_x);
+    radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(sign_bit, normal_y), half_extent_y));
+    radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(sign_bit, normal_z), half_extent_z));
+
+    outside |= PlaneMask(_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero))) << i;
+    inside |= PlaneMask(_mm_movemask_ps(_mm_cmpge_ps(_mm_sub_ps(distance, radius), zero))) << i;
+  }
+#else
+  for (int i = 0; i < NUM_PLANES; i++)
+  {
+    if (!(mask & (1u << i)))
+      continue;
+
+    const float distance = m_normal_x[i] * center.x +
+                           m_normal_y[i] * center.y +
+                           m_normal_z[i] * center.z +
+                           m_distance[i];
+    const float radius = std::abs(m_normal_x[i] * half_extent.x) +
+                         std::abs(m_normal_y[i] * half_extent.y) +
+                         std::abs(m_normal_z[i] * half_extent.z);
+
+    if (distance + radius < 0)
+      outside |= 1u << i;
+    if (distance - radius >= 0)
+      inside |= 1u << i;
+  }
+#endif
+
+  if (outside & mask)
+    return Visibility::OUTSIDE;
+
+  mask &= ~inside;
+
+  return mask ? Visibility::INTERSECTING : Visibility::INSIDE;
+}
+
+
+} // namespace render_util
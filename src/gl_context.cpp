@@ -19,19 +19,280 @@
 #include <render_util/gl_context.h>
 #include <render_util/gl_binding/gl_functions.h>
 
+#include <GL/gl.h>
+
 using namespace render_util::gl_binding;
 
-void render_util::GLContext::setCurrentProgram(ShaderProgramPtr program)
+
+namespace
+{
+
+
+using Counts = render_util::GLBindingStatistics::Counts;
+
+
+bool updateBinding(unsigned int &binding, unsigned int id, Counts &counts)
+{
+  if (binding == id)
+  {
+    counts.num_elided++;
+    return false;
+  }
+
+  binding = id;
+  counts.num_issued++;
+
+  return true;
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+unsigned long long GLBindingStatistics::getNumIssued() const
+{
+  return programs.num_issued +
+         vertex_arrays.num_issued +
+         array_buffers.num_issued +
+         element_array_buffers.num_issued +
+         uniform_buffers.num_issued +
+         framebuffers.num_issued;
+}
+
+
+unsigned long long GLBindingStatistics::getNumElided() const
 {
+  return programs.num_elided +
+         vertex_arrays.num_elided +
+         array_buffers.num_elided +
+         element_array_buffers.num_elided +
+         uniform_buffers.num_elided +
+         framebuffers.num_elided;
+}
+
+
+void GLContext::setCurrentProgram(ShaderProgramPtr program)
+{
+  assert(!program || program->isValid());
+
   m_current_program = program;
 
-  if (m_current_program)
+  auto id = m_current_program ? m_current_program->getId() : 0;
+
+  if (updateBinding(m_program, id, m_statistics.programs))
+    gl::UseProgram(id);
+}
+
+
+void GLContext::bindVertexArray(unsigned int id)
+{
+  if (updateBinding(m_vertex_array, id, m_statistics.vertex_arrays))
+    gl::BindVertexArray(id);
+}
+
+
+void GLContext::bindBuffer(unsigned int target, unsigned int id)
+{
+  switch (target)
+  {
+    case GL_ARRAY_BUFFER:
+      if (updateBinding(m_array_buffer, id, m_statistics.array_buffers))
+        gl::BindBuffer(target, id);
+      break;
+    case GL_ELEMENT_ARRAY_BUFFER:
+      if (m_vertex_array == UNKNOWN)
+      {
+        m_statistics.element_array_buffers.num_issued++;
+        gl::BindBuffer(target, id);
+      }
+      else
+      {
+        auto it = m_element_array_buffers.insert({ m_vertex_array, UNKNOWN }).first;
+        if (updateBinding(it->second, id, m_statistics.element_array_buffers))
+          gl::BindBuffer(target, id);
+      }
+      break;
+    case GL_UNIFORM_BUFFER:
+      if (updateBinding(m_uniform_buffer, id, m_statistics.uniform_buffers))
+        gl::BindBuffer(target, id);
+      break;
+    default:
+      gl::BindBuffer(target, id);
+  }
+}
+
+
+void GLContext::bindBufferBase(unsigned int target, unsigned int index, unsigned int id)
+{
+  if (target != GL_UNIFORM_BUFFER)
+  {
+    gl::BindBufferBase(target, index, id);
+    return;
+  }
+
+  if (index >= m_uniform_buffer_bindings.size())
+    m_uniform_buffer_bindings.resize(index + 1, UNKNOWN);
+
+  if (updateBinding(m_uniform_buffer_bindings[index], id, m_statistics.uniform_buffers))
   {
-    assert(m_current_program->isValid());
-    gl::UseProgram(m_current_program->getId());
+    gl::BindBufferBase(target, index, id);
+    // binds the generic binding point as well
+    m_uniform_buffer = id;
   }
-  else
+}
+
+
+void GLContext::bindFramebuffer(unsigned int target, unsigned int id)
+{
+  switch (target)
+  {
+    case GL_FRAMEBUFFER:
+      if (m_draw_framebuffer == id && m_read_framebuffer == id)
+      {
+        m_statistics.framebuffers.num_elided++;
+      }
+      else
+      {
+        m_statistics.framebuffers.num_issued++;
+        m_draw_framebuffer = id;
+        m_read_framebuffer = id;
+        gl::BindFramebuffer(target, id);
+      }
+      break;
+    case GL_DRAW_FRAMEBUFFER:
+      if (updateBinding(m_draw_framebuffer, id, m_statistics.framebuffers))
+        gl::BindFramebuffer(target, id);
+      break;
+    case GL_READ_FRAMEBUFFER:
+      if (updateBinding(m_read_framebuffer, id, m_statistics.framebuffers))
+        gl::BindFramebuffer(target, id);
+      break;
+    default:
+      assert(0);
+      gl::BindFramebuffer(target, id);
+  }
+}
+
+
+unsigned int GLContext::getBufferBinding(unsigned int target) const
+{
+  switch (target)
+  {
+    case GL_ARRAY_BUFFER:
+      return m_array_buffer;
+    case GL_ELEMENT_ARRAY_BUFFER:
+    {
+      auto it = m_element_array_buffers.find(m_vertex_array);
+      return it != m_element_array_buffers.end() ? it->second : UNKNOWN;
+    }
+    case GL_UNIFORM_BUFFER:
+      return m_uniform_buffer;
+    default:
+      return UNKNOWN;
+  }
+}
+
+
+unsigned int GLContext::getFramebufferBinding(unsigned int target) const
+{
+  switch (target)
+  {
+    case GL_FRAMEBUFFER:
+    case GL_DRAW_FRAMEBUFFER:
+      return m_draw_framebuffer;
+    case GL_READ_FRAMEBUFFER:
+      return m_read_framebuffer;
+    default:
+      assert(0);
+      return UNKNOWN;
+  }
+}
+
+
+void GLContext::forgetVertexArray(unsigned int id)
+{
+  if (!id)
+    return;
+
+  // deleting the bound vertex array binds 0
+  if (m_vertex_array == id)
+    m_vertex_array = 0;
+
+  m_element_array_buffers.erase(id);
+}
+
+
+void GLContext::forgetBuffer(unsigned int id)
+{
+  if (!id)
+    return;
+
+  // GL unbinds the buffer in the current context and in the bound vertex array -
+  // other vertex arrays may still refer to it while its name is reused
+  if (m_array_buffer == id)
+    m_array_buffer = 0;
+  if (m_uniform_buffer == id)
+    m_uniform_buffer = 0;
+
+  for (auto &binding : m_uniform_buffer_bindings)
   {
-    gl::UseProgram(0);
+    if (binding == id)
+      binding = UNKNOWN;
   }
+
+  for (auto it = m_element_array_buffers.begin(); it != m_element_array_buffers.end();)
+  {
+    if (it->second == id && it->first == m_vertex_array)
+    {
+      it->second = 0;
+      it++;
+    }
+    else if (it->second == id)
+    {
+      it = m_element_array_buffers.erase(it);
+    }
+    else
+    {
+      it++;
+    }
+  }
+}
+
+
+void GLContext::forgetFramebuffer(unsigned int id)
+{
+  if (!id)
+    return;
+
+  if (m_draw_framebuffer == id)
+    m_draw_framebuffer = 0;
+  if (m_read_framebuffer == id)
+    m_read_framebuffer = 0;
+}
+
+
+void GLContext::invalidate()
+{
+  m_program = UNKNOWN;
+  m_vertex_array = UNKNOWN;
+  m_array_buffer = UNKNOWN;
+  m_uniform_buffer = UNKNOWN;
+  m_draw_framebuffer = UNKNOWN;
+  m_read_framebuffer = UNKNOWN;
+  m_element_array_buffers.clear();
+  m_uniform_buffer_bindings.clear();
 }
+
+
+void GLContext::nextFrame()
+{
+  m_last_frame_statistics = m_statistics;
+  m_statistics = {};
+}
+
+
+} // namespace render_util
@@ -0,0 +1,1130 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/image_kernels.h>
+
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define RENDER_UTIL_IMAGE_KERNELS_X86 1
+  #include <immintrin.h>
+#else
+  #define RENDER_UTIL_IMAGE_KERNELS_X86 0
+#endif
+
+using namespace std;
+using namespace render_util::image::kernels;
+
+
+namespace
+{
+
+
+// tile edge in pixels for the transposition - two tiles of 4 byte pixels fit in the L1 cache
+constexpr int TRANSPOSE_TILE_SIZE = 32;
+
+
+struct Kernels
+{
+  void (*fill_row)(unsigned char*, const void*, size_t, size_t);
+  void (*reverse_row)(const unsigned char*, unsigned char*, size_t, size_t);
+  void (*extract_component)(const unsigned char*, unsigned char*, size_t, size_t, size_t, size_t);
+  void (*convert_to_float)(const unsigned char*, float*, size_t);
+  void (*convert_to_byte)(const float*, unsigned char*, size_t);
+  void (*transpose)(const unsigned char*, size_t, unsigned char*, size_t, size_t, int, int);
+  void (*calc_normal_row)(const float*, const float*, const float*, float*, size_t, float);
+};
+
+
+//
+// scalar
+//
+
+void fillRowScalar(unsigned char *dst, const void *pixel, size_t pixel_size, size_t num_pixels)
+{
+  if (!num_pixels)
+    return;
+
+  memcpy(dst, pixel, pixel_size);
+
+  // double the filled part until the row is complete
+  size_t num_filled = 1;
+  while (num_filled < num_pixels)
+  {
+    auto n = min(num_filled, num_pixels - num_filled);
+    memcpy(dst + num_filled * pixel_size, dst, n * pixel_size);
+    num_filled += n;
+  }
+}
+
+
+template <size_t PIXEL_SIZE>
+void reverseRowFixed(const unsigned char *src, unsigned char *dst, size_t num_pixels)
+{
+  for (size_t i = 0; i < num_pixels; i++)
+    memcpy(dst + (num_pixels - 1 - i) * PIXEL_SIZE, src + i * PIXEL_SIZE, PIXEL_SIZE);
+}
+
+
+void reverseRowScalar(const unsigned char *src, unsigned char *dst,
+                      size_t pixel_size, size_t num_pixels)
+{
+  switch (pixel_size)
+  {
+    case 1:
+      reverse_copy(src, src + num_pixels, dst);
+      break;
+    case 2:
+      reverseRowFixed<2>(src, dst, num_pixels);
+      break;
+    case 3:
+      reverseRowFixed<3>(src, dst, num_pixels);
+      break;
+    case 4:
+      reverseRowFixed<4>(src, dst, num_pixels);
+      break;
+    case 8:
+      reverseRowFixed<8>(src, dst, num_pixels);
+      break;
+    case 12:
+      reverseRowFixed<12>(src, dst, num_pixels);
+      break;
+    case 16:
+      reverseRowFixed<16>(src, dst, num_pixels);
+      break;
+    default:
+      for (size_t i = 0; i < num_pixels; i++)
+        memcpy(dst + (num_pixels - 1 - i) * pixel_size, src + i * pixel_size, pixel_size);
+  }
+}
+
+
+template <size_t COMPONENT_SIZE>
+void extractComponentFixed(const unsigned char *src, unsigned char *dst,
+                           size_t num_components, size_t component, size_t num_pixels)
+{
+  src += component * COMPONENT_SIZE;
+  for (size_t i = 0; i < num_pixels; i++)
+    memcpy(dst + i * COMPONENT_SIZE, src + i * num_components * COMPONENT_SIZE, COMPONENT_SIZE);
+}
+
+
+void extractComponentScalar(const unsigned char *src, unsigned char *dst,
+                            size_t component_size, size_t num_components, size_t component,
+                            size_t num_pixels)
+{
+  switch (component_size)
+  {
+    case 1:
+      extractComponentFixed<1>(src, dst, num_components, component, num_pixels);
+      break;
+    case 2:
+      extractComponentFixed<2>(src, dst, num_components, component, num_pixels);
+      break;
+    case 4:
+      extractComponentFixed<4>(src, dst, num_components, component, num_pixels);
+      break;
+    default:
+      src += component * component_size;
+      for (size_t i = 0; i < num_pixels; i++)
+      {
+        memcpy(dst + i * component_size,
+               src + i * num_components * component_size,
+               component_size);
+      }
+  }
+}
+
+
+void convertToFloatScalar(const unsigned char *src, float *dst, size_t num_values)
+{
+  for (size_t i = 0; i < num_values; i++)
+    dst[i] = src[i];
+}
+
+
+void convertToByteScalar(const float *src, unsigned char *dst, size_t num_values)
+{
+  for (size_t i = 0; i < num_values; i++)
+  {
+    // written so that NaN gives 0
+    float value = src[i] > 0 ? src[i] : 0;
+    dst[i] = value < 255 ? value : 255;
+  }
+}
+
+
+template <size_t PIXEL_SIZE>
+void transposeRectFixed(const unsigned char *src, size_t src_stride,
+                        unsigned char *dst, size_t dst_stride,
+                        int x_begin, int y_begin, int x_end, int y_end)
+{
+  for (int y = y_begin; y < y_end; y++)
+  {
+    auto src_row = src + y * src_stride;
+    for (int x = x_begin; x < x_end; x++)
+      memcpy(dst + x * dst_stride + y * PIXEL_SIZE, src_row + x * PIXEL_SIZE, PIXEL_SIZE);
+  }
+}
+
+
+void transposeRect(const unsigned char *src, size_t src_stride,
+                   unsigned char *dst, size_t dst_stride,
+                   size_t pixel_size, int x_begin, int y_begin, int x_end, int y_end)
+{
+  switch (pixel_size)
+  {
+    case 1:
+      transposeRectFixed<1>(src, src_stride, dst, dst_stride, x_begin, y_begin, x_end, y_end);
+      break;
+    case 2:
+      transposeRectFixed<2>(src, src_stride, dst, dst_stride, x_begin, y_begin, x_end, y_end);
+      break;
+    case 3:
+      transposeRectFixed<3>(src, src_stride, dst, dst_stride, x_begin, y_begin, x_end, y_end);
+      break;
+    case 4:
+      transposeRectFixed<4>(src, src_stride, dst, dst_stride, x_begin, y_begin, x_end, y_end);
+      break;
+    default:
+      for (int y = y_begin; y < y_end; y++)
+      {
+        for (int x = x_begin; x < x_end; x++)
+        {
+          memcpy(dst + x * dst_stride + y * pixel_size,
+                 src + y * src_stride + x * pixel_size,
+                 pixel_size);
+        }
+      }
+  }
+}
+
+
+void transposeScalar(const unsigned char *src, size_t src_stride,
+                     unsigned char *dst, size_t dst_stride,
+                     size_t pixel_size, int w, int h)
+{
+  for (int y = 0; y < h; y += TRANSPOSE_TILE_SIZE)
+  {
+    for (int x = 0; x < w; x += TRANSPOSE_TILE_SIZE)
+    {
+      transposeRect(src, src_stride, dst, dst_stride, pixel_size, x, y,
+                    min(x + TRANSPOSE_TILE_SIZE, w), min(y + TRANSPOSE_TILE_SIZE, h));
+    }
+  }
+}
+
+
+void calcNormalRowScalar(const float *previous_row, const float *row, const float *next_row,
+                         float *dst, size_t num_pixels, float grid_scale)
+{
+  const float z = 6 * grid_scale;
+
+  for (size_t i = 0; i < num_pixels; i++)
+  {
+    const float *p = previous_row + i;
+    const float *r = row + i;
+    const float *n = next_row + i;
+
+    float x = 2 * (r[-1] - r[1]) + (n[0] - n[1]) + (p[-1] - p[0]);
+    float y = 2 * (p[0] - n[0]) + (r[1] - n[1]) + (p[-1] - r[-1]);
+    float scale = 1 / sqrt(x * x + y * y + z * z);
+
+    dst[i * 3 + 0] = x * scale;
+    dst[i * 3 + 1] = y * scale;
+    dst[i * 3 + 2] = z * scale;
+  }
+}
+
+
+const Kernels SCALAR_KERNELS
+{
+  fillRowScalar,
+  reverseRowScalar,
+  extractComponentScalar,
+  convertToFloatScalar,
+  convertToByteScalar,
+  transposeScalar,
+  calcNormalRowScalar,
+};
+
+
+#if RENDER_UTIL_IMAGE_KERNELS_X86
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+
+typedef void TransposeBlockFunction(const unsigned char *src, size_t src_stride,
+                                    unsigned char *dst, size_t dst_stride);
+
+
+/**
+ * Transposes the full BLOCK_SIZE x BLOCK_SIZE blocks of each tile with TRANSPOSE_BLOCK,
+ * the remainder at the right and bottom edges pixel by pixel.
+ */
+template <int BLOCK_SIZE, TransposeBlockFunction TRANSPOSE_BLOCK>
+void transposeBlocked(const unsigned char *src, size_t src_stride,
+                      unsigned char *dst, size_t dst_stride,
+                      size_t pixel_size, int w, int h)
+{
+  for (int tile_y = 0; tile_y < h; tile_y += TRANSPOSE_TILE_SIZE)
+  {
+    int tile_y_end = min(tile_y + TRANSPOSE_TILE_SIZE, h);
+
+    for (int tile_x = 0; tile_x < w; tile_x += TRANSPOSE_TILE_SIZE)
+    {
+      int tile_x_end = min(tile_x + TRANSPOSE_TILE_SIZE, w);
+
+      for (int y = tile_y; y < tile_y_end; y += BLOCK_SIZE)
+      {
+        for (int x = tile_x; x < tile_x_end; x += BLOCK_SIZE)
+        {
+          if (x + BLOCK_SIZE <= tile_x_end && y + BLOCK_SIZE <= tile_y_end)
+          {
+            TRANSPOSE_BLOCK(src + y * src_stride + x * pixel_size, src_stride,
+                            dst + x * dst_stride + y * pixel_size, dst_stride);
+          }
+          else
+          {
+            transposeRect(src, src_stride, dst, dst_stride, pixel_size, x, y,
+                          min(x + BLOCK_SIZE, tile_x_end), min(y + BLOCK_SIZE, tile_y_end));
+          }
+        }
+      }
+    }
+  }
+}
+
+
+//
+// SSE2
+//
+
+TARGET_SSE2
+void fillRowSSE2(unsigned char *dst, const void *pixel, size_t pixel_size, size_t num_pixels)
+{
+  constexpr size_t MAX_PATTERN_SIZE = 64;
+
+  // the pattern holds whole pixels and whole vectors
+  size_t pattern_size = lcm(pixel_size, sizeof(__m128i));
+  if (pattern_size > MAX_PATTERN_SIZE)
+  {
+    fillRowScalar(dst, pixel, pixel_size, num_pixels);
+    return;
+  }
+
+  unsigned char pattern[MAX_PATTERN_SIZE];
+  for (size_t i = 0; i < pattern_size; i += pixel_size)
+    memcpy(pattern + i, pixel, pixel_size);
+
+  size_t num_vectors = pattern_size / sizeof(__m128i);
+  __m128i vectors[MAX_PATTERN_SIZE / sizeof(__m128i)];
+  for (size_t i = 0; i < num_vectors; i++)
+    vectors[i] = _mm_loadu_si128((const __m128i*) pattern + i);
+
+  size_t size = pixel_size * num_pixels;
+  size_t pos = 0;
+  for (; pos + pattern_size <= size; pos += pattern_size)
+  {
+    for (size_t i = 0; i < num_vectors; i++)
+      _mm_storeu_si128((__m128i*) (dst + pos) + i, vectors[i]);
+  }
+
+  memcpy(dst + pos, pattern, size - pos);
+}
+
+
+template <size_t PIXEL_SIZE>
+TARGET_SSE2 inline __m128i reversePixelsSSE2(__m128i v)
+{
+  if constexpr (PIXEL_SIZE == 16)
+  {
+    return v;
+  }
+  else if constexpr (PIXEL_SIZE == 8)
+  {
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+  }
+  else if constexpr (PIXEL_SIZE == 4)
+  {
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  else
+  {
+    // reverse the dwords, then the words and bytes within them
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+
+    if constexpr (PIXEL_SIZE == 2)
+    {
+      return v;
+    }
+    else
+    {
+      static_assert(PIXEL_SIZE == 1);
+      return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+  }
+}
+
+
+template <size_t PIXEL_SIZE>
+TARGET_SSE2
+void reverseRowFixedSSE2(const unsigned char *src, unsigned char *dst, size_t num_pixels)
+{
+  size_t size = PIXEL_SIZE * num_pixels;
+  size_t pos = 0;
+  for (; pos + sizeof(__m128i) <= size; pos += sizeof(__m128i))
+  {
+    auto v = _mm_loadu_si128((const __m128i*) (src + pos));
+    _mm_storeu_si128((__m128i*) (dst + size - pos - sizeof(__m128i)),
+                     reversePixelsSSE2<PIXEL_SIZE>(v));
+  }
+
+  reverseRowScalar(src + pos, dst, PIXEL_SIZE, (size - pos) / PIXEL_SIZE);
+}
+
+
+void reverseRowSSE2(const unsigned char *src, unsigned char *dst,
+                    size_t pixel_size, size_t num_pixels)
+{
+  switch (pixel_size)
+  {
+    case 1:
+      reverseRowFixedSSE2<1>(src, dst, num_pixels);
+      break;
+    case 2:
+      reverseRowFixedSSE2<2>(src, dst, num_pixels);
+      break;
+    case 4:
+      reverseRowFixedSSE2<4>(src, dst, num_pixels);
+      break;
+    case 8:
+      reverseRowFixedSSE2<8>(src, dst, num_pixels);
+      break;
+    case 16:
+      reverseRowFixedSSE2<16>(src, dst, num_pixels);
+      break;
+    default:
+      reverseRowScalar(src, dst, pixel_size, num_pixels);
+  }
+}
+
+
+TARGET_SSE2
+size_t extractComponentRGBA8SSE2(const unsigned char *src, unsigned char *dst,
+                                 size_t component, size_t num_pixels)
+{
+  auto shift = _mm_cvtsi32_si128(8 * component);
+  auto mask = _mm_set1_epi32(0xFF);
+  auto in = (const __m128i*) src;
+
+  size_t i = 0;
+  for (; i + 16 <= num_pixels; i += 16, in += 4)
+  {
+    auto a = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in + 0), shift), mask);
+    auto b = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in + 1), shift), mask);
+    auto c = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in + 2), shift), mask);
+    auto d = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in + 3), shift), mask);
+
+    auto packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128((__m128i*) (dst + i), packed);
+  }
+
+  return i;
+}
+
+
+TARGET_SSE2
+size_t extractComponentRGBA32SSE2(const unsigned char *src, unsigned char *dst,
+                                  size_t component, size_t num_pixels)
+{
+  auto in = (const float*) src;
+  auto out = (float*) dst;
+
+  size_t i = 0;
+  for (; i + 4 <= num_pixels; i += 4, in += 16)
+  {
+    __m128 rows[4] =
+    {
+      _mm_loadu_ps(in + 0),
+      _mm_loadu_ps(in + 4),
+      _mm_loadu_ps(in + 8),
+      _mm_loadu_ps(in + 12),
+    };
+    _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+    _mm_storeu_ps(out + i, rows[component]);
+  }
+
+  return i;
+}
+
+
+void extractComponentSSE2(const unsigned char *src, unsigned char *dst,
+                          size_t component_size, size_t num_components, size_t component,
+                          size_t num_pixels)
+{
+  size_t num_done = 0;
+
+  if (num_components == 4 && component_size == 1)
+    num_done = extractComponentRGBA8SSE2(src, dst, component, num_pixels);
+  else if (num_components == 4 && component_size == 4)
+    num_done = extractComponentRGBA32SSE2(src, dst, component, num_pixels);
+
+  extractComponentScalar(src + num_done * num_components * component_size,
+                         dst + num_done * component_size,
+                         component_size, num_components, component,
+                         num_pixels - num_done);
+}
+
+
+TARGET_SSE2
+void convertToFloatSSE2(const unsigned char *src, float *dst, size_t num_values)
+{
+  auto zero = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 16 <= num_values; i += 16)
+  {
+    auto v = _mm_loadu_si128((const __m128i*) (src + i));
+    auto lo = _mm_unpacklo_epi8(v, zero);
+    auto hi = _mm_unpackhi_epi8(v, zero);
+
+    _mm_storeu_ps(dst + i + 0, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_ps(dst + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_ps(dst + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+  }
+
+  convertToFloatScalar(src + i, dst + i, num_values - i);
+}
+
+
+TARGET_SSE2
+void convertToByteSSE2(const float *src, unsigned char *dst, size_t num_values)
+{
+  // clamped before the conversion - values from 2^31 up would give INT_MIN, which packs to 0
+  // (max returns its second operand for NaN)
+  auto zero = _mm_setzero_ps();
+  auto upper = _mm_set1_ps(255);
+
+  size_t i = 0;
+  for (; i + 16 <= num_values; i += 16)
+  {
+    auto a = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 0), zero), upper));
+    auto b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), upper));
+    auto c = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 8), zero), upper));
+    auto d = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 12), zero), upper));
+
+    auto packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128((__m128i*) (dst + i), packed);
+  }
+
+  convertToByteScalar(src + i, dst + i, num_values - i);
+}
+
+
+TARGET_SSE2
+void transposeBlock8x8x8SSE2(const unsigned char *src, size_t src_stride,
+                             unsigned char *dst, size_t dst_stride)
+{
+  __m128i rows[8];
+  for (int i = 0; i < 8; i++)
+    rows[i] = _mm_loadl_epi64((const __m128i*) (src + i * src_stride));
+
+  auto a0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+  auto a1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+  auto a2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+  auto a3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+
+  auto b0 = _mm_unpacklo_epi16(a0, a1);
+  auto b1 = _mm_unpackhi_epi16(a0, a1);
+  auto b2 = _mm_unpacklo_epi16(a2, a3);
+  auto b3 = _mm_unpackhi_epi16(a2, a3);
+
+  // each vector holds two columns
+  __m128i columns[4] =
+  {
+    _mm_unpacklo_epi32(b0, b2),
+    _mm_unpackhi_epi32(b0, b2),
+    _mm_unpacklo_epi32(b1, b3),
+    _mm_unpackhi_epi32(b1, b3),
+  };
+
+  for (int i = 0; i < 4; i++)
+  {
+    _mm_storel_epi64((__m128i*) (dst + (2 * i) * dst_stride), columns[i]);
+    _mm_storel_epi64((__m128i*) (dst + (2 * i + 1) * dst_stride),
+                     _mm_unpackhi_epi64(columns[i], columns[i]));
+  }
+}
+
+
+TARGET_SSE2
+void transposeBlock4x4x32SSE2(const unsigned char *src, size_t src_stride,
+                              unsigned char *dst, size_t dst_stride)
+{
+  // only moves - the float operations don't alter the bits
+  auto r0 = _mm_loadu_ps((const float*) (src + 0 * src_stride));
+  auto r1 = _mm_loadu_ps((const float*) (src + 1 * src_stride));
+  auto r2 = _mm_loadu_ps((const float*) (src + 2 * src_stride));
+  auto r3 = _mm_loadu_ps((const float*) (src + 3 * src_stride));
+
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+  _mm_storeu_ps((float*) (dst + 0 * dst_stride), r0);
+  _mm_storeu_ps((float*) (dst + 1 * dst_stride), r1);
+  _mm_storeu_ps((float*) (dst + 2 * dst_stride), r2);
+  _mm_storeu_ps((float*) (dst + 3 * dst_stride), r3);
+}
+
+
+void transposeSSE2(const unsigned char *src, size_t src_stride,
+                   unsigned char *dst, size_t dst_stride,
+                   size_t pixel_size, int w, int h)
+{
+  switch (pixel_size)
+  {
+    case 1:
+      transposeBlocked<8, transposeBlock8x8x8SSE2>(src, src_stride, dst, dst_stride,
+                                                   pixel_size, w, h);
+      break;
+    case 4:
+      transposeBlocked<4, transposeBlock4x4x32SSE2>(src, src_stride, dst, dst_stride,
+                                                    pixel_size, w, h);
+      break;
+    default:
+      transposeScalar(src, src_stride, dst, dst_stride, pixel_size, w, h);
+  }
+}
+
+
+// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 - in each 128 bit lane
+#define INTERLEAVE_XYZ(SUFFIX, TYPE) \
+  auto xy_low = _mm##SUFFIX##_unpacklo_ps(x, y); \
+  auto xy_high = _mm##SUFFIX##_unpackhi_ps(x, y); \
+  auto z0_x1 = _mm##SUFFIX##_shuffle_ps(z, xy_low, _MM_SHUFFLE(2, 2, 0, 0)); \
+  auto y1_z1 = _mm##SUFFIX##_shuffle_ps(xy_low, z, _MM_SHUFFLE(1, 1, 3, 3)); \
+  auto z2_x3 = _mm##SUFFIX##_shuffle_ps(z, xy_high, _MM_SHUFFLE(2, 2, 2, 2)); \
+  auto y3_z3 = _mm##SUFFIX##_shuffle_ps(xy_high, z, _MM_SHUFFLE(3, 3, 3, 3)); \
+  TYPE out0 = _mm##SUFFIX##_shuffle_ps(xy_low, z0_x1, _MM_SHUFFLE(2, 0, 1, 0)); \
+  TYPE out1 = _mm##SUFFIX##_shuffle_ps(y1_z1, xy_high, _MM_SHUFFLE(1, 0, 2, 0)); \
+  TYPE out2 = _mm##SUFFIX##_shuffle_ps(z2_x3, y3_z3, _MM_SHUFFLE(2, 0, 2, 0));
+
+
+TARGET_SSE2 inline void storeInterleavedSSE2(float *dst, __m128 x, __m128 y, __m128 z)
+{
+  INTERLEAVE_XYZ(, __m128)
+  _mm_storeu_ps(dst + 0, out0);
+  _mm_storeu_ps(dst + 4, out1);
+  _mm_storeu_ps(dst + 8, out2);
+}
+
+
+TARGET_SSE2
+void calcNormalRowSSE2(const float *previous_row, const float *row, const float *next_row,
+                       float *dst, size_t num_pixels, float grid_scale)
+{
+  const auto two = _mm_set1_ps(2);
+  const auto one = _mm_set1_ps(1);
+  const auto z = _mm_set1_ps(6 * grid_scale);
+  const auto z_squared = _mm_mul_ps(z, z);
+
+  size_t i = 0;
+  for (; i + 4 <= num_pixels; i += 4)
+  {
+    auto p_left = _mm_loadu_ps(previous_row + i - 1);
+    auto p = _mm_loadu_ps(previous_row + i);
+    auto r_left = _mm_loadu_ps(row + i - 1);
+    auto r_right = _mm_loadu_ps(row + i + 1);
+    auto n = _mm_loadu_ps(next_row + i);
+    auto n_right = _mm_loadu_ps(next_row + i + 1);
+
+    auto x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(two, _mm_sub_ps(r_left, r_right)),
+                                   _mm_sub_ps(n, n_right)),
+                        _mm_sub_ps(p_left, p));
+    auto y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(two, _mm_sub_ps(p, n)),
+                                   _mm_sub_ps(r_right, n_right)),
+                        _mm_sub_ps(p_left, r_left));
+
+    auto length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), z_squared);
+    auto scale = _mm_div_ps(one, _mm_sqrt_ps(length_squared));
+
+    storeInterleavedSSE2(dst + i * 3, _mm_mul_ps(x, scale), _mm_mul_ps(y, scale),
+                         _mm_mul_ps(z, scale));
+  }
+
+  calcNormalRowScalar(previous_row + i, row + i, next_row + i, dst + i * 3,
+                      num_pixels - i, grid_scale);
+}
+
+
+const Kernels SSE2_KERNELS
+{
+  fillRowSSE2,
+  reverseRowSSE2,
+  extractComponentSSE2,
+  convertToFloatSSE2,
+  convertToByteSSE2,
+  transposeSSE2,
+  calcNormalRowSSE2,
+};
+
+
+//
+// AVX2
+//
+
+TARGET_AVX2
+void fillRowAVX2(unsigned char *dst, const void *pixel, size_t pixel_size, size_t num_pixels)
+{
+  constexpr size_t MAX_PATTERN_SIZE = 128;
+
+  size_t pattern_size = lcm(pixel_size, sizeof(__m256i));
+  if (pattern_size > MAX_PATTERN_SIZE)
+  {
+    fillRowSSE2(dst, pixel, pixel_size, num_pixels);
+    return;
+  }
+
+  unsigned char pattern[MAX_PATTERN_SIZE];
+  for (size_t i = 0; i < pattern_size; i += pixel_size)
+    memcpy(pattern + i, pixel, pixel_size);
+
+  size_t num_vectors = pattern_size / sizeof(__m256i);
+  __m256i vectors[MAX_PATTERN_SIZE / sizeof(__m256i)];
+  for (size_t i = 0; i < num_vectors; i++)
+    vectors[i] = _mm256_loadu_si256((const __m256i*) pattern + i);
+
+  size_t size = pixel_size * num_pixels;
+  size_t pos = 0;
+  for (; pos + pattern_size <= size; pos += pattern_size)
+  {
+    for (size_t i = 0; i < num_vectors; i++)
+      _mm256_storeu_si256((__m256i*) (dst + pos) + i, vectors[i]);
+  }
+
+  memcpy(dst + pos, pattern, size - pos);
+}
+
+
+template <size_t PIXEL_SIZE>
+TARGET_AVX2 inline __m256i reversePixelsAVX2(__m256i v)
+{
+  if constexpr (PIXEL_SIZE == 16)
+  {
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+  }
+  else if constexpr (PIXEL_SIZE == 8)
+  {
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  else if constexpr (PIXEL_SIZE == 4)
+  {
+    return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  }
+  else
+  {
+    // reverse within the lanes, then swap the lanes
+    __m256i mask;
+    if constexpr (PIXEL_SIZE == 2)
+    {
+      mask = _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                              14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    }
+    else
+    {
+      static_assert(PIXEL_SIZE == 1);
+      mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                              15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    }
+
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, mask), _MM_SHUFFLE(1, 0, 3, 2));
+  }
+}
+
+
+template <size_t PIXEL_SIZE>
+TARGET_AVX2
+void reverseRowFixedAVX2(const unsigned char *src, unsigned char *dst, size_t num_pixels)
+{
+  size_t size = PIXEL_SIZE * num_pixels;
+  size_t pos = 0;
+  for (; pos + sizeof(__m256i) <= size; pos += sizeof(__m256i))
+  {
+    auto v = _mm256_loadu_si256((const __m256i*) (src + pos));
+    _mm256_storeu_si256((__m256i*) (dst + size - pos - sizeof(__m256i)),
+                        reversePixelsAVX2<PIXEL_SIZE>(v));
+  }
+
+  reverseRowScalar(src + pos, dst, PIXEL_SIZE, (size - pos) / PIXEL_SIZE);
+}
+
+
+void reverseRowAVX2(const unsigned char *src, unsigned char *dst,
+                    size_t pixel_size, size_t num_pixels)
+{
+  switch (pixel_size)
+  {
+    case 1:
+      reverseRowFixedAVX2<1>(src, dst, num_pixels);
+      break;
+    case 2:
+      reverseRowFixedAVX2<2>(src, dst, num_pixels);
+      break;
+    case 4:
+      reverseRowFixedAVX2<4>(src, dst, num_pixels);
+      break;
+    case 8:
+      reverseRowFixedAVX2<8>(src, dst, num_pixels);
+      break;
+    case 16:
+      reverseRowFixedAVX2<16>(src, dst, num_pixels);
+      break;
+    default:
+      reverseRowScalar(src, dst, pixel_size, num_pixels);
+  }
+}
+
+
+TARGET_AVX2
+size_t extractComponentRGBA8AVX2(const unsigned char *src, unsigned char *dst,
+                                 size_t component, size_t num_pixels)
+{
+  auto shift = _mm_cvtsi32_si128(8 * component);
+  auto mask = _mm256_set1_epi32(0xFF);
+  // the packs interleave the lanes
+  auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  auto in = (const __m256i*) src;
+
+  size_t i = 0;
+  for (; i + 32 <= num_pixels; i += 32, in += 4)
+  {
+    auto a = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(in + 0), shift), mask);
+    auto b = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(in + 1), shift), mask);
+    auto c = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(in + 2), shift), mask);
+    auto d = _mm256_and_si256(_mm256_srl_epi32(_mm256_loadu_si256(in + 3), shift), mask);
+
+    auto packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_permutevar8x32_epi32(packed, order));
+  }
+
+  return i;
+}
+
+
+void extractComponentAVX2(const unsigned char *src, unsigned char *dst,
+                          size_t component_size, size_t num_components, size_t component,
+                          size_t num_pixels)
+{
+  size_t num_done = 0;
+
+  if (num_components == 4 && component_size == 1)
+    num_done = extractComponentRGBA8AVX2(src, dst, component, num_pixels);
+
+  extractComponentSSE2(src + num_done * num_components * component_size,
+                       dst + num_done * component_size,
+                       component_size, num_components, component,
+                       num_pixels - num_done);
+}
+
+
+TARGET_AVX2
+void convertToFloatAVX2(const unsigned char *src, float *dst, size_t num_values)
+{
+  size_t i = 0;
+  for (; i + 8 <= num_values; i += 8)
+  {
+    auto v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));
+  }
+
+  convertToFloatScalar(src + i, dst + i, num_values - i);
+}
+
+
+TARGET_AVX2
+void convertToByteAVX2(const float *src, unsigned char *dst, size_t num_values)
+{
+  auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  // clamped like in convertToByteSSE2()
+  auto zero = _mm256_setzero_ps();
+  auto upper = _mm256_set1_ps(255);
+
+  size_t i = 0;
+  for (; i + 32 <= num_values; i += 32)
+  {
+    auto a = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 0), zero), upper));
+    auto b = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), zero), upper));
+    auto c = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 16), zero), upper));
+    auto d = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 24), zero), upper));
+
+    auto packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_permutevar8x32_epi32(packed, order));
+  }
+
+  convertToByteSSE2(src + i, dst + i, num_values - i);
+}
+
+
+TARGET_AVX2
+void transposeBlock8x8x32AVX2(const unsigned char *src, size_t src_stride,
+                              unsigned char *dst, size_t dst_stride)
+{
+  __m256 r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_ps((const float*) (src + i * src_stride));
+
+  __m256 t[8];
+  for (int i = 0; i < 4; i++)
+  {
+    t[2 * i] = _mm256_unpacklo_ps(r[2 * i], r[2 * i + 1]);
+    t[2 * i + 1] = _mm256_unpackhi_ps(r[2 * i], r[2 * i + 1]);
+  }
+
+  __m256 s[8];
+  for (int i = 0; i < 2; i++)
+  {
+    s[4 * i + 0] = _mm256_shuffle_ps(t[4 * i + 0], t[4 * i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    s[4 * i + 1] = _mm256_shuffle_ps(t[4 * i + 0], t[4 * i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    s[4 * i + 2] = _mm256_shuffle_ps(t[4 * i + 1], t[4 * i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    s[4 * i + 3] = _mm256_shuffle_ps(t[4 * i + 1], t[4 * i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+
+  for (int i = 0; i < 4; i++)
+  {
+    _mm256_storeu_ps((float*) (dst + i * dst_stride),
+                     _mm256_permute2f128_ps(s[i], s[i + 4], 0x20));
+    _mm256_storeu_ps((float*) (dst + (i + 4) * dst_stride),
+                     _mm256_permute2f128_ps(s[i], s[i + 4], 0x31));
+  }
+}
+
+
+void transposeAVX2(const unsigned char *src, size_t src_stride,
+                   unsigned char *dst, size_t dst_stride,
+                   size_t pixel_size, int w, int h)
+{
+  if (pixel_size == 4)
+  {
+    transposeBlocked<8, transposeBlock8x8x32AVX2>(src, src_stride, dst, dst_stride,
+                                                  pixel_size, w, h);
+  }
+  else
+  {
+    transposeSSE2(src, src_stride, dst, dst_stride, pixel_size, w, h);
+  }
+}
+
+
+TARGET_AVX2 inline void storeInterleavedAVX2(float *dst, __m256 x, __m256 y, __m256 z)
+{
+  // the low lanes hold the first four normals, the high lanes the others
+  INTERLEAVE_XYZ(256, __m256)
+  _mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(out0, out1, 0x20));
+  _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(out2, out0, 0x30));
+  _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(out1, out2, 0x31));
+}
+
+
+TARGET_AVX2
+void calcNormalRowAVX2(const float *previous_row, const float *row, const float *next_row,
+                       float *dst, size_t num_pixels, float grid_scale)
+{
+  const auto two = _mm256_set1_ps(2);
+  const auto one = _mm256_set1_ps(1);
+  const auto z = _mm256_set1_ps(6 * grid_scale);
+  const auto z_squared = _mm256_mul_ps(z, z);
+
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8)
+  {
+    auto p_left = _mm256_loadu_ps(previous_row + i - 1);
+    auto p = _mm256_loadu_ps(previous_row + i);
+    auto r_left = _mm256_loadu_ps(row + i - 1);
+    auto r_right = _mm256_loadu_ps(row + i + 1);
+    auto n = _mm256_loadu_ps(next_row + i);
+    auto n_right = _mm256_loadu_ps(next_row + i + 1);
+
+    auto x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(two, _mm256_sub_ps(r_left, r_right)),
+                                         _mm256_sub_ps(n, n_right)),
+                           _mm256_sub_ps(p_left, p));
+    auto y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(two, _mm256_sub_ps(p, n)),
+                                         _mm256_sub_ps(r_right, n_right)),
+                           _mm256_sub_ps(p_left, r_left));
+
+    auto length_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+                                        z_squared);
+    auto scale = _mm256_div_ps(one, _mm256_sqrt_ps(length_squared));
+
+    storeInterleavedAVX2(dst + i * 3, _mm256_mul_ps(x, scale), _mm256_mul_ps(y, scale),
+                         _mm256_mul_ps(z, scale));
+  }
+
+  calcNormalRowSSE2(previous_row + i, row + i, next_row + i, dst + i * 3,
+                    num_pixels - i, grid_scale);
+}
+
+
+const Kernels AVX2_KERNELS
+{
+  fillRowAVX2,
+  reverseRowAVX2,
+  extractComponentAVX2,
+  convertToFloatAVX2,
+  convertToByteAVX2,
+  transposeAVX2,
+  calcNormalRowAVX2,
+};
+
+#endif // RENDER_UTIL_IMAGE_KERNELS_X86
+
+
+atomic<InstructionSet> &currentInstructionSet()
+{
+  static atomic<InstructionSet> instruction_set { getBestInstructionSet() };
+  return instruction_set;
+}
+
+
+const Kernels &getKernels()
+{
+#if RENDER_UTIL_IMAGE_KERNELS_X86
+  switch (currentInstructionSet().load(memory_order_relaxed))
+  {
+    case InstructionSet::AVX2:
+      return AVX2_KERNELS;
+    case InstructionSet::SSE2:
+      return SSE2_KERNELS;
+    case InstructionSet::SCALAR:
+      break;
+  }
+#endif
+  return SCALAR_KERNELS;
+}
+
+
+} // namespace
+
+
+namespace render_util::image::kernels
+{
+
+
+InstructionSet getBestInstructionSet()
+{
+#if RENDER_UTIL_IMAGE_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return InstructionSet::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return InstructionSet::SSE2;
+#endif
+  return InstructionSet::SCALAR;
+}
+
+
+InstructionSet getInstructionSet()
+{
+  return currentInstructionSet();
+}
+
+
+void setInstructionSet(InstructionSet instruction_set)
+{
+  assert(instruction_set <= getBestInstructionSet());
+  currentInstructionSet() = instruction_set;
+}
+
+
+const char *getInstructionSetName(InstructionSet instruction_set)
+{
+  switch (instruction_set)
+  {
+    case InstructionSet::SCALAR:
+      return "scalar";
+    case InstructionSet::SSE2:
+      return "SSE2";
+    case InstructionSet::AVX2:
+      return "AVX2";
+  }
+  abort();
+}
+
+
+void fillRow(unsigned char *dst, const void *pixel, size_t pixel_size, size_t num_pixels)
+{
+  getKernels().fill_row(dst, pixel, pixel_size, num_pixels);
+}
+
+
+void reverseRow(const unsigned char *src, unsigned char *dst,
+                size_t pixel_size, size_t num_pixels)
+{
+  assert(src + pixel_size * num_pixels <= dst || dst + pixel_size * num_pixels <= src);
+  getKernels().reverse_row(src, dst, pixel_size, num_pixels);
+}
+
+
+void extractComponent(const unsigned char *src, unsigned char *dst,
+                      size_t component_size, size_t num_components, size_t component,
+                      size_t num_pixels)
+{
+  assert(component < num_components);
+  getKernels().extract_component(src, dst, component_size, num_components, component,
+                                 num_pixels);
+}
+
+
+void convertRow(const unsigned char *src, float *dst, size_t num_values)
+{
+  getKernels().convert_to_float(src, dst, num_values);
+}
+
+
+void convertRow(const float *src, unsigned char *dst, size_t num_values)
+{
+  getKernels().convert_to_byte(src, dst, num_values);
+}
+
+
+void transpose(const unsigned char *src, size_t src_stride,
+               unsigned char *dst, size_t dst_stride,
+               size_t pixel_size, int w, int h)
+{
+  assert(w >= 0);
+  assert(h >= 0);
+  getKernels().transpose(src, src_stride, dst, dst_stride, pixel_size, w, h);
+}
+
+void calcNormalRow(const float *previous_row, const float *row, const float *next_row,
+                   float *dst, size_t num_pixels, float grid_scale)
+{
+  getKernels().calc_normal_row(previous_row, row, next_row, dst, num_pixels, grid_scale);
+}
+
+
+} // namespace render_util::image::kernels
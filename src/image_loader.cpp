@@ -18,9 +18,11 @@
  */
 
 #include <render_util/image_loader.h>
+#include <render_util/texture_container.h>
 #include <log.h>
 
 #include <iostream>
+#include <limits>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_ONLY_TGA
@@ -28,6 +30,60 @@
 
 #include "stb_image.h"
 
+
+std::unique_ptr<render_util::ImageStorage>
+render_util::decodeImage(const unsigned char *data,
+                         size_t data_size,
+                         int force_channels,
+                         glm::ivec2 &size,
+                         int &num_channels)
+{
+  if (data_size > size_t(std::numeric_limits<int>::max()))
+  {
+    LOG_ERROR << "error loading image: file too large" << std::endl;
+    return {};
+  }
+
+  int width = 0;
+  int height = 0;
+  int channels_in_file = 0;
+
+  unsigned char *image_data =
+    stbi_load_from_memory(data, data_size, &width, &height, &channels_in_file, force_channels);
+
+  if (!image_data)
+  {
+    LOG_ERROR << "error loading image: " << stbi_failure_reason() << std::endl;
+    return {};
+  }
+
+  size = glm::ivec2(width, height);
+  num_channels = force_channels ? force_channels : channels_in_file;
+
+  return std::make_unique<AdoptedImageStorage>(image_data,
+                                               size_t(width) * height * num_channels,
+                                               stbi_image_free);
+}
+
+
+std::unique_ptr<render_util::ImageStorage>
+render_util::mapImageFile(const std::string &file_path, size_t offset, size_t size, bool quiet)
+{
+  auto file = util::MappedFile::open(file_path, quiet);
+  if (!file)
+    return {};
+
+  if (offset + size > file->getSize())
+  {
+    LOG_ERROR << file_path << " is too small: " << file->getSize() << " bytes, expected "
+              << offset + size << std::endl;
+    return {};
+  }
+
+  return std::make_unique<MappedImageStorage>(std::move(file), offset, size);
+}
+
+
 bool render_util::loadImageFromMemory(const std::vector<char> &data_in,
                           std::vector<unsigned char> &data_out,
                           int &width,
@@ -130,16 +186,42 @@ namespace
 
 void render_util::getImageInfo(util::File &file, glm::ivec2 &size, int &num_components)
 {
+  ImageInfo info;
+  auto res = getImageInfo(file, info);
+  assert(res);
+
+  size = info.size;
+  num_components = info.num_components;
+}
+
+
+bool render_util::getImageInfo(util::File &file, ImageInfo &info)
+{
+  info = {};
+
+  // enough for any container header
+  unsigned char header[256];
+  int header_size = file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+  file.rewind();
+
+  if (header_size > 0 && isTextureContainer(header, header_size))
+    return getTextureContainerInfo(header, header_size, info);
 
   int x, y, comp;
 
   auto res = stbi_info_from_callbacks(&g_callbacks, &file, &x, &y, &comp);
-  assert(res);
 
   file.rewind();
 
-  size = glm::ivec2(x,y);
-  num_components = comp;
+  if (!res)
+    return false;
+
+  info.file_format = ImageFileFormat::ENCODED;
+  info.size = glm::ivec2(x,y);
+  info.num_components = comp;
+
+  return true;
 }
 
 
@@ -157,7 +239,7 @@ bool render_util::loadImage(util::File &file,
 
   if (image_data)
   {
-    //FIXME don't copy but pass buffer and deleter
+    // loadImage(util::File&, int) adopts the buffer instead of copying
 
     if (force_channels)
       channels = force_channels;
@@ -179,15 +261,30 @@ bool render_util::loadImage(util::File &file,
 
 std::unique_ptr<render_util::GenericImage> render_util::loadImage(util::File &file, int force_channels)
 {
-  std::vector<unsigned char> data;
   int width = 0;
   int height = 0;
   int channels = 0;
 
-  if (loadImage(file, data, width, height, channels, force_channels))
+  auto image_data = stbi_load_from_callbacks(&g_callbacks, &file, &width, &height, &channels,
+                                             force_channels);
+
+  file.rewind();
+
+  if (image_data)
   {
-    return std::make_unique<GenericImage>(glm::ivec2(width, height), std::move(data), channels);
+    if (force_channels)
+      channels = force_channels;
+
+    std::unique_ptr<ImageStorage> storage =
+      std::make_unique<AdoptedImageStorage>(image_data,
+                                            size_t(width) * height * channels,
+                                            stbi_image_free);
+
+    return std::make_unique<GenericImage>(glm::ivec2(width, height), std::move(storage), channels);
   }
   else
+  {
+    LOG_ERROR << "error loading image: " << stbi_failure_reason() << std::endl;
     return {};
+  }
 }
@@ -0,0 +1,252 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/image_resample.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+using namespace std;
+using namespace render_util;
+
+
+namespace
+{
+
+
+constexpr double PI = 3.14159265358979323846;
+
+
+double getFilterRadius(ResampleFilter filter)
+{
+  switch (filter)
+  {
+    case ResampleFilter::BOX:
+      return 0.5;
+    case ResampleFilter::BILINEAR:
+      return 1.0;
+    case ResampleFilter::LANCZOS3:
+      return 3.0;
+  }
+  abort();
+}
+
+
+double sinc(double x)
+{
+  if (x == 0.0)
+    return 1.0;
+  x *= PI;
+  return sin(x) / x;
+}
+
+
+// x is in units of the (possibly widened) filter
+double evaluateFilter(ResampleFilter filter, double x)
+{
+  x = abs(x);
+
+  switch (filter)
+  {
+    case ResampleFilter::BOX:
+      return x < 0.5 ? 1.0 : 0.0;
+    case ResampleFilter::BILINEAR:
+      return x < 1.0 ? 1.0 - x : 0.0;
+    case ResampleFilter::LANCZOS3:
+      return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+  }
+  abort();
+}
+
+
+int applyEdgeMode(int index, int size, ResampleEdgeMode edge_mode)
+{
+  switch (edge_mode)
+  {
+    case ResampleEdgeMode::CLAMP:
+      return clamp(index, 0, size - 1);
+    case ResampleEdgeMode::WRAP:
+      index %= size;
+      return index < 0 ? index + size : index;
+  }
+  abort();
+}
+
+
+template <int N>
+void resampleRowFixed(const float *src, float *dst, const ResampleWeights &weights)
+{
+  auto indices = weights.indices.data();
+  auto factors = weights.weights.data();
+
+  for (int x = 0; x < weights.dst_size; x++)
+  {
+    float sum[N] = {};
+
+    for (int tap = 0; tap < weights.num_taps; tap++)
+    {
+      auto pixel = src + *indices++ * N;
+      auto weight = *factors++;
+      for (int c = 0; c < N; c++)
+        sum[c] += weight * pixel[c];
+    }
+
+    for (int c = 0; c < N; c++)
+      *dst++ = sum[c];
+  }
+}
+
+
+} // namespace
+
+
+ResampleWeights render_util::createResampleWeights(int src_size, int dst_size,
+                                                   ResampleFilter filter,
+                                                   ResampleEdgeMode edge_mode)
+{
+  assert(src_size > 0);
+  assert(dst_size > 0);
+
+  const double scale = double(src_size) / double(dst_size);
+
+  // widen the filter when minifying so that every source pixel contributes
+  const double filter_scale = max(scale, 1.0);
+  const double support = getFilterRadius(filter) * filter_scale;
+
+  vector<vector<pair<int, float>>> taps(dst_size);
+  size_t max_taps = 1;
+
+  for (int i = 0; i < dst_size; i++)
+  {
+    const double center = (i + 0.5) * scale - 0.5;
+
+    auto &pixel_taps = taps[i];
+    double sum = 0;
+
+    for (int j = int(ceil(center - support)); j <= int(floor(center + support)); j++)
+    {
+      double weight = 0;
+
+      if (filter == ResampleFilter::BOX && scale > 1.0)
+      {
+        // area average - the coverage of source pixel j by the destination pixel
+        double begin = max(j - 0.5, center - 0.5 * scale);
+        double end = min(j + 0.5, center + 0.5 * scale);
+        weight = max(0.0, end - begin);
+      }
+      else
+      {
+        weight = evaluateFilter(filter, (j - center) / filter_scale);
+      }
+
+      if (weight == 0.0)
+        continue;
+
+      pixel_taps.emplace_back(applyEdgeMode(j, src_size, edge_mode), float(weight));
+      sum += weight;
+    }
+
+    if (pixel_taps.empty())
+    {
+      int nearest = int(floor(center + 0.5));
+      pixel_taps.emplace_back(applyEdgeMode(nearest, src_size, edge_mode), 1.f);
+      sum = 1.0;
+    }
+
+    for (auto &tap : pixel_taps)
+      tap.second = float(tap.second / sum);
+
+    max_taps = max(max_taps, pixel_taps.size());
+  }
+
+  ResampleWeights weights;
+  weights.src_size = src_size;
+  weights.dst_size = dst_size;
+  weights.num_taps = max_taps;
+  weights.indices.reserve(dst_size * max_taps);
+  weights.weights.reserve(dst_size * max_taps);
+
+  for (auto &pixel_taps : taps)
+  {
+    for (size_t tap = 0; tap < max_taps; tap++)
+    {
+      // pad with zero weights so that every pixel has the same number of taps
+      if (tap < pixel_taps.size())
+      {
+        weights.indices.push_back(pixel_taps[tap].first);
+        weights.weights.push_back(pixel_taps[tap].second);
+      }
+      else
+      {
+        weights.indices.push_back(pixel_taps.front().first);
+        weights.weights.push_back(0.f);
+      }
+    }
+  }
+
+  return weights;
+}
+
+
+void render_util::resampleRow(const float *src, float *dst, int num_components,
+                              const ResampleWeights &weights)
+{
+  switch (num_components)
+  {
+    case 1:
+      resampleRowFixed<1>(src, dst, weights);
+      break;
+    case 2:
+      resampleRowFixed<2>(src, dst, weights);
+      break;
+    case 3:
+      resampleRowFixed<3>(src, dst, weights);
+      break;
+    case 4:
+      resampleRowFixed<4>(src, dst, weights);
+      break;
+    default:
+    {
+      auto indices = weights.indices.data();
+      auto factors = weights.weights.data();
+
+      for (int x = 0; x < weights.dst_size; x++)
+      {
+        fill(dst, dst + num_components, 0.f);
+
+        for (int tap = 0; tap < weights.num_taps; tap++)
+        {
+          auto pixel = src + *indices++ * num_components;
+          auto weight = *factors++;
+          for (int c = 0; c < num_components; c++)
+            dst[c] += weight * pixel[c];
+        }
+
+        dst += num_components;
+      }
+    }
+  }
+}
+
+
+void render_util::accumulateRow(const float *src, float weight, float *dst, size_t num_values)
+{
+  for (size_t i = 0; i < num_values; i++)
+    dst[i] += weight * src[i];
+}
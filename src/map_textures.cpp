@@ -16,7 +16,7 @@
  *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <FastNoise.h>
+#include "procedural_textures.h"
 #include <render_util/map_textures.h>
 #include <render_util/texture_util.h>
 #include <render_util/texunits.h>
@@ -29,8 +29,8 @@
 
 #include <cassert>
 #include <iostream>
+#include <chrono>
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtc/noise.hpp>
 #include <GL/gl.h>
 
 #include <render_util/gl_binding/gl_functions.h>
@@ -110,80 +110,28 @@ public:
 };
 
 
-TexturePtr createNoiseTexture()
-{
-  auto image = image::create<unsigned char>(0, glm::ivec2(2048));
+const std::string PROCEDURAL_TEXTURES_CACHE_DIR = RENDER_UTIL_CACHE_DIR "/procedural_textures";
 
-  const double pi = util::PI;
 
-  const double x1 = 0;
-  const double y1 = 0;
-  const double x2 = 800;
-  const double y2 = 800;
-
-//   siv::PerlinNoise noise_generator;
-  FastNoise noise_generator;
-  noise_generator.SetFrequency(0.4);
+ImageGreyScale::Ptr convertToGreyScale(const Image<float> &image)
+{
+  auto converted = make_shared<ImageGreyScale>(image.size());
 
-  for (int y = 0; y < image->h(); y++)
+  for (int y = 0; y < image.h(); y++)
   {
-    for (int x = 0; x < image->w(); x++)
-    {
-      double s = (double)x / image->w();
-      double t = (double)y / image->h();
-      double dx=x2-x1;
-      double dy=y2-y1;
-
-      double nx=x1+cos(s*2*pi)*dx/(2*pi);
-      double ny=y1+cos(t*2*pi)*dy/(2*pi);
-      double nz=x1+sin(s*2*pi)*dx/(2*pi);
-      double nw=y1+sin(t*2*pi)*dy/(2*pi);
-      
-//       glm::dvec4 params(nx, ny, nz, nw);
-//       glm::vec2 params(s, t);
-      
-//       double value = glm::perlin(params);
-      
-//       double value = noise_generator.octaveNoise(nx, ny, nz, nw);
-      
-      double value = noise_generator.GetSimplex(nx, ny, nz, nw);
-     
-//       double value = glm::simplex(params);
-//       value = glm::clamp(value, 0.0, 1.0);
-      
-//       LOG_INFO<<"value:"<<value<<endl
-
-//       assert(value <= 1);
-      
-      
-
-//       assert(value < 0.006);
-
-      assert(!isnan(value));
-      assert(value >= -1);
-      assert(value <= 1);
-
-      value += 1;
-      value /= 2;
-
-//       value = glm::clamp(value, 0.0f, 1.0f);
-      
-//       value *= 0.0;
-      
-      value *= 255;
-
-      image->at(x,y) = value;
-    }
+    for (int x = 0; x < image.w(); x++)
+      converted->at(x,y) = image.get(x,y) * 255;
   }
-  
-//   image->setPixel(0, 0, 255);
-//   image->setPixel(0, 1, 255);
-//   image->setPixel(1, 0, 255);
-//   image->setPixel(1, 1, 255);
 
-//   saveImageToFile("noise.tga", image.get());
-  
-  TexturePtr texture = createTexture(image);
+  return converted;
+}
+
+
+TexturePtr createNoiseTexture()
+{
+  auto image = getNoiseImage(NoiseParameters(), PROCEDURAL_TEXTURES_CACHE_DIR);
+
+  TexturePtr texture = createTexture(convertToGreyScale(*image));
 
   TextureParameters<int> params;
   params.set(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -194,36 +142,9 @@ TexturePtr createNoiseTexture()
 }
 
 
-float sampleShoreWave(float pos)
-{
-  const float peak_pos = 0.05;
-
-  if (pos < peak_pos)
-  {
-    pos = pos /= peak_pos;
-    return pow(pos, 2);
-  }
-  else
-  {
-    pos -= peak_pos;
-    pos /= 1.0 - peak_pos;
-    return pow(1 - pos, 8);
-  }
-}
-
-
 ImageGreyScale::Ptr createShoreWaveTexture()
 {
-  auto shore_wave = render_util::image::create<unsigned char>(0, glm::ivec2(4096, 1));
-  assert(shore_wave);
-  for (int i = 0; i < shore_wave->w(); i++)
-  {
-    float pos = 1.0 * i;
-    pos /= shore_wave->w();
-    float value = sampleShoreWave(pos);
-    shore_wave->at(i,0) = value * 255;
-  }
-  return shore_wave;
+  return convertToGreyScale(*getShoreWaveImage(4096, PROCEDURAL_TEXTURES_CACHE_DIR));
 }
 
 
@@ -239,7 +160,9 @@ TexturePtr createTextureArray(const std::vector<ImageRGBA::ConstPtr> &textures)
   }
 
   LOG_INFO << "resampling textures ... done." << endl;
-  return render_util::createTextureArray<ImageRGBA>(textures_resampled);
+  return render_util::createCompressedTextureArray<ImageRGBA>(textures_resampled,
+                                         TextureCompression::COLOR,
+                                         getDefaultCompressedTextureCacheDir());
 }
 
 
@@ -252,6 +175,8 @@ struct render_util::MapTextures::Private
   glm::vec3 water_color = glm::vec3(0);
   glm::ivec2 water_map_table_size = glm::ivec2(0);
   ShaderParameters shader_params;
+  bool has_procedural_textures = false;
+  int num_binds = 0;
 };
 
 
@@ -276,15 +201,29 @@ const render_util::ShaderParameters &render_util::MapTextures::getShaderParamete
 
 void render_util::MapTextures::bind(TextureManager &mgr)
 {
-  //HACK
-  setTexture(TEXUNIT_SHORE_WAVE, createShoreWaveTexture());
+  using Clock = chrono::steady_clock;
 
-  //HACK
-  p->m_material->setTexture(TEXUNIT_GENERIC_NOISE, createNoiseTexture());
+  auto start = Clock::now();
+
+  // created here because they are not set by the map loaders
+  if (!p->has_procedural_textures)
+  {
+    setTexture(TEXUNIT_SHORE_WAVE, createShoreWaveTexture());
+    p->m_material->setTexture(TEXUNIT_GENERIC_NOISE, createNoiseTexture());
+    p->has_procedural_textures = true;
+  }
 
   p->m_material->bind(mgr);
 
   CHECK_GL_ERROR();
+
+  chrono::duration<double, milli> elapsed = Clock::now() - start;
+  p->num_binds++;
+
+  if (p->num_binds == 1)
+    LOG_INFO << "MapTextures: first bind took " << elapsed.count() << " ms" << endl;
+  else
+    LOG_INFO << "MapTextures: bind " << p->num_binds << " took " << elapsed.count() << " ms" << endl;
 }
 
 
@@ -0,0 +1,233 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "procedural_textures.h"
+#include <render_util/image_storage.h>
+#include <mapped_file.h>
+#include <thread_pool.h>
+#include <FastNoise.h>
+#include <util.h>
+#include <log.h>
+
+#include <unordered_map>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+
+using namespace std;
+
+
+namespace
+{
+
+
+using namespace render_util;
+
+using Clock = chrono::steady_clock;
+
+// increment when the output of a generator changes
+constexpr int FORMAT_VERSION = 1;
+
+
+string makeCacheKey(const string &name, const string &description)
+{
+  return name + '_' + util::makeHashString(description);
+}
+
+
+Image<float>::ConstPtr load(const string &path, glm::ivec2 size)
+{
+  auto file = util::MappedFile::open(path, true);
+  if (!file)
+    return {};
+
+  size_t data_size = size_t(size.x) * size.y * sizeof(float);
+  if (file->getSize() != data_size)
+  {
+    LOG_INFO << "Ignoring truncated procedural texture cache " << path << endl;
+    return {};
+  }
+
+  // the mapping is the storage - pages are read when the image is used
+  unique_ptr<ImageStorage> storage = make_unique<MappedImageStorage>(std::move(file), 0, data_size);
+  return make_shared<Image<float>>(size, std::move(storage));
+}
+
+
+void save(const string &dir, const string &path, const Image<float> &image)
+{
+  if (!util::mkdir(dir, true))
+  {
+    LOG_ERROR << "Failed to create directory " << dir << endl;
+    return;
+  }
+
+  util::writeFile(path, reinterpret_cast<const char*>(image.data()), image.dataSize());
+}
+
+
+Image<float>::ConstPtr getCached(const string &key, glm::ivec2 size, const string &cache_dir,
+                                 const function<Image<float>::Ptr()> &generate)
+{
+  static util::Mutex s_mutex;
+  static unordered_map<string, Image<float>::ConstPtr> s_images;
+
+  // generation is parallel itself - holding the lock just keeps concurrent callers
+  // from generating the same image twice
+  util::LockGuard lock(s_mutex);
+
+  auto &image = s_images[key];
+  if (image)
+    return image;
+
+  auto start = Clock::now();
+
+  string path;
+  if (!cache_dir.empty())
+  {
+    path = cache_dir + '/' + key + ".raw";
+    image = load(path, size);
+  }
+
+  if (image)
+  {
+    chrono::duration<double, milli> elapsed = Clock::now() - start;
+    LOG_INFO << "Loaded " << key << " from " << path << " in " << elapsed.count() << " ms" << endl;
+    return image;
+  }
+
+  auto generated = generate();
+  assert(generated->size() == size);
+
+  chrono::duration<double, milli> elapsed = Clock::now() - start;
+  LOG_INFO << "Generated " << key << " in " << elapsed.count() << " ms" << endl;
+
+  if (!path.empty())
+    save(cache_dir, path, *generated);
+
+  image = generated;
+
+  return image;
+}
+
+
+Image<float>::Ptr generateNoise(const NoiseParameters &params)
+{
+  auto image = make_shared<Image<float>>(glm::ivec2(params.size));
+
+  const double pi = util::PI;
+  const double radius = params.period / (2 * pi);
+
+  FastNoise noise_generator(params.seed);
+  noise_generator.SetFrequency(params.frequency);
+
+  // the 2D texture coordinates are mapped onto two circles in 4D, which makes the noise tileable
+  auto generate_row = [&] (int y)
+  {
+    double t = (double)y / image->h();
+    double ny = cos(t * 2 * pi) * radius;
+    double nw = sin(t * 2 * pi) * radius;
+
+    for (int x = 0; x < image->w(); x++)
+    {
+      double s = (double)x / image->w();
+      double nx = cos(s * 2 * pi) * radius;
+      double nz = sin(s * 2 * pi) * radius;
+
+      double value = noise_generator.GetSimplex(nx, ny, nz, nw);
+
+      assert(!isnan(value));
+      assert(value >= -1);
+      assert(value <= 1);
+
+      image->at(x,y) = (value + 1) / 2;
+    }
+  };
+
+  util::ThreadPool::getDefault().parallelFor(image->h(), generate_row, 16);
+
+  return image;
+}
+
+
+float sampleShoreWave(float pos)
+{
+  const float peak_pos = 0.05;
+
+  if (pos < peak_pos)
+  {
+    pos /= peak_pos;
+    return pow(pos, 2);
+  }
+  else
+  {
+    pos -= peak_pos;
+    pos /= 1.0 - peak_pos;
+    return pow(1 - pos, 8);
+  }
+}
+
+
+Image<float>::Ptr generateShoreWave(int size)
+{
+  auto image = make_shared<Image<float>>(glm::ivec2(size, 1));
+
+  for (int i = 0; i < image->w(); i++)
+    image->at(i,0) = sampleShoreWave(float(i) / image->w());
+
+  return image;
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+Image<float>::ConstPtr getNoiseImage(const NoiseParameters &params, const string &cache_dir)
+{
+  assert(params.size > 0);
+
+  ostringstream description;
+  description << setprecision(17)
+              << "noise " << FORMAT_VERSION << ' ' << params.size << ' ' << params.frequency
+              << ' ' << params.period << ' ' << params.seed;
+
+  return getCached(makeCacheKey("noise", description.str()), glm::ivec2(params.size), cache_dir,
+                   [&params] { return generateNoise(params); });
+}
+
+
+Image<float>::ConstPtr getShoreWaveImage(int size, const string &cache_dir)
+{
+  assert(size > 0);
+
+  ostringstream description;
+  description << "shore_wave " << FORMAT_VERSION << ' ' << size;
+
+  return getCached(makeCacheKey("shore_wave", description.str()), glm::ivec2(size, 1), cache_dir,
+                   [size] { return generateShoreWave(size); });
+}
+
+
+} // namespace render_util
@@ -0,0 +1,52 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_PROCEDURAL_TEXTURES_H
+#define RENDER_UTIL_PROCEDURAL_TEXTURES_H
+
+#include <render_util/image.h>
+
+#include <string>
+
+namespace render_util
+{
+
+
+/// parameters of the tileable 4D simplex noise used as generic noise texture
+struct NoiseParameters
+{
+  int size = 2048;
+  double frequency = 0.4;
+  double period = 800;
+  int seed = 1337;
+};
+
+
+/**
+ * Procedural images which only depend on their parameters, with values in [0, 1].
+ * Each image is generated once per process and shared by all callers.
+ * With a non-empty cache_dir it is also stored there as raw float data
+ * and loaded from there by later processes.
+ */
+Image<float>::ConstPtr getNoiseImage(const NoiseParameters&, const std::string &cache_dir = {});
+Image<float>::ConstPtr getShoreWaveImage(int size, const std::string &cache_dir = {});
+
+
+} // namespace render_util
+
+#endif
@@ -0,0 +1,385 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/profiler.h>
+#include <render_util/gl_binding/gl_functions.h>
+#include <util.h>
+#include <log.h>
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cassert>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace render_util::gl_binding;
+using namespace std;
+
+
+namespace
+{
+
+
+constexpr int NUM_QUERIES_PER_ALLOCATION = 64;
+
+
+/// as microseconds with fractions, which the trace format expects
+void writeMicroseconds(ostream &out, int64_t ns)
+{
+  char str[32];
+  snprintf(str, sizeof(str), "%.3f", ns / 1000.0);
+  out << str;
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+void Profiler::Samples::add(float duration_ms)
+{
+  if (durations_ms.size() < NUM_SAMPLES)
+  {
+    durations_ms.push_back(duration_ms);
+  }
+  else
+  {
+    durations_ms[next] = duration_ms;
+    next = (next + 1) % NUM_SAMPLES;
+  }
+}
+
+
+Profiler &Profiler::get()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+
+int Profiler::getThread()
+{
+  auto id = util::getCurrentThreadID();
+
+  auto it = m_threads.find(id);
+  if (it != m_threads.end())
+    return it->second;
+
+  int thread = m_threads.size() + 1;
+  m_threads[id] = thread;
+  return thread;
+}
+
+
+int64_t Profiler::getNanoseconds(Clock::time_point time) const
+{
+  return chrono::duration_cast<chrono::nanoseconds>(time - m_epoch).count();
+}
+
+
+void Profiler::addSample(const char *name, bool is_gpu, int64_t begin_ns, int64_t duration_ns,
+                         int thread, uint64_t frame)
+{
+  m_samples[{ name, is_gpu }].add(duration_ns / 1e6);
+
+  TraceEvent event;
+  event.name = name;
+  event.thread = thread;
+  event.begin_ns = begin_ns;
+  event.duration_ns = duration_ns;
+  event.frame = frame;
+
+  m_trace.push_back(event);
+}
+
+
+void Profiler::addCPUScope(const char *name, Clock::time_point begin, Clock::time_point end)
+{
+  util::LockGuard lock(m_mutex);
+  addSample(name, false, getNanoseconds(begin), getNanoseconds(end) - getNanoseconds(begin),
+            getThread(), m_frame);
+}
+
+
+bool Profiler::checkTimerQueries()
+{
+  if (m_timer_state == TimerState::UNKNOWN)
+  {
+    auto iface = getCurrentInterface();
+
+    bool is_available = iface->GenQueries &&
+                        iface->DeleteQueries &&
+                        iface->QueryCounter &&
+                        iface->GetQueryiv &&
+                        iface->GetQueryObjectiv &&
+                        iface->GetQueryObjectui64v &&
+                        iface->GetInteger64v;
+
+    if (is_available)
+    {
+      GLint num_bits = 0;
+      gl::GetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &num_bits);
+      is_available = num_bits > 0;
+    }
+
+    if (is_available)
+    {
+      m_timer_state = TimerState::AVAILABLE;
+      syncGPUClock();
+    }
+    else
+    {
+      m_timer_state = TimerState::UNAVAILABLE;
+      LOG_INFO<<"Profiler: no timer queries - GPU scopes are timed on the CPU only."<<endl;
+    }
+  }
+
+  return m_timer_state == TimerState::AVAILABLE;
+}
+
+
+unsigned int Profiler::allocQuery()
+{
+  if (m_free_queries.empty())
+  {
+    m_free_queries.resize(NUM_QUERIES_PER_ALLOCATION);
+    gl::GenQueries(m_free_queries.size(), m_free_queries.data());
+  }
+
+  auto query = m_free_queries.back();
+  m_free_queries.pop_back();
+
+  assert(query);
+  return query;
+}
+
+
+void Profiler::syncGPUClock()
+{
+  GLint64 gpu_time_ns = 0;
+  gl::GetInteger64v(GL_TIMESTAMP, &gpu_time_ns);
+
+  m_gpu_clock_offset_ns = getNanoseconds(Clock::now()) - gpu_time_ns;
+}
+
+
+Profiler::GPUScope Profiler::beginGPUScope()
+{
+  if (!checkTimerQueries())
+    return {};
+
+  GPUScope scope;
+  scope.begin_query = allocQuery();
+  scope.end_query = allocQuery();
+
+  gl::QueryCounter(scope.begin_query, GL_TIMESTAMP);
+
+  return scope;
+}
+
+
+void Profiler::endGPUScope(const char *name, GPUScope &scope)
+{
+  if (!scope.begin_query)
+    return;
+
+  gl::QueryCounter(scope.end_query, GL_TIMESTAMP);
+
+  PendingGPUScope pending;
+  pending.name = name;
+  pending.scope = scope;
+  pending.frame = m_frame;
+
+  m_pending_gpu_scopes.push_back(pending);
+}
+
+
+void Profiler::collectGPUScopes()
+{
+  // The queries finish in the order they were issued.
+  while (!m_pending_gpu_scopes.empty())
+  {
+    auto &pending = m_pending_gpu_scopes.front();
+
+    GLint is_available = 0;
+    gl::GetQueryObjectiv(pending.scope.end_query, GL_QUERY_RESULT_AVAILABLE, &is_available);
+    if (!is_available)
+      break;
+
+    GLuint64 begin_ns = 0;
+    GLuint64 end_ns = 0;
+    gl::GetQueryObjectui64v(pending.scope.begin_query, GL_QUERY_RESULT, &begin_ns);
+    gl::GetQueryObjectui64v(pending.scope.end_query, GL_QUERY_RESULT, &end_ns);
+
+    {
+      util::LockGuard lock(m_mutex);
+      addSample(pending.name, true,
+                int64_t(begin_ns) + m_gpu_clock_offset_ns,
+                int64_t(end_ns) - int64_t(begin_ns),
+                0, pending.frame);
+    }
+
+    m_free_queries.push_back(pending.scope.begin_query);
+    m_free_queries.push_back(pending.scope.end_query);
+
+    m_pending_gpu_scopes.pop_front();
+  }
+}
+
+
+void Profiler::nextFrame()
+{
+  if (m_timer_state == TimerState::AVAILABLE)
+  {
+    collectGPUScopes();
+    syncGPUClock();
+  }
+
+  auto now = Clock::now();
+
+  util::LockGuard lock(m_mutex);
+
+  if (isEnabled())
+  {
+    addSample("frame", false, getNanoseconds(m_frame_begin),
+              getNanoseconds(now) - getNanoseconds(m_frame_begin), getThread(), m_frame);
+  }
+
+  m_frame++;
+  m_frame_begin = now;
+
+  while (!m_trace.empty() && m_trace.front().frame + NUM_TRACE_FRAMES < m_frame)
+    m_trace.pop_front();
+}
+
+
+void Profiler::reset()
+{
+  if (m_timer_state == TimerState::AVAILABLE)
+  {
+    for (auto &pending : m_pending_gpu_scopes)
+    {
+      m_free_queries.push_back(pending.scope.begin_query);
+      m_free_queries.push_back(pending.scope.end_query);
+    }
+
+    if (!m_free_queries.empty())
+      gl::DeleteQueries(m_free_queries.size(), m_free_queries.data());
+  }
+
+  m_pending_gpu_scopes.clear();
+  m_free_queries.clear();
+  m_timer_state = TimerState::UNKNOWN;
+
+  util::LockGuard lock(m_mutex);
+
+  m_samples.clear();
+  m_trace.clear();
+  m_frame_begin = Clock::now();
+}
+
+
+vector<Profiler::ScopeStatistics> Profiler::getStatistics() const
+{
+  util::LockGuard lock(m_mutex);
+
+  vector<ScopeStatistics> statistics;
+
+  for (auto &it : m_samples)
+  {
+    auto durations = it.second.durations_ms;
+    if (durations.empty())
+      continue;
+
+    sort(durations.begin(), durations.end());
+
+    auto get_percentile = [&durations] (double percentile)
+    {
+      size_t index = size_t(percentile / 100.0 * (durations.size() - 1) + 0.5);
+      return durations.at(std::min(index, durations.size() - 1));
+    };
+
+    ScopeStatistics scope;
+    scope.name = it.first.first;
+    scope.is_gpu = it.first.second;
+    scope.num_samples = durations.size();
+    for (auto duration : durations)
+      scope.mean_ms += duration;
+    scope.mean_ms /= durations.size();
+    scope.median_ms = get_percentile(50);
+    scope.p95_ms = get_percentile(95);
+    scope.p99_ms = get_percentile(99);
+    scope.max_ms = durations.back();
+
+    statistics.push_back(scope);
+  }
+
+  return statistics;
+}
+
+
+void Profiler::writeChromeTrace(ostream &out) const
+{
+  util::LockGuard lock(m_mutex);
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+      << "\"args\":{\"name\":\"GPU\"}}";
+
+  for (auto &it : m_threads)
+  {
+    out << "," << endl
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it.second << ","
+        << "\"args\":{\"name\":\"thread " << it.second << "\"}}";
+  }
+
+  for (auto &event : m_trace)
+  {
+    out << "," << endl << "{\"name\":";
+    out << util::quoteJSON(event.name);
+    out << ",\"cat\":\"" << (event.thread ? "cpu" : "gpu") << "\""
+        << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+        << ",\"ts\":";
+    writeMicroseconds(out, event.begin_ns);
+    out << ",\"dur\":";
+    writeMicroseconds(out, event.duration_ns);
+    out << ",\"args\":{\"frame\":" << event.frame << "}}";
+  }
+
+  out << endl << "]}" << endl;
+}
+
+
+bool Profiler::saveChromeTrace(const string &path) const
+{
+  ofstream file(path);
+  if (!file)
+    return false;
+
+  writeChromeTrace(file);
+
+  return bool(file);
+}
+
+
+} // namespace render_util
@@ -20,8 +20,10 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
 #include <cassert>
 #include <cstdlib>
+#include <cctype>
 #include <glm/gtc/type_ptr.hpp>
 #include <GL/gl.h>
 
@@ -29,7 +31,10 @@
 #include <distances.h>
 #include <curvature_map.h>
 #include <render_util/shader.h>
+#include <render_util/uniform_buffer.h>
 #include <render_util/gl_binding/gl_functions.h>
+#include "shader_cache.h"
+#include <util.h>
 #include <log.h>
 
 using namespace render_util::gl_binding;
@@ -205,28 +210,51 @@ Shader::Shader(const std::string &name,
   else
     throw ShaderCreationError();
 
-  vector<char> data;
-
-  vector<string> paths;
-
+  string key = type_str + '\n' + name + '\n';
   for (auto &path : paths_)
-  {
-    paths.push_back(path + '/' + name + ext);
-    paths.push_back(path + '/' + name + ".glsl");
-  }
+    key += path + '\n';
+  key += params.toString();
 
-  for (auto p : paths)
+  auto preprocess = [&] ()
   {
-    if (util::readFile(p, data, true))
+    vector<char> data;
+
+    vector<string> paths;
+
+    for (auto &path : paths_)
     {
-      LOG_TRACE << "sucessully read shader: " << p << endl;
-      m_filename = p;
-      preProcess(data, params, paths_);
-      return;
+      paths.push_back(path + '/' + name + ext);
+      paths.push_back(path + '/' + name + ".glsl");
     }
-  }
 
-  LOG_ERROR << "Failed to read " << type_str << " shader file: " << name << endl;
+    PreprocessedShaderSource source;
+
+    for (auto p : paths)
+    {
+      if (util::readFile(p, data, true))
+      {
+        LOG_TRACE << "sucessully read shader: " << p << endl;
+        m_filename = p;
+        preProcess(data, params, paths_);
+
+        source.filename = m_filename;
+        source.source = m_preprocessed_source;
+        source.includes = m_includes;
+        break;
+      }
+    }
+
+    return source;
+  };
+
+  auto source = getPreprocessedShaderSource(key, preprocess);
+
+  m_filename = source->filename;
+  m_preprocessed_source = source->source;
+  m_includes = source->includes;
+
+  if (m_filename.empty())
+    LOG_ERROR << "Failed to read " << type_str << " shader file: " << name << endl;
 }
 
 
@@ -249,15 +277,11 @@ void Shader::compile()
 
   gl::ShaderSource(id, 1, sources, 0);
 
-  try
   {
+    // some drivers report failed compilation as an error - we check for it anyway
+    ScopedGLCallSite call_site(RENDER_UTIL_GL_CALL_SITE_EXPECTING_ERRORS());
     gl::CompileShader(id);
   }
-  catch (GLError&)
-  {
-    // ignore the error as we check for successful compilation anyway
-    GL_Interface::getCurrent()->clearError();
-  }
 
   GLint success = 0;
   gl::GetShaderiv(id, GL_COMPILE_STATUS, &success);
@@ -363,6 +387,18 @@ void ShaderParameters::set(const std::string &name, const std::string &value)
 }
 
 
+std::string ShaderParameters::toString() const
+{
+  map<string, string> sorted(m_map.begin(), m_map.end());
+
+  string out;
+  for (auto &entry : sorted)
+    out += entry.first + '=' + entry.second + '\n';
+
+  return out;
+}
+
+
 void ShaderParameters::add(const ShaderParameters &other)
 {
   for (auto &entry : other.m_map)
@@ -442,6 +478,7 @@ void ShaderProgram::link()
 void ShaderProgram::create()
 {
   FORCE_CHECK_GL_ERROR();
+  clearGLError(RENDER_UTIL_GL_CALL_SITE());
 
   GLint current_program_save;
   gl::GetIntegerv(GL_CURRENT_PROGRAM, &current_program_save);
@@ -483,6 +520,39 @@ void ShaderProgram::create()
 
   FORCE_CHECK_GL_ERROR();
 
+  bool use_binary_cache = !shaders.empty() && isProgramBinaryCacheAvailable();
+
+  string binary_key;
+  if (use_binary_cache)
+  {
+    binary_key = getBinaryCacheKey();
+    is_valid = loadProgramBinary(id, binary_key);
+  }
+
+  if (!is_valid)
+    compileAndLink(use_binary_cache, binary_key);
+
+  auto error = gl::GetError();
+  assert(error == GL_NO_ERROR || error == GL_INVALID_VALUE);
+  assert(gl::GetError() == GL_NO_ERROR);
+
+  if (isValid())
+  {
+    setUniform<float>("planet_radius", planet_radius);
+    setUniform("atmosphereVisibility", atmosphere_visibility);
+    setUniform("atmosphereHeight", atmosphere_height);
+    setUniform("max_elevation", max_elevation);
+    setUniform("curvature_map_max_distance", curvature_map_max_distance);
+
+    for (unsigned int i = 0; i < UNIFORM_BLOCK_NUM; i++)
+      bindUniformBlock(getUniformBlockName(i), i);
+  }
+
+  FORCE_CHECK_GL_ERROR();
+}
+
+void ShaderProgram::compileAndLink(bool save_binary, const std::string &binary_key)
+{
   for (auto &shader : shaders)
   {
     shader->compile();
@@ -490,6 +560,8 @@ void ShaderProgram::create()
 
   int num_attached = 0;
 
+  clearGLError(RENDER_UTIL_GL_CALL_SITE());
+
   for (auto &shader : shaders)
   {
     if (!shader->getID())
@@ -497,50 +569,49 @@ void ShaderProgram::create()
 
     gl::AttachShader(id, shader->getID());
     num_attached++;
-
-    gl::Finish();
-    GLenum error = gl::GetError();
-    if (error != GL_NO_ERROR)
-    {
-      LOG_ERROR<<"glAttachShader() failed for program "<<name<<", shader: "<<shader->getFileName()<<endl;
-      LOG_ERROR<<"gl error: "<<gl_binding::getGLErrorString(error)<<endl;
-      throw ShaderCreationError();
-    }
   }
 
   for (auto it : attribute_locations)
-  {
     gl::BindAttribLocation(id, it.first, it.second.c_str());
 
-    gl::Finish();
-    GLenum error = gl::GetError();
-    if (error != GL_NO_ERROR)
-    {
-      LOG_ERROR<<"gl::BindAttribLocation() failed for program "<<name<<endl;
-      LOG_ERROR<<"index: "<<it.first<<", name: "<<it.second<<endl;
-      LOG_ERROR<<"gl error: "<<gl_binding::getGLErrorString(error)<<endl;
-      throw ShaderCreationError();
-    }
+  // errors are recorded when the call is made - there's no need to wait for the GPU,
+  // so one check for all calls is enough
+  GLenum error = gl::GetError();
+  if (error != GL_NO_ERROR)
+  {
+    LOG_ERROR<<"glAttachShader() or glBindAttribLocation() failed for program "<<name<<endl;
+    LOG_ERROR<<"gl error: "<<gl_binding::getGLErrorString(error)<<endl;
+    throw ShaderCreationError();
   }
 
-  if (num_attached)
-    link();
+  if (!num_attached)
+    return;
 
-  gl::Finish();
-  auto error = gl::GetError();
-  assert(error == GL_NO_ERROR || error == GL_INVALID_VALUE);
-  assert(gl::GetError() == GL_NO_ERROR);
+  if (save_binary)
+    prepareProgramForBinaryRetrieval(id);
 
-  if (isValid())
-  {
-    setUniform<float>("planet_radius", planet_radius);
-    setUniform("atmosphereVisibility", atmosphere_visibility);
-    setUniform("atmosphereHeight", atmosphere_height);
-    setUniform("max_elevation", max_elevation);
-    setUniform("curvature_map_max_distance", curvature_map_max_distance);
-  }
+  link();
 
-  FORCE_CHECK_GL_ERROR();
+  if (is_valid && save_binary)
+    saveProgramBinary(id, binary_key);
+}
+
+std::string ShaderProgram::getBinaryCacheKey()
+{
+  // everything the linked program depends on
+  string description = getProgramBinaryDriverString() + '\n';
+
+  for (auto &shader : shaders)
+    description += to_string(shader->getType()) + '\n' + shader->getPreprocessedSource() + '\n';
+
+  for (auto &it : attribute_locations)
+    description += to_string(it.first) + '=' + it.second + '\n';
+
+  string name_part;
+  for (char c : name)
+    name_part.push_back(isalnum(c) ? c : '_');
+
+  return name_part + '_' + util::makeHashString(description);
 }
 
 GLuint ShaderProgram::getId()
@@ -584,6 +655,24 @@ void ShaderProgram::assertUniformsAreSet()
 #endif
 }
 
+bool ShaderProgram::bindUniformBlock(const std::string &block_name, unsigned int binding_point)
+{
+  auto index = gl::GetUniformBlockIndex(id, block_name.c_str());
+  if (index == GL_INVALID_INDEX)
+    return false;
+
+  gl::UniformBlockBinding(id, index, binding_point);
+  return true;
+}
+
+void ShaderProgram::markUniformAsSet(int location)
+{
+  // only needed by assertUniformsAreSet()
+#if RENDER_UTIL_ENABLE_DEBUG
+  set_uniforms.insert(location);
+#endif
+}
+
 GLint ShaderProgram::getUniformLocation(const string &name)
 {
   auto it = uniform_locations.find(name);
@@ -598,55 +687,61 @@ GLint ShaderProgram::getUniformLocation(const string &name)
 void ShaderProgram::setUniformi(GLint location, GLint value)
 {
   gl::ProgramUniform1i(id, location, value);
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
+}
+
+void ShaderProgram::setUniform(GLint location, const GLint &value)
+{
+  gl::ProgramUniform1i(id, location, value);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(int location, const bool &value)
 {
   gl::ProgramUniform1i(id, location, value);
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const GLfloat &value)
 {
   gl::ProgramUniform1f(id, location, value);
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const glm::vec2 &value)
 {
   gl::ProgramUniform2fv(id, location, 1, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const glm::vec3 &value)
 {
   gl::ProgramUniform3fv(id, location, 1, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const glm::vec4 &value)
 {
   gl::ProgramUniform4fv(id, location, 1, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const glm::ivec2 &value)
 {
   gl::ProgramUniform2iv(id, location, 1, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(int location, const glm::mat3 &value)
 {
   gl::ProgramUniformMatrix3fv(id, location, 1, false, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 void ShaderProgram::setUniform(GLint location, const glm::mat4 &value)
 {
   gl::ProgramUniformMatrix4fv(id, location, 1, false, value_ptr(value));
-  set_uniforms.insert(location);
+  markUniformAsSet(location);
 }
 
 
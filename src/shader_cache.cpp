@@ -0,0 +1,312 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "shader_cache.h"
+#include <render_util/shader.h>
+#include <render_util/gl_binding/gl_functions.h>
+#include <util.h>
+#include <thread_pool.h>
+#include <log.h>
+
+#include <unordered_map>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace render_util::gl_binding;
+using namespace std;
+
+
+namespace
+{
+
+
+const string CACHE_DIR = RENDER_UTIL_CACHE_DIR "/shader_programs";
+
+constexpr char BINARY_CACHE_MAGIC[8] = { 'R', 'U', 'P', 'R', 'O', 'G', 'B', 'N' };
+
+// increment when the file format changes
+constexpr uint32_t BINARY_CACHE_VERSION = 1;
+
+// far above what drivers produce - a larger size means the file is corrupt
+constexpr uint64_t MAX_BINARY_SIZE = 64 * 1024 * 1024;
+
+
+struct BinaryCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint64_t driver_string_size;
+  uint64_t binary_size;
+};
+
+
+struct Statistics
+{
+  atomic<unsigned long long> num_source_hits { 0 };
+  atomic<unsigned long long> num_source_misses { 0 };
+  atomic<unsigned long long> num_binary_hits { 0 };
+  atomic<unsigned long long> num_binary_misses { 0 };
+  atomic<unsigned long long> num_binary_rejected { 0 };
+};
+
+
+Statistics &getStatistics()
+{
+  static Statistics statistics;
+  return statistics;
+}
+
+
+string getBinaryPath(const string &key)
+{
+  return CACHE_DIR + '/' + key + ".bin";
+}
+
+
+string getString(GLenum name)
+{
+  auto value = gl::GetString(name);
+  return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+ShaderCacheStatistics getShaderCacheStatistics()
+{
+  auto &statistics = getStatistics();
+
+  ShaderCacheStatistics s;
+  s.num_source_hits = statistics.num_source_hits;
+  s.num_source_misses = statistics.num_source_misses;
+  s.num_binary_hits = statistics.num_binary_hits;
+  s.num_binary_misses = statistics.num_binary_misses;
+  s.num_binary_rejected = statistics.num_binary_rejected;
+  return s;
+}
+
+
+std::shared_ptr<const PreprocessedShaderSource>
+getPreprocessedShaderSource(const std::string &key,
+                            const std::function<PreprocessedShaderSource()> &preprocess)
+{
+  static util::Mutex s_mutex;
+  static unordered_map<string, shared_ptr<const PreprocessedShaderSource>> s_sources;
+
+  {
+    util::LockGuard lock(s_mutex);
+    auto it = s_sources.find(key);
+    if (it != s_sources.end())
+    {
+      getStatistics().num_source_hits++;
+      return it->second;
+    }
+  }
+
+  getStatistics().num_source_misses++;
+
+  // preprocess without holding the lock - if two threads miss the same key
+  // both results are equal, so it doesn't matter which one is kept
+  auto source = make_shared<const PreprocessedShaderSource>(preprocess());
+
+  util::LockGuard lock(s_mutex);
+  auto &entry = s_sources[key];
+  if (!entry)
+    entry = source;
+  return entry;
+}
+
+
+bool isProgramBinaryCacheAvailable()
+{
+  auto iface = getCurrentInterface();
+  if (!iface->GetProgramBinary || !iface->ProgramBinary || !iface->ProgramParameteri)
+    return false;
+
+  GLint num_formats = 0;
+  gl::GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+
+  return num_formats > 0;
+}
+
+
+std::string getProgramBinaryDriverString()
+{
+  return getString(GL_VENDOR) + '\n' + getString(GL_RENDERER) + '\n' + getString(GL_VERSION);
+}
+
+
+bool loadProgramBinary(unsigned int program, const std::string &key)
+{
+  auto path = getBinaryPath(key);
+
+  ifstream in(path, ios_base::binary);
+  if (!in.good())
+  {
+    getStatistics().num_binary_misses++;
+    return false;
+  }
+
+  BinaryCacheHeader header {};
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  auto driver_string = getProgramBinaryDriverString();
+
+  string stored_driver_string;
+  if (in.good() && header.driver_string_size == driver_string.size())
+  {
+    stored_driver_string.resize(header.driver_string_size);
+    in.read(&stored_driver_string[0], stored_driver_string.size());
+  }
+
+  if (!in.good() ||
+      !equal(header.magic, header.magic + sizeof(header.magic), BINARY_CACHE_MAGIC) ||
+      header.version != BINARY_CACHE_VERSION ||
+      stored_driver_string != driver_string)
+  {
+    LOG_INFO << "Ignoring stale program binary " << path << endl;
+    getStatistics().num_binary_misses++;
+    return false;
+  }
+
+  const auto binary_begin = in.tellg();
+  in.seekg(0, ios_base::end);
+  const auto remaining_size = in.tellg() - binary_begin;
+  in.seekg(binary_begin);
+
+  if (!in.good() || header.binary_size > MAX_BINARY_SIZE ||
+      header.binary_size > uint64_t(remaining_size))
+  {
+    LOG_INFO << "Ignoring corrupt program binary " << path << endl;
+    getStatistics().num_binary_misses++;
+    return false;
+  }
+
+  vector<char> binary(header.binary_size);
+  in.read(binary.data(), binary.size());
+
+  if (!in.good())
+  {
+    LOG_INFO << "Ignoring truncated program binary " << path << endl;
+    getStatistics().num_binary_misses++;
+    return false;
+  }
+
+  {
+    // ignore the error as we check for successful linking anyway
+    ScopedGLCallSite call_site(RENDER_UTIL_GL_CALL_SITE_EXPECTING_ERRORS());
+    gl::ProgramBinary(program, header.format, binary.data(), binary.size());
+  }
+
+  // an unsupported format is reported as GL_INVALID_ENUM
+  for (int i = 0; i < MAX_GL_ERROR_FLAGS && gl::GetError() != GL_NO_ERROR; i++) {}
+
+  GLint is_linked = 0;
+  gl::GetProgramiv(program, GL_LINK_STATUS, &is_linked);
+
+  if (!is_linked)
+  {
+    // e.g. after a driver update which kept the version string
+    LOG_INFO << "Program binary " << path << " was rejected by the driver" << endl;
+    getStatistics().num_binary_rejected++;
+    return false;
+  }
+
+  getStatistics().num_binary_hits++;
+  return true;
+}
+
+
+void prepareProgramForBinaryRetrieval(unsigned int program)
+{
+  gl::ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+void saveProgramBinary(unsigned int program, const std::string &key)
+{
+  GLint size = 0;
+  gl::GetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+
+  vector<char> binary(size);
+  GLenum format = 0;
+  gl::GetProgramBinary(program, binary.size(), &size, &format, binary.data());
+  binary.resize(size);
+
+  if (!util::mkdir(CACHE_DIR, true))
+  {
+    LOG_ERROR << "Failed to create directory " << CACHE_DIR << endl;
+    return;
+  }
+
+  auto driver_string = getProgramBinaryDriverString();
+
+  auto path = getBinaryPath(key);
+
+  // write to a temporary file first, so an interrupted write never leaves a truncated file
+  auto tmp_path = path + ".tmp";
+
+  {
+    ofstream out(tmp_path, ios_base::binary | ios_base::trunc);
+    if (!out.good())
+    {
+      LOG_ERROR << "Can't open output file " << tmp_path << endl;
+      return;
+    }
+
+    BinaryCacheHeader header {};
+    copy(BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC + sizeof(BINARY_CACHE_MAGIC), header.magic);
+    header.version = BINARY_CACHE_VERSION;
+    header.format = format;
+    header.driver_string_size = driver_string.size();
+    header.binary_size = binary.size();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(driver_string.data(), driver_string.size());
+    out.write(binary.data(), binary.size());
+
+    if (!out.good())
+    {
+      LOG_ERROR << "Error during writing to output file " << tmp_path << endl;
+      return;
+    }
+  }
+
+  remove(path.c_str());
+  if (rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    LOG_ERROR << "Failed to rename " << tmp_path << " to " << path << endl;
+    remove(tmp_path.c_str());
+  }
+}
+
+
+} // namespace render_util
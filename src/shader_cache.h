@@ -0,0 +1,73 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_SHADER_CACHE_H
+#define RENDER_UTIL_SHADER_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+/**
+ * Caches for ShaderProgram:
+ * preprocessed shader sources are memoized for the lifetime of the process,
+ * linked program binaries are stored in the cache directory.
+ */
+
+namespace render_util
+{
+
+
+struct PreprocessedShaderSource
+{
+  std::string filename;
+  std::string source;
+  std::vector<std::string> includes;
+};
+
+
+/**
+ * Returns the source memoized under key, calling preprocess to create it on a miss.
+ * key must identify the file and the shader parameters.
+ */
+std::shared_ptr<const PreprocessedShaderSource>
+getPreprocessedShaderSource(const std::string &key,
+                            const std::function<PreprocessedShaderSource()> &preprocess);
+
+
+/// false if the driver can't retrieve program binaries
+bool isProgramBinaryCacheAvailable();
+
+/// returns a string identifying the driver - binaries are only valid for the same driver
+std::string getProgramBinaryDriverString();
+
+/**
+ * Loads a program binary which was saved under key and passes it to program.
+ * Returns true if the program was linked successfully.
+ */
+bool loadProgramBinary(unsigned int program, const std::string &key);
+
+/// must be called before linking a program which is going to be saved
+void prepareProgramForBinaryRetrieval(unsigned int program);
+void saveProgramBinary(unsigned int program, const std::string &key);
+
+
+} // namespace render_util
+
+#endif
@@ -51,6 +51,64 @@ ifstream openDefinition(const std::string &definition, const render_util::Shader
 }
 
 
+struct ProgramDefinition
+{
+  vector<string> vertex;
+  vector<string> fragment;
+  vector<string> geometry;
+  vector<string> compute;
+  vector<string> texunits;
+};
+
+
+ProgramDefinition readDefinition(const std::string &definition,
+                                 const render_util::ShaderSearchPath &search_path)
+{
+  ProgramDefinition shaders;
+
+  auto in = openDefinition(definition, search_path);
+
+  while (in.good())
+  {
+    string line;
+    getline(in, line);
+    if (line.empty())
+      continue;
+    if (line[0] == '#')
+      continue;
+
+    istringstream line_in(line);
+
+    assert(line_in.good());
+    string type;
+    line_in >> type;
+    assert(!type.empty());
+
+    assert(line_in.good());
+    string name;
+    line_in >> name;
+    assert(!name.empty());
+
+    if (type == "vert")
+      shaders.vertex.push_back(name);
+    else if (type == "frag")
+      shaders.fragment.push_back(name);
+    else if (type == "geom")
+      shaders.geometry.push_back(name);
+    else if (type == "compute")
+      shaders.compute.push_back(name);
+    else if (type == "texunit")
+      shaders.texunits.push_back(name);
+    else
+    {
+      throw render_util::ShaderCreationError();
+    }
+  }
+
+  return shaders;
+}
+
+
 }
 
 
@@ -66,61 +124,16 @@ ShaderProgramPtr createShaderProgram(const std::string &definition,
 {
   LOG_TRACE<<"creating shader program: "<<definition<<endl;
 
-  vector<string> vertex_shaders;
-  vector<string> fragment_shaders;
-  vector<string> geometry_shaders;
-  vector<string> compute_shaders;
-  vector<string> texunits;
-
-  auto in = openDefinition(definition, search_path);
-
-  {
-    while (in.good())
-    {
-      string line;
-      getline(in, line);
-      if (line.empty())
-        continue;
-      if (line[0] == '#')
-        continue;
-
-      istringstream line_in(line);
-
-      assert(line_in.good());
-      string type;
-      line_in >> type;
-      assert(!type.empty());
-
-      assert(line_in.good());
-      string name;
-      line_in >> name;
-      assert(!name.empty());
-
-      if (type == "vert")
-        vertex_shaders.push_back(name);
-      else if (type == "frag")
-        fragment_shaders.push_back(name);
-      else if (type == "geom")
-        geometry_shaders.push_back(name);
-      else if (type == "compute")
-        compute_shaders.push_back(name);
-      else if (type == "texunit")
-        texunits.push_back(name);
-      else
-      {
-        throw ShaderCreationError();
-      }
-    }
-  }
+  auto shaders = readDefinition(definition, search_path);
 
   ShaderProgramPtr program = make_shared<ShaderProgram>(definition,
-                                                        vertex_shaders,
-                                                        fragment_shaders,
-                                                        geometry_shaders,
-                                                        compute_shaders,
+                                                        shaders.vertex,
+                                                        shaders.fragment,
+                                                        shaders.geometry,
+                                                        shaders.compute,
                                                         search_path, true, attribute_locations, params);
 
-  for (auto name : texunits)
+  for (auto name : shaders.texunits)
   {
     int number = getTexUnitNumber(name);
     assert(number >= 0);
@@ -134,4 +147,30 @@ ShaderProgramPtr createShaderProgram(const std::string &definition,
 }
 
 
+std::string getShaderProgramSource(const std::string &definition,
+                                   const ShaderSearchPath &search_path,
+                                   const ShaderParameters &params)
+{
+  auto shaders = readDefinition(definition, search_path);
+
+  string source;
+
+  auto add = [&] (const vector<string> &names, GLenum type)
+  {
+    for (auto &name : names)
+    {
+      Shader shader(name, search_path, type, params);
+      source += to_string(type) + '\n' + shader.getPreprocessedSource() + '\n';
+    }
+  };
+
+  add(shaders.fragment, GL_FRAGMENT_SHADER);
+  add(shaders.vertex, GL_VERTEX_SHADER);
+  add(shaders.geometry, GL_GEOMETRY_SHADER);
+  add(shaders.compute, GL_COMPUTE_SHADER);
+
+  return source;
+}
+
+
 } // namespace
@@ -0,0 +1,172 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/stream_buffer.h>
+#include <render_util/globals.h>
+#include <render_util/gl_binding/gl_functions.h>
+#include <log.h>
+
+#include <cassert>
+
+using namespace render_util::gl_binding;
+
+
+namespace
+{
+
+
+void waitForFence(void *&fence)
+{
+  if (!fence)
+    return;
+
+  auto sync = static_cast<GLsync>(fence);
+
+  GLbitfield flags = 0;
+  while (true)
+  {
+    auto res = gl::ClientWaitSync(sync, flags, 1000 * 1000 * 1000);
+    if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED)
+      break;
+    if (res == GL_WAIT_FAILED)
+    {
+      LOG_ERROR << "glClientWaitSync() failed." << std::endl;
+      break;
+    }
+    assert(res == GL_TIMEOUT_EXPIRED);
+    flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+  }
+
+  gl::DeleteSync(sync);
+  fence = nullptr;
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+StreamBuffer::StreamBuffer(unsigned int target, size_t region_size) :
+  m_target(target),
+  m_region_size(region_size)
+{
+  gl::GenBuffers(1, &m_id);
+  assert(m_id > 0);
+
+  auto buffer_size = m_region_size * NUM_REGIONS;
+
+  getCurrentGLContext()->bindBuffer(m_target, m_id);
+
+  if (getCurrentInterface()->BufferStorage)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    gl::BufferStorage(m_target, buffer_size, nullptr, flags);
+    m_persistent_mapping =
+      static_cast<unsigned char*>(gl::MapBufferRange(m_target, 0, buffer_size, flags));
+    assert(m_persistent_mapping);
+  }
+  else
+  {
+    LOG_INFO << "ARB_buffer_storage is not available - using unsynchronized mapping." << std::endl;
+    gl::BufferData(m_target, buffer_size, nullptr, GL_STREAM_DRAW);
+  }
+
+  getCurrentGLContext()->bindBuffer(m_target, 0);
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+  assert(!m_is_mapped);
+
+  for (auto &fence : m_fences)
+  {
+    if (fence)
+      gl::DeleteSync(static_cast<GLsync>(fence));
+  }
+
+  if (m_persistent_mapping)
+  {
+    getCurrentGLContext()->bindBuffer(m_target, m_id);
+    gl::UnmapBuffer(m_target);
+    getCurrentGLContext()->bindBuffer(m_target, 0);
+  }
+
+  gl::DeleteBuffers(1, &m_id);
+  getCurrentGLContext()->forgetBuffer(m_id);
+}
+
+
+void *StreamBuffer::map(size_t size, size_t &offset)
+{
+  assert(!m_is_mapped);
+  assert(size <= m_region_size);
+
+  if (m_current_region >= 0)
+  {
+    assert(!m_fences[m_current_region]);
+    m_fences[m_current_region] = gl::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  m_current_region = (m_current_region + 1) % NUM_REGIONS;
+
+  waitForFence(m_fences[m_current_region]);
+
+  offset = m_current_region * m_region_size;
+
+  m_bytes_uploaded_last_frame = size;
+  m_bytes_uploaded_total += size;
+
+  m_is_mapped = true;
+
+  if (m_persistent_mapping)
+    return m_persistent_mapping + offset;
+
+  if (!size)
+    return nullptr;
+
+  getCurrentGLContext()->bindBuffer(m_target, m_id);
+  auto ptr = gl::MapBufferRange(m_target, offset, size,
+                                GL_MAP_WRITE_BIT |
+                                GL_MAP_INVALIDATE_RANGE_BIT |
+                                GL_MAP_UNSYNCHRONIZED_BIT);
+  getCurrentGLContext()->bindBuffer(m_target, 0);
+  assert(ptr);
+
+  return ptr;
+}
+
+
+void StreamBuffer::unmap()
+{
+  assert(m_is_mapped);
+  m_is_mapped = false;
+
+  if (m_persistent_mapping || !m_bytes_uploaded_last_frame)
+    return;
+
+  getCurrentGLContext()->bindBuffer(m_target, m_id);
+  gl::UnmapBuffer(m_target);
+  getCurrentGLContext()->bindBuffer(m_target, 0);
+}
+
+
+} // namespace render_util
@@ -0,0 +1,591 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * This terrain implementation makes use of the technique described in the paper
+ * "Continuous Distance-Dependent Level of Detail for Rendering Heightmaps (CDLOD)"
+ * by Filip Strugar <http://www.vertexasylum.com/downloads/cdlod/cdlod_latest.pdf>.
+ */
+
+#include "cdlod_quad_tree.h"
+
+#include <cmath>
+#include <cassert>
+
+using namespace glm;
+using render_util::TerrainBase;
+using render_util::TerrainCDLODBase;
+using MaterialID = render_util::TerrainBase::MaterialID;
+using MaterialMap = render_util::TerrainBase::MaterialMap;
+
+
+namespace
+{
+
+
+// Must match the blend distance in getDetailMapBlend() (terrain_geometry_util.glsl).
+constexpr float DETAIL_MAP_BLEND_DIST = 18000;
+
+
+unsigned int getDefaultMaterial()
+{
+  return MaterialID::WATER;
+}
+
+
+unsigned int getMaterial(MaterialMap::ConstPtr map, ivec2 pos)
+{
+  if (pos.x < 0 || pos.y < 0 || pos.x >= map->w() || pos.y >= map->h())
+  {
+    return getDefaultMaterial();
+  }
+
+  return map->get(pos);
+}
+
+
+unsigned int gatherMaterials(MaterialMap::ConstPtr map,
+                             ivec2 begin,
+                             ivec2 size)
+{
+  auto end = begin + size;
+
+  unsigned int material = 0;
+
+  for (int y = begin.y; y < end.y; y++)
+  {
+    for (int x = begin.x; x < end.x; x++)
+    {
+      material |= getMaterial(map, ivec2(x,y));
+    }
+  }
+
+  assert(material);
+
+  return material;
+}
+
+
+MaterialMap::Ptr processMaterialMap(MaterialMap::ConstPtr in)
+{
+  if (!in)
+    return {};
+
+  uvec2 new_size = uvec2(in->getSize()) / TerrainCDLODBase::MESH_GRID_SIZE;
+
+  if (in->w() % TerrainCDLODBase::MESH_GRID_SIZE != 0)
+    new_size.x++;
+  if (in->h() % TerrainCDLODBase::MESH_GRID_SIZE != 0)
+    new_size.y++;
+
+  auto resized = std::make_shared<MaterialMap>(new_size);
+
+  for (int y = 0; y < resized->h(); y++)
+  {
+    for (int x = 0; x < resized->w(); x++)
+    {
+      auto src_coords = ivec2(x,y) * ivec2(TerrainCDLODBase::MESH_GRID_SIZE);
+      auto size = ivec2(TerrainCDLODBase::MESH_GRID_SIZE);
+
+      resized->at(x,y) = gatherMaterials(in, src_coords, size);
+    }
+  }
+
+  return resized;
+}
+
+
+unsigned int getMaterialID(MaterialMap::ConstPtr material_map, const dvec2 &node_origin)
+{
+  assert(fract(node_origin) == dvec2(0));
+
+  if (material_map)
+  {
+    const uvec2 grid_pos = uvec2(node_origin) / (unsigned int)TerrainCDLODBase::LEAF_NODE_SIZE;
+
+    if (node_origin.x < 0 || node_origin.y < 0)
+      return getDefaultMaterial();
+
+    if (grid_pos.x >= material_map->w() || grid_pos.y >= material_map->h())
+      return getDefaultMaterial();
+
+    return material_map->get(grid_pos.x, grid_pos.y);
+  }
+  else
+  {
+    return MaterialID::ALL;
+  }
+}
+
+
+} // namespace
+
+
+namespace render_util::terrain
+{
+
+
+HeightRangePyramid::Parameters CDLODQuadTree::getHeightRangeParameters()
+{
+  static_assert(TerrainCDLODBase::LEAF_NODE_SIZE % TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID == 0);
+
+  HeightRangePyramid::Parameters params;
+  params.num_levels = TerrainCDLODBase::MAX_LOD + 1;
+  params.cell_size_px =
+    TerrainCDLODBase::LEAF_NODE_SIZE / TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID;
+  params.origin_px = ivec2(getRootNodePos() / (double)TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID);
+  params.base_map_blend_px =
+    std::ceil(DETAIL_MAP_BLEND_DIST / TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID);
+
+  return params;
+}
+
+
+std::unique_ptr<HeightRangePyramid>
+CDLODQuadTree::createHeightRanges(const ElevationMap &map, const ElevationMap *base_map)
+{
+  return std::make_unique<HeightRangePyramid>(map, base_map, getHeightRangeParameters());
+}
+
+
+std::unique_ptr<HeightRangePyramid>
+CDLODQuadTree::createHeightRanges(const TiledHeightMap &map, const ElevationMap *base_map)
+{
+  return std::make_unique<HeightRangePyramid>(map, base_map, getHeightRangeParameters());
+}
+
+
+void CDLODQuadTree::createMaterialLevels(MaterialMap::ConstPtr material_map_)
+{
+  auto material_map = processMaterialMap(material_map_);
+
+  const int num_levels = TerrainCDLODBase::MAX_LOD + 1;
+  const int num_cells_level_0 = 1 << TerrainCDLODBase::MAX_LOD;
+
+  m_material_levels.resize(num_levels);
+  for (int i = 0; i < num_levels; i++)
+  {
+    int num_cells = num_cells_level_0 >> i;
+    m_material_levels[i].resize(num_cells * num_cells);
+  }
+
+  for (int y = 0; y < num_cells_level_0; y++)
+  {
+    for (int x = 0; x < num_cells_level_0; x++)
+    {
+      auto pos = getRootNodePos() + dvec2(x, y) * (double)TerrainCDLODBase::LEAF_NODE_SIZE;
+
+      auto &cell = m_material_levels[0][y * num_cells_level_0 + x];
+      cell.id = ::getMaterialID(material_map, pos);
+      assert(cell.id);
+    }
+  }
+
+  for (int level = 1; level < num_levels; level++)
+  {
+    int num_cells = num_cells_level_0 >> level;
+
+    for (int y = 0; y < num_cells; y++)
+    {
+      for (int x = 0; x < num_cells; x++)
+      {
+        const MaterialCell *children[] =
+        {
+          &getMaterialCell(level-1, ivec2(x*2, y*2)),
+          &getMaterialCell(level-1, ivec2(x*2 + 1, y*2)),
+          &getMaterialCell(level-1, ivec2(x*2, y*2 + 1)),
+          &getMaterialCell(level-1, ivec2(x*2 + 1, y*2 + 1)),
+        };
+
+        MaterialCell cell;
+        for (auto child : children)
+        {
+          cell.id |= child->id;
+          cell.is_uniform = cell.is_uniform && child->is_uniform &&
+                            child->id == children[0]->id;
+        }
+
+        m_material_levels[level][y * num_cells + x] = cell;
+      }
+    }
+  }
+
+  for (auto &level : m_material_levels)
+  {
+    for (auto &cell : level)
+      m_material_ids.insert(cell.id);
+  }
+}
+
+
+const CDLODQuadTree::MaterialCell &CDLODQuadTree::getMaterialCell(int lod_level, ivec2 cell) const
+{
+  assert(lod_level >= 0);
+  assert(lod_level < (int)m_material_levels.size());
+
+  int num_cells = 1 << (TerrainCDLODBase::MAX_LOD - lod_level);
+
+  assert(cell.x >= 0);
+  assert(cell.y >= 0);
+  assert(cell.x < num_cells);
+  assert(cell.y < num_cells);
+
+  return m_material_levels[lod_level][cell.y * num_cells + cell.x];
+}
+
+
+CDLODQuadTree::Node *CDLODQuadTree::allocNode()
+{
+  util::LockGuard lock(m_node_allocator_mutex);
+
+  m_num_nodes++;
+  return m_node_allocator.alloc();
+}
+
+
+CDLODQuadTree::Node *CDLODQuadTree::createNode(dvec2 pos, int lod_level)
+{
+  assert(fract(pos) == dvec2(0));
+
+  Node *node = allocNode();
+
+  node->pos = vec2(pos);
+  node->pos_grid = vec2(pos / (double)TerrainCDLODBase::METERS_PER_GRID);
+
+  assert(fract(node->pos) == vec2(0));
+  assert(fract(node->pos_grid) == vec2(0));
+
+  double node_size = TerrainCDLODBase::getNodeSize(lod_level);
+
+  node->size = node_size;
+
+  auto cell = ivec2((pos - getRootNodePos()) / node_size);
+
+  auto &material = getMaterialCell(lod_level, cell);
+  node->material_id = material.id;
+
+  if (m_height_ranges)
+  {
+    auto range = m_height_ranges->get(lod_level, cell, m_base_map_height);
+    node->min_height = range.x + m_height_offset;
+    node->max_height = range.y + m_height_offset;
+  }
+  else
+  {
+    node->min_height = m_height_offset;
+    node->max_height = DEFAULT_MAX_HEIGHT + m_height_offset;
+  }
+
+  // A flat area with a single material looks the same at every level of detail.
+  node->is_homogeneous = lod_level > 0 &&
+                         m_height_ranges &&
+                         material.is_uniform &&
+                         node->min_height == node->max_height;
+
+  auto bb_origin = vec3(node->pos, node->min_height);
+  auto bb_extent = vec3(node_size, node_size, node->max_height - node->min_height);
+  node->bounding_box.set(bb_origin, bb_extent);
+
+  assert(node->material_id);
+
+  return node;
+}
+
+
+void CDLODQuadTree::createChildren(Node *node, int lod_level)
+{
+  assert(lod_level > 0);
+  assert(!node->has_children);
+  assert(!node->is_homogeneous);
+
+  const dvec2 pos = node->pos;
+  const double child_node_size = TerrainCDLODBase::getNodeSize(lod_level-1);
+  assert(child_node_size == node->size / 2);
+
+  node->children[0] = createNode(pos + dvec2(0, child_node_size), lod_level-1);
+  node->children[1] = createNode(pos + dvec2(child_node_size), lod_level-1);
+  node->children[2] = createNode(pos + dvec2(0, 0), lod_level-1);
+  node->children[3] = createNode(pos + dvec2(child_node_size, 0), lod_level-1);
+
+  node->has_children = true;
+}
+
+
+void CDLODQuadTree::build(std::shared_ptr<const HeightRangePyramid> height_ranges,
+                          MaterialMap::ConstPtr material_map)
+{
+  assert(!m_root);
+  assert(!height_ranges || height_ranges->getNumLevels() == TerrainCDLODBase::MAX_LOD + 1);
+
+  m_height_ranges = height_ranges;
+
+  createMaterialLevels(material_map);
+
+  m_root = createNode(getRootNodePos(), TerrainCDLODBase::MAX_LOD);
+}
+
+
+void CDLODQuadTree::clear()
+{
+  m_root = nullptr;
+  m_num_nodes = 0;
+  m_material_ids.clear();
+  m_material_levels.clear();
+  m_height_ranges.reset();
+  m_node_allocator.clear();
+}
+
+
+void CDLODQuadTree::setHeightOffsets(float base_map_height, float height_offset)
+{
+  if (base_map_height == m_base_map_height && height_offset == m_height_offset)
+    return;
+
+  m_base_map_height = base_map_height;
+  m_height_offset = height_offset;
+
+  if (m_root)
+  {
+    m_node_allocator.clear();
+    m_num_nodes = 0;
+    m_root = createNode(getRootNodePos(), TerrainCDLODBase::MAX_LOD);
+  }
+}
+
+
+size_t CDLODQuadTree::getMemoryUsage() const
+{
+  size_t size = m_node_allocator.getCapacity() * sizeof(Node);
+
+  for (auto &level : m_material_levels)
+    size += level.capacity() * sizeof(MaterialCell);
+
+  if (m_height_ranges)
+    size += m_height_ranges->getMemoryUsage();
+
+  return size;
+}
+
+
+void CDLODQuadTree::selectNode(Node *node,
+                               int lod_level,
+                               const Camera &camera,
+                               float draw_distance,
+                               Frustum::PlaneMask planes,
+                               Selection &selection,
+                               int split_depth,
+                               std::vector<Subtree> *subtrees)
+{
+  if (subtrees && split_depth == 0)
+  {
+    Subtree subtree;
+    subtree.node = node;
+    subtree.lod_level = lod_level;
+    subtree.planes = planes;
+    subtree.position = selection.nodes.size();
+    subtrees->push_back(std::move(subtree));
+    return;
+  }
+
+  auto camera_pos = camera.getPos();
+
+  selection.num_nodes_visited++;
+
+  // the bounding boxes of the children are inside of the parent's,
+  // so they only need to be tested against the planes the parent intersects
+  if (planes)
+  {
+    if (camera.testVisibility(node->bounding_box, planes) == Frustum::Visibility::OUTSIDE)
+    {
+      selection.num_nodes_culled++;
+      return;
+    }
+  }
+  else
+  {
+    selection.num_nodes_inside++;
+  }
+
+  if (lod_level > 0 &&
+      node->isInRange(camera_pos, TerrainCDLODBase::getLodLevelDist(lod_level-1)))
+  {
+    if (node->is_homogeneous)
+    {
+      selectHomogeneousChildren(node, node->pos, lod_level, camera, draw_distance, planes,
+                                selection);
+      return;
+    }
+
+    if (!node->has_children)
+      createChildren(node, lod_level);
+
+    // select children
+    for (Node *child : node->children)
+    {
+      selectNode(child, lod_level-1, camera, draw_distance, planes, selection,
+                 split_depth - 1, subtrees);
+    }
+  }
+  else
+  {
+    auto distance = node->bounding_box.getShortestDistance(camera_pos);
+
+    if (draw_distance > 0.0 && distance > draw_distance)
+      return;
+
+    selection.nodes.push_back({ node, lod_level, node->pos_grid, distance });
+  }
+}
+
+
+void CDLODQuadTree::selectHomogeneousChildren(const Node *node,
+                                              dvec2 pos,
+                                              int lod_level,
+                                              const Camera &camera,
+                                              float draw_distance,
+                                              Frustum::PlaneMask planes,
+                                              Selection &selection)
+{
+  assert(node->is_homogeneous);
+  assert(lod_level > 0);
+
+  const double child_node_size = TerrainCDLODBase::getNodeSize(lod_level-1);
+  const dvec2 child_offsets[] =
+  {
+    // same order as in createChildren()
+    dvec2(0, child_node_size),
+    dvec2(child_node_size),
+    dvec2(0, 0),
+    dvec2(child_node_size, 0),
+  };
+
+  auto camera_pos = camera.getPos();
+
+  for (auto &offset : child_offsets)
+  {
+    const dvec2 child_pos = pos + offset;
+
+    Box bounding_box;
+    bounding_box.set(vec3(vec2(child_pos), node->min_height),
+                     vec3(child_node_size, child_node_size, node->max_height - node->min_height));
+
+    selection.num_nodes_visited++;
+
+    // testVisibility() narrows the mask - each child starts from the parent's
+    auto child_planes = planes;
+
+    if (child_planes)
+    {
+      if (camera.testVisibility(bounding_box, child_planes) == Frustum::Visibility::OUTSIDE)
+      {
+        selection.num_nodes_culled++;
+        continue;
+      }
+    }
+    else
+    {
+      selection.num_nodes_inside++;
+    }
+
+    auto distance = bounding_box.getShortestDistance(camera_pos);
+
+    if (lod_level-1 > 0 && distance <= TerrainCDLODBase::getLodLevelDist(lod_level-2))
+    {
+      selectHomogeneousChildren(node, child_pos, lod_level-1, camera, draw_distance,
+                                child_planes, selection);
+    }
+    else
+    {
+      if (draw_distance > 0.0 && distance > draw_distance)
+        continue;
+
+      auto pos_grid = vec2(child_pos / (double)TerrainCDLODBase::METERS_PER_GRID);
+      selection.nodes.push_back({ node, lod_level-1, pos_grid, distance });
+    }
+  }
+}
+
+
+void CDLODQuadTree::select(const Camera &camera, float draw_distance, Selection &selection)
+{
+  assert(m_root);
+  selectNode(m_root, TerrainCDLODBase::MAX_LOD, camera, draw_distance,
+             Frustum::ALL_PLANES, selection);
+}
+
+
+void CDLODQuadTree::select(const Camera &camera, float draw_distance, Selection &selection,
+                           int split_depth, util::ThreadPool &thread_pool)
+{
+  assert(m_root);
+  assert(split_depth >= 0);
+
+  if (split_depth == 0)
+  {
+    select(camera, draw_distance, selection);
+    return;
+  }
+
+  Selection top;
+  std::vector<Subtree> subtrees;
+
+  selectNode(m_root, TerrainCDLODBase::MAX_LOD, camera, draw_distance,
+             Frustum::ALL_PLANES, top, split_depth, &subtrees);
+
+  thread_pool.parallelFor(subtrees.size(), [&] (int i)
+  {
+    auto &subtree = subtrees[i];
+    selectNode(subtree.node, subtree.lod_level, camera, draw_distance,
+               subtree.planes, subtree.selection);
+  });
+
+  // Put the subtrees' nodes where the serial selection would have put them.
+  size_t num_nodes = top.nodes.size();
+  for (auto &subtree : subtrees)
+    num_nodes += subtree.selection.nodes.size();
+
+  selection.nodes.reserve(selection.nodes.size() + num_nodes);
+
+  auto merge = [&selection] (const Selection &part, size_t begin, size_t end)
+  {
+    selection.nodes.insert(selection.nodes.end(),
+                           part.nodes.begin() + begin,
+                           part.nodes.begin() + end);
+  };
+
+  size_t top_pos = 0;
+  for (auto &subtree : subtrees)
+  {
+    merge(top, top_pos, subtree.position);
+    top_pos = subtree.position;
+
+    merge(subtree.selection, 0, subtree.selection.nodes.size());
+
+    selection.num_nodes_visited += subtree.selection.num_nodes_visited;
+    selection.num_nodes_culled += subtree.selection.num_nodes_culled;
+    selection.num_nodes_inside += subtree.selection.num_nodes_inside;
+  }
+  merge(top, top_pos, top.nodes.size());
+
+  selection.num_nodes_visited += top.num_nodes_visited;
+  selection.num_nodes_culled += top.num_nodes_culled;
+  selection.num_nodes_inside += top.num_nodes_inside;
+}
+
+
+} // namespace render_util::terrain
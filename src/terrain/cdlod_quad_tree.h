@@ -0,0 +1,236 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * This terrain implementation makes use of the technique described in the paper
+ * "Continuous Distance-Dependent Level of Detail for Rendering Heightmaps (CDLOD)"
+ * by Filip Strugar <http://www.vertexasylum.com/downloads/cdlod/cdlod_latest.pdf>.
+ */
+
+#ifndef RENDER_UTIL_TERRAIN_CDLOD_QUAD_TREE_H
+#define RENDER_UTIL_TERRAIN_CDLOD_QUAD_TREE_H
+
+#include "terrain_cdlod_base.h"
+#include "height_range_pyramid.h"
+#include <render_util/camera.h>
+#include <render_util/geometry.h>
+#include <block_allocator.h>
+#include <thread_pool.h>
+
+#include <array>
+#include <set>
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+
+namespace render_util::terrain
+{
+
+
+/**
+ * The node hierarchy of TerrainCDLOD and the selection of the nodes to draw.
+ * Contains no GL state, so it can be used without a context.
+ *
+ * Nodes are created lazily - the children of a node are created when the selection
+ * first descends into it. Subtrees with a single material and a flat height range
+ * (usually open water) don't get any child nodes - where the distance requires a finer
+ * level of detail, the selection emits instances for the parts of such a node instead,
+ * so the LOD still differs by at most one level between neighbours.
+ *
+ * The selection of disjoint subtrees may run in parallel - apart from the node allocation
+ * it only writes to the nodes of the subtree.
+ */
+class CDLODQuadTree
+{
+public:
+  using MaterialMap = TerrainBase::MaterialMap;
+
+  /// vertical extent of the nodes when no height ranges are available
+  static constexpr float DEFAULT_MAX_HEIGHT = 4000;
+
+  struct Node
+  {
+    std::array<Node*, 4> children {};
+    glm::vec2 pos = glm::vec2(0);
+    glm::vec2 pos_grid = glm::vec2(0);
+    float size = 0;
+    float min_height = 0;
+    float max_height = 0;
+    Box bounding_box;
+    unsigned int material_id = 0;
+    /// the children would be identical to the node, so they are never created
+    bool is_homogeneous = false;
+    bool has_children = false;
+
+    bool isInRange(const glm::vec3 &camera_pos, float radius) const
+    {
+      return bounding_box.getShortestDistance(camera_pos) <= radius;
+    }
+  };
+
+  struct SelectedNode
+  {
+    /// for a part of a homogeneous node, the homogeneous node
+    const Node *node = nullptr;
+    int lod_level = 0;
+    /// position of the instance - differs from node->pos_grid for a part of a homogeneous node
+    glm::vec2 pos_grid = glm::vec2(0);
+    /// shortest distance between the instance and the camera
+    float distance = 0;
+
+    bool isInRange(float radius) const
+    {
+      return distance <= radius;
+    }
+  };
+
+  struct Selection
+  {
+    std::vector<SelectedNode> nodes;
+    size_t num_nodes_visited = 0;
+    size_t num_nodes_culled = 0;
+    /// visited nodes whose parent was entirely inside the frustum, so they weren't tested
+    size_t num_nodes_inside = 0;
+
+    void clear()
+    {
+      nodes.clear();
+      num_nodes_visited = 0;
+      num_nodes_culled = 0;
+      num_nodes_inside = 0;
+    }
+  };
+
+private:
+  using NodeAllocator = util::BlockAllocator<Node, 1000>;
+
+  struct MaterialCell
+  {
+    /// all materials in the cell
+    unsigned int id = 0;
+    /// all leaf nodes in the cell have the same material
+    bool is_uniform = true;
+  };
+
+  /// a subtree whose selection is deferred to a worker thread
+  struct Subtree
+  {
+    Node *node = nullptr;
+    int lod_level = 0;
+    Frustum::PlaneMask planes = 0;
+    /// where the subtree's nodes belong in the selection of the levels above it
+    size_t position = 0;
+    Selection selection;
+  };
+
+  NodeAllocator m_node_allocator;
+  /// protects m_node_allocator and m_num_nodes
+  util::Mutex m_node_allocator_mutex;
+  Node *m_root = nullptr;
+  size_t m_num_nodes = 0;
+  std::set<unsigned int> m_material_ids;
+  std::shared_ptr<const HeightRangePyramid> m_height_ranges;
+  std::vector<std::vector<MaterialCell>> m_material_levels;
+  float m_base_map_height = 0;
+  float m_height_offset = 0;
+
+  void createMaterialLevels(MaterialMap::ConstPtr material_map);
+  const MaterialCell &getMaterialCell(int lod_level, glm::ivec2 cell) const;
+  Node *allocNode();
+  Node *createNode(glm::dvec2 pos, int lod_level);
+  void createChildren(Node *node, int lod_level);
+  /**
+   * With subtrees set, the nodes split_depth levels below node aren't selected
+   * but added to subtrees instead.
+   */
+  void selectNode(Node *node, int lod_level, const Camera &camera, float draw_distance,
+                  Frustum::PlaneMask planes, Selection &selection,
+                  int split_depth = 0, std::vector<Subtree> *subtrees = nullptr);
+  /**
+   * Selects the parts of the homogeneous node one level below the area at pos,
+   * without creating nodes for them.
+   */
+  void selectHomogeneousChildren(const Node *node, glm::dvec2 pos, int lod_level,
+                                 const Camera &camera, float draw_distance,
+                                 Frustum::PlaneMask planes, Selection &selection);
+
+  static HeightRangePyramid::Parameters getHeightRangeParameters();
+
+public:
+  static glm::dvec2 getRootNodePos()
+  {
+    return -glm::dvec2(TerrainCDLODBase::getNodeSize(TerrainCDLODBase::MAX_LOD) / 2.0);
+  }
+
+  /**
+   * Creates the min/max height pyramid for map, laid out to match the nodes.
+   * base_map may be null.
+   */
+  static std::unique_ptr<HeightRangePyramid> createHeightRanges(const ElevationMap &map,
+                                                                const ElevationMap *base_map);
+
+  /// like the above, from the tile ranges of a TiledHeightMap
+  static std::unique_ptr<HeightRangePyramid> createHeightRanges(const TiledHeightMap &map,
+                                                                const ElevationMap *base_map);
+
+  /**
+   * Only creates the root node.
+   * height_ranges may be null, in which case all nodes span [0, DEFAULT_MAX_HEIGHT] plus the offset
+   * and no subtree is considered homogeneous.
+   */
+  void build(std::shared_ptr<const HeightRangePyramid> height_ranges,
+             MaterialMap::ConstPtr material_map);
+  void clear();
+
+  /**
+   * The values of terrain_base_map_height and terrain_height_offset in the terrain shaders -
+   * the node heights are displaced like the vertices.
+   * If they change, the nodes are created anew, so no selection may refer to them.
+   */
+  void setHeightOffsets(float base_map_height, float height_offset);
+
+  /**
+   * Adds the nodes to draw to selection, which is not cleared beforehand.
+   * Creates the nodes the selection reaches for the first time.
+   * A draw_distance of 0 means unlimited.
+   */
+  void select(const Camera &camera, float draw_distance, Selection &selection);
+
+  /**
+   * Like the above, but the subtrees split_depth levels below the root are selected
+   * on thread_pool. The levels above are selected on the calling thread.
+   * The result is the same as that of the serial selection, including the order of the nodes.
+   * A split_depth of 0 selects serially.
+   */
+  void select(const Camera &camera, float draw_distance, Selection &selection,
+              int split_depth, util::ThreadPool &thread_pool = util::ThreadPool::getDefault());
+
+  const Node *getRoot() const { return m_root; }
+  size_t getNumNodes() const { return m_num_nodes; }
+
+  /// memory allocated for nodes, material and height range levels
+  size_t getMemoryUsage() const;
+
+  /// all material IDs a node can have
+  const std::set<unsigned int> &getMaterialIDs() const { return m_material_ids; }
+};
+
+
+} // namespace render_util::terrain
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "height_range_pyramid.h"
+
+#include <limits>
+#include <cassert>
+
+using namespace glm;
+
+
+namespace
+{
+
+
+constexpr vec2 EMPTY_RANGE = vec2(std::numeric_limits<float>::max(),
+                                  std::numeric_limits<float>::lowest());
+
+
+vec2 merge(const vec2 &a, const vec2 &b)
+{
+  return vec2(min(a.x, b.x), max(a.y, b.y));
+}
+
+
+vec2 getRange(const render_util::ElevationMap &map)
+{
+  vec2 range = EMPTY_RANGE;
+
+  for (int y = 0; y < map.h(); y++)
+  {
+    for (int x = 0; x < map.w(); x++)
+    {
+      auto height = map.get(x, y);
+      range = merge(range, vec2(height));
+    }
+  }
+
+  return range;
+}
+
+
+ivec2 getFloorDiv(ivec2 value, int divisor)
+{
+  return ivec2(floor(vec2(value) / float(divisor)));
+}
+
+
+} // namespace
+
+
+namespace render_util::terrain
+{
+
+
+HeightRangePyramid::HeightRangePyramid(const ElevationMap &map,
+                                       const ElevationMap *base_map,
+                                       const Parameters &params) :
+  HeightRangePyramid(map.getSize(), base_map, params, [&map] (ivec2 begin, ivec2 end)
+  {
+    const ivec2 clipped_begin = max(begin, ivec2(0));
+    const ivec2 clipped_end = min(end, map.getSize());
+
+    vec2 range = EMPTY_RANGE;
+
+    for (int y = clipped_begin.y; y < clipped_end.y; y++)
+    {
+      for (int x = clipped_begin.x; x < clipped_end.x; x++)
+      {
+        auto height = map.get(x, map.h() - 1 - y);
+        range = merge(range, vec2(height));
+      }
+    }
+
+    // outside of the map the height map texture is sampled as 0
+    if (clipped_begin != begin || clipped_end != end)
+      range = merge(range, vec2(0));
+
+    return range;
+  })
+{
+}
+
+
+HeightRangePyramid::HeightRangePyramid(const TiledHeightMap &map,
+                                       const ElevationMap *base_map,
+                                       const Parameters &params) :
+  HeightRangePyramid(map.getSize(), base_map, params, [&map] (ivec2 begin, ivec2 end)
+  {
+    const int tile_size = map.getTileSize();
+    const int border = TiledHeightMap::TILE_BORDER;
+
+    const ivec2 clipped_begin = max(begin, ivec2(0));
+    const ivec2 clipped_end = min(end, map.getSize());
+
+    vec2 range = EMPTY_RANGE;
+
+    if (all(lessThan(clipped_begin, clipped_end)))
+    {
+      // the fewest tiles whose samples - border included - cover the part inside the map
+      const ivec2 last_tile_in_map = map.getNumTiles(0) - ivec2(1);
+      const ivec2 first_tile = min(getFloorDiv(clipped_begin + ivec2(border), tile_size),
+                                   last_tile_in_map);
+      const ivec2 last_tile = clamp(getFloorDiv(clipped_end - ivec2(border + 2), tile_size),
+                                    first_tile, last_tile_in_map);
+
+      for (int y = first_tile.y; y <= last_tile.y; y++)
+      {
+        for (int x = first_tile.x; x <= last_tile.x; x++)
+          range = merge(range, map.getHeightRange(0, ivec2(x, y)));
+      }
+    }
+
+    // outside of the map the height map texture is sampled as 0
+    if (clipped_begin != begin || clipped_end != end)
+      range = merge(range, vec2(0));
+
+    return range;
+  })
+{
+}
+
+
+HeightRangePyramid::HeightRangePyramid(ivec2 map_size,
+                                       const ElevationMap *base_map,
+                                       const Parameters &params,
+                                       const CellRangeFunction &get_cell_range)
+{
+  assert(params.num_levels > 0);
+  assert(params.cell_size_px > 0);
+
+  m_num_cells_level_0 = 1 << (params.num_levels - 1);
+
+  m_levels.resize(params.num_levels);
+  m_base_map_levels.resize(params.num_levels);
+  for (int i = 0; i < params.num_levels; i++)
+  {
+    int num_cells = m_num_cells_level_0 >> i;
+    m_levels[i].resize(num_cells * num_cells, vec2(0));
+    m_base_map_levels[i].resize(num_cells * num_cells, false);
+  }
+
+  if (base_map)
+    m_base_map_range = getRange(*base_map);
+
+  const ivec2 detail_only_begin = ivec2(params.base_map_blend_px);
+  const ivec2 detail_only_end = map_size - ivec2(params.base_map_blend_px);
+
+  for (int cell_y = 0; cell_y < m_num_cells_level_0; cell_y++)
+  {
+    for (int cell_x = 0; cell_x < m_num_cells_level_0; cell_x++)
+    {
+      // The mesh of a cell has cell_size_px + 1 vertices per side -
+      // add one texel on each side to account for the bilinear filtering.
+      const ivec2 begin = params.origin_px + ivec2(cell_x, cell_y) * params.cell_size_px - ivec2(1);
+      const ivec2 end = begin + ivec2(params.cell_size_px + 3);
+
+      vec2 range = get_cell_range(begin, end);
+      assert(range.x <= range.y);
+
+      at(0, cell_x, cell_y) = range;
+
+      if (base_map)
+      {
+        bool is_detail_only = all(greaterThanEqual(begin, detail_only_begin)) &&
+                              all(lessThanEqual(end, detail_only_end));
+        m_base_map_levels[0][getIndex(0, cell_x, cell_y)] = !is_detail_only;
+      }
+    }
+  }
+
+  for (int level = 1; level < params.num_levels; level++)
+  {
+    int num_cells = m_num_cells_level_0 >> level;
+
+    for (int y = 0; y < num_cells; y++)
+    {
+      for (int x = 0; x < num_cells; x++)
+      {
+        vec2 range = at(level-1, x*2, y*2);
+        range = merge(range, at(level-1, x*2 + 1, y*2));
+        range = merge(range, at(level-1, x*2, y*2 + 1));
+        range = merge(range, at(level-1, x*2 + 1, y*2 + 1));
+
+        at(level, x, y) = range;
+
+        auto &base_map_level = m_base_map_levels[level-1];
+        m_base_map_levels[level][getIndex(level, x, y)] =
+          base_map_level[getIndex(level-1, x*2, y*2)] ||
+          base_map_level[getIndex(level-1, x*2 + 1, y*2)] ||
+          base_map_level[getIndex(level-1, x*2, y*2 + 1)] ||
+          base_map_level[getIndex(level-1, x*2 + 1, y*2 + 1)];
+      }
+    }
+  }
+}
+
+
+size_t HeightRangePyramid::getIndex(int level, int x, int y) const
+{
+  assert(level >= 0);
+  assert(level < getNumLevels());
+
+  int num_cells = m_num_cells_level_0 >> level;
+
+  assert(x >= 0);
+  assert(y >= 0);
+  assert(x < num_cells);
+  assert(y < num_cells);
+
+  return y * num_cells + x;
+}
+
+
+vec2 &HeightRangePyramid::at(int level, int x, int y)
+{
+  return m_levels[level][getIndex(level, x, y)];
+}
+
+
+vec2 HeightRangePyramid::get(int level, ivec2 cell, float base_map_height) const
+{
+  const size_t index = getIndex(level, cell.x, cell.y);
+
+  vec2 range = m_levels[level][index];
+  if (m_base_map_levels[level][index])
+    range = merge(range, m_base_map_range + vec2(base_map_height));
+
+  return range;
+}
+
+
+size_t HeightRangePyramid::getMemoryUsage() const
+{
+  size_t size = 0;
+  for (auto &level : m_levels)
+    size += level.capacity() * sizeof(vec2);
+  for (auto &level : m_base_map_levels)
+    size += level.capacity() / 8;
+  return size;
+}
+
+
+} // namespace render_util::terrain
@@ -0,0 +1,96 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TERRAIN_HEIGHT_RANGE_PYRAMID_H
+#define RENDER_UTIL_TERRAIN_HEIGHT_RANGE_PYRAMID_H
+
+#include <render_util/elevation_map.h>
+#include <render_util/tiled_height_map.h>
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+namespace render_util::terrain
+{
+
+
+/**
+ * Min/max mip pyramid over a height map, used to give terrain nodes a tight vertical extent.
+ * Level 0 has one cell per leaf node, each following level halves the resolution.
+ * Ranges are stored as vec2(min, max) in meters.
+ */
+class HeightRangePyramid
+{
+  /// the range of the detail map - the base map is merged in by get()
+  std::vector<std::vector<glm::vec2>> m_levels;
+  /// whether the base map shows in (part of) the cell
+  std::vector<std::vector<bool>> m_base_map_levels;
+  glm::vec2 m_base_map_range = glm::vec2(0);
+  int m_num_cells_level_0 = 0;
+
+  /// range of the map samples from begin to end (exclusive), in terrain space
+  using CellRangeFunction = std::function<glm::vec2(glm::ivec2 begin, glm::ivec2 end)>;
+
+  size_t getIndex(int level, int x, int y) const;
+  glm::vec2 &at(int level, int x, int y);
+
+public:
+  struct Parameters
+  {
+    int num_levels = 0;
+    /// number of height map texels per side of a level 0 cell
+    int cell_size_px = 0;
+    /// position of the first level 0 cell in height map texels, relative to the map origin
+    glm::ivec2 origin_px = glm::ivec2(0);
+    /// width of the border (in texels) in which the detail map is blended with the base map
+    int base_map_blend_px = 0;
+  };
+
+  /**
+   * map is sampled the way the terrain shader does it: texel (x, y) of the image
+   * is located at (x, map.h() - 1 - y) in terrain space, everything outside the map has height 0.
+   * If base_map is given, cells that are not entirely covered by the detail map
+   * also include the range of the base map.
+   */
+  HeightRangePyramid(const ElevationMap &map, const ElevationMap *base_map, const Parameters&);
+
+  /**
+   * Like the above, but only the tile ranges stored in the file are read, so the ranges
+   * may be wider than necessary where the cells don't line up with the tiles.
+   */
+  HeightRangePyramid(const TiledHeightMap &map, const ElevationMap *base_map, const Parameters&);
+
+  int getNumLevels() const { return m_levels.size(); }
+  size_t getMemoryUsage() const;
+
+  /**
+   * base_map_height is added to the base map samples,
+   * like terrain_base_map_height in the terrain shaders.
+   */
+  glm::vec2 get(int level, glm::ivec2 cell, float base_map_height = 0) const;
+
+private:
+  HeightRangePyramid(glm::ivec2 map_size, const ElevationMap *base_map, const Parameters&,
+                     const CellRangeFunction&);
+};
+
+
+} // namespace render_util::terrain
+
+#endif
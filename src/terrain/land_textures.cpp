@@ -34,6 +34,7 @@ namespace
 
 template <class T>
 void createTextureArrays(std::vector<typename T::Ptr> &textures_in,
+    TextureCompression compression,
     const std::vector<int> &scale_level_indices,
     TerrainBase::TypeMap::ConstPtr type_map_in,
     std::array<TexturePtr, render_util::MAX_TERRAIN_TEXUNITS> &arrays_out,
@@ -78,12 +79,10 @@ void createTextureArrays(std::vector<typename T::Ptr> &textures_in,
     if (!image)
       continue;
 
-    while (image->w() < smallest_size)
+    if (image->w() < smallest_size)
     {
-//       auto biggest_size = texture_sizes.back();
-//       LOG_INFO<<"image->w(): "<<image->w()<<", smallest_size: "
-//         <<smallest_size<<", biggest_size: "<<biggest_size<<endl;
-      image = render_util::upSample(image, 2);
+      image = render_util::resample(image, ivec2(smallest_size),
+                                    ResampleFilter::BILINEAR, ResampleEdgeMode::WRAP);
     }
 
     auto index = array_index_for_size.at(image->w());
@@ -155,7 +154,8 @@ void createTextureArrays(std::vector<typename T::Ptr> &textures_in,
       continue;
 
     LOG_TRACE<<"array: "<<i<<endl;
-    arrays_out.at(i) = render_util::createTextureArray<T>(textures);
+    arrays_out.at(i) = render_util::createCompressedTextureArray<T>(textures, compression,
+                                              getDefaultCompressedTextureCacheDir());
     textures.clear();
 
     CHECK_GL_ERROR();
@@ -218,6 +218,7 @@ LandTextures::LandTextures(const TextureManager &texture_manager,
   m_enable_normal_maps = !textures_nm.empty();
 
   createTextureArrays<ImageRGBA>(textures,
+                                 TextureCompression::COLOR,
                                  scale_level_indices,
                                  type_map_,
                                  m_textures,
@@ -228,9 +229,13 @@ LandTextures::LandTextures(const TextureManager &texture_manager,
   if (m_enable_normal_maps)
   {
     m_shader_params.set("enable_terrain_detail_nm", true);
+    // BC5 only stores x and y
+    m_shader_params.set("terrain_detail_nm_xy",
+                        isTextureCompressionSupported(TextureCompression::NORMAL_MAP));
     assert(textures.size() == textures_nm.size());
 
     createTextureArrays<ImageRGB>(textures_nm,
+                                  TextureCompression::NORMAL_MAP,
                                   scale_level_indices,
                                   type_map_,
                                   m_textures_nm,
@@ -351,19 +356,32 @@ void LandTextures::unbind(TextureManager &tm)
 }
 
 
-void LandTextures::setUniforms(ShaderProgramPtr program)
+LandTextures::Uniforms LandTextures::getUniforms(ShaderProgram &program) const
 {
-  assert(m_type_map_size != glm::ivec2(0));
-  program->setUniform("typeMapSize", m_type_map_size);
-  assert(!m_scale_levels.empty());
-  program->setUniform("terrain.max_texture_scale", m_scale_levels.back());
+  Uniforms uniforms;
+  uniforms.type_map_size = program.getUniformHandle<glm::ivec2>("typeMapSize");
+  uniforms.max_texture_scale = program.getUniformHandle<float>("terrain.max_texture_scale");
 
-  int i = 0;
-  for (auto scale : m_scale_levels)
+  for (size_t i = 0; i < m_scale_levels.size(); i++)
   {
-    program->setUniform("terrain.land_texture_scale_levels[" + std::to_string(i) + "]", scale);
-    i++;
+    uniforms.scale_levels.push_back(program.getUniformHandle<float>(
+      "terrain.land_texture_scale_levels[" + std::to_string(i) + "]"));
   }
+
+  return uniforms;
+}
+
+
+void LandTextures::setUniforms(ShaderProgram &program, const Uniforms &uniforms) const
+{
+  assert(m_type_map_size != glm::ivec2(0));
+  program.setUniform(uniforms.type_map_size, m_type_map_size);
+  assert(!m_scale_levels.empty());
+  program.setUniform(uniforms.max_texture_scale, m_scale_levels.back());
+
+  assert(uniforms.scale_levels.size() == m_scale_levels.size());
+  for (size_t i = 0; i < m_scale_levels.size(); i++)
+    program.setUniform(uniforms.scale_levels[i], m_scale_levels[i]);
 }
 
 
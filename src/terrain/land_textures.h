@@ -60,7 +60,17 @@ public:
 
   void bind(TextureManager&);
   void unbind(TextureManager&);
-  void setUniforms(ShaderProgramPtr program);
+
+  /// uniform handles resolved for one program
+  struct Uniforms
+  {
+    UniformHandle<glm::ivec2> type_map_size;
+    UniformHandle<float> max_texture_scale;
+    std::vector<UniformHandle<float>> scale_levels;
+  };
+
+  Uniforms getUniforms(ShaderProgram &program) const;
+  void setUniforms(ShaderProgram &program, const Uniforms &uniforms) const;
 };
 
 
@@ -289,20 +289,21 @@ struct render_util::Terrain::Private
   
   void deleteGLObjects() {
     if (vao_id)
+    {
       gl::DeleteVertexArrays(1, &vao_id);
+      getCurrentGLContext()->forgetVertexArray(vao_id);
+    }
     vao_id = 0;
 
-    if (vertex_buffer_id)
-      gl::DeleteBuffers(1, &vertex_buffer_id);
-    vertex_buffer_id = 0;
-
-    if (normal_buffer_id)
-      gl::DeleteBuffers(1, &normal_buffer_id);
-    normal_buffer_id = 0;
-
-    if (index_buffer_id)
-      gl::DeleteBuffers(1, &index_buffer_id);
-    index_buffer_id = 0;
+    for (auto id : { &vertex_buffer_id, &normal_buffer_id, &index_buffer_id })
+    {
+      if (*id)
+      {
+        gl::DeleteBuffers(1, id);
+        getCurrentGLContext()->forgetBuffer(*id);
+      }
+      *id = 0;
+    }
   }
   
   void build(bool low_detail)
@@ -330,17 +331,19 @@ struct render_util::Terrain::Private
     gl::GenVertexArrays(1, &vao_id);
     assert(vao_id > 0);
 
-    gl::BindVertexArray(vao_id);
+    auto context = getCurrentGLContext();
 
-    createVboIndexed();
+    context->bindVertexArray(vao_id);
 
-    gl::BindVertexArray(0);
+    createVboIndexed();
 
-    gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
+    // stays attached to the vertex array
+    context->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
     gl::BufferData(GL_ELEMENT_ARRAY_BUFFER,
                 mesh->triangle_data_indexed.size() * sizeof(GLuint),
                 mesh->triangle_data_indexed.data(), GL_STATIC_DRAW);
-    gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    context->bindVertexArray(0);
 
 
     for (auto &n : mesh->normals)
@@ -357,7 +360,9 @@ struct render_util::Terrain::Private
 
     cout<<"Terrain::Private::createVboIndexed()"<<endl;
 
-    gl::BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+    auto context = getCurrentGLContext();
+
+    context->bindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
     gl::BufferData(GL_ARRAY_BUFFER,
                   mesh->vertices.size() * sizeof(Vertex),
                   mesh->vertices.data(), GL_STATIC_DRAW);
@@ -369,7 +374,7 @@ struct render_util::Terrain::Private
     CHECK_GL_ERROR();
 
 
-    gl::BindBuffer(GL_ARRAY_BUFFER, normal_buffer_id);
+    context->bindBuffer(GL_ARRAY_BUFFER, normal_buffer_id);
     gl::BufferData(GL_ARRAY_BUFFER,
                   mesh->normals.size() * sizeof(Normal),
                   mesh->normals.data(), GL_STATIC_DRAW);
@@ -378,7 +383,7 @@ struct render_util::Terrain::Private
 
     CHECK_GL_ERROR();
 
-    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    context->bindBuffer(GL_ARRAY_BUFFER, 0);
   }
 };
 
@@ -413,18 +418,15 @@ void render_util::Terrain::draw()
 
   program->assertUniformsAreSet();
 
-  gl::BindVertexArray(p->vao_id);
-  CHECK_GL_ERROR();
-  
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->index_buffer_id);
+  auto context = getCurrentGLContext();
+
+  context->bindVertexArray(p->vao_id);
   CHECK_GL_ERROR();
 
   gl::DrawElements(GL_TRIANGLES, p->num_indices, GL_UNSIGNED_INT, 0);
   CHECK_GL_ERROR();
-  
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-  gl::BindVertexArray(0);
+  context->bindVertexArray(0);
 }
 
 const string &render_util::Terrain::getName()
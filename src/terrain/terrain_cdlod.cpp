@@ -23,10 +23,13 @@
  */
 
 #include "terrain_cdlod_base.h"
+#include "cdlod_quad_tree.h"
+#include "terrain_tile_cache.h"
 #include "terrain_layer.h"
 #include "land_textures.h"
 #include "grid_mesh.h"
 #include <render_util/vao.h>
+#include <render_util/stream_buffer.h>
 #include <render_util/terrain_cdlod.h>
 #include <render_util/texture_manager.h>
 #include <render_util/texunits.h>
@@ -39,11 +42,12 @@
 #include <render_util/shader_util.h>
 #include <render_util/render_util.h>
 #include <render_util/globals.h>
-#include <block_allocator.h>
+#include <render_util/profiler.h>
 
 #include <array>
 #include <vector>
 #include <iostream>
+#include <chrono>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/round.hpp>
 
@@ -73,10 +77,14 @@ namespace
 {
 
 
+/// with a tiled map, the first level that doesn't exceed this is kept in memory as a whole
+constexpr int MAX_OVERVIEW_MAP_SIZE = 2048;
+
+
 class Material;
 
 using MaterialID = render_util::TerrainBase::MaterialID;
-using BoundingBox = render_util::Box;
+using SelectedNode = render_util::terrain::CDLODQuadTree::SelectedNode;
 
 
 struct DetailOption
@@ -123,12 +131,6 @@ size_t getDetailLevelAtDistance(double dist)
 }
 
 
-unsigned int getDefaultMaterial()
-{
-  return TerrainBase::MaterialID::WATER;
-}
-
-
 render_util::ShaderProgramPtr createProgram(std::string name,
                                             unsigned int material,
                                             size_t detail_level,
@@ -152,7 +154,7 @@ render_util::ShaderProgramPtr createProgram(std::string name,
 
   CHECK_GL_ERROR();
 
-  map<unsigned int, string>  attribute_locations = { { 4, "attrib_pos" } };
+  map<unsigned int, string>  attribute_locations = { { 4, "attrib_pos" }, { 5, "attrib_tile" } };
 
   ShaderParameters params = params_;
   params.set("enable_base_map", enable_base_map);
@@ -183,27 +185,21 @@ render_util::ShaderProgramPtr createProgram(std::string name,
 }
 
 
-struct Node
+// handles of the uniforms set by TerrainCDLOD - resolved once per program
+struct TerrainUniforms
 {
-  std::array<Node*, 4> children;
-  vec2 pos = vec2(0);
-  vec2 pos_grid = vec2(0);
-  float size = 0;
-  float max_height = 0;
-  BoundingBox bounding_box;
-  unsigned int material_id = 0;
-  Material *material = nullptr;
-
-  bool isInRange(const vec3 &camera_pos, float radius)
-  {
-    return bounding_box.getShortestDistance(camera_pos) <= radius;
-  }
+  std::vector<TerrainLayer::Uniforms> layers;
+  LandTextures::Uniforms land_textures;
+  render_util::UniformHandle<float> cdlod_min_dist;
+  render_util::UniformHandle<int> mesh_resolution_m;
+  render_util::UniformHandle<int> tile_size_m;
+  render_util::UniformHandle<float> max_texture_scale;
+  render_util::UniformHandle<int> tile_cache_height_tiles;
+  render_util::UniformHandle<int> tile_cache_normal_tiles;
+  render_util::UniformHandle<int> tile_cache_resolution_m;
 };
 
 
-typedef util::BlockAllocator<Node, 1000> NodeAllocator;
-
-
 struct RenderBatch
 {
   struct NodePos
@@ -214,7 +210,17 @@ struct RenderBatch
     float w = 0;
   };
 
+  /// follows each NodePos if the terrain uses a tile cache - see TerrainTileCache::TileInstance
+  struct NodeTile
+  {
+    float layer = 0;
+    float x = 0;
+    float y = 0;
+    float scale = 0;
+  };
+
   const render_util::ShaderProgramPtr program;
+  TerrainUniforms uniforms;
   std::vector<vec2> positions;
   std::vector<int> lods;
   size_t node_pos_buffer_offset = 0;
@@ -222,10 +228,10 @@ struct RenderBatch
 
   RenderBatch(render_util::ShaderProgramPtr program) : program(program) {}
 
-  void addNode(Node *node, int lod)
+  void addNode(const SelectedNode &node)
   {
-    positions.push_back(node->pos_grid);
-    lods.push_back(lod);
+    positions.push_back(node.pos_grid);
+    lods.push_back(node.lod_level);
   }
 
   void clear()
@@ -277,17 +283,17 @@ public:
     clear();
   }
 
-  void addNode(Node *node, int lod, size_t detail_level)
+  void addNode(Material *material, const SelectedNode &node, size_t detail_level)
   {
-    assert(node->material);
+    assert(material);
 
-    auto batch = node->material->getBatch(detail_level);
+    auto batch = material->getBatch(detail_level);
     if (!batch->is_active)
     {
       m_active_batches.push_back(batch);
       batch->is_active = true;
     }
-    batch->addNode(node, lod);
+    batch->addNode(node);
   }
 
   void clear()
@@ -306,93 +312,6 @@ public:
 };
 
 
-unsigned int getMaterial(render_util::TerrainBase::MaterialMap::ConstPtr map, ivec2 pos)
-{
-  if (pos.x < 0 || pos.y < 0 || pos.x >= map->w() || pos.y >= map->h())
-  {
-    return getDefaultMaterial();
-  }
-
-  return map->get(pos);
-}
-
-
-unsigned int gatherMaterials(render_util::TerrainBase::MaterialMap::ConstPtr map,
-                             ivec2 begin,
-                             ivec2 size)
-{
-  auto end = begin + size;
-
-  unsigned int material = 0;
-
-  for (int y = begin.y; y < end.y; y++)
-  {
-    for (int x = begin.x; x < end.x; x++)
-    {
-      material |= getMaterial(map, ivec2(x,y));
-    }
-  }
-
-  assert(material);
-
-  return material;
-}
-
-
-render_util::TerrainBase::MaterialMap::Ptr
-processMaterialMap(render_util::TerrainBase::MaterialMap::ConstPtr in)
-{
-  if (!in)
-    return {};
-
-  uvec2 new_size = uvec2(in->getSize()) / TerrainCDLODBase::MESH_GRID_SIZE;
-
-  if (in->w() % TerrainCDLODBase::MESH_GRID_SIZE != 0)
-    new_size.x++;
-  if (in->h() % TerrainCDLODBase::MESH_GRID_SIZE != 0)
-    new_size.y++;
-
-  auto resized = std::make_shared<render_util::TerrainBase::MaterialMap>(new_size);
-
-  for (int y = 0; y < resized->h(); y++)
-  {
-    for (int x = 0; x < resized->w(); x++)
-    {
-      auto src_coords = ivec2(x,y) * ivec2(TerrainCDLODBase::MESH_GRID_SIZE);
-      auto size = ivec2(TerrainCDLODBase::MESH_GRID_SIZE);
-
-      resized->at(x,y) = gatherMaterials(in, src_coords, size);
-    }
-  }
-
-  return resized;
-}
-
-
-unsigned int getMaterialID(render_util::TerrainBase::MaterialMap::ConstPtr material_map,
-                         const glm::dvec2 &node_origin)
-{
-  assert(fract(node_origin) == dvec2(0));
-
-  if (material_map)
-  {
-    const uvec2 grid_pos = uvec2(node_origin) / (unsigned int)TerrainCDLODBase::LEAF_NODE_SIZE;
-
-    if (node_origin.x < 0 || node_origin.y < 0)
-      return getDefaultMaterial();
-
-    if (grid_pos.x >= material_map->w() || grid_pos.y >= material_map->h())
-      return getDefaultMaterial();
-
-    return material_map->get(grid_pos.x, grid_pos.y);
-  }
-  else
-  {
-    return MaterialID::ALL;
-  }
-}
-
-
 } // namespace
 
 
@@ -406,29 +325,34 @@ class TerrainCDLOD : public TerrainCDLODBase
 
   ShaderSearchPath shader_search_path;
 
-  NodeAllocator node_allocator;
+  CDLODQuadTree quad_tree;
+  CDLODQuadTree::Selection selection;
   RenderList render_list;
-  Node *root_node = 0;
-  dvec2 root_node_pos = -dvec2(getNodeSize(MAX_LOD) / 2.0);
 
   std::unique_ptr<VertexArrayObject> vao;
-  GLuint node_pos_buffer_id = 0;
+  std::unique_ptr<StreamBuffer> node_pos_buffer;
+  size_t instance_size = sizeof(RenderBatch::NodePos);
+  size_t num_instances = 0;
 
   int num_indices = 0;
   float draw_distance = 0;
+  int selection_split_depth = 0;
 
   vec2 m_base_map_origin = vec2(0);
+  float m_base_map_height = 0;
+  float m_height_offset = 0;
 
   std::vector<TerrainLayer> m_layers;
   std::unordered_map<unsigned int, std::unique_ptr<Material>> materials;
   std::unique_ptr<LandTextures> m_land_textures;
   render_util::ShaderParameters m_shader_params;
   std::string m_program_name;
+  std::unique_ptr<TerrainTileCache> m_tile_cache;
 
-  void processNode(Node *node, int lod_level, const Camera &camera, bool low_detail);
+  void createInstanceBuffer();
   void drawInstanced(TerrainBase::Client *client);
-  Node *createNode(const render_util::ElevationMap &map, dvec2 pos, int lod_level, MaterialMap::ConstPtr material_map);
-  void setUniforms(ShaderProgramPtr program);
+  TerrainUniforms getUniforms(ShaderProgram &program);
+  void setUniforms(RenderBatch &batch);
   Material *getMaterial(unsigned int id);
   bool hasBaseMap();
 
@@ -440,9 +364,13 @@ public:
   void draw(TerrainBase::Client *client) override;
   void update(const Camera &camera, bool low_detail) override;
   void setDrawDistance(float dist) override;
+  void setSelectionSplitDepth(int depth) override;
   render_util::TexturePtr getNormalMapTexture() override;
   void setProgramName(std::string name) override;
   void setBaseMapOrigin(glm::vec2 origin) override;
+  void setBaseMapHeight(float height) override;
+  void setHeightOffset(float offset) override;
+  Statistics getStatistics() override;
 };
 
 
@@ -454,12 +382,13 @@ TerrainCDLOD::~TerrainCDLOD()
 
   CHECK_GL_ERROR();
 
-  gl::DeleteBuffers(1, &node_pos_buffer_id);
+  node_pos_buffer.reset();
+  m_tile_cache.reset();
 
   CHECK_GL_ERROR();
 
-  root_node = nullptr;
-  node_allocator.clear();
+  selection.clear();
+  quad_tree.clear();
 
   m_land_textures->unbind(texture_manager);
 
@@ -475,19 +404,40 @@ TerrainCDLOD::TerrainCDLOD(TextureManager &tm, const ShaderSearchPath &shader_se
 
   num_indices = mesh.getNumIndices();
 
-  gl::GenBuffers(1, &node_pos_buffer_id);
-  assert(node_pos_buffer_id > 0);
-
   vao = std::make_unique<VertexArrayObject>(mesh, false);
 
+  createInstanceBuffer();
+}
+
+
+void TerrainCDLOD::createInstanceBuffer()
+{
+  instance_size = sizeof(RenderBatch::NodePos);
+  if (m_tile_cache)
+    instance_size += sizeof(RenderBatch::NodeTile);
+
+  node_pos_buffer = std::make_unique<StreamBuffer>(GL_ARRAY_BUFFER,
+                                                   getNumLeafNodes() * instance_size);
+
   VertexArrayObjectBinding vao_binding(*vao);
 
+  auto context = getCurrentGLContext();
+
+  context->bindBuffer(GL_ARRAY_BUFFER, node_pos_buffer->getID());
+
   gl::EnableVertexAttribArray(4);
   gl::VertexAttribDivisor(4, 1);
+  gl::VertexAttribPointer(4, 4, GL_FLOAT, false, instance_size, nullptr);
 
-  gl::BindBuffer(GL_ARRAY_BUFFER, node_pos_buffer_id);
-  gl::VertexAttribPointer(4, 4, GL_FLOAT, false, 0, nullptr);
-  gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+  if (m_tile_cache)
+  {
+    gl::EnableVertexAttribArray(5);
+    gl::VertexAttribDivisor(5, 1);
+    gl::VertexAttribPointer(5, 4, GL_FLOAT, false, instance_size,
+                            (void*)sizeof(RenderBatch::NodePos));
+  }
+
+  context->bindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 
@@ -510,145 +460,136 @@ Material *TerrainCDLOD::getMaterial(unsigned int id)
   auto shader_params = m_shader_params;
   shader_params.add(m_land_textures->getShaderParameters());
 
-  materials[id] = std::make_unique<Material>(m_program_name,
+  auto material = std::make_unique<Material>(m_program_name,
                                              id, texture_manager, shader_search_path,
                                              shader_params,
                                              hasBaseMap());
 
+  for (size_t i = 0; i < NUM_DETAIL_LEVELS; i++)
+  {
+    auto batch = material->getBatch(i);
+    batch->uniforms = getUniforms(*batch->program);
+  }
+
+  materials[id] = std::move(material);
+
   return materials[id].get();
 }
 
 
-void TerrainCDLOD::setUniforms(ShaderProgramPtr program)
+TerrainUniforms TerrainCDLOD::getUniforms(ShaderProgram &program)
 {
-  for (auto& layer : m_layers)
-    layer.setUniforms(program, texture_manager);
-
-  program->setUniform("cdlod_min_dist", MIN_LOD_DIST);
+  TerrainUniforms uniforms;
 
-  program->setUniformi("terrain.mesh_resolution_m", GRID_RESOLUTION_M);
-
-  program->setUniformi("terrain.tile_size_m", TILE_SIZE_M);
-  program->setUniform("terrain.max_texture_scale", LandTextures::MAX_TEXTURE_SCALE);
+  for (auto& layer : m_layers)
+    uniforms.layers.push_back(layer.getUniforms(program));
+
+  uniforms.cdlod_min_dist = program.getUniformHandle<float>("cdlod_min_dist");
+  uniforms.mesh_resolution_m = program.getUniformHandle<int>("terrain.mesh_resolution_m");
+  uniforms.tile_size_m = program.getUniformHandle<int>("terrain.tile_size_m");
+  uniforms.max_texture_scale = program.getUniformHandle<float>("terrain.max_texture_scale");
+  uniforms.tile_cache_height_tiles =
+    program.getUniformHandle<int>("terrain.tile_cache.height_tiles");
+  uniforms.tile_cache_normal_tiles =
+    program.getUniformHandle<int>("terrain.tile_cache.normal_tiles");
+  uniforms.tile_cache_resolution_m =
+    program.getUniformHandle<int>("terrain.tile_cache.resolution_m");
 
   assert(m_land_textures);
-  m_land_textures->setUniforms(program);
+  uniforms.land_textures = m_land_textures->getUniforms(program);
+
+  return uniforms;
 }
 
 
-Node *TerrainCDLOD::createNode(const render_util::ElevationMap &map,
-                                        dvec2 pos,
-                                        int lod_level,
-                                        MaterialMap::ConstPtr material_map)
+void TerrainCDLOD::setUniforms(RenderBatch &batch)
 {
-  assert(fract(pos) == dvec2(0));
+  auto &program = *batch.program;
+  auto &uniforms = batch.uniforms;
 
-  Node *node = node_allocator.alloc();
-  node->pos = vec2(pos);
-  node->pos_grid = vec2(pos / (double)METERS_PER_GRID);
+  assert(uniforms.layers.size() == m_layers.size());
+  for (size_t i = 0; i < m_layers.size(); i++)
+    m_layers[i].setUniforms(program, uniforms.layers[i], texture_manager);
 
-  assert(fract(node->pos) == vec2(0));
-  assert(fract(node->pos_grid) == vec2(0));
+  program.setUniform(uniforms.cdlod_min_dist, MIN_LOD_DIST);
 
-  double node_size = getNodeSize(lod_level);
+  program.setUniform(uniforms.mesh_resolution_m, GRID_RESOLUTION_M);
 
-  node->size = node_size;
+  program.setUniform(uniforms.tile_size_m, TILE_SIZE_M);
+  program.setUniform(uniforms.max_texture_scale, LandTextures::MAX_TEXTURE_SCALE);
 
-  if (lod_level == 0)
+  if (m_tile_cache)
   {
-    node->max_height = getMaxHeight(map, node->pos, node_size);
-    node->material_id = ::getMaterialID(material_map, pos);
+    program.setUniform(uniforms.tile_cache_height_tiles,
+                       texture_manager.getTexUnitNum(TEXUNIT_TERRAIN_CDLOD_HEIGHT_TILES));
+    program.setUniform(uniforms.tile_cache_normal_tiles,
+                       texture_manager.getTexUnitNum(TEXUNIT_TERRAIN_CDLOD_NORMAL_TILES));
+    program.setUniform(uniforms.tile_cache_resolution_m, (int)HEIGHT_MAP_METERS_PER_GRID);
   }
-  else
-  {
-    double child_node_size = node_size / 2;
-    assert(child_node_size == getNodeSize(lod_level-1));
-
-    node->children[0] = createNode(map, pos + dvec2(0, child_node_size), lod_level-1, material_map);
-    node->children[1] = createNode(map, pos + dvec2(child_node_size), lod_level-1, material_map);
-    node->children[2] = createNode(map, pos + dvec2(0, 0), lod_level-1, material_map);
-    node->children[3] = createNode(map, pos + dvec2(child_node_size, 0), lod_level-1, material_map);
 
-    for (Node *child : node->children)
-    {
-      node->max_height = max(node->max_height, child->max_height);
-      node->material_id |= child->material_id;
-    }
-  }
+  assert(m_land_textures);
+  m_land_textures->setUniforms(program, uniforms.land_textures);
+}
 
-  auto bb_origin = vec3(node->pos, 0);
-  auto bb_extent = vec3(node_size, node_size, node->max_height);
-  node->bounding_box.set(bb_origin, bb_extent);
 
-  assert(node->material_id);
-  node->material = getMaterial(node->material_id);
+void TerrainCDLOD::build(BuildParameters &params)
+{
+  CHECK_GL_ERROR();
 
-  return node;
-}
+  assert(params.material_map);
+  assert(params.map || params.tiled_map);
+  assert(!quad_tree.getRoot());
+  assert(m_layers.empty());
 
+  m_shader_params = params.shader_parameters;
 
-void TerrainCDLOD::processNode(Node *node, int lod_level, const Camera &camera, bool low_detail)
-{
-  auto camera_pos = camera.getPos();
+  CHECK_GL_ERROR();
 
-  if (camera.cull(node->bounding_box))
-    return;
+  m_land_textures =
+    std::make_unique<LandTextures>(texture_manager, params.textures,
+                                      params.textures_nm, params.texture_scale, params.type_map);
 
-  size_t detail_level = 0;
-  if (!low_detail)
-  {
-    for (size_t i = 0; i < NUM_DETAIL_LEVELS; i++)
-    {
-      if (node->isInRange(camera_pos, getDetailLevel(i).distance))
-        detail_level = i;
-    }
-  }
+  auto map = params.map;
+  int map_resolution_m = HEIGHT_MAP_METERS_PER_GRID;
 
-  if (lod_level == 0)
+  if (params.tiled_map)
   {
-    if (draw_distance > 0.0  && !node->isInRange(camera_pos, draw_distance))
-      return;
+    auto &tiled_map = *params.tiled_map;
 
-    render_list.addNode(node, 0, detail_level);
-  }
-  else
-  {
-    if (node->isInRange(camera_pos, getLodLevelDist(lod_level-1)))
+    // a node must not span more than one tile
+    if (!glm::isPowerOfTwo(tiled_map.getTileSize()) ||
+        tiled_map.getTileSize() < (int)MESH_GRID_SIZE)
     {
-      // select children
-      for (Node *child : node->children)
-      {
-        processNode(child, lod_level-1, camera, low_detail);
-      }
+      LOG_ERROR<<"TerrainCDLOD: unsupported tile size: "<<tiled_map.getTileSize()<<endl;
+      abort();
     }
-    else
-    {
-      if (draw_distance > 0.0  && !node->isInRange(camera_pos, draw_distance))
-        return;
 
-      render_list.addNode(node, lod_level, detail_level);
+    // the tiles are used for the terrain mesh - everything else gets by with a coarser level
+    int level = 0;
+    while (level < tiled_map.getNumLevels() - 1 &&
+           std::max(tiled_map.getSize(level).x, tiled_map.getSize(level).y) > MAX_OVERVIEW_MAP_SIZE)
+    {
+      level++;
     }
-  }
-}
 
+    map = tiled_map.readLevel(level);
+    map_resolution_m = HEIGHT_MAP_METERS_PER_GRID << level;
 
-void TerrainCDLOD::build(BuildParameters &params)
-{
-  CHECK_GL_ERROR();
-
-  assert(params.material_map);
-  assert(!root_node);
-  assert(m_layers.empty());
-
-  m_shader_params = params.shader_parameters;
+    m_tile_cache = std::make_unique<TerrainTileCache>(params.tiled_map);
+    m_shader_params.set("enable_terrain_tile_cache", true);
+    createInstanceBuffer();
 
-  CHECK_GL_ERROR();
+    LOG_INFO<<"TerrainCDLOD: tiled height map: "<<tiled_map.getSize().x<<"x"<<tiled_map.getSize().y
+            <<", "<<tiled_map.getNumLevels()<<" levels, tile size: "<<tiled_map.getTileSize()
+            <<", file size: "<<tiled_map.getFileSize() / (1024 * 1024)<<" MiB, "
+            <<"overview level: "<<level<<" ("<<map->w()<<"x"<<map->h()<<")"<<endl;
+  }
 
-  m_land_textures =
-    std::make_unique<LandTextures>(texture_manager, params.textures,
-                                      params.textures_nm, params.texture_scale, params.type_map);
+  const vec2 map_size_m = params.tiled_map ?
+    vec2(params.tiled_map->getSize() * (int)HEIGHT_MAP_METERS_PER_GRID) :
+    vec2(map->getSize() * (int)HEIGHT_MAP_METERS_PER_GRID);
 
-  auto hm_image = params.map;
+  auto hm_image = map;
   auto new_size = glm::ceilPowerOfTwo(hm_image->size());
 
   if (new_size != hm_image->size())
@@ -660,8 +601,8 @@ void TerrainCDLOD::build(BuildParameters &params)
     TerrainTextureMap hm =
     {
       .texunit = TEXUNIT_TERRAIN_CDLOD_HEIGHT_MAP,
-      .resolution_m = HEIGHT_MAP_METERS_PER_GRID,
-      .size_m = hm_image->getSize() * (int)HEIGHT_MAP_METERS_PER_GRID,
+      .resolution_m = map_resolution_m,
+      .size_m = hm_image->getSize() * map_resolution_m,
       .size_px = hm_image->getSize(),
       .texture = createHeightMapTexture(hm_image),
       .name = "height_map",
@@ -670,16 +611,16 @@ void TerrainCDLOD::build(BuildParameters &params)
     TerrainTextureMap nm =
     {
       .texunit = TEXUNIT_TERRAIN_CDLOD_NORMAL_MAP,
-      .resolution_m = HEIGHT_MAP_METERS_PER_GRID,
-      .size_m = params.map->getSize() * (int)HEIGHT_MAP_METERS_PER_GRID,
-      .size_px = params.map->getSize(),
-      .texture = createNormalMapTexture(params.map, HEIGHT_MAP_METERS_PER_GRID),
+      .resolution_m = map_resolution_m,
+      .size_m = map->getSize() * map_resolution_m,
+      .size_px = map->getSize(),
+      .texture = createNormalMapTexture(map, map_resolution_m),
       .name = "normal_map",
     };
 
     TerrainLayer layer;
     layer.origin_m = vec2(0);
-    layer.size_m = vec2(params.map->getSize() * (int)HEIGHT_MAP_METERS_PER_GRID);
+    layer.size_m = map_size_m;
     layer.uniform_prefix = "terrain.detail_layer.";
     layer.texture_maps.push_back(hm);
     layer.texture_maps.push_back(nm);
@@ -724,57 +665,163 @@ void TerrainCDLOD::build(BuildParameters &params)
   }
 
   LOG_DEBUG<<"TerrainCDLOD: creating nodes ..."<<endl;
-  root_node = createNode(*params.map, root_node_pos, MAX_LOD, processMaterialMap(params.material_map));
+  {
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    auto start_time = Clock::now();
+
+    std::shared_ptr<const HeightRangePyramid> height_ranges = params.tiled_map ?
+      CDLODQuadTree::createHeightRanges(*params.tiled_map, params.base_map.get()) :
+      CDLODQuadTree::createHeightRanges(*params.map, params.base_map.get());
+
+    auto height_ranges_time = Clock::now();
+
+    quad_tree.build(height_ranges, params.material_map);
+
+    auto end_time = Clock::now();
+
+    LOG_INFO<<"TerrainCDLOD: height ranges: "<<Seconds(height_ranges_time - start_time).count()
+            <<" s, "<<height_ranges->getMemoryUsage() / 1024<<" KiB"<<endl;
+    LOG_INFO<<"TerrainCDLOD: quad tree: "<<Seconds(end_time - height_ranges_time).count()
+            <<" s, "<<quad_tree.getNumNodes()<<" nodes, "
+            <<quad_tree.getMemoryUsage() / 1024<<" KiB total"<<endl;
+  }
   LOG_DEBUG<<"TerrainCDLOD: creating nodes done."<<endl;
 
+  {
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    auto cache_stats_before = render_util::getShaderCacheStatistics();
+    auto start_time = Clock::now();
+
+    for (auto id : quad_tree.getMaterialIDs())
+      getMaterial(id);
+
+    auto cache_stats = render_util::getShaderCacheStatistics();
+
+    LOG_INFO<<"TerrainCDLOD: programs: "<<Seconds(Clock::now() - start_time).count()<<" s, "
+            <<"source cache: "
+            <<cache_stats.num_source_hits - cache_stats_before.num_source_hits<<" hits / "
+            <<cache_stats.num_source_misses - cache_stats_before.num_source_misses<<" misses, "
+            <<"binary cache: "
+            <<cache_stats.num_binary_hits - cache_stats_before.num_binary_hits<<" hits / "
+            <<cache_stats.num_binary_misses - cache_stats_before.num_binary_misses<<" misses"
+            <<endl;
+  }
+
   LOG_DEBUG<<"TerrainCDLOD: done building terrain."<<endl;
 }
 
 
 void TerrainCDLOD::update(const Camera &camera, bool low_detail)
 {
-  assert(root_node);
+  RENDER_UTIL_PROFILE_SCOPE("TerrainCDLOD::update");
 
   render_list.clear();
+  selection.clear();
 
-  processNode(root_node, MAX_LOD, camera, low_detail);
+  // recreates the nodes if the offsets changed - nothing refers to them now
+  quad_tree.setHeightOffsets(m_base_map_height, m_height_offset);
 
-  constexpr int buffer_elements = getNumLeafNodes();
-  constexpr int buffer_size = sizeof(RenderBatch::NodePos) * buffer_elements;
+  quad_tree.select(camera, draw_distance, selection, selection_split_depth);
 
-  size_t buffer_pos = 0;
+  for (auto &selected : selection.nodes)
+  {
+    size_t detail_level = 0;
+    if (!low_detail)
+    {
+      for (size_t i = 0; i < NUM_DETAIL_LEVELS; i++)
+      {
+        if (selected.isInRange(getDetailLevel(i).distance))
+          detail_level = i;
+      }
+    }
+
+    render_list.addNode(getMaterial(selected.node->material_id), selected, detail_level);
+  }
+
+  num_instances = 0;
+  for (auto batch : render_list.getBatches())
+    num_instances += batch->getSize();
+
+  assert(num_instances <= getNumLeafNodes());
 
-  gl::BindBuffer(GL_ARRAY_BUFFER, node_pos_buffer_id);
+  // only the visible instances are written - the buffer region is sized for the worst case
+  size_t buffer_offset = 0;
+  auto buffer = (unsigned char*) node_pos_buffer->map(num_instances * instance_size, buffer_offset);
+  assert(buffer || !num_instances);
 
-  gl::BufferData(GL_ARRAY_BUFFER, buffer_size, 0, GL_STREAM_DRAW);
+  assert(buffer_offset % instance_size == 0);
+  const size_t base_instance = buffer_offset / instance_size;
 
-  RenderBatch::NodePos *buffer = (RenderBatch::NodePos*) gl::MapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-  assert(buffer);
+  size_t buffer_pos = 0;
 
   for (auto batch : render_list.getBatches())
   {
-    batch->node_pos_buffer_offset = buffer_pos;
+    batch->node_pos_buffer_offset = base_instance + buffer_pos;
 
     for (int i = 0; i < batch->getSize(); i++)
     {
-      assert(buffer_pos < buffer_elements);
+      assert(buffer_pos < num_instances);
 
       const int lod = batch->lods[i];
 
-      RenderBatch::NodePos &pos = buffer[buffer_pos];
+      auto instance = buffer + buffer_pos * instance_size;
+
+      RenderBatch::NodePos &pos = *reinterpret_cast<RenderBatch::NodePos*>(instance);
       pos.x = batch->positions[i].x;
       pos.y = batch->positions[i].y;
       pos.z = getNodeScale(lod);
       pos.w = getLodLevelDist(lod);
 
+      if (m_tile_cache)
+      {
+        auto tile_instance = m_tile_cache->getTile(batch->positions[i], lod);
+
+        RenderBatch::NodeTile &tile =
+          *reinterpret_cast<RenderBatch::NodeTile*>(instance + sizeof(RenderBatch::NodePos));
+        tile.layer = tile_instance.x;
+        tile.x = tile_instance.y;
+        tile.y = tile_instance.z;
+        tile.scale = tile_instance.w;
+      }
+
       buffer_pos++;
     }
   }
 
   buffer = nullptr;
-  gl::UnmapBuffer(GL_ARRAY_BUFFER);
+  node_pos_buffer->unmap();
 
-  gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+  // the tiles requested above are paged in for the following frames
+  if (m_tile_cache)
+    m_tile_cache->update();
+}
+
+
+TerrainBase::Statistics TerrainCDLOD::getStatistics()
+{
+  Statistics stats;
+  stats.num_nodes = quad_tree.getNumNodes();
+  stats.num_nodes_visited = selection.num_nodes_visited;
+  stats.num_nodes_culled = selection.num_nodes_culled;
+  stats.num_instances = num_instances;
+  stats.instance_bytes_uploaded = node_pos_buffer->getBytesUploadedLastFrame();
+
+  if (m_tile_cache)
+  {
+    auto &tile_stats = m_tile_cache->getStatistics();
+    stats.num_tile_requests = tile_stats.num_requests;
+    stats.num_tile_hits = tile_stats.num_hits;
+    stats.num_tile_page_ins = tile_stats.num_page_ins;
+    stats.tile_cache_memory = tile_stats.gpu_memory + tile_stats.cpu_memory;
+    stats.average_tile_page_in_ms = tile_stats.average_page_in_ms;
+    stats.max_tile_page_in_ms = tile_stats.max_page_in_ms;
+  }
+
+  return stats;
 }
 
 
@@ -795,6 +842,18 @@ void TerrainCDLOD::setBaseMapOrigin(glm::vec2 origin)
 }
 
 
+void TerrainCDLOD::setBaseMapHeight(float height)
+{
+  m_base_map_height = height;
+}
+
+
+void TerrainCDLOD::setHeightOffset(float offset)
+{
+  m_height_offset = offset;
+}
+
+
 render_util::TexturePtr TerrainCDLOD::getNormalMapTexture()
 {
   assert(!m_layers.empty());
@@ -809,11 +868,19 @@ void TerrainCDLOD::draw(Client *client)
   if (render_list.isEmpty())
     return;
 
+  RENDER_UTIL_PROFILE_GPU_SCOPE("TerrainCDLOD::draw");
+
   m_land_textures->bind(texture_manager);
 
   for (auto& layer : m_layers)
     layer.bindTextures(texture_manager);
 
+  if (m_tile_cache)
+  {
+    texture_manager.bind(TEXUNIT_TERRAIN_CDLOD_HEIGHT_TILES, m_tile_cache->getHeightTexture());
+    texture_manager.bind(TEXUNIT_TERRAIN_CDLOD_NORMAL_TILES, m_tile_cache->getNormalTexture());
+  }
+
   assert(client);
 
   VertexArrayObjectBinding vao_binding(*vao);
@@ -824,7 +891,7 @@ void TerrainCDLOD::draw(Client *client)
     auto program = batch->program;
     assert(program);
     client->setActiveProgram(program);
-    setUniforms(program);
+    setUniforms(*batch);
     program->assertUniformsAreSet();
 
     gl::DrawElementsInstancedBaseInstance(GL_TRIANGLES,
@@ -843,6 +910,14 @@ void TerrainCDLOD::setDrawDistance(float dist)
 }
 
 
+void TerrainCDLOD::setSelectionSplitDepth(int depth)
+{
+  assert(depth >= 0);
+  assert(depth <= MAX_LOD);
+  selection_split_depth = depth;
+}
+
+
 const TerrainFactory g_terrain_cdlod_factory = makeTerrainFactory<TerrainCDLOD>();
 
 
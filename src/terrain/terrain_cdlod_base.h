@@ -59,12 +59,6 @@ public:
   }
 
 
-  static float getMaxHeight(const render_util::ElevationMap &map, const glm::vec2 &pos, float size)
-  {
-    return 4000.0;
-  }
-
-
   static constexpr double getNodeSize(int lod_level)
   {
     return pow(2, lod_level) * LEAF_NODE_SIZE;
@@ -19,6 +19,13 @@
 #ifndef RENDER_UTIL_TERRAIN_TERRAIN_LAYER_H
 #define RENDER_UTIL_TERRAIN_TERRAIN_LAYER_H
 
+#include <render_util/shader.h>
+#include <render_util/texture_manager.h>
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
 namespace render_util::terrain
 {
 
@@ -36,6 +43,22 @@ struct TerrainTextureMap
 
 struct TerrainLayer
 {
+  /// uniform handles of a layer, resolved for one program
+  struct Uniforms
+  {
+    struct TextureMap
+    {
+      UniformHandle<int> sampler;
+      UniformHandle<int> resolution_m;
+      UniformHandle<glm::ivec2> size_px;
+      UniformHandle<glm::vec2> size_m;
+    };
+
+    UniformHandle<glm::vec2> size_m;
+    UniformHandle<glm::vec2> origin_m;
+    std::vector<TextureMap> texture_maps;
+  };
+
   glm::vec2 origin_m;
   glm::vec2 size_m;
   std::string uniform_prefix;
@@ -47,26 +70,49 @@ struct TerrainLayer
       tex_mgr.bind(map.texunit, map.texture);
   }
 
-  void setUniforms(ShaderProgramPtr program, render_util::TextureManager &tex_mgr)
+  Uniforms getUniforms(ShaderProgram &program) const
   {
-    program->setUniform(uniform_prefix + "size_m", size_m);
-    program->setUniform(uniform_prefix + "origin_m", origin_m);
+    Uniforms uniforms;
+    uniforms.size_m = program.getUniformHandle<glm::vec2>(uniform_prefix + "size_m");
+    uniforms.origin_m = program.getUniformHandle<glm::vec2>(uniform_prefix + "origin_m");
+
     for (auto& map : texture_maps)
-      setTextureMapUniforms(map, program, tex_mgr);
+    {
+      auto prefix = uniform_prefix + map.name + ".";
+
+      Uniforms::TextureMap map_uniforms;
+      map_uniforms.sampler = program.getUniformHandle<int>(prefix + "sampler");
+      map_uniforms.resolution_m = program.getUniformHandle<int>(prefix + "resolution_m");
+      map_uniforms.size_px = program.getUniformHandle<glm::ivec2>(prefix + "size_px");
+      map_uniforms.size_m = program.getUniformHandle<glm::vec2>(prefix + "size_m");
+
+      uniforms.texture_maps.push_back(map_uniforms);
+    }
+
+    return uniforms;
   }
 
-private:
-  void setTextureMapUniforms(TerrainTextureMap &map, ShaderProgramPtr program,
-                             render_util::TextureManager &tex_mgr)
+  void setUniforms(ShaderProgram &program, const Uniforms &uniforms,
+                   render_util::TextureManager &tex_mgr) const
   {
-    program->setUniformi(uniform_prefix + map.name + ".sampler", tex_mgr.getTexUnitNum(map.texunit));
-    program->setUniformi(uniform_prefix + map.name + ".resolution_m", map.resolution_m);
-    program->setUniform(uniform_prefix + map.name + ".size_px", map.size_px);
-    program->setUniform(uniform_prefix + map.name + ".size_m", map.size_m);
+    assert(uniforms.texture_maps.size() == texture_maps.size());
+
+    program.setUniform(uniforms.size_m, size_m);
+    program.setUniform(uniforms.origin_m, origin_m);
+
+    for (size_t i = 0; i < texture_maps.size(); i++)
+    {
+      auto &map = texture_maps[i];
+      auto &map_uniforms = uniforms.texture_maps[i];
+
+      program.setUniform(map_uniforms.sampler, tex_mgr.getTexUnitNum(map.texunit));
+      program.setUniform(map_uniforms.resolution_m, map.resolution_m);
+      program.setUniform(map_uniforms.size_px, map.size_px);
+      program.setUniform(map_uniforms.size_m, map.size_m);
+    }
   }
 };
 
-
 }
 
 #endif
@@ -0,0 +1,444 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "terrain_tile_cache.h"
+#include "terrain_cdlod_base.h"
+#include <render_util/image_kernels.h>
+#include <render_util/gl_binding/gl_functions.h>
+#include <log.h>
+
+#include <algorithm>
+#include <cassert>
+
+using namespace render_util::gl_binding;
+using namespace glm;
+using std::endl;
+
+
+namespace
+{
+
+
+using Seconds = std::chrono::duration<double>;
+
+
+render_util::TexturePtr createTileArray(int internal_format, int format, int size, int num_layers)
+{
+  auto texture = render_util::Texture::create(GL_TEXTURE_2D_ARRAY);
+
+  render_util::TemporaryTextureBinding binding(texture);
+
+  gl::TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  gl::TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl::TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl::TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  gl::TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+  gl::TexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, size, size, num_layers, 0,
+                 format, GL_FLOAT, nullptr);
+
+  CHECK_GL_ERROR();
+
+  return texture;
+}
+
+
+} // namespace
+
+
+namespace render_util::terrain
+{
+
+
+TerrainTileCache::TerrainTileCache(std::shared_ptr<const TiledHeightMap> map,
+                                   int num_tiles,
+                                   int max_page_ins_per_frame,
+                                   util::ThreadPool &thread_pool) :
+  m_map(map),
+  m_thread_pool(thread_pool),
+  m_num_tiles(num_tiles),
+  m_max_page_ins_per_frame(max_page_ins_per_frame)
+{
+  assert(m_map);
+  assert(m_num_tiles > 1);
+  assert(m_max_page_ins_per_frame > 0);
+
+  const int size = m_map->getTileSizeWithBorder();
+
+  m_height_tiles = createTileArray(GL_R32F, GL_RED, size, m_num_tiles);
+  m_normal_tiles = createTileArray(GL_RGB32F, GL_RGB, size, m_num_tiles);
+
+  // layer 0 is reserved for the last level
+  for (int layer = m_num_tiles - 1; layer > 0; layer--)
+    m_free_layers.push_back(layer);
+
+  m_root.level = m_map->getNumLevels() - 1;
+  m_root.layer = 0;
+  assert(m_map->getNumTiles(m_root.level) == ivec2(1));
+
+  TileData data;
+  loadTile(*m_map, m_root.level, m_root.pos, data.heights, data.normals);
+  upload(m_root, data);
+
+  m_statistics.num_tiles = m_num_tiles;
+  m_statistics.num_resident = 1;
+  m_statistics.gpu_memory = size_t(size) * size * m_num_tiles * (1 + 3) * sizeof(float);
+
+  LOG_INFO<<"TerrainTileCache: "<<m_num_tiles<<" tiles of "<<size<<"x"<<size<<", "
+          <<m_statistics.gpu_memory / (1024 * 1024)<<" MiB"<<endl;
+}
+
+
+TerrainTileCache::~TerrainTileCache()
+{
+  // the loading tasks keep the map alive - don't leave them running behind the cache's back
+  for (auto &it : m_tiles)
+  {
+    if (it.second.data.valid())
+      it.second.data.wait();
+  }
+}
+
+
+uint64_t TerrainTileCache::getKey(int level, ivec2 pos)
+{
+  assert(level >= 0 && level < 256);
+  assert(pos.x >= 0 && pos.x < (1 << 28));
+  assert(pos.y >= 0 && pos.y < (1 << 28));
+
+  return (uint64_t(level) << 56) | (uint64_t(pos.x) << 28) | uint64_t(pos.y);
+}
+
+
+TerrainTileCache::TileInstance TerrainTileCache::getInstance(const Tile &tile) const
+{
+  assert(tile.layer >= 0);
+
+  const int tile_size = m_map->getTileSize();
+  const ivec2 origin = (tile.pos * tile_size - ivec2(TiledHeightMap::TILE_BORDER)) * (1 << tile.level);
+
+  return TileInstance(tile.layer, origin.x, origin.y, 1 << tile.level);
+}
+
+
+TerrainTileCache::Tile *TerrainTileCache::findResidentTile(int level, ivec2 pos)
+{
+  auto it = m_tiles.find(getKey(level, pos));
+  if (it == m_tiles.end() || it->second.layer < 0)
+    return nullptr;
+
+  auto &tile = it->second;
+  tile.last_used_frame = m_frame;
+  m_lru.splice(m_lru.begin(), m_lru, tile.lru_pos);
+
+  return &tile;
+}
+
+
+void TerrainTileCache::request(int level, ivec2 pos)
+{
+  auto key = getKey(level, pos);
+
+  auto it = m_tiles.find(key);
+  if (it == m_tiles.end())
+  {
+    auto &tile = m_tiles[key];
+    tile.level = level;
+    tile.pos = pos;
+    tile.request_time = Clock::now();
+    tile.last_used_frame = m_frame;
+    m_missing.push_back(key);
+  }
+  else
+  {
+    assert(it->second.layer < 0);
+    it->second.last_used_frame = m_frame;
+  }
+}
+
+
+void TerrainTileCache::startLoading(Tile &tile)
+{
+  assert(!tile.data.valid());
+
+  tile.data = m_thread_pool.submit([map = m_map, level = tile.level, pos = tile.pos] ()
+  {
+    auto data = std::make_shared<TileData>();
+    loadTile(*map, level, pos, data->heights, data->normals);
+    return data;
+  });
+}
+
+
+int TerrainTileCache::allocateLayer()
+{
+  if (!m_free_layers.empty())
+  {
+    auto layer = m_free_layers.back();
+    m_free_layers.pop_back();
+    return layer;
+  }
+
+  if (m_lru.empty())
+    return -1;
+
+  auto key = m_lru.back();
+  auto it = m_tiles.find(key);
+  assert(it != m_tiles.end());
+
+  // tiles used in this frame are still referenced by instances
+  if (it->second.last_used_frame >= m_frame)
+    return -1;
+
+  auto layer = it->second.layer;
+  assert(layer > 0);
+
+  m_lru.pop_back();
+  m_tiles.erase(it);
+  m_statistics.num_evictions++;
+
+  return layer;
+}
+
+
+void TerrainTileCache::upload(Tile &tile, const TileData &data)
+{
+  assert(tile.layer >= 0 && tile.layer < m_num_tiles);
+
+  const int size = m_map->getTileSizeWithBorder();
+  assert(data.heights.size() == size_t(size * size));
+  assert(data.normals.size() == size_t(size * size * 3));
+
+  {
+    TemporaryTextureBinding binding(m_height_tiles);
+    gl::TexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile.layer, size, size, 1,
+                      GL_RED, GL_FLOAT, data.heights.data());
+  }
+  {
+    TemporaryTextureBinding binding(m_normal_tiles);
+    gl::TexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile.layer, size, size, 1,
+                      GL_RGB, GL_FLOAT, data.normals.data());
+  }
+
+  CHECK_GL_ERROR();
+
+  const size_t num_bytes = (data.heights.size() + data.normals.size()) * sizeof(float);
+  m_statistics.bytes_uploaded_last_frame += num_bytes;
+  m_statistics.bytes_uploaded_total += num_bytes;
+}
+
+
+TerrainTileCache::TileInstance TerrainTileCache::getTile(vec2 node_pos_grid, int lod_level)
+{
+  assert(lod_level >= 0);
+
+  const auto &map = *m_map;
+  const int last_level = map.getNumLevels() - 1;
+  const int node_size = TerrainCDLODBase::MESH_GRID_SIZE << lod_level;
+
+  const ivec2 node_begin = ivec2(floor(node_pos_grid));
+  const ivec2 node_end = node_begin + ivec2(node_size);
+
+  m_statistics.num_requests++;
+
+  // nodes outside of the map are flat - and so is the border of the last level's tile
+  if (any(lessThan(node_end, ivec2(0))) || any(greaterThanEqual(node_begin, map.getSize())))
+  {
+    m_statistics.num_hits++;
+    m_root.last_used_frame = m_frame;
+    return getInstance(m_root);
+  }
+
+  // the finest level whose tiles cover the node
+  int level = std::min(lod_level, last_level);
+  while (level < last_level && (node_size >> level) > map.getTileSize())
+    level++;
+
+  if (level == last_level)
+  {
+    m_statistics.num_hits++;
+    m_root.last_used_frame = m_frame;
+    return getInstance(m_root);
+  }
+
+  ivec2 pos = (max(node_begin, ivec2(0)) / (1 << level)) / map.getTileSize();
+  assert(map.hasTile(level, pos));
+
+  if (auto tile = findResidentTile(level, pos))
+  {
+    m_statistics.num_hits++;
+    return getInstance(*tile);
+  }
+
+  request(level, pos);
+
+  // until then the node is drawn with the closest resident ancestor
+  while (++level < last_level)
+  {
+    pos /= 2;
+    if (auto tile = findResidentTile(level, pos))
+      return getInstance(*tile);
+  }
+
+  m_root.last_used_frame = m_frame;
+  return getInstance(m_root);
+}
+
+
+void TerrainTileCache::update()
+{
+  m_statistics.bytes_uploaded_last_frame = 0;
+
+  // coarser tiles first - they stand in for more nodes
+  std::stable_sort(m_missing.begin(), m_missing.end(),
+                   [this] (uint64_t a, uint64_t b)
+                   {
+                     return m_tiles.at(a).level > m_tiles.at(b).level;
+                   });
+
+  const int max_num_loading = 4 * m_max_page_ins_per_frame;
+  const int tile_size = m_map->getTileSizeWithBorder();
+  const size_t tile_data_size = size_t(tile_size) * tile_size * (1 + 3) * sizeof(float);
+
+  int num_loading = 0;
+  int num_page_ins = 0;
+  size_t cpu_memory = 0;
+
+  std::vector<uint64_t> still_missing;
+
+  for (auto key : m_missing)
+  {
+    auto it = m_tiles.find(key);
+    assert(it != m_tiles.end());
+
+    auto &tile = it->second;
+    assert(tile.layer < 0);
+
+    const bool is_requested = tile.last_used_frame >= m_frame;
+
+    if (!tile.data.valid())
+    {
+      if (!is_requested)
+      {
+        m_tiles.erase(it);
+        continue;
+      }
+
+      if (num_loading < max_num_loading)
+      {
+        startLoading(tile);
+        num_loading++;
+      }
+
+      still_missing.push_back(key);
+      continue;
+    }
+
+    if (!util::isReady(tile.data))
+    {
+      // loading tiles are finished even if they are no longer needed
+      num_loading++;
+      still_missing.push_back(key);
+      continue;
+    }
+
+    if (!is_requested)
+    {
+      m_tiles.erase(it);
+      continue;
+    }
+
+    if (num_page_ins < m_max_page_ins_per_frame)
+    {
+      auto layer = allocateLayer();
+      if (layer > 0)
+      {
+        auto data = tile.data.get();
+        assert(data);
+
+        tile.layer = layer;
+        upload(tile, *data);
+
+        m_lru.push_front(key);
+        tile.lru_pos = m_lru.begin();
+
+        num_page_ins++;
+        m_statistics.num_page_ins++;
+
+        const double page_in_ms = Seconds(Clock::now() - tile.request_time).count() * 1000.0;
+        m_statistics.last_page_in_ms = page_in_ms;
+        m_statistics.max_page_in_ms = std::max(m_statistics.max_page_in_ms, page_in_ms);
+        m_statistics.average_page_in_ms +=
+          (page_in_ms - m_statistics.average_page_in_ms) / m_statistics.num_page_ins;
+
+        continue;
+      }
+    }
+
+    // waits for the next frame's budget or for a layer to become free
+    cpu_memory += tile_data_size;
+    still_missing.push_back(key);
+  }
+
+  m_missing = std::move(still_missing);
+
+  m_statistics.num_resident = m_lru.size() + 1;
+  m_statistics.num_loading = num_loading;
+  m_statistics.cpu_memory = cpu_memory;
+
+  m_frame++;
+}
+
+
+void TerrainTileCache::loadTile(const TiledHeightMap &map, int level, ivec2 pos,
+                                std::vector<float> &heights, std::vector<float> &normals)
+{
+  const int size = map.getTileSizeWithBorder();
+  const float *tile = map.getTile(level, pos);
+  assert(tile);
+
+  heights.assign(tile, tile + size * size);
+  normals.resize(size * size * 3);
+
+  const float grid_scale = float(TerrainCDLODBase::HEIGHT_MAP_METERS_PER_GRID) * (1 << level);
+
+  auto get_normal = [&] (int x, int y) { return normals.data() + (y * size + x) * 3; };
+
+  // rows are stored bottom to top, so row y + 1 is the previous row of the kernel
+  for (int y = 1; y < size - 1; y++)
+  {
+    image::kernels::calcNormalRow(&heights[(y + 1) * size + 1],
+                                  &heights[y * size + 1],
+                                  &heights[(y - 1) * size + 1],
+                                  get_normal(1, y),
+                                  size - 2,
+                                  grid_scale);
+  }
+
+  // the outermost samples lack neighbours - they repeat the normals next to them
+  for (int y = 1; y < size - 1; y++)
+  {
+    std::copy_n(get_normal(1, y), 3, get_normal(0, y));
+    std::copy_n(get_normal(size - 2, y), 3, get_normal(size - 1, y));
+  }
+  std::copy_n(get_normal(0, 1), size * 3, get_normal(0, 0));
+  std::copy_n(get_normal(0, size - 2), size * 3, get_normal(0, size - 1));
+}
+
+
+} // namespace render_util::terrain
@@ -0,0 +1,167 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_UTIL_TERRAIN_TERRAIN_TILE_CACHE_H
+#define RENDER_UTIL_TERRAIN_TERRAIN_TILE_CACHE_H
+
+#include <render_util/tiled_height_map.h>
+#include <render_util/texture_manager.h>
+#include <thread_pool.h>
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <chrono>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace render_util::terrain
+{
+
+
+/**
+ * Keeps a fixed number of TiledHeightMap tiles, together with their normals,
+ * in a pair of texture arrays.
+ *
+ * getTile() is called for each node to draw and returns the tile matching the node's
+ * level of detail if it is resident, otherwise its closest resident ancestor -
+ * the tile of the last level covers the whole map and is always resident.
+ * Missing tiles are read from the mapped file and get their normals on the thread pool.
+ * update() uploads at most max_page_ins_per_frame of them per frame,
+ * replacing the least recently used tiles.
+ */
+class TerrainTileCache
+{
+public:
+  static constexpr int DEFAULT_NUM_TILES = 512;
+  static constexpr int DEFAULT_MAX_PAGE_INS_PER_FRAME = 16;
+
+  /**
+   * x: layer in the texture arrays
+   * yz: position of the first texel in level 0 grid units
+   * w: level 0 grid units per texel
+   */
+  using TileInstance = glm::vec4;
+
+  struct Statistics
+  {
+    size_t num_tiles = 0;
+    size_t num_resident = 0;
+    size_t num_loading = 0;
+    size_t num_requests = 0;
+    size_t num_hits = 0;
+    size_t num_page_ins = 0;
+    size_t num_evictions = 0;
+    /// size of the texture arrays
+    size_t gpu_memory = 0;
+    /// tiles that are read but not uploaded yet
+    size_t cpu_memory = 0;
+    size_t bytes_uploaded_last_frame = 0;
+    size_t bytes_uploaded_total = 0;
+    /// from the first request of a tile until it is uploaded
+    double last_page_in_ms = 0;
+    double max_page_in_ms = 0;
+    double average_page_in_ms = 0;
+
+    double getHitRate() const { return num_requests ? double(num_hits) / num_requests : 1.0; }
+  };
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct TileData
+  {
+    std::vector<float> heights;
+    std::vector<float> normals;
+  };
+
+  struct Tile
+  {
+    int level = 0;
+    glm::ivec2 pos = glm::ivec2(0);
+    /// -1 until the tile is uploaded
+    int layer = -1;
+    unsigned long long last_used_frame = 0;
+    Clock::time_point request_time;
+    util::Future<std::shared_ptr<TileData>> data;
+    std::list<uint64_t>::iterator lru_pos;
+  };
+
+  std::shared_ptr<const TiledHeightMap> m_map;
+  util::ThreadPool &m_thread_pool;
+  const int m_num_tiles = 0;
+  const int m_max_page_ins_per_frame = 0;
+  TexturePtr m_height_tiles;
+  TexturePtr m_normal_tiles;
+
+  /// resident, loading and requested tiles
+  std::unordered_map<uint64_t, Tile> m_tiles;
+  /// resident tiles, most recently used first - the last level's tile isn't in here
+  std::list<uint64_t> m_lru;
+  std::vector<int> m_free_layers;
+  /// in the order of their first request
+  std::vector<uint64_t> m_missing;
+  Tile m_root;
+  unsigned long long m_frame = 1;
+  Statistics m_statistics;
+
+  static uint64_t getKey(int level, glm::ivec2 pos);
+  TileInstance getInstance(const Tile&) const;
+  Tile *findResidentTile(int level, glm::ivec2 pos);
+  void request(int level, glm::ivec2 pos);
+  void startLoading(Tile&);
+  int allocateLayer();
+  void upload(Tile&, const TileData&);
+
+public:
+  TerrainTileCache(std::shared_ptr<const TiledHeightMap> map,
+                   int num_tiles = DEFAULT_NUM_TILES,
+                   int max_page_ins_per_frame = DEFAULT_MAX_PAGE_INS_PER_FRAME,
+                   util::ThreadPool &thread_pool = util::ThreadPool::getDefault());
+  ~TerrainTileCache();
+
+  TerrainTileCache(const TerrainTileCache&) = delete;
+  TerrainTileCache &operator=(const TerrainTileCache&) = delete;
+
+  /**
+   * The tile to draw a node with.
+   * node_pos_grid is the lower left corner of the node in level 0 grid units.
+   */
+  TileInstance getTile(glm::vec2 node_pos_grid, int lod_level);
+
+  /// to be called once per frame, after the getTile() calls of the frame
+  void update();
+
+  /// no tiles are loading or waiting to be uploaded
+  bool isIdle() const { return m_missing.empty(); }
+
+  const TiledHeightMap &getMap() const { return *m_map; }
+  TexturePtr getHeightTexture() { return m_height_tiles; }
+  TexturePtr getNormalTexture() { return m_normal_tiles; }
+  const Statistics &getStatistics() const { return m_statistics; }
+
+  /// reads a tile and calculates its normals
+  static void loadTile(const TiledHeightMap &map, int level, glm::ivec2 pos,
+                       std::vector<float> &heights, std::vector<float> &normals);
+};
+
+
+} // namespace render_util::terrain
+
+#endif
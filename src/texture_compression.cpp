@@ -0,0 +1,761 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/texture_compression.h>
+#include <render_util/image_resample.h>
+#include <render_util/image_storage.h>
+#include <util.h>
+#include <log.h>
+
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace render_util;
+using namespace std;
+
+
+namespace
+{
+
+
+using Clock = chrono::steady_clock;
+
+// increment when the encoder output changes - invalidates the cache
+constexpr int FORMAT_VERSION = 2;
+
+constexpr int BLOCK_PIXELS = 16;
+
+
+uint16_t packRGB565(const float color[3])
+{
+  auto quantize = [] (float value, int max)
+  {
+    return clamp(int(value * max / 255.f + 0.5f), 0, max);
+  };
+
+  return (quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31);
+}
+
+
+void unpackRGB565(uint16_t packed, int color[3])
+{
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+
+void getBC1Palette(uint16_t c0, uint16_t c1, bool four_color_mode, int palette[4][4])
+{
+  unpackRGB565(c0, palette[0]);
+  unpackRGB565(c1, palette[1]);
+  palette[0][3] = palette[1][3] = 255;
+
+  for (int i = 0; i < 3; i++)
+  {
+    if (four_color_mode)
+    {
+      palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+      palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+    }
+    else
+    {
+      palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+      palette[3][i] = 0;
+    }
+  }
+
+  palette[2][3] = 255;
+  palette[3][3] = four_color_mode ? 255 : 0;
+}
+
+
+/// returns the squared error
+int encodeBC1Endpoints(const unsigned char rgba[BLOCK_PIXELS * 4],
+                       uint16_t c0, uint16_t c1,
+                       unsigned char out[8])
+{
+  // four color mode needs c0 > c1 - with equal endpoints every pixel gets index 0
+  if (c0 < c1)
+    swap(c0, c1);
+
+  int palette[4][4];
+  getBC1Palette(c0, c1, true, palette);
+
+  const int num_candidates = (c0 == c1) ? 1 : 4;
+
+  uint32_t indices = 0;
+  int error = 0;
+
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    auto pixel = rgba + i * 4;
+
+    int best_index = 0;
+    int best_distance = numeric_limits<int>::max();
+
+    for (int index = 0; index < num_candidates; index++)
+    {
+      int distance = 0;
+      for (int c = 0; c < 3; c++)
+      {
+        int d = pixel[c] - palette[index][c];
+        distance += d * d;
+      }
+      if (distance < best_distance)
+      {
+        best_distance = distance;
+        best_index = index;
+      }
+    }
+
+    indices |= uint32_t(best_index) << (2 * i);
+    error += best_distance;
+  }
+
+  memcpy(out, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &indices, 4);
+
+  return error;
+}
+
+
+/**
+ * Endpoints at the extremes of the principal axis, then one least squares fit
+ * of the endpoints to the indices chosen for them.
+ */
+void encodeBC1(const unsigned char rgba[BLOCK_PIXELS * 4], unsigned char out[8])
+{
+  float mean[3] = {};
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    for (int c = 0; c < 3; c++)
+      mean[c] += rgba[i * 4 + c];
+  }
+  for (auto &m : mean)
+    m /= BLOCK_PIXELS;
+
+  float covariance[3][3] = {};
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    float d[3];
+    for (int c = 0; c < 3; c++)
+      d[c] = rgba[i * 4 + c] - mean[c];
+
+    for (int row = 0; row < 3; row++)
+    {
+      for (int column = 0; column < 3; column++)
+        covariance[row][column] += d[row] * d[column];
+    }
+  }
+
+  // power iteration, starting from the row of the channel which varies most -
+  // a fixed start like (1, 1, 1) is orthogonal to e.g. red - green and never leaves it
+  int largest_channel = 0;
+  for (int c = 1; c < 3; c++)
+  {
+    if (covariance[c][c] > covariance[largest_channel][largest_channel])
+      largest_channel = c;
+  }
+
+  float axis[3] =
+  {
+    covariance[largest_channel][0],
+    covariance[largest_channel][1],
+    covariance[largest_channel][2],
+  };
+  if (covariance[largest_channel][largest_channel] == 0)
+    axis[0] = axis[1] = axis[2] = 1;
+
+  for (int iteration = 0; iteration < 8; iteration++)
+  {
+    float next[3] = {};
+    for (int row = 0; row < 3; row++)
+    {
+      for (int column = 0; column < 3; column++)
+        next[row] += covariance[row][column] * axis[column];
+    }
+
+    float largest = *max_element(next, next + 3,
+                                 [] (float a, float b) { return fabs(a) < fabs(b); });
+    if (fabs(largest) < 1e-6f)
+      break;
+
+    for (int c = 0; c < 3; c++)
+      axis[c] = next[c] / largest;
+  }
+
+  float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  for (auto &a : axis)
+    a /= length;
+
+  float min_t = numeric_limits<float>::max();
+  float max_t = numeric_limits<float>::lowest();
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    float t = 0;
+    for (int c = 0; c < 3; c++)
+      t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+    min_t = min(min_t, t);
+    max_t = max(max_t, t);
+  }
+
+  float e0[3], e1[3];
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c] = mean[c] + axis[c] * max_t;
+    e1[c] = mean[c] + axis[c] * min_t;
+  }
+
+  int error = encodeBC1Endpoints(rgba, packRGB565(e0), packRGB565(e1), out);
+  if (error == 0)
+    return;
+
+  // weight of the first endpoint per index
+  constexpr float WEIGHTS[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+  uint32_t indices = 0;
+  memcpy(&indices, out + 4, 4);
+
+  float aa = 0, bb = 0, ab = 0;
+  float x0[3] = {}, x1[3] = {};
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    float w = WEIGHTS[(indices >> (2 * i)) & 3];
+    aa += w * w;
+    bb += (1 - w) * (1 - w);
+    ab += w * (1 - w);
+    for (int c = 0; c < 3; c++)
+    {
+      x0[c] += w * rgba[i * 4 + c];
+      x1[c] += (1 - w) * rgba[i * 4 + c];
+    }
+  }
+
+  float determinant = aa * bb - ab * ab;
+  if (fabs(determinant) < 1e-6f)
+    return;
+
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c] = (bb * x0[c] - ab * x1[c]) / determinant;
+    e1[c] = (aa * x1[c] - ab * x0[c]) / determinant;
+  }
+
+  unsigned char refined[8];
+  if (encodeBC1Endpoints(rgba, packRGB565(e0), packRGB565(e1), refined) < error)
+    memcpy(out, refined, 8);
+}
+
+
+/// eight value mode - the palette is linear between the endpoints
+void encodeBC4(const unsigned char rgba[BLOCK_PIXELS * 4], int component, unsigned char out[8])
+{
+  int min_value = 255;
+  int max_value = 0;
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    min_value = min<int>(min_value, rgba[i * 4 + component]);
+    max_value = max<int>(max_value, rgba[i * 4 + component]);
+  }
+
+  memset(out, 0, 8);
+  out[0] = max_value;
+  out[1] = min_value;
+
+  if (max_value == min_value)
+    return;
+
+  const float scale = 7.f / (max_value - min_value);
+
+  uint64_t indices = 0;
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    // 0 is min_value, 7 is max_value
+    int step = int((rgba[i * 4 + component] - min_value) * scale + 0.5f);
+
+    int index = 0;
+    if (step == 7)
+      index = 0;
+    else if (step == 0)
+      index = 1;
+    else
+      index = 8 - step;
+
+    indices |= uint64_t(index) << (3 * i);
+  }
+
+  memcpy(out + 2, &indices, 6);
+}
+
+
+void decodeBC1(const unsigned char *block,
+               bool four_color_mode,
+               unsigned char rgba[BLOCK_PIXELS * 4])
+{
+  uint16_t c0, c1;
+  uint32_t indices;
+  memcpy(&c0, block, 2);
+  memcpy(&c1, block + 2, 2);
+  memcpy(&indices, block + 4, 4);
+
+  int palette[4][4];
+  getBC1Palette(c0, c1, four_color_mode || c0 > c1, palette);
+
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+  {
+    auto &color = palette[(indices >> (2 * i)) & 3];
+    for (int c = 0; c < 4; c++)
+      rgba[i * 4 + c] = color[c];
+  }
+}
+
+
+void decodeBC4(const unsigned char *block, int component, unsigned char rgba[BLOCK_PIXELS * 4])
+{
+  int a0 = block[0];
+  int a1 = block[1];
+
+  int palette[8] = { a0, a1 };
+  if (a0 > a1)
+  {
+    for (int i = 2; i < 8; i++)
+      palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+  }
+  else
+  {
+    for (int i = 2; i < 6; i++)
+      palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t indices = 0;
+  memcpy(&indices, block + 2, 6);
+
+  for (int i = 0; i < BLOCK_PIXELS; i++)
+    rgba[i * 4 + component] = palette[(indices >> (3 * i)) & 7];
+}
+
+
+string makeCacheName(BlockFormat format,
+                     TextureCompression compression,
+                     const unsigned char *pixels,
+                     glm::ivec2 size,
+                     int num_components)
+{
+  ostringstream description;
+  description << FORMAT_VERSION << ' ' << getBlockFormatName(format) << ' '
+              << int(compression) << ' ' << size.x << 'x' << size.y << ' ' << num_components;
+
+  auto hash = util::hashFNV1a(description.str());
+  hash = util::hashFNV1a(pixels, size_t(size.x) * size.y * num_components, hash);
+
+  ostringstream name;
+  name << getBlockFormatName(format) << '_' << size.x << 'x' << size.y << '_'
+       << hex << setw(16) << setfill('0') << hash;
+
+  return name.str();
+}
+
+
+template <int N>
+void renormalize(Image<unsigned char, N> &normal_map)
+{
+  static_assert(N >= 3);
+
+  for (int y = 0; y < normal_map.h(); y++)
+  {
+    auto row = normal_map.getRow(y);
+    for (int x = 0; x < normal_map.w(); x++)
+    {
+      auto pixel = row + x * N;
+
+      float normal[3];
+      for (int c = 0; c < 3; c++)
+        normal[c] = pixel[c] / 255.f * 2 - 1;
+
+      float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      if (length < 1e-6f)
+      {
+        normal[0] = normal[1] = 0;
+        normal[2] = length = 1;
+      }
+
+      for (int c = 0; c < 3; c++)
+        pixel[c] = clamp(int((normal[c] / length * 0.5f + 0.5f) * 255 + 0.5f), 0, 255);
+    }
+  }
+}
+
+
+template <int N>
+vector<vector<unsigned char>> compressMipChain(BlockFormat format,
+                                               TextureCompression compression,
+                                               const unsigned char *pixels,
+                                               glm::ivec2 size,
+                                               size_t &num_pixels)
+{
+  using ImageType = Image<unsigned char, N>;
+
+  const bool is_normal_map = N >= 3 && compression == TextureCompression::NORMAL_MAP;
+
+  typename ImageType::ConstPtr level;
+  if (is_normal_map)
+  {
+    vector<unsigned char> data(pixels, pixels + size_t(size.x) * size.y * N);
+    auto normalized = make_shared<ImageType>(size, std::move(data));
+    if constexpr (N >= 3)
+      renormalize(*normalized);
+    level = normalized;
+  }
+  else
+  {
+    // the pixels are only read
+    unique_ptr<ImageStorage> storage =
+      make_unique<AdoptedImageStorage>(const_cast<unsigned char*>(pixels),
+                                       size_t(size.x) * size.y * N,
+                                       nullptr);
+    level = make_shared<ImageType>(size, std::move(storage));
+  }
+
+  vector<vector<unsigned char>> levels;
+
+  while (true)
+  {
+    levels.push_back(compressImage(format, level->data(), level->size(), N));
+    num_pixels += size_t(level->w()) * level->h();
+
+    if (level->w() == 1 && level->h() == 1)
+      break;
+
+    glm::ivec2 next_size(max(1, level->w() / 2), max(1, level->h() / 2));
+    auto next = resample(level, next_size, ResampleFilter::BOX);
+    if constexpr (N >= 3)
+    {
+      // averaged normals are too short
+      if (is_normal_map)
+        renormalize(*next);
+    }
+    level = next;
+  }
+
+  return levels;
+}
+
+
+int getMipChainLength(glm::ivec2 size)
+{
+  int num_levels = 1;
+  while (size.x > 1 || size.y > 1)
+  {
+    size = glm::ivec2(max(1, size.x / 2), max(1, size.y / 2));
+    num_levels++;
+  }
+  return num_levels;
+}
+
+
+} // namespace
+
+
+unsigned int render_util::getInternalFormat(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+      return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC3:
+      return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4:
+      return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::BC5:
+      return GL_COMPRESSED_RG_RGTC2;
+  }
+  abort();
+}
+
+
+int render_util::getBlockBytes(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+    case BlockFormat::BC4:
+      return 8;
+    case BlockFormat::BC3:
+    case BlockFormat::BC5:
+      return 16;
+  }
+  abort();
+}
+
+
+const char *render_util::getBlockFormatName(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+      return "bc1";
+    case BlockFormat::BC3:
+      return "bc3";
+    case BlockFormat::BC4:
+      return "bc4";
+    case BlockFormat::BC5:
+      return "bc5";
+  }
+  abort();
+}
+
+
+void render_util::encodeBlock(BlockFormat format,
+                              const unsigned char rgba[BLOCK_PIXELS * 4],
+                              unsigned char *out)
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+      encodeBC1(rgba, out);
+      break;
+    case BlockFormat::BC3:
+      encodeBC4(rgba, 3, out);
+      encodeBC1(rgba, out + 8);
+      break;
+    case BlockFormat::BC4:
+      encodeBC4(rgba, 0, out);
+      break;
+    case BlockFormat::BC5:
+      encodeBC4(rgba, 0, out);
+      encodeBC4(rgba, 1, out + 8);
+      break;
+  }
+}
+
+
+void render_util::decodeBlock(BlockFormat format,
+                              const unsigned char *block,
+                              unsigned char rgba[BLOCK_PIXELS * 4])
+{
+  switch (format)
+  {
+    case BlockFormat::BC1:
+      decodeBC1(block, false, rgba);
+      break;
+    case BlockFormat::BC3:
+      decodeBC1(block + 8, true, rgba);
+      decodeBC4(block, 3, rgba);
+      break;
+    case BlockFormat::BC4:
+    case BlockFormat::BC5:
+      for (int i = 0; i < BLOCK_PIXELS; i++)
+      {
+        rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+        rgba[i * 4 + 3] = 255;
+      }
+      decodeBC4(block, 0, rgba);
+      if (format == BlockFormat::BC5)
+        decodeBC4(block + 8, 1, rgba);
+      break;
+  }
+}
+
+
+vector<unsigned char> render_util::compressImage(BlockFormat format,
+                                                 const unsigned char *pixels,
+                                                 glm::ivec2 size,
+                                                 int num_components,
+                                                 util::ThreadPool &thread_pool)
+{
+  assert(size.x > 0 && size.y > 0);
+  assert(num_components >= 1 && num_components <= 4);
+
+  const int blocks_x = (size.x + 3) / 4;
+  const int blocks_y = (size.y + 3) / 4;
+  const int block_bytes = getBlockBytes(format);
+
+  vector<unsigned char> blocks(size_t(blocks_x) * blocks_y * block_bytes);
+
+  thread_pool.parallelFor(blocks_y, [&] (int block_y)
+  {
+    unsigned char rgba[BLOCK_PIXELS * 4];
+
+    for (int block_x = 0; block_x < blocks_x; block_x++)
+    {
+      for (int i = 0; i < BLOCK_PIXELS; i++)
+      {
+        // partial blocks repeat the last row or column
+        int x = min(block_x * 4 + i % 4, size.x - 1);
+        int y = min(block_y * 4 + i / 4, size.y - 1);
+        auto src = pixels + (size_t(y) * size.x + x) * num_components;
+        auto dst = rgba + i * 4;
+
+        if (num_components == 1)
+        {
+          dst[0] = dst[1] = dst[2] = src[0];
+          dst[3] = 255;
+        }
+        else
+        {
+          for (int c = 0; c < 4; c++)
+            dst[c] = c < num_components ? src[c] : (c == 3 ? 255 : 0);
+        }
+      }
+
+      encodeBlock(format, rgba,
+                  blocks.data() + (size_t(block_y) * blocks_x + block_x) * block_bytes);
+    }
+  });
+
+  return blocks;
+}
+
+
+vector<unsigned char> render_util::decompressImage(BlockFormat format,
+                                                   const unsigned char *blocks,
+                                                   glm::ivec2 size)
+{
+  const int blocks_x = (size.x + 3) / 4;
+  const int blocks_y = (size.y + 3) / 4;
+  const int block_bytes = getBlockBytes(format);
+
+  vector<unsigned char> pixels(size_t(size.x) * size.y * 4);
+
+  for (int block_y = 0; block_y < blocks_y; block_y++)
+  {
+    for (int block_x = 0; block_x < blocks_x; block_x++)
+    {
+      unsigned char rgba[BLOCK_PIXELS * 4];
+      decodeBlock(format, blocks + (size_t(block_y) * blocks_x + block_x) * block_bytes, rgba);
+
+      for (int i = 0; i < BLOCK_PIXELS; i++)
+      {
+        int x = block_x * 4 + i % 4;
+        int y = block_y * 4 + i / 4;
+        if (x < size.x && y < size.y)
+          memcpy(pixels.data() + (size_t(y) * size.x + x) * 4, rgba + i * 4, 4);
+      }
+    }
+  }
+
+  return pixels;
+}
+
+
+string render_util::getDefaultCompressedTextureCacheDir()
+{
+  return RENDER_UTIL_CACHE_DIR "/compressed_textures";
+}
+
+
+unique_ptr<TextureContainer>
+render_util::getCompressedTexture(BlockFormat format,
+                                  TextureCompression compression,
+                                  const unsigned char *pixels,
+                                  glm::ivec2 size,
+                                  int num_components,
+                                  const string &cache_dir,
+                                  TextureCompressionStatistics &statistics)
+{
+  assert(size.x > 0 && size.y > 0);
+
+  const int num_levels = getMipChainLength(size);
+  const auto internal_format = getInternalFormat(format);
+
+  statistics.num_layers++;
+  for (int level = 0; level < num_levels; level++)
+  {
+    glm::ivec2 level_size(max(1, size.x >> level), max(1, size.y >> level));
+    statistics.uncompressed_bytes += size_t(level_size.x) * level_size.y * num_components;
+    statistics.compressed_bytes += getTextureLevelSize(internal_format, level_size);
+  }
+
+  string path;
+  if (!cache_dir.empty())
+  {
+    path = cache_dir + '/' + makeCacheName(format, compression, pixels, size, num_components) +
+           ".ktx2";
+
+    auto cached = TextureContainer::load(path, true);
+    if (cached &&
+        cached->getInternalFormat() == internal_format &&
+        cached->getSize() == size &&
+        cached->getNumLevels() == num_levels &&
+        cached->getNumLayers() == 1)
+    {
+      statistics.num_cache_hits++;
+      return cached;
+    }
+    else if (cached)
+    {
+      LOG_INFO << "Ignoring mismatching compressed texture cache " << path << endl;
+    }
+  }
+
+  auto start = Clock::now();
+
+  vector<vector<unsigned char>> levels;
+  switch (num_components)
+  {
+    case 1:
+      levels = compressMipChain<1>(format, compression, pixels, size, statistics.encoded_pixels);
+      break;
+    case 2:
+      levels = compressMipChain<2>(format, compression, pixels, size, statistics.encoded_pixels);
+      break;
+    case 3:
+      levels = compressMipChain<3>(format, compression, pixels, size, statistics.encoded_pixels);
+      break;
+    case 4:
+      levels = compressMipChain<4>(format, compression, pixels, size, statistics.encoded_pixels);
+      break;
+    default:
+      assert(0);
+      abort();
+  }
+
+  chrono::duration<double> elapsed = Clock::now() - start;
+  statistics.encode_seconds += elapsed.count();
+
+  auto data = writeTextureContainer(ImageFileFormat::KTX2, internal_format, size, 1, levels);
+  assert(!data.empty());
+
+  if (!path.empty())
+  {
+    if (util::mkdir(cache_dir, true))
+      util::writeFile(path, reinterpret_cast<const char*>(data.data()), data.size());
+    else
+      LOG_ERROR << "Failed to create directory " << cache_dir << endl;
+  }
+
+  unique_ptr<ImageStorage> storage = make_unique<VectorImageStorage>(std::move(data));
+
+  return TextureContainer::create(std::move(storage));
+}
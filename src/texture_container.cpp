@@ -0,0 +1,948 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * DDS and KTX2 containers.
+ * Both formats are little endian - like every platform this runs on - so header fields
+ * are read and written with memcpy.
+ */
+
+#include <render_util/texture_container.h>
+#include <log.h>
+
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+using namespace render_util;
+using std::endl;
+
+
+namespace
+{
+
+
+enum ChannelFlags : unsigned char
+{
+  CHANNEL_SIGNED = 0x40,
+  CHANNEL_FLOAT = 0x80,
+};
+
+
+struct FormatDesc
+{
+  unsigned int internal_format;
+  /// pixel transfer format and type - 0 for compressed formats
+  unsigned int format;
+  unsigned int type;
+  int num_components;
+  /// bytes per 4x4 block - 0 for uncompressed formats
+  int block_bytes;
+  /// bytes per pixel of uncompressed formats
+  int pixel_bytes;
+  unsigned int dxgi_format;
+  unsigned int vk_format;
+  /// KTX2 data format descriptor
+  unsigned char color_model;
+  unsigned char channel_flags;
+  bool srgb;
+};
+
+
+enum ColorModel : unsigned char
+{
+  MODEL_RGBSDA = 1,
+  MODEL_BC1A = 128,
+  MODEL_BC2 = 129,
+  MODEL_BC3 = 130,
+  MODEL_BC4 = 131,
+  MODEL_BC5 = 132,
+  MODEL_BC6H = 133,
+  MODEL_BC7 = 134,
+};
+
+
+// Formats with the same internal format are looked up by DXGI or Vulkan format when reading;
+// when writing the first entry is used.
+const FormatDesc g_formats[] =
+{
+  { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, 0, 4, 8, 0, 71, 133, MODEL_BC1A, 0, false },
+  { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0, 3, 8, 0, 71, 131, MODEL_BC1A, 0, false },
+  { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 0, 0, 4, 8, 0, 72, 134, MODEL_BC1A, 0, true },
+  { GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 0, 0, 3, 8, 0, 72, 132, MODEL_BC1A, 0, true },
+  { GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, 0, 4, 16, 0, 74, 135, MODEL_BC2, 0, false },
+  { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 0, 0, 4, 16, 0, 75, 136, MODEL_BC2, 0, true },
+  { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0, 4, 16, 0, 77, 137, MODEL_BC3, 0, false },
+  { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, 0, 4, 16, 0, 78, 138, MODEL_BC3, 0, true },
+  { GL_COMPRESSED_RED_RGTC1, 0, 0, 1, 8, 0, 80, 139, MODEL_BC4, 0, false },
+  { GL_COMPRESSED_SIGNED_RED_RGTC1, 0, 0, 1, 8, 0, 81, 140, MODEL_BC4, CHANNEL_SIGNED, false },
+  { GL_COMPRESSED_RG_RGTC2, 0, 0, 2, 16, 0, 83, 141, MODEL_BC5, 0, false },
+  { GL_COMPRESSED_SIGNED_RG_RGTC2, 0, 0, 2, 16, 0, 84, 142, MODEL_BC5, CHANNEL_SIGNED, false },
+  { GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 0, 0, 3, 16, 0, 95, 143, MODEL_BC6H,
+    CHANNEL_FLOAT, false },
+  { GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 0, 0, 3, 16, 0, 96, 144, MODEL_BC6H,
+    CHANNEL_FLOAT | CHANNEL_SIGNED, false },
+  { GL_COMPRESSED_RGBA_BPTC_UNORM, 0, 0, 4, 16, 0, 98, 145, MODEL_BC7, 0, false },
+  { GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 0, 0, 4, 16, 0, 99, 146, MODEL_BC7, 0, true },
+  { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, 0, 1, 61, 9, MODEL_RGBSDA, 0, false },
+  { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2, 0, 2, 49, 16, MODEL_RGBSDA, 0, false },
+  { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, 4, 28, 37, MODEL_RGBSDA, 0, false },
+  { GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4, 0, 4, 87, 44, MODEL_RGBSDA, 0, false },
+  { GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, 4, 29, 43, MODEL_RGBSDA, 0, true },
+  { GL_R16F, GL_RED, GL_HALF_FLOAT, 1, 0, 2, 54, 76, MODEL_RGBSDA,
+    CHANNEL_FLOAT | CHANNEL_SIGNED, false },
+  { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 4, 0, 8, 10, 97, MODEL_RGBSDA,
+    CHANNEL_FLOAT | CHANNEL_SIGNED, false },
+  { GL_R32F, GL_RED, GL_FLOAT, 1, 0, 4, 41, 100, MODEL_RGBSDA,
+    CHANNEL_FLOAT | CHANNEL_SIGNED, false },
+  { GL_RGBA32F, GL_RGBA, GL_FLOAT, 4, 0, 16, 2, 109, MODEL_RGBSDA,
+    CHANNEL_FLOAT | CHANNEL_SIGNED, false },
+};
+
+
+template <typename Predicate>
+const FormatDesc *findFormat(Predicate predicate)
+{
+  auto it = std::find_if(std::begin(g_formats), std::end(g_formats), predicate);
+  return it != std::end(g_formats) ? &*it : nullptr;
+}
+
+
+const FormatDesc *getFormatFromInternalFormat(unsigned int internal_format)
+{
+  return findFormat([&] (auto &f) { return f.internal_format == internal_format; });
+}
+
+
+const FormatDesc *getFormatFromDXGI(unsigned int dxgi_format)
+{
+  return findFormat([&] (auto &f) { return f.dxgi_format == dxgi_format; });
+}
+
+
+const FormatDesc *getFormatFromVulkan(unsigned int vk_format)
+{
+  return findFormat([&] (auto &f) { return f.vk_format == vk_format; });
+}
+
+
+size_t getLevelSize(const FormatDesc &format, glm::ivec2 size)
+{
+  if (format.block_bytes)
+    return size_t((size.x + 3) / 4) * ((size.y + 3) / 4) * format.block_bytes;
+  else
+    return size_t(size.x) * size.y * format.pixel_bytes;
+}
+
+
+glm::ivec2 getLevelExtent(glm::ivec2 size, int level)
+{
+  return glm::ivec2(std::max(1, size.x >> level), std::max(1, size.y >> level));
+}
+
+
+int getMaxNumLevels(glm::ivec2 size)
+{
+  int num_levels = 1;
+  while ((size.x >> num_levels) || (size.y >> num_levels))
+    num_levels++;
+  return num_levels;
+}
+
+
+template <typename T>
+T readValue(const unsigned char *data, size_t offset)
+{
+  T value;
+  memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+
+template <typename T>
+void writeValue(std::vector<unsigned char> &out, T value)
+{
+  auto bytes = reinterpret_cast<const unsigned char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+{
+  return uint32_t((unsigned char)a) | (uint32_t((unsigned char)b) << 8) |
+         (uint32_t((unsigned char)c) << 16) | (uint32_t((unsigned char)d) << 24);
+}
+
+
+/// the data layout of a parsed header
+struct Layout
+{
+  const FormatDesc *format = nullptr;
+  /// DDS: start of the data, which is stored layer by layer
+  size_t data_offset = 0;
+  /// KTX2: start of the level index
+  size_t level_index_offset = 0;
+};
+
+
+namespace dds
+{
+  constexpr uint32_t MAGIC = makeFourCC('D', 'D', 'S', ' ');
+  constexpr size_t HEADER_SIZE = 4 + 124;
+  constexpr size_t HEADER_DX10_SIZE = 20;
+
+  // offsets in the file, including the magic
+  constexpr size_t OFFSET_FLAGS = 8;
+  constexpr size_t OFFSET_HEIGHT = 12;
+  constexpr size_t OFFSET_WIDTH = 16;
+  constexpr size_t OFFSET_DEPTH = 24;
+  constexpr size_t OFFSET_MIPMAP_COUNT = 28;
+  constexpr size_t OFFSET_PF_FLAGS = 80;
+  constexpr size_t OFFSET_PF_FOURCC = 84;
+  constexpr size_t OFFSET_PF_BIT_COUNT = 88;
+  constexpr size_t OFFSET_PF_R_MASK = 92;
+  constexpr size_t OFFSET_PF_B_MASK = 100;
+  constexpr size_t OFFSET_CAPS2 = 112;
+
+  constexpr size_t OFFSET_DX10_FORMAT = HEADER_SIZE;
+  constexpr size_t OFFSET_DX10_DIMENSION = HEADER_SIZE + 4;
+  constexpr size_t OFFSET_DX10_ARRAY_SIZE = HEADER_SIZE + 12;
+
+  constexpr uint32_t DDSD_CAPS = 0x1;
+  constexpr uint32_t DDSD_HEIGHT = 0x2;
+  constexpr uint32_t DDSD_WIDTH = 0x4;
+  constexpr uint32_t DDSD_PITCH = 0x8;
+  constexpr uint32_t DDSD_PIXELFORMAT = 0x1000;
+  constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+  constexpr uint32_t DDSD_LINEARSIZE = 0x80000;
+  constexpr uint32_t DDSD_DEPTH = 0x800000;
+
+  constexpr uint32_t DDPF_FOURCC = 0x4;
+  constexpr uint32_t DDPF_RGB = 0x40;
+  constexpr uint32_t DDPF_LUMINANCE = 0x20000;
+
+  constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+  constexpr uint32_t DDSCAPS_TEXTURE = 0x1000;
+  constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+  constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+  constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+  constexpr uint32_t DIMENSION_TEXTURE2D = 3;
+
+
+  const FormatDesc *getLegacyFormat(const unsigned char *data)
+  {
+    auto flags = readValue<uint32_t>(data, OFFSET_PF_FLAGS);
+
+    if (flags & DDPF_FOURCC)
+    {
+      switch (readValue<uint32_t>(data, OFFSET_PF_FOURCC))
+      {
+        case makeFourCC('D', 'X', 'T', '1'):
+          return getFormatFromDXGI(71);
+        case makeFourCC('D', 'X', 'T', '2'):
+        case makeFourCC('D', 'X', 'T', '3'):
+          return getFormatFromDXGI(74);
+        case makeFourCC('D', 'X', 'T', '4'):
+        case makeFourCC('D', 'X', 'T', '5'):
+          return getFormatFromDXGI(77);
+        case makeFourCC('A', 'T', 'I', '1'):
+        case makeFourCC('B', 'C', '4', 'U'):
+          return getFormatFromDXGI(80);
+        case makeFourCC('B', 'C', '4', 'S'):
+          return getFormatFromDXGI(81);
+        case makeFourCC('A', 'T', 'I', '2'):
+        case makeFourCC('B', 'C', '5', 'U'):
+          return getFormatFromDXGI(83);
+        case makeFourCC('B', 'C', '5', 'S'):
+          return getFormatFromDXGI(84);
+        // D3DFORMAT values
+        case 111:
+          return getFormatFromDXGI(54);
+        case 113:
+          return getFormatFromDXGI(10);
+        case 114:
+          return getFormatFromDXGI(41);
+        case 116:
+          return getFormatFromDXGI(2);
+        default:
+          return nullptr;
+      }
+    }
+
+    auto bit_count = readValue<uint32_t>(data, OFFSET_PF_BIT_COUNT);
+    auto r_mask = readValue<uint32_t>(data, OFFSET_PF_R_MASK);
+    auto b_mask = readValue<uint32_t>(data, OFFSET_PF_B_MASK);
+
+    if ((flags & DDPF_RGB) && bit_count == 32)
+    {
+      if (r_mask == 0xff && b_mask == 0xff0000)
+        return getFormatFromDXGI(28);
+      if (r_mask == 0xff0000 && b_mask == 0xff)
+        return getFormatFromDXGI(87);
+    }
+
+    if ((flags & DDPF_LUMINANCE) && bit_count == 8)
+      return getFormatFromDXGI(61);
+
+    return nullptr;
+  }
+
+
+  bool parseHeader(const unsigned char *data, size_t data_size, ImageInfo &info, Layout &layout)
+  {
+    if (data_size < HEADER_SIZE)
+    {
+      LOG_ERROR << "DDS header is truncated" << endl;
+      return false;
+    }
+
+    auto flags = readValue<uint32_t>(data, OFFSET_FLAGS);
+    auto caps2 = readValue<uint32_t>(data, OFFSET_CAPS2);
+
+    if ((caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) ||
+        ((flags & DDSD_DEPTH) && readValue<uint32_t>(data, OFFSET_DEPTH) > 1))
+    {
+      LOG_ERROR << "DDS cube maps and volume textures are unsupported" << endl;
+      return false;
+    }
+
+    info.size.x = readValue<uint32_t>(data, OFFSET_WIDTH);
+    info.size.y = readValue<uint32_t>(data, OFFSET_HEIGHT);
+    info.num_levels = 1;
+    info.num_layers = 1;
+
+    if (flags & DDSD_MIPMAPCOUNT)
+      info.num_levels = std::max<int>(1, readValue<uint32_t>(data, OFFSET_MIPMAP_COUNT));
+
+    layout.data_offset = HEADER_SIZE;
+
+    if ((readValue<uint32_t>(data, OFFSET_PF_FLAGS) & DDPF_FOURCC) &&
+        readValue<uint32_t>(data, OFFSET_PF_FOURCC) == makeFourCC('D', 'X', '1', '0'))
+    {
+      if (data_size < HEADER_SIZE + HEADER_DX10_SIZE)
+      {
+        LOG_ERROR << "DDS header is truncated" << endl;
+        return false;
+      }
+
+      if (readValue<uint32_t>(data, OFFSET_DX10_DIMENSION) != DIMENSION_TEXTURE2D)
+      {
+        LOG_ERROR << "DDS: only 2D textures are supported" << endl;
+        return false;
+      }
+
+      auto dxgi_format = readValue<uint32_t>(data, OFFSET_DX10_FORMAT);
+      layout.format = getFormatFromDXGI(dxgi_format);
+      if (!layout.format)
+      {
+        LOG_ERROR << "DDS: unsupported DXGI format " << dxgi_format << endl;
+        return false;
+      }
+
+      info.num_layers = std::max<int>(1, readValue<uint32_t>(data, OFFSET_DX10_ARRAY_SIZE));
+      layout.data_offset += HEADER_DX10_SIZE;
+    }
+    else
+    {
+      layout.format = getLegacyFormat(data);
+      if (!layout.format)
+      {
+        LOG_ERROR << "DDS: unsupported pixel format" << endl;
+        return false;
+      }
+    }
+
+    info.file_format = ImageFileFormat::DDS;
+
+    return true;
+  }
+
+
+  void computeOffsets(const ImageInfo &info,
+                      const Layout &layout,
+                      const std::vector<size_t> &level_sizes,
+                      std::vector<size_t> &offsets)
+  {
+    size_t offset = layout.data_offset;
+    for (int layer = 0; layer < info.num_layers; layer++)
+    {
+      for (int level = 0; level < info.num_levels; level++)
+      {
+        offsets.at(size_t(level) * info.num_layers + layer) = offset;
+        offset += level_sizes.at(level);
+      }
+    }
+  }
+
+
+  void write(std::vector<unsigned char> &out,
+             const FormatDesc &format,
+             glm::ivec2 size,
+             int num_layers,
+             const std::vector<std::vector<unsigned char>> &levels)
+  {
+    const size_t level0_size = getLevelSize(format, size);
+    const bool has_mipmaps = levels.size() > 1;
+
+    uint32_t flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+    flags |= format.block_bytes ? DDSD_LINEARSIZE : DDSD_PITCH;
+
+    uint32_t caps = DDSCAPS_TEXTURE;
+    if (has_mipmaps)
+      caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    writeValue<uint32_t>(out, MAGIC);
+    writeValue<uint32_t>(out, 124);
+    writeValue<uint32_t>(out, flags);
+    writeValue<uint32_t>(out, size.y);
+    writeValue<uint32_t>(out, size.x);
+    writeValue<uint32_t>(out, format.block_bytes ? level0_size : size.x * format.pixel_bytes);
+    writeValue<uint32_t>(out, 0); // depth
+    writeValue<uint32_t>(out, levels.size());
+    out.resize(out.size() + 11 * 4); // reserved
+
+    // pixel format - the actual format is in the DX10 header
+    writeValue<uint32_t>(out, 32);
+    writeValue<uint32_t>(out, DDPF_FOURCC);
+    writeValue<uint32_t>(out, makeFourCC('D', 'X', '1', '0'));
+    out.resize(out.size() + 5 * 4); // bit count and masks
+
+    writeValue<uint32_t>(out, caps);
+    out.resize(out.size() + 4 * 4); // caps2 - caps4, reserved
+
+    assert(out.size() == HEADER_SIZE);
+
+    writeValue<uint32_t>(out, format.dxgi_format);
+    writeValue<uint32_t>(out, DIMENSION_TEXTURE2D);
+    writeValue<uint32_t>(out, 0); // misc flags
+    writeValue<uint32_t>(out, num_layers);
+    writeValue<uint32_t>(out, 0); // alpha mode unknown
+
+    for (int layer = 0; layer < num_layers; layer++)
+    {
+      for (auto &level : levels)
+      {
+        auto layer_size = level.size() / num_layers;
+        auto layer_data = level.data() + layer * layer_size;
+        out.insert(out.end(), layer_data, layer_data + layer_size);
+      }
+    }
+  }
+}
+
+
+namespace ktx2
+{
+  constexpr unsigned char IDENTIFIER[12] =
+  {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+  };
+
+  constexpr size_t HEADER_SIZE = 80;
+  constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+  constexpr size_t OFFSET_VK_FORMAT = 12;
+  constexpr size_t OFFSET_PIXEL_WIDTH = 20;
+  constexpr size_t OFFSET_PIXEL_HEIGHT = 24;
+  constexpr size_t OFFSET_PIXEL_DEPTH = 28;
+  constexpr size_t OFFSET_LAYER_COUNT = 32;
+  constexpr size_t OFFSET_FACE_COUNT = 36;
+  constexpr size_t OFFSET_LEVEL_COUNT = 40;
+  constexpr size_t OFFSET_SUPERCOMPRESSION_SCHEME = 44;
+
+  // data format descriptor
+  constexpr uint32_t DF_VERSION = 2;
+  constexpr uint8_t DF_PRIMARIES_BT709 = 1;
+  constexpr uint8_t DF_TRANSFER_LINEAR = 1;
+  constexpr uint8_t DF_TRANSFER_SRGB = 2;
+  constexpr uint8_t DF_CHANNEL_ALPHA = 15;
+  constexpr uint8_t DF_SAMPLE_LINEAR = 0x10;
+
+
+  bool parseHeader(const unsigned char *data, size_t data_size, ImageInfo &info, Layout &layout)
+  {
+    if (data_size < HEADER_SIZE)
+    {
+      LOG_ERROR << "KTX2 header is truncated" << endl;
+      return false;
+    }
+
+    auto vk_format = readValue<uint32_t>(data, OFFSET_VK_FORMAT);
+
+    if (readValue<uint32_t>(data, OFFSET_SUPERCOMPRESSION_SCHEME) != 0)
+    {
+      LOG_ERROR << "KTX2: supercompression is unsupported" << endl;
+      return false;
+    }
+
+    if (readValue<uint32_t>(data, OFFSET_PIXEL_HEIGHT) == 0 ||
+        readValue<uint32_t>(data, OFFSET_PIXEL_DEPTH) != 0 ||
+        readValue<uint32_t>(data, OFFSET_FACE_COUNT) != 1)
+    {
+      LOG_ERROR << "KTX2: only 2D textures are supported" << endl;
+      return false;
+    }
+
+    layout.format = getFormatFromVulkan(vk_format);
+    if (!layout.format)
+    {
+      LOG_ERROR << "KTX2: unsupported format " << vk_format << endl;
+      return false;
+    }
+
+    info.size.x = readValue<uint32_t>(data, OFFSET_PIXEL_WIDTH);
+    info.size.y = readValue<uint32_t>(data, OFFSET_PIXEL_HEIGHT);
+    // 0 means "generate the mipmaps at load time" - only level 0 is stored then
+    info.num_levels = std::max<int>(1, readValue<uint32_t>(data, OFFSET_LEVEL_COUNT));
+    info.num_layers = std::max<int>(1, readValue<uint32_t>(data, OFFSET_LAYER_COUNT));
+    info.file_format = ImageFileFormat::KTX2;
+
+    layout.level_index_offset = HEADER_SIZE;
+
+    return true;
+  }
+
+
+  bool computeOffsets(const unsigned char *data,
+                      size_t data_size,
+                      const ImageInfo &info,
+                      const Layout &layout,
+                      const std::vector<size_t> &level_sizes,
+                      std::vector<size_t> &offsets)
+  {
+    if (layout.level_index_offset + info.num_levels * LEVEL_INDEX_ENTRY_SIZE > data_size)
+    {
+      LOG_ERROR << "KTX2 level index is truncated" << endl;
+      return false;
+    }
+
+    for (int level = 0; level < info.num_levels; level++)
+    {
+      auto entry = layout.level_index_offset + level * LEVEL_INDEX_ENTRY_SIZE;
+      auto offset = readValue<uint64_t>(data, entry);
+      auto size = readValue<uint64_t>(data, entry + 8);
+
+      if (offset > data_size || size > data_size - offset)
+      {
+        LOG_ERROR << "KTX2: level " << level << " is out of bounds" << endl;
+        return false;
+      }
+
+      // num_layers is bounded by data_size / level_sizes[0] - this can't overflow
+      if (size != level_sizes.at(level) * info.num_layers)
+      {
+        LOG_ERROR << "KTX2: level " << level << " has " << size << " bytes, expected "
+                  << level_sizes.at(level) * info.num_layers << endl;
+        return false;
+      }
+
+      for (int layer = 0; layer < info.num_layers; layer++)
+        offsets.at(size_t(level) * info.num_layers + layer) = offset + layer * level_sizes.at(level);
+    }
+
+    return true;
+  }
+
+
+  void writeDataFormatDescriptor(std::vector<unsigned char> &out, const FormatDesc &format)
+  {
+    struct Sample
+    {
+      uint8_t channel;
+      uint16_t bit_offset;
+      uint16_t bit_length;
+    };
+
+    std::vector<Sample> samples;
+
+    switch (format.color_model)
+    {
+      case MODEL_RGBSDA:
+      {
+        uint16_t bits = format.pixel_bytes * 8 / format.num_components;
+        for (int i = 0; i < format.num_components; i++)
+        {
+          uint8_t channel = (i == 3) ? DF_CHANNEL_ALPHA : i;
+          samples.push_back({ channel, uint16_t(i * bits), bits });
+        }
+        break;
+      }
+      case MODEL_BC2:
+      case MODEL_BC3:
+        samples.push_back({ DF_CHANNEL_ALPHA, 0, 64 });
+        samples.push_back({ 0, 64, 64 });
+        break;
+      case MODEL_BC5:
+        samples.push_back({ 0, 0, 64 });
+        samples.push_back({ 1, 64, 64 });
+        break;
+      default:
+      {
+        uint8_t channel = (format.color_model == MODEL_BC1A && format.num_components == 4) ?
+          1 : 0;
+        samples.push_back({ channel, 0, uint16_t(format.block_bytes * 8) });
+      }
+    }
+
+    const uint32_t block_size = 24 + 16 * samples.size();
+    const uint8_t block_dimension = format.block_bytes ? 3 : 0;
+    const int bytes_per_block = format.block_bytes ? format.block_bytes : format.pixel_bytes;
+    const bool is_float = format.channel_flags & CHANNEL_FLOAT;
+    const bool is_signed = format.channel_flags & CHANNEL_SIGNED;
+
+    writeValue<uint32_t>(out, 4 + block_size);
+    writeValue<uint32_t>(out, 0); // vendor id, descriptor type
+    writeValue<uint32_t>(out, DF_VERSION | (block_size << 16));
+    writeValue<uint8_t>(out, format.color_model);
+    writeValue<uint8_t>(out, DF_PRIMARIES_BT709);
+    writeValue<uint8_t>(out, format.srgb ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR);
+    writeValue<uint8_t>(out, 0); // flags - straight alpha
+    for (int i = 0; i < 4; i++)
+      writeValue<uint8_t>(out, i < 2 ? block_dimension : 0);
+    writeValue<uint8_t>(out, bytes_per_block);
+    out.resize(out.size() + 7); // bytes of the other planes
+
+    for (auto &sample : samples)
+    {
+      uint8_t channel_type = sample.channel | format.channel_flags;
+      if (format.srgb && sample.channel == DF_CHANNEL_ALPHA)
+        channel_type |= DF_SAMPLE_LINEAR;
+
+      writeValue<uint16_t>(out, sample.bit_offset);
+      writeValue<uint8_t>(out, sample.bit_length - 1);
+      writeValue<uint8_t>(out, channel_type);
+      writeValue<uint32_t>(out, 0); // sample position
+
+      if (is_float)
+      {
+        // -1.0f / 1.0f
+        writeValue<uint32_t>(out, is_signed ? 0xBF800000 : 0);
+        writeValue<uint32_t>(out, 0x3F800000);
+      }
+      else if (is_signed)
+      {
+        writeValue<uint32_t>(out, 0x80000000);
+        writeValue<uint32_t>(out, 0x7FFFFFFF);
+      }
+      else
+      {
+        uint32_t upper = (sample.bit_length >= 32 || format.block_bytes) ?
+          0xFFFFFFFF : (1u << sample.bit_length) - 1;
+        writeValue<uint32_t>(out, 0);
+        writeValue<uint32_t>(out, upper);
+      }
+    }
+  }
+
+
+  void write(std::vector<unsigned char> &out,
+             const FormatDesc &format,
+             glm::ivec2 size,
+             int num_layers,
+             const std::vector<std::vector<unsigned char>> &levels)
+  {
+    const size_t level_index_size = levels.size() * LEVEL_INDEX_ENTRY_SIZE;
+    const size_t dfd_offset = HEADER_SIZE + level_index_size;
+
+    std::vector<unsigned char> dfd;
+    writeDataFormatDescriptor(dfd, format);
+
+    // level data must be aligned to lcm(texel block size, 4)
+    const size_t bytes_per_block = format.block_bytes ? format.block_bytes : format.pixel_bytes;
+    const size_t alignment = bytes_per_block % 4 ? 4 : bytes_per_block;
+
+    out.insert(out.end(), std::begin(IDENTIFIER), std::end(IDENTIFIER));
+    writeValue<uint32_t>(out, format.vk_format);
+    writeValue<uint32_t>(out, format.block_bytes ? 1 : format.pixel_bytes / format.num_components);
+    writeValue<uint32_t>(out, size.x);
+    writeValue<uint32_t>(out, size.y);
+    writeValue<uint32_t>(out, 0); // depth
+    writeValue<uint32_t>(out, num_layers > 1 ? num_layers : 0);
+    writeValue<uint32_t>(out, 1); // faces
+    writeValue<uint32_t>(out, levels.size());
+    writeValue<uint32_t>(out, 0); // no supercompression
+    writeValue<uint32_t>(out, dfd_offset);
+    writeValue<uint32_t>(out, dfd.size());
+    writeValue<uint32_t>(out, 0); // key/value data
+    writeValue<uint32_t>(out, 0);
+    writeValue<uint64_t>(out, 0); // supercompression global data
+    writeValue<uint64_t>(out, 0);
+
+    assert(out.size() == HEADER_SIZE);
+
+    // the level index is filled in below
+    out.resize(dfd_offset);
+    out.insert(out.end(), dfd.begin(), dfd.end());
+
+    // the smallest level comes first
+    for (int level = levels.size() - 1; level >= 0; level--)
+    {
+      out.resize((out.size() + alignment - 1) / alignment * alignment);
+
+      auto entry = out.data() + HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+      uint64_t offset = out.size();
+      uint64_t level_size = levels[level].size();
+      memcpy(entry, &offset, 8);
+      memcpy(entry + 8, &level_size, 8);
+      memcpy(entry + 16, &level_size, 8);
+
+      out.insert(out.end(), levels[level].begin(), levels[level].end());
+    }
+  }
+}
+
+
+bool parseHeader(const unsigned char *data, size_t data_size, ImageInfo &info, Layout &layout)
+{
+  info = {};
+  layout = {};
+
+  bool res = false;
+
+  if (data_size >= 4 && readValue<uint32_t>(data, 0) == dds::MAGIC)
+    res = dds::parseHeader(data, data_size, info, layout);
+  else if (data_size >= sizeof(ktx2::IDENTIFIER) &&
+           memcmp(data, ktx2::IDENTIFIER, sizeof(ktx2::IDENTIFIER)) == 0)
+    res = ktx2::parseHeader(data, data_size, info, layout);
+
+  if (!res)
+    return false;
+
+  // the extent is limited so that the level sizes can't overflow
+  if (info.size.x < 1 || info.size.y < 1 || info.size.x > 0x10000 || info.size.y > 0x10000 ||
+      info.num_levels > getMaxNumLevels(info.size))
+  {
+    LOG_ERROR << "texture container has an invalid size: " << info.size.x << "x" << info.size.y
+              << ", " << info.num_levels << " levels" << endl;
+    return false;
+  }
+
+  info.num_components = layout.format->num_components;
+  info.internal_format = layout.format->internal_format;
+  info.compressed = layout.format->block_bytes != 0;
+
+  return true;
+}
+
+
+} // namespace
+
+
+std::unique_ptr<TextureContainer>
+TextureContainer::create(std::unique_ptr<ImageStorage> &&storage)
+{
+  assert(storage);
+
+  const unsigned char *data = storage->getData();
+  const size_t data_size = storage->getSize();
+
+  std::unique_ptr<TextureContainer> container(new TextureContainer);
+  auto &info = container->m_info;
+
+  Layout layout;
+  if (!parseHeader(data, data_size, info, layout))
+    return {};
+
+  container->m_format = layout.format->format;
+  container->m_type = layout.format->type;
+
+  for (int level = 0; level < info.num_levels; level++)
+    container->m_level_sizes.push_back(getLevelSize(*layout.format, container->getSize(level)));
+
+  // a file can't hold more layers than fit into it - checked before allocating the offsets
+  if (size_t(info.num_layers) > data_size / container->m_level_sizes.at(0))
+  {
+    LOG_ERROR << "texture container is truncated: " << data_size << " bytes for "
+              << info.num_layers << " layers" << endl;
+    return {};
+  }
+
+  auto &offsets = container->m_offsets;
+  offsets.resize(size_t(info.num_levels) * info.num_layers);
+
+  if (info.file_format == ImageFileFormat::DDS)
+  {
+    dds::computeOffsets(info, layout, container->m_level_sizes, offsets);
+  }
+  else
+  {
+    if (!ktx2::computeOffsets(data, data_size, info, layout, container->m_level_sizes, offsets))
+      return {};
+  }
+
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    auto level_size = container->m_level_sizes[i / info.num_layers];
+    if (offsets[i] > data_size || level_size > data_size - offsets[i])
+    {
+      LOG_ERROR << "texture container is truncated: " << data_size << " bytes" << endl;
+      return {};
+    }
+  }
+
+  container->m_storage = std::move(storage);
+
+  return container;
+}
+
+
+std::unique_ptr<TextureContainer> TextureContainer::load(const std::string &file_path, bool quiet)
+{
+  auto file = util::MappedFile::open(file_path, quiet);
+  if (!file)
+    return {};
+
+  auto size = file->getSize();
+  std::unique_ptr<ImageStorage> storage =
+    std::make_unique<MappedImageStorage>(std::move(file), 0, size);
+
+  auto container = create(std::move(storage));
+  if (!container)
+    LOG_ERROR << "failed to load " << file_path << endl;
+
+  return container;
+}
+
+
+std::unique_ptr<TextureContainer> TextureContainer::load(util::File &file)
+{
+  const int size = file.getSize();
+
+  std::unique_ptr<ImageStorage> storage = std::make_unique<VectorImageStorage>(size);
+  int read = file.read(reinterpret_cast<char*>(storage->getData()), size);
+
+  file.rewind();
+
+  if (read != size)
+  {
+    LOG_ERROR << "failed to read texture container" << endl;
+    return {};
+  }
+
+  return create(std::move(storage));
+}
+
+
+const unsigned char *TextureContainer::getData(int level, int layer) const
+{
+  assert(level >= 0 && level < m_info.num_levels);
+  assert(layer >= 0 && layer < m_info.num_layers);
+  return m_storage->getData() + m_offsets.at(size_t(level) * m_info.num_layers + layer);
+}
+
+
+size_t TextureContainer::getDataSize(int level) const
+{
+  return m_level_sizes.at(level);
+}
+
+
+bool render_util::isTextureContainer(const unsigned char *data, size_t data_size)
+{
+  return (data_size >= 4 && readValue<uint32_t>(data, 0) == dds::MAGIC) ||
+         (data_size >= sizeof(ktx2::IDENTIFIER) &&
+          memcmp(data, ktx2::IDENTIFIER, sizeof(ktx2::IDENTIFIER)) == 0);
+}
+
+
+bool render_util::getTextureContainerInfo(const unsigned char *data,
+                                          size_t data_size,
+                                          ImageInfo &info)
+{
+  Layout layout;
+  return parseHeader(data, data_size, info, layout);
+}
+
+
+size_t render_util::getTextureLevelSize(unsigned int internal_format, glm::ivec2 size)
+{
+  auto format = getFormatFromInternalFormat(internal_format);
+  return format ? getLevelSize(*format, size) : 0;
+}
+
+
+std::vector<unsigned char>
+render_util::writeTextureContainer(ImageFileFormat file_format,
+                                   unsigned int internal_format,
+                                   glm::ivec2 size,
+                                   int num_layers,
+                                   const std::vector<std::vector<unsigned char>> &levels)
+{
+  assert(num_layers > 0);
+  assert(!levels.empty());
+  assert(int(levels.size()) <= getMaxNumLevels(size));
+
+  auto format = getFormatFromInternalFormat(internal_format);
+  if (!format)
+  {
+    LOG_ERROR << "can't write texture container: unsupported internal format 0x"
+              << std::hex << internal_format << std::dec << endl;
+    return {};
+  }
+
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    assert(levels[i].size() == getLevelSize(*format, getLevelExtent(size, i)) * num_layers);
+  }
+
+  std::vector<unsigned char> out;
+
+  switch (file_format)
+  {
+    case ImageFileFormat::DDS:
+      dds::write(out, *format, size, num_layers, levels);
+      break;
+    case ImageFileFormat::KTX2:
+      ktx2::write(out, *format, size, num_layers, levels);
+      break;
+    default:
+      assert(0);
+      abort();
+  }
+
+  return out;
+}
+
+
+bool render_util::saveTextureContainer(const std::string &file_path,
+                                       ImageFileFormat file_format,
+                                       unsigned int internal_format,
+                                       glm::ivec2 size,
+                                       int num_layers,
+                                       const std::vector<std::vector<unsigned char>> &levels)
+{
+  auto out = writeTextureContainer(file_format, internal_format, size, num_layers, levels);
+  if (out.empty())
+    return false;
+
+  std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(out.data()), out.size());
+
+  if (!file.good())
+  {
+    LOG_ERROR << "failed to write " << file_path << endl;
+    return false;
+  }
+
+  return true;
+}
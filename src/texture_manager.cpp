@@ -21,8 +21,10 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <cstdio>
 #include <cassert>
+#include <utility>
 #include <glm/gtc/type_ptr.hpp>
 #include <GL/gl.h>
 
@@ -35,10 +37,306 @@ using std::vector;
 using std::endl;
 
 
+namespace
+{
+
+
+using render_util::TextureBindingStatistics;
+
+constexpr unsigned int UNKNOWN = ~0u;
+
+/// targets whose bindings are tracked - binds to other targets are always issued
+const unsigned int g_tracked_targets[] =
+{
+  GL_TEXTURE_1D,
+  GL_TEXTURE_2D,
+  GL_TEXTURE_2D_ARRAY,
+  GL_TEXTURE_3D,
+  GL_TEXTURE_CUBE_MAP,
+};
+
+constexpr size_t NUM_TRACKED_TARGETS = sizeof(g_tracked_targets) / sizeof(g_tracked_targets[0]);
+
+
+TextureBindingStatistics g_statistics;
+
+
+int getTargetIndex(unsigned int target)
+{
+  for (size_t i = 0; i < NUM_TRACKED_TARGETS; i++)
+  {
+    if (g_tracked_targets[i] == target)
+      return i;
+  }
+  return -1;
+}
+
+
+bool hasDirectStateAccess()
+{
+  auto iface = getCurrentInterface();
+  return iface->CreateTextures && iface->BindTextureUnit;
+}
+
+
+/**
+ * Shadow copy of the active unit and of the units from first_unit on.
+ * Whatever isn't known is UNKNOWN.
+ */
+class TextureBindingState
+{
+  render_util::TextureManager &m_manager;
+  unsigned int m_first_unit = 0;
+  unsigned int m_active_unit = UNKNOWN;
+  std::vector<std::array<unsigned int, NUM_TRACKED_TARGETS>> m_bindings;
+
+public:
+  TextureBindingState(render_util::TextureManager &manager,
+                      unsigned int first_unit, unsigned int num_units) :
+    m_manager(manager),
+    m_first_unit(first_unit),
+    m_bindings(num_units)
+  {
+    invalidate();
+  }
+
+  void invalidate()
+  {
+    m_active_unit = UNKNOWN;
+    for (auto &unit : m_bindings)
+      unit.fill(UNKNOWN);
+  }
+
+  render_util::TextureManager &getManager() { return m_manager; }
+
+  unsigned int getActiveUnit() const { return m_active_unit; }
+  void setActiveUnit(unsigned int unit) { m_active_unit = unit; }
+
+  unsigned int *getBinding(unsigned int unit, unsigned int target)
+  {
+    if (unit < m_first_unit || unit - m_first_unit >= m_bindings.size())
+      return nullptr;
+
+    auto target_index = getTargetIndex(target);
+    if (target_index < 0)
+      return nullptr;
+
+    return &m_bindings[unit - m_first_unit][target_index];
+  }
+
+  void invalidateUnit(unsigned int unit)
+  {
+    if (unit >= m_first_unit && unit - m_first_unit < m_bindings.size())
+      m_bindings[unit - m_first_unit].fill(UNKNOWN);
+  }
+
+  /// GL unbinds deleted textures
+  void forgetTexture(unsigned int texture)
+  {
+    for (auto &unit : m_bindings)
+    {
+      for (auto &binding : unit)
+      {
+        if (binding == texture)
+          binding = 0;
+      }
+    }
+  }
+};
+
+
+/// the state of the active TextureManager - null if there is none
+TextureBindingState *g_state = nullptr;
+
+
+unsigned int getActiveUnit()
+{
+  if (g_state && g_state->getActiveUnit() != UNKNOWN)
+  {
+    g_statistics.num_queries_avoided++;
+    return g_state->getActiveUnit();
+  }
+
+  GLint active_texture = GL_TEXTURE0;
+  gl::GetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+  g_statistics.num_queries++;
+
+  unsigned int unit = active_texture - GL_TEXTURE0;
+  if (g_state)
+    g_state->setActiveUnit(unit);
+
+  return unit;
+}
+
+
+void setActiveUnit(unsigned int unit)
+{
+  if (g_state && g_state->getActiveUnit() == unit)
+  {
+    g_statistics.num_redundant_active_texture_calls_avoided++;
+    return;
+  }
+
+  gl::ActiveTexture(GL_TEXTURE0 + unit);
+  g_statistics.num_active_texture_calls++;
+
+  if (g_state)
+    g_state->setActiveUnit(unit);
+}
+
+
+unsigned int *getActiveUnitBinding(unsigned int target)
+{
+  if (!g_state)
+    return nullptr;
+  return g_state->getBinding(getActiveUnit(), target);
+}
+
+
+unsigned int queryBinding(unsigned int target)
+{
+  GLint binding = 0;
+
+  switch (target)
+  {
+    case GL_TEXTURE_1D:
+      gl::GetIntegerv(GL_TEXTURE_BINDING_1D, &binding);
+      break;
+    case GL_TEXTURE_2D:
+      gl::GetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+      break;
+    case GL_TEXTURE_2D_ARRAY:
+      gl::GetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &binding);
+      break;
+    case GL_TEXTURE_3D:
+      gl::GetIntegerv(GL_TEXTURE_BINDING_3D, &binding);
+      break;
+    case GL_TEXTURE_CUBE_MAP:
+      gl::GetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &binding);
+      break;
+    default:
+      LOG_INFO<<std::hex<<target<<endl;
+      assert(0);
+  }
+
+  g_statistics.num_queries++;
+
+  return binding;
+}
+
+
+/// the texture bound to target on the active unit
+unsigned int getBinding(unsigned int target)
+{
+  auto binding = getActiveUnitBinding(target);
+
+  if (binding && *binding != UNKNOWN)
+  {
+    g_statistics.num_queries_avoided++;
+    return *binding;
+  }
+
+  auto texture = queryBinding(target);
+
+  if (binding)
+    *binding = texture;
+
+  return texture;
+}
+
+
+void bindToActiveUnit(unsigned int target, unsigned int texture)
+{
+  auto binding = getActiveUnitBinding(target);
+
+  if (binding && *binding == texture)
+  {
+    g_statistics.num_redundant_binds_avoided++;
+    return;
+  }
+
+  gl::BindTexture(target, texture);
+  g_statistics.num_binds++;
+
+  if (binding)
+    *binding = texture;
+}
+
+
+/// leaves the active unit as it is
+void bindToUnit(unsigned int unit, unsigned int target, unsigned int texture)
+{
+  assert(g_state);
+
+  auto binding = g_state->getBinding(unit, target);
+
+  if (binding && *binding == texture)
+  {
+    g_statistics.num_redundant_binds_avoided++;
+    return;
+  }
+
+  // glBindTextureUnit() with 0 would unbind all targets
+  if (texture && hasDirectStateAccess())
+  {
+    gl::BindTextureUnit(unit, texture);
+    g_statistics.num_binds++;
+
+    if (binding)
+      *binding = texture;
+  }
+  else
+  {
+    auto active_unit = getActiveUnit();
+    setActiveUnit(unit);
+    bindToActiveUnit(target, texture);
+    setActiveUnit(active_unit);
+  }
+
+  CHECK_GL_ERROR();
+}
+
+
+} // namespace
+
+
 namespace render_util
 {
 
 
+TextureBindingStatistics getTextureBindingStatistics()
+{
+  return g_statistics;
+}
+
+
+void resetTextureBindingStatistics()
+{
+  g_statistics = {};
+}
+
+
+void rebindTexture(TexturePtr texture)
+{
+  if (g_state)
+    g_state->getManager().rebind(texture);
+}
+
+
+void invalidateTextureUnit(unsigned int unit)
+{
+  if (g_state)
+    g_state->invalidateUnit(unit);
+}
+
+
+void invalidateTextureState()
+{
+  if (g_state)
+    g_state->getManager().invalidateState();
+}
+
+
 void applyTextureParameter(unsigned int name, int value, unsigned int target)
 {
   gl::TexParameteri(target, name, value);
@@ -54,13 +352,24 @@ void applyTextureParameter(unsigned int name, const glm::vec4 &value, unsigned i
 Texture::~Texture()
 {
   if (m_id)
+  {
     gl::DeleteTextures(1, &m_id);
+    if (g_state)
+      g_state->forgetTexture(m_id);
+  }
 }
 
 
 void Texture::bind()
 {
-  gl::BindTexture(getTarget(), getID());
+  bindToActiveUnit(getTarget(), getID());
+}
+
+
+void Texture::swap(Texture &other)
+{
+  assert(m_target == other.m_target);
+  std::swap(m_id, other.m_id);
 }
 
 
@@ -68,7 +377,14 @@ std::shared_ptr<Texture> Texture::create(unsigned int target)
 {
   std::shared_ptr<Texture> texture(new Texture);
   texture->m_target = target;
-  gl::GenTextures(1, &texture->m_id);
+
+  // the name has to be a texture object for glBindTextureUnit() - a generated one becomes one
+  // when it's bound for the first time
+  if (hasDirectStateAccess())
+    gl::CreateTextures(target, 1, &texture->m_id);
+  else
+    gl::GenTextures(1, &texture->m_id);
+
   return texture;
 }
 
@@ -78,40 +394,26 @@ TemporaryTextureBinding::TemporaryTextureBinding(TexturePtr texture, int texunit
   m_texunit(texunit)
 {
   if (m_texunit >= 0)
-    gl::ActiveTexture(GL_TEXTURE0 + texunit);
+    setActiveUnit(texunit);
 
-  switch (texture->getTarget())
-  {
-    case GL_TEXTURE_1D:
-      gl::GetIntegerv(GL_TEXTURE_BINDING_1D, (GLint*) &m_previous_binding);
-      break;
-    case GL_TEXTURE_2D:
-      gl::GetIntegerv(GL_TEXTURE_BINDING_2D, (GLint*) &m_previous_binding);
-      break;
-    case GL_TEXTURE_2D_ARRAY:
-      gl::GetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, (GLint*) &m_previous_binding);
-      break;
-    default:
-      LOG_INFO<<std::hex<<texture->getTarget()<<endl;
-      assert(0);
-  }
+  m_previous_binding = getBinding(texture->getTarget());
 
   m_texture->bind();
 
   if (m_texunit >= 0)
-    gl::ActiveTexture(GL_TEXTURE0);
+    setActiveUnit(0);
 }
 
 
 TemporaryTextureBinding::~TemporaryTextureBinding()
 {
   if (m_texunit >= 0)
-    gl::ActiveTexture(GL_TEXTURE0 + m_texunit);
+    setActiveUnit(m_texunit);
 
-  gl::BindTexture(m_texture->getTarget(), m_previous_binding);
+  bindToActiveUnit(m_texture->getTarget(), m_previous_binding);
 
   if (m_texunit >= 0)
-    gl::ActiveTexture(GL_TEXTURE0);
+    setActiveUnit(0);
 }
 
 
@@ -127,37 +429,79 @@ namespace
   };
 
 
-  void applyBinding(unsigned int unit, unsigned int target, unsigned int texture, TextureManager &mgr)
+  /**
+   * After the state was invalidated nothing is known, so with glBindTextures
+   * the first texture of each unit is bound in one call per run of units.
+   * The remaining bindings are applied one by one.
+   */
+  void applyBindings(const vector<Texunit> &units, TextureManager &mgr)
   {
-    CHECK_GL_ERROR();
+    // per unit - already bound with glBindTextures
+    vector<Texture*> multi_bound(units.size(), nullptr);
 
-    GLenum active_unit_save;
-    gl::GetIntegerv(GL_ACTIVE_TEXTURE, reinterpret_cast<GLint*>(&active_unit_save));
+    if (getCurrentInterface()->BindTextures)
+    {
+      vector<GLuint> textures;
+      unsigned int first_unit = 0;
 
-    gl::ActiveTexture(GL_TEXTURE0 + mgr.getTexUnitNum(unit));
-    CHECK_GL_ERROR();
+      auto flush = [&] ()
+      {
+        if (textures.empty())
+          return;
 
-//     LOG_INFO<<"target: "<<binding.target<<endl;
-//     LOG_INFO<<"texture: "<<binding.texture<<endl;
+        gl::BindTextures(first_unit, textures.size(), textures.data());
+        g_statistics.num_multi_binds++;
+        g_statistics.num_binds += textures.size();
 
-    gl::BindTexture(target, texture);
-    CHECK_GL_ERROR();
+        textures.clear();
+      };
 
-    gl::ActiveTexture(active_unit_save);
-    CHECK_GL_ERROR();
-  }
+      for (size_t i = 0; i < units.size(); i++)
+      {
+        for (auto &binding : units[i].bindings)
+        {
+          if (binding.second)
+          {
+            multi_bound[i] = binding.second.get();
+            break;
+          }
+        }
+
+        if (!multi_bound[i])
+        {
+          flush();
+          continue;
+        }
+
+        auto texture = multi_bound[i];
+        unsigned int unit = mgr.getTexUnitNum(i);
+
+        if (textures.empty())
+          first_unit = unit;
+        textures.push_back(texture->getID());
+
+        if (auto binding = g_state->getBinding(unit, texture->getTarget()))
+          *binding = texture->getID();
+      }
+
+      flush();
+    }
 
-  void applyBindings(const vector<Texunit> &units, TextureManager &mgr)
-  {
     for (size_t i = 0; i < units.size(); i++)
     {
       for (auto &binding : units[i].bindings)
       {
         auto target = binding.first;
         auto texture = binding.second;
-        applyBinding(i, target, texture ? texture->getID() : 0, mgr);
+
+        if (texture && texture.get() == multi_bound[i])
+          continue;
+
+        bindToUnit(mgr.getTexUnitNum(i), target, texture ? texture->getID() : 0);
       }
     }
+
+    CHECK_GL_ERROR();
   }
 
 
@@ -172,6 +516,7 @@ struct TextureManager::Private
   unsigned int max_units = 0;
   bool is_active = false;
   vector<Texunit> texunits;
+  std::unique_ptr<TextureBindingState> binding_state;
 };
 
 
@@ -192,15 +537,21 @@ TextureManager::TextureManager(unsigned int lowest_unit, unsigned int highest_un
   p->highest_unit = highest_unit;
 
   p->texunits.resize(p->max_units);
+
+  assert(lowest_unit < p->max_units);
+  p->binding_state = std::make_unique<TextureBindingState>(*this, lowest_unit,
+                                                           p->max_units - lowest_unit);
 }
 
 TextureManager::~TextureManager()
 {
   LOG_TRACE<<endl;
-  delete p;
-}
 
+  if (g_state == p->binding_state.get())
+    g_state = nullptr;
 
+  delete p;
+}
 int TextureManager::getMaxUnits() const
 {
   return p->max_units;
@@ -234,13 +585,29 @@ void TextureManager::setActive(bool active)
 
   if (active)
   {
+    assert(!g_state);
+
+    p->binding_state->invalidate();
+    g_state = p->binding_state.get();
+
     applyBindings(p->texunits, *this);
   }
+  else
+  {
+    assert(g_state == p->binding_state.get());
+    g_state = nullptr;
+  }
 
   p->is_active = active;
 }
 
 
+void TextureManager::invalidateState()
+{
+  p->binding_state->invalidate();
+}
+
+
 void TextureManager::bind(unsigned int unit_, TexturePtr texture)
 {
   assert(unit_ <= p->highest_unit);
@@ -250,7 +617,22 @@ void TextureManager::bind(unsigned int unit_, TexturePtr texture)
   unit.bindings[texture->getTarget()] = texture;
 
   if (p->is_active)
-    applyBinding(unit_, texture->getTarget(), texture->getID(), *this);
+    bindToUnit(getTexUnitNum(unit_), texture->getTarget(), texture->getID());
+}
+
+
+void TextureManager::rebind(TexturePtr texture)
+{
+  if (!p->is_active)
+    return;
+
+  for (unsigned int i = 0; i < p->texunits.size(); i++)
+  {
+    auto &bindings = p->texunits[i].bindings;
+    auto it = bindings.find(texture->getTarget());
+    if (it != bindings.end() && it->second == texture)
+      bindToUnit(getTexUnitNum(i), texture->getTarget(), texture->getID());
+  }
 }
 
 
@@ -263,7 +645,7 @@ void TextureManager::unbind(unsigned int unit_, unsigned int target)
   unit.bindings[target] = nullptr;
 
   if (p->is_active)
-    applyBinding(unit_, target, 0, *this);
+    bindToUnit(getTexUnitNum(unit_), target, 0);
 }
 
 
@@ -0,0 +1,508 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/texture_upload_queue.h>
+#include <render_util/profiler.h>
+#include <render_util/gl_binding/gl_functions.h>
+#include <log.h>
+
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+using namespace render_util::gl_binding;
+using std::endl;
+
+
+namespace
+{
+
+
+void getTextureFormat(int bytes_per_pixel, GLint &internal_format, GLenum &format)
+{
+  switch (bytes_per_pixel)
+  {
+    case 1:
+      internal_format = GL_R8;
+      format = GL_RED;
+      break;
+    case 2:
+      internal_format = GL_RG8;
+      format = GL_RG;
+      break;
+    case 3:
+      internal_format = GL_RGB8;
+      format = GL_RGB;
+      break;
+    case 4:
+      internal_format = GL_RGBA8;
+      format = GL_RGBA;
+      break;
+    default:
+      LOG_ERROR << "unsupported bytes per pixel: " << bytes_per_pixel << endl;
+      assert(0);
+      abort();
+  }
+}
+
+
+bool isValid(const render_util::TextureUploadImage &image)
+{
+  return image.data &&
+         image.size.x > 0 &&
+         image.size.y > 0 &&
+         image.bytes_per_pixel >= 1 &&
+         image.bytes_per_pixel <= 4;
+}
+
+
+bool isSignaled(void *fence, bool wait)
+{
+  auto sync = static_cast<GLsync>(fence);
+
+  GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+  GLuint64 timeout = wait ? 1000 * 1000 * 1000 : 0;
+
+  while (true)
+  {
+    auto res = gl::ClientWaitSync(sync, flags, timeout);
+    if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED)
+      return true;
+    if (res == GL_WAIT_FAILED)
+    {
+      LOG_ERROR << "glClientWaitSync() failed." << endl;
+      return true;
+    }
+    assert(res == GL_TIMEOUT_EXPIRED);
+    if (!wait)
+      return false;
+  }
+}
+
+
+class UnpackState
+{
+  GLint m_previous_alignment = 4;
+
+public:
+  UnpackState(unsigned int buffer)
+  {
+    gl::GetIntegerv(GL_UNPACK_ALIGNMENT, &m_previous_alignment);
+    gl::PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  }
+
+  ~UnpackState()
+  {
+    gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    gl::PixelStorei(GL_UNPACK_ALIGNMENT, m_previous_alignment);
+  }
+};
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+TextureUploadQueue::TextureUploadQueue(size_t bytes_per_frame, util::ThreadPool &thread_pool) :
+  m_bytes_per_frame(bytes_per_frame),
+  m_thread_pool(thread_pool)
+{
+  assert(m_bytes_per_frame > 0);
+  m_staging_buffer = std::make_unique<StreamBuffer>(GL_PIXEL_UNPACK_BUFFER, m_bytes_per_frame);
+}
+
+
+TextureUploadQueue::~TextureUploadQueue()
+{
+  // the decode functions may refer to objects owned by the caller
+  for (auto &request : m_decoding)
+    request->decoded.wait();
+
+  for (auto &batch : m_in_flight)
+    gl::DeleteSync(static_cast<GLsync>(batch.fence));
+}
+
+
+void TextureUploadQueue::enqueue(TexturePtr texture,
+                                 DecodeFunction decode,
+                                 bool mipmaps,
+                                 DoneFunction done)
+{
+  assert(texture);
+  assert(texture->getTarget() == GL_TEXTURE_2D);
+  assert(decode);
+
+  for (auto &request : m_decoding)
+  {
+    if (request->texture == texture && !request->superseded)
+    {
+      request->superseded = true;
+      m_statistics.num_superseded++;
+    }
+  }
+
+  for (auto it = m_waiting.begin(); it != m_waiting.end();)
+  {
+    auto &request = *it;
+    if (request->texture == texture && request->num_rows_uploaded == 0)
+    {
+      m_statistics.num_superseded++;
+      it = m_waiting.erase(it);
+    }
+    else
+    {
+      it++;
+    }
+  }
+
+  auto request = std::make_shared<Request>();
+  request->texture = texture;
+  request->mipmaps = mipmaps;
+  request->done = std::move(done);
+  request->enqueue_time = Clock::now();
+  request->decoded = m_thread_pool.submit(std::move(decode));
+
+  m_decoding.push_back(request);
+
+  updateStatistics();
+}
+
+
+void TextureUploadQueue::update()
+{
+  RENDER_UTIL_PROFILE_GPU_SCOPE("TextureUploadQueue::update");
+
+  swapCompleted(false);
+  collectDecoded(false);
+  upload(m_bytes_per_frame);
+  updateStatistics();
+}
+
+
+void TextureUploadQueue::finish()
+{
+  while (!isEmpty())
+  {
+    collectDecoded(true);
+    upload(m_bytes_per_frame);
+    swapCompleted(true);
+  }
+
+  updateStatistics();
+}
+
+
+bool TextureUploadQueue::isEmpty() const
+{
+  return m_decoding.empty() && m_waiting.empty() && m_in_flight.empty();
+}
+
+
+void TextureUploadQueue::collectDecoded(bool wait)
+{
+  for (auto it = m_decoding.begin(); it != m_decoding.end();)
+  {
+    auto request = *it;
+
+    if (!wait && !util::isReady(request->decoded))
+    {
+      it++;
+      continue;
+    }
+
+    it = m_decoding.erase(it);
+
+    try
+    {
+      request->image = request->decoded.get();
+    }
+    catch (std::exception &e)
+    {
+      LOG_ERROR << "Failed to decode texture image: " << e.what() << endl;
+      m_statistics.num_failed++;
+      continue;
+    }
+
+    if (request->superseded)
+      continue;
+
+    if (!isValid(request->image))
+    {
+      LOG_ERROR << "Decoded texture image is invalid." << endl;
+      m_statistics.num_failed++;
+      continue;
+    }
+
+    m_waiting.push_back(request);
+  }
+}
+
+
+void TextureUploadQueue::upload(size_t budget)
+{
+  struct Rows
+  {
+    Request *request = nullptr;
+    int first = 0;
+    int num = 0;
+    size_t offset = 0;
+  };
+
+  std::vector<Rows> staged;
+  std::vector<Request*> direct;
+  size_t staged_size = 0;
+  size_t num_bytes = 0;
+
+  for (auto &request : m_waiting)
+  {
+    auto &image = request->image;
+    const size_t row_size = image.getRowSize();
+    const int num_remaining = image.size.y - request->num_rows_uploaded;
+    assert(num_remaining > 0);
+
+    if (row_size > m_staging_buffer->getRegionSize())
+    {
+      // doesn't fit into the staging buffer row by row - upload the whole image from client memory
+      if (num_bytes)
+        break;
+      direct.push_back(request.get());
+      num_bytes = row_size * num_remaining;
+      break;
+    }
+
+    const int num_rows = std::min<size_t>(num_remaining, (budget - num_bytes) / row_size);
+    if (num_rows == 0)
+      break;
+
+    Rows rows;
+    rows.request = request.get();
+    rows.first = request->num_rows_uploaded;
+    rows.num = num_rows;
+    rows.offset = staged_size;
+    staged.push_back(rows);
+
+    staged_size += row_size * num_rows;
+    num_bytes += row_size * num_rows;
+
+    if (num_rows < num_remaining)
+      break;
+  }
+
+  m_statistics.bytes_uploaded_last_frame = num_bytes;
+  m_statistics.bytes_uploaded_total += num_bytes;
+
+  if (!num_bytes)
+    return;
+
+  Batch batch;
+
+  // with no unpack buffer bound, so the allocation doesn't read from it
+  for (auto &rows : staged)
+  {
+    if (!rows.request->staging_texture)
+      createStagingTexture(*rows.request);
+  }
+
+  for (auto request : direct)
+  {
+    if (!request->staging_texture)
+      createStagingTexture(*request);
+
+    auto &image = request->image;
+    UnpackState unpack_state(0);
+    uploadRows(*request, request->num_rows_uploaded, image.size.y - request->num_rows_uploaded,
+               image.data + image.getRowSize() * request->num_rows_uploaded);
+  }
+
+  if (!staged.empty())
+  {
+    size_t buffer_offset = 0;
+    auto mapping = static_cast<unsigned char*>(m_staging_buffer->map(staged_size, buffer_offset));
+
+    for (auto &rows : staged)
+    {
+      auto &image = rows.request->image;
+      memcpy(mapping + rows.offset,
+             image.data + image.getRowSize() * rows.first,
+             image.getRowSize() * rows.num);
+    }
+
+    m_staging_buffer->unmap();
+
+    UnpackState unpack_state(m_staging_buffer->getID());
+
+    for (auto &rows : staged)
+    {
+      auto offset = reinterpret_cast<const void*>(uintptr_t(buffer_offset + rows.offset));
+      uploadRows(*rows.request, rows.first, rows.num, offset);
+    }
+  }
+
+  while (!m_waiting.empty() &&
+         m_waiting.front()->num_rows_uploaded == m_waiting.front()->image.size.y)
+  {
+    finishUpload(*m_waiting.front());
+    batch.requests.push_back(m_waiting.front());
+    m_waiting.pop_front();
+  }
+
+  if (!batch.requests.empty())
+  {
+    batch.fence = gl::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_in_flight.push_back(std::move(batch));
+  }
+
+  CHECK_GL_ERROR();
+}
+
+
+void TextureUploadQueue::createStagingTexture(Request &request)
+{
+  assert(!request.staging_texture);
+
+  auto &image = request.image;
+
+  GLint internal_format = -1;
+  GLenum format = 0;
+  getTextureFormat(image.bytes_per_pixel, internal_format, format);
+
+  GLint min_filter = request.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+  GLint mag_filter = GL_LINEAR;
+  GLint wrap_s = GL_REPEAT;
+  GLint wrap_t = GL_REPEAT;
+
+  {
+    TemporaryTextureBinding binding(request.texture);
+    gl::GetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &min_filter);
+    gl::GetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &mag_filter);
+    gl::GetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrap_s);
+    gl::GetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrap_t);
+  }
+
+  request.staging_texture = Texture::create(GL_TEXTURE_2D);
+
+  TemporaryTextureBinding binding(request.staging_texture);
+
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+
+  gl::TexImage2D(GL_TEXTURE_2D, 0, internal_format, image.size.x, image.size.y, 0,
+                 format, GL_UNSIGNED_BYTE, nullptr);
+}
+
+
+void TextureUploadQueue::uploadRows(Request &request, int first_row, int num_rows,
+                                    const void *data)
+{
+  assert(request.staging_texture);
+
+  auto &image = request.image;
+
+  GLint internal_format = -1;
+  GLenum format = 0;
+  getTextureFormat(image.bytes_per_pixel, internal_format, format);
+
+  TemporaryTextureBinding binding(request.staging_texture);
+
+  gl::TexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, image.size.x, num_rows,
+                    format, GL_UNSIGNED_BYTE, data);
+
+  request.num_rows_uploaded += num_rows;
+}
+
+
+void TextureUploadQueue::finishUpload(Request &request)
+{
+  if (request.mipmaps)
+  {
+    TemporaryTextureBinding binding(request.staging_texture);
+    gl::GenerateMipmap(GL_TEXTURE_2D);
+  }
+
+  // the staging texture now holds its own copy
+  request.image = {};
+}
+
+
+void TextureUploadQueue::swapCompleted(bool wait)
+{
+  while (!m_in_flight.empty())
+  {
+    auto &batch = m_in_flight.front();
+
+    if (!isSignaled(batch.fence, wait))
+      break;
+
+    gl::DeleteSync(static_cast<GLsync>(batch.fence));
+
+    auto now = Clock::now();
+
+    for (auto &request : batch.requests)
+    {
+      // the staging texture takes the previous name with it
+      request->texture->swap(*request->staging_texture);
+      request->staging_texture.reset();
+
+      // GL unbound the previous name when the staging texture deleted it
+      rebindTexture(request->texture);
+
+      std::chrono::duration<double, std::milli> latency = now - request->enqueue_time;
+
+      auto &s = m_statistics;
+      s.num_completed++;
+      s.last_latency_ms = latency.count();
+      s.max_latency_ms = std::max(s.max_latency_ms, s.last_latency_ms);
+      s.average_latency_ms += (s.last_latency_ms - s.average_latency_ms) / s.num_completed;
+
+      if (request->done)
+        request->done(request->texture);
+    }
+
+    m_in_flight.pop_front();
+  }
+}
+
+
+void TextureUploadQueue::updateStatistics()
+{
+  auto &s = m_statistics;
+
+  s.num_decoding = 0;
+  for (auto &request : m_decoding)
+  {
+    if (!request->superseded)
+      s.num_decoding++;
+  }
+
+  s.num_waiting = m_waiting.size();
+
+  s.num_in_flight = 0;
+  for (auto &batch : m_in_flight)
+    s.num_in_flight += batch.requests.size();
+
+  s.queue_depth = s.num_decoding + s.num_waiting + s.num_in_flight;
+}
+
+
+} // namespace render_util
@@ -19,11 +19,14 @@
 #include <render_util/image_resample.h>
 #include <render_util/image_loader.h>
 #include <render_util/image_util.h>
+#include <render_util/image_kernels.h>
 #include <render_util/texture_util.h>
 #include <render_util/texunits.h>
 #include <render_util/elevation_map.h>
+#include <render_util/config.h>
 
 #include <fstream>
+#include <cstring>
 #include <memory>
 #include <iostream>
 #include <sstream>
@@ -113,75 +116,83 @@ void createTextureArrayLevel0(const std::vector<const unsigned char*> &textures,
 }
 
 
-struct NormalMapCreator
+class TightUnpackAlignment
 {
-  render_util::ElevationMap::ConstPtr elevation_map;
-  render_util::Image<Normal>::Ptr normals;
-  float grid_scale = 1.0;
+  GLint m_previous = 4;
 
-  vec3 getNormal(ivec2 coords) const
+public:
+  TightUnpackAlignment()
   {
-    return normals->get(coords).to_vec3();
+    gl::GetIntegerv(GL_UNPACK_ALIGNMENT, &m_previous);
+    gl::PixelStorei(GL_UNPACK_ALIGNMENT, 1);
   }
 
-  void setNormal(ivec2 coords, glm::vec3 normal)
+  ~TightUnpackAlignment()
   {
-    normals->at(coords) = { normal.x, normal.y, normal.z };
+    gl::PixelStorei(GL_UNPACK_ALIGNMENT, m_previous);
   }
+};
 
-  glm::vec3 calcTriangleNormal(const vec2 vertex_coords[3])
-  {
-    vec3 vertices[3];
-    for (unsigned int i = 0; i < 3; i++)
-      vertices[i] = getVertex(vertex_coords[i]);
 
-    return calcNormal(vertices);
-  }
+void setContainerTextureParameters(GLenum target, int num_levels)
+{
+  gl::TexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+  // containers may hold only part of the mip chain
+  gl::TexParameteri(target, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+  gl::TexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                    num_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  gl::TexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+
+// rows per parallel work item
+constexpr int NORMAL_MAP_BAND_HEIGHT = 32;
+
+static_assert(sizeof(Normal) == 3 * sizeof(float));
 
-  vec3 getVertex(ivec2 coords)
-  {
-    vec3 v;
-    v.x = coords.x * grid_scale;
-    v.y = coords.y * grid_scale;
-    v.z = elevation_map->get(coords.x, coords.y);
-    return v;
-  }
 
-  void calcNormals()
+/**
+ * Sums the cross products of the triangles adjacent to (x, y) which are inside the map -
+ * the same as image::kernels::calcNormalRow(), but usable at the edges.
+ */
+Normal calcEdgeNormal(const ElevationMap &elevation_map, int x, int y, float grid_scale)
+{
+  const int w = elevation_map.w();
+  const int h = elevation_map.h();
+
+  auto height = [&] (int x, int y) { return elevation_map.get(x, y); };
+
+  // cell (x, y) is split into (x+1,y+1), (x,y), (x+1,y) and (x+1,y+1), (x,y+1), (x,y)
+  auto triangle0 = [&] (int x, int y)
   {
-    normals.reset(new Image<Normal>(elevation_map->getSize()));
+    return vec3(height(x, y) - height(x+1, y), height(x+1, y) - height(x+1, y+1), grid_scale);
+  };
+  auto triangle1 = [&] (int x, int y)
+  {
+    return vec3(height(x, y+1) - height(x+1, y+1), height(x, y) - height(x, y+1), grid_scale);
+  };
+  auto hasCell = [&] (int x, int y)
+  {
+    return x >= 0 && y >= 0 && x < w - 1 && y < h - 1;
+  };
 
-    for (int y = 0; y < elevation_map->getHeight()-1; y++)
-    {
-      for (int x = 0; x < elevation_map->getWidth()-1; x++)
-      {
-        vec2 triangle0[3] =
-        {
-          vec2(x+1, y+1),
-          vec2(x+0, y+0),
-          vec2(x+1, y+0)
-        };
+  vec3 sum(0);
 
-        vec2 triangle1[3] =
-        {
-          vec2(x+1, y+1),
-          vec2(x+0, y+1),
-          vec2(x+0, y+0)
-        };
-
-        vec3 normal0 = calcTriangleNormal(triangle0);
-        for (unsigned int i = 0; i < 3; i++)
-          setNormal(triangle0[i], glm::normalize(getNormal(triangle0[i]) + normal0));
-
-        vec3 normal1 = calcTriangleNormal(triangle1);
-        for (unsigned int i = 0; i < 3; i++)
-          setNormal(triangle1[i], glm::normalize(getNormal(triangle1[i]) + normal1));
-      }
-    }
+  if (hasCell(x, y))
+    sum += triangle0(x, y) + triangle1(x, y);
+  if (hasCell(x-1, y))
+    sum += triangle0(x-1, y);
+  if (hasCell(x-1, y-1))
+    sum += triangle0(x-1, y-1) + triangle1(x-1, y-1);
+  if (hasCell(x, y-1))
+    sum += triangle1(x, y-1);
 
-  }
+  // a map of a single row or column has no triangles
+  vec3 normal = sum != vec3(0) ? normalize(sum) : vec3(0, 0, 1);
+
+  return { normal.x, normal.y, normal.z };
+}
 
-};
 
 float mapFloatToUnsignedChar(float value)
 {
@@ -447,6 +458,253 @@ TexturePtr createTextureArray(const std::vector<const unsigned char*> &textures,
 }
 
 
+TexturePtr createTexture(const TextureContainer &container)
+{
+  assert(container.getNumLayers() == 1);
+
+  CHECK_GL_ERROR();
+
+  TexturePtr texture = Texture::create(GL_TEXTURE_2D);
+  TemporaryTextureBinding binding(texture);
+
+  TightUnpackAlignment unpack_alignment;
+
+  for (int level = 0; level < container.getNumLevels(); level++)
+  {
+    auto size = container.getSize(level);
+
+    if (container.isCompressed())
+    {
+      gl::CompressedTexImage2D(GL_TEXTURE_2D, level,
+                               container.getInternalFormat(),
+                               size.x, size.y,
+                               0,
+                               container.getDataSize(level),
+                               container.getData(level));
+    }
+    else
+    {
+      gl::TexImage2D(GL_TEXTURE_2D, level,
+                     container.getInternalFormat(),
+                     size.x, size.y,
+                     0,
+                     container.getFormat(),
+                     container.getType(),
+                     container.getData(level));
+    }
+
+    FORCE_CHECK_GL_ERROR();
+  }
+
+  setContainerTextureParameters(GL_TEXTURE_2D, container.getNumLevels());
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  CHECK_GL_ERROR();
+
+  return texture;
+}
+
+
+TexturePtr createTextureArray(const std::vector<const TextureContainer*> &containers)
+{
+  assert(!containers.empty());
+
+  auto &first = *containers.front();
+
+  int num_layers = 0;
+  for (auto container : containers)
+  {
+    assert(container);
+    assert(container->getInternalFormat() == first.getInternalFormat());
+    assert(container->getFormat() == first.getFormat());
+    assert(container->getSize() == first.getSize());
+    assert(container->getNumLevels() == first.getNumLevels());
+    num_layers += container->getNumLayers();
+  }
+
+  CHECK_GL_ERROR();
+
+  int max_layers = 0;
+  gl::GetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  assert(num_layers <= max_layers);
+
+  TexturePtr texture = Texture::create(GL_TEXTURE_2D_ARRAY);
+  TemporaryTextureBinding binding(texture);
+
+  TightUnpackAlignment unpack_alignment;
+
+  for (int level = 0; level < first.getNumLevels(); level++)
+  {
+    auto size = first.getSize(level);
+    auto layer_size = first.getDataSize(level);
+
+    LOG_TRACE << "level " << level << ": " << size.x << "x" << size.y << ", "
+              << num_layers << " layers" << endl;
+
+    if (first.isCompressed())
+    {
+      gl::CompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.getInternalFormat(),
+                               size.x, size.y, num_layers,
+                               0, layer_size * num_layers, nullptr);
+    }
+    else
+    {
+      gl::TexImage3D(GL_TEXTURE_2D_ARRAY, level, first.getInternalFormat(),
+                     size.x, size.y, num_layers,
+                     0, first.getFormat(), first.getType(), nullptr);
+    }
+    FORCE_CHECK_GL_ERROR();
+
+    int layer = 0;
+    for (auto container : containers)
+    {
+      for (int i = 0; i < container->getNumLayers(); i++, layer++)
+      {
+        if (first.isCompressed())
+        {
+          gl::CompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level,
+                                      0, 0, layer,
+                                      size.x, size.y, 1,
+                                      first.getInternalFormat(),
+                                      layer_size,
+                                      container->getData(level, i));
+        }
+        else
+        {
+          gl::TexSubImage3D(GL_TEXTURE_2D_ARRAY, level,
+                            0, 0, layer,
+                            size.x, size.y, 1,
+                            first.getFormat(), first.getType(),
+                            container->getData(level, i));
+        }
+        FORCE_CHECK_GL_ERROR();
+      }
+    }
+  }
+
+  setContainerTextureParameters(GL_TEXTURE_2D_ARRAY, first.getNumLevels());
+
+  CHECK_GL_ERROR();
+
+  return texture;
+}
+
+
+bool isTextureCompressionSupported(TextureCompression compression)
+{
+#if ENABLE_TEXTURE_COMPRESSION
+  const char *extension = compression == TextureCompression::COLOR ?
+                            "GL_EXT_texture_compression_s3tc" :
+                            "GL_ARB_texture_compression_rgtc";
+
+  // RGTC is core since 3.0 - S3TC never became core
+  if (compression != TextureCompression::COLOR)
+  {
+    GLint major_version = 0;
+    gl::GetIntegerv(GL_MAJOR_VERSION, &major_version);
+    if (major_version >= 3)
+      return true;
+  }
+
+  GLint num_extensions = 0;
+  gl::GetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+
+  for (GLint i = 0; i < num_extensions; i++)
+  {
+    auto name = gl::GetStringi(GL_EXTENSIONS, i);
+    if (name && strcmp(reinterpret_cast<const char*>(name), extension) == 0)
+      return true;
+  }
+
+  return false;
+#else
+  return false;
+#endif
+}
+
+
+TexturePtr createCompressedTextureArray(const std::vector<const unsigned char*> &textures,
+                                        int texture_width,
+                                        int num_components,
+                                        TextureCompression compression,
+                                        const std::string &cache_dir)
+{
+  assert(!textures.empty());
+
+  if (!isTextureCompressionSupported(compression))
+  {
+    LOG_INFO << "Texture compression unavailable - uploading " << textures.size()
+             << " layers uncompressed" << endl;
+    return createTextureArray(textures, 0, texture_width, num_components);
+  }
+
+  const glm::ivec2 size(texture_width);
+  const size_t num_pixels = size_t(texture_width) * texture_width;
+
+  BlockFormat format = BlockFormat::BC1;
+
+  switch (compression)
+  {
+    case TextureCompression::COLOR:
+      if (num_components == 4)
+      {
+        for (auto data : textures)
+        {
+          bool has_alpha = false;
+          for (size_t i = 0; i < num_pixels && !has_alpha; i++)
+            has_alpha = data[i * 4 + 3] != 255;
+          if (has_alpha)
+          {
+            format = BlockFormat::BC3;
+            break;
+          }
+        }
+      }
+      break;
+    case TextureCompression::GREY:
+      format = BlockFormat::BC4;
+      break;
+    case TextureCompression::NORMAL_MAP:
+      format = BlockFormat::BC5;
+      break;
+  }
+
+  TextureCompressionStatistics statistics;
+
+  std::vector<std::unique_ptr<TextureContainer>> containers;
+  std::vector<const TextureContainer*> layers;
+
+  for (auto data : textures)
+  {
+    containers.push_back(getCompressedTexture(format, compression, data, size, num_components,
+                                              cache_dir, statistics));
+    assert(containers.back());
+    layers.push_back(containers.back().get());
+  }
+
+  auto texture = createTextureArray(layers);
+
+  const double mb = 1024.0 * 1024.0;
+
+  LOG_INFO << "Compressed texture array: " << statistics.num_layers << " layers, "
+           << texture_width << "x" << texture_width << ", " << getBlockFormatName(format) << ", "
+           << statistics.uncompressed_bytes / mb << " MB -> " << statistics.compressed_bytes / mb
+           << " MB (" << (statistics.uncompressed_bytes - statistics.compressed_bytes) / mb
+           << " MB saved), " << statistics.num_cache_hits << " layers from cache" << endl;
+
+  if (statistics.encoded_pixels)
+  {
+    LOG_INFO << "Encoded " << statistics.encoded_pixels / 1e6 << " Mpixels in "
+             << statistics.encode_seconds << " s ("
+             << statistics.encoded_pixels / 1e6 / statistics.encode_seconds << " Mpixels/s)"
+             << endl;
+  }
+
+  return texture;
+}
+
+
 TexturePtr createFloatTexture1D(const float *data, size_t size, int num_components)
 {
   TexturePtr texture = Texture::create(GL_TEXTURE_1D);
@@ -846,14 +1104,45 @@ ImageRGB::Ptr createNormalMap(ImageGreyScale::ConstPtr height_map,
 }
 
 
-Image<Normal>::Ptr createNormalMap(ElevationMap::ConstPtr elevation_map, float grid_scale)
+Image<Normal>::Ptr createNormalMap(ElevationMap::ConstPtr elevation_map, float grid_scale,
+                                   util::ThreadPool &thread_pool)
 {
-  NormalMapCreator c;
-  c.grid_scale = grid_scale;
-  c.elevation_map = elevation_map;
-  c.calcNormals();
+  assert(elevation_map);
+
+  auto normals = make_shared<Image<Normal>>(elevation_map->getSize());
+
+  const int w = elevation_map->w();
+  const int h = elevation_map->h();
+  const int num_bands = (h + NORMAL_MAP_BAND_HEIGHT - 1) / NORMAL_MAP_BAND_HEIGHT;
+
+  thread_pool.parallelFor(num_bands, [&] (int band)
+  {
+    const int y_end = std::min(h, (band + 1) * NORMAL_MAP_BAND_HEIGHT);
+
+    for (int y = band * NORMAL_MAP_BAND_HEIGHT; y < y_end; y++)
+    {
+      auto dst = reinterpret_cast<Normal*>(normals->getRow(y));
+
+      if (y == 0 || y == h - 1 || w < 3)
+      {
+        for (int x = 0; x < w; x++)
+          dst[x] = calcEdgeNormal(*elevation_map, x, y, grid_scale);
+        continue;
+      }
+
+      auto previous_row = reinterpret_cast<const float*>(elevation_map->getRow(y - 1));
+      auto row = reinterpret_cast<const float*>(elevation_map->getRow(y));
+      auto next_row = reinterpret_cast<const float*>(elevation_map->getRow(y + 1));
+
+      image::kernels::calcNormalRow(previous_row + 1, row + 1, next_row + 1,
+                                    reinterpret_cast<float*>(dst + 1), w - 2, grid_scale);
+
+      dst[0] = calcEdgeNormal(*elevation_map, 0, y, grid_scale);
+      dst[w - 1] = calcEdgeNormal(*elevation_map, w - 1, y, grid_scale);
+    }
+  });
 
-  return c.normals;
+  return normals;
 }
 
 
@@ -0,0 +1,514 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/tiled_height_map.h>
+#include <mapped_file.h>
+#include <log.h>
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+using namespace glm;
+using std::endl;
+
+
+namespace render_util
+{
+
+
+struct TiledHeightMap::Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t tile_size;
+  uint32_t tile_border;
+  uint32_t num_levels;
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_tiles;
+  uint32_t reserved;
+  uint64_t index_offset;
+};
+
+
+struct TiledHeightMap::TileIndexEntry
+{
+  uint64_t offset;
+  float min_height;
+  float max_height;
+};
+
+
+} // namespace render_util
+
+
+namespace
+{
+
+
+using render_util::TiledHeightMap;
+using Header = TiledHeightMap::Header;
+using TileIndexEntry = TiledHeightMap::TileIndexEntry;
+
+
+constexpr char MAGIC[8] = { 'R', 'U', 'T', 'H', 'M', 'A', 'P', 0 };
+constexpr uint32_t VERSION = 1;
+
+// tiles start at page boundaries, so reading one touches as few pages as possible
+constexpr size_t TILE_ALIGNMENT = 4096;
+
+static_assert(sizeof(Header) == 48);
+static_assert(sizeof(TileIndexEntry) == 16);
+
+
+size_t align(size_t offset)
+{
+  return (offset + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+}
+
+
+ivec2 getNumTiles(ivec2 size, int tile_size)
+{
+  return (size + ivec2(tile_size - 1)) / tile_size;
+}
+
+
+size_t getTotalNumTiles(ivec2 size, int tile_size, int num_levels)
+{
+  size_t num_tiles = 0;
+  for (int level = 0; level < num_levels; level++)
+  {
+    auto level_num_tiles = getNumTiles(TiledHeightMap::getLevelSize(size, level), tile_size);
+    num_tiles += size_t(level_num_tiles.x) * level_num_tiles.y;
+  }
+  return num_tiles;
+}
+
+
+size_t getTileDataSize(int tile_size)
+{
+  size_t samples = tile_size + 1 + 2 * TiledHeightMap::TILE_BORDER;
+  return samples * samples * sizeof(float);
+}
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+int TiledHeightMap::getNumLevels(ivec2 size, int tile_size)
+{
+  assert(tile_size > 0);
+
+  int num_levels = 1;
+  while (any(greaterThan(getLevelSize(size, num_levels - 1), ivec2(tile_size))))
+    num_levels++;
+
+  return num_levels;
+}
+
+
+ivec2 TiledHeightMap::getLevelSize(ivec2 size, int level)
+{
+  assert(all(greaterThan(size, ivec2(0))));
+  return ((size - ivec2(1)) >> level) + ivec2(1);
+}
+
+
+std::shared_ptr<TiledHeightMap> TiledHeightMap::open(const std::string &path, bool quiet)
+{
+  auto file = util::MappedFile::open(path, quiet);
+  if (!file)
+    return {};
+
+  auto fail = [&] (const char *reason) -> std::shared_ptr<TiledHeightMap>
+  {
+    LOG_ERROR << path << ": " << reason << endl;
+    return {};
+  };
+
+  if (file->getSize() < sizeof(Header))
+    return fail("not a tiled height map");
+
+  auto header = reinterpret_cast<const Header*>(file->getData());
+
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+    return fail("not a tiled height map");
+  if (header->version != VERSION)
+    return fail("unsupported version");
+  if (header->tile_border != TILE_BORDER)
+    return fail("unsupported tile border");
+  if (!header->tile_size || !header->width || !header->height ||
+      header->tile_size > 0x10000 || header->width > 0x1000000 || header->height > 0x1000000)
+  {
+    return fail("invalid size");
+  }
+
+  const ivec2 size(header->width, header->height);
+  const int tile_size = header->tile_size;
+  const int num_levels = getNumLevels(size, tile_size);
+  const size_t num_tiles = getTotalNumTiles(size, tile_size, num_levels);
+
+  if (header->num_levels != uint32_t(num_levels) || header->num_tiles != num_tiles)
+    return fail("inconsistent header");
+
+  if (header->index_offset % alignof(TileIndexEntry) != 0 ||
+      header->index_offset > file->getSize() ||
+      (file->getSize() - header->index_offset) / sizeof(TileIndexEntry) < num_tiles)
+  {
+    return fail("truncated tile index");
+  }
+
+  auto index = reinterpret_cast<const TileIndexEntry*>(file->getData() + header->index_offset);
+  const size_t tile_data_size = ::getTileDataSize(tile_size);
+
+  for (size_t i = 0; i < num_tiles; i++)
+  {
+    if (index[i].offset % alignof(float) != 0 ||
+        index[i].offset > file->getSize() ||
+        file->getSize() - index[i].offset < tile_data_size)
+    {
+      return fail("truncated tile data");
+    }
+  }
+
+  std::shared_ptr<TiledHeightMap> map(new TiledHeightMap);
+  map->m_file = file;
+  map->m_header = header;
+  map->m_index = index;
+  map->m_tile_size = tile_size;
+  map->m_num_levels = num_levels;
+  map->m_size = size;
+
+  return map;
+}
+
+
+size_t TiledHeightMap::getTileDataSize() const
+{
+  return ::getTileDataSize(m_tile_size);
+}
+
+
+size_t TiledHeightMap::getFileSize() const
+{
+  return m_file->getSize();
+}
+
+
+ivec2 TiledHeightMap::getNumTiles(int level) const
+{
+  assert(level >= 0);
+  assert(level < m_num_levels);
+  return ::getNumTiles(getSize(level), m_tile_size);
+}
+
+
+bool TiledHeightMap::hasTile(int level, ivec2 tile) const
+{
+  if (level < 0 || level >= m_num_levels)
+    return false;
+  return all(greaterThanEqual(tile, ivec2(0))) && all(lessThan(tile, getNumTiles(level)));
+}
+
+
+size_t TiledHeightMap::getTileIndex(int level, ivec2 tile) const
+{
+  assert(hasTile(level, tile));
+
+  size_t index = 0;
+  for (int i = 0; i < level; i++)
+  {
+    auto num_tiles = getNumTiles(i);
+    index += size_t(num_tiles.x) * num_tiles.y;
+  }
+
+  return index + size_t(tile.y) * getNumTiles(level).x + tile.x;
+}
+
+
+const float *TiledHeightMap::getTile(int level, ivec2 tile) const
+{
+  auto &entry = m_index[getTileIndex(level, tile)];
+  return reinterpret_cast<const float*>(m_file->getData() + entry.offset);
+}
+
+
+vec2 TiledHeightMap::getHeightRange(int level, ivec2 tile) const
+{
+  auto &entry = m_index[getTileIndex(level, tile)];
+  return vec2(entry.min_height, entry.max_height);
+}
+
+
+ElevationMap::Ptr TiledHeightMap::readLevel(int level) const
+{
+  const ivec2 size = getSize(level);
+  const ivec2 num_tiles = getNumTiles(level);
+  const int tile_stride = getTileSizeWithBorder();
+
+  auto map = std::make_shared<ElevationMap>(size);
+
+  for (int tile_y = 0; tile_y < num_tiles.y; tile_y++)
+  {
+    for (int tile_x = 0; tile_x < num_tiles.x; tile_x++)
+    {
+      auto tile = getTile(level, ivec2(tile_x, tile_y));
+      const ivec2 begin = ivec2(tile_x, tile_y) * m_tile_size;
+      const ivec2 end = min(begin + ivec2(m_tile_size), size);
+
+      for (int y = begin.y; y < end.y; y++)
+      {
+        auto src = tile + (y - begin.y + TILE_BORDER) * tile_stride + TILE_BORDER;
+        auto dst = reinterpret_cast<float*>(map->getRow(size.y - 1 - y));
+        std::copy(src, src + (end.x - begin.x), dst + begin.x);
+      }
+    }
+  }
+
+  return map;
+}
+
+
+struct TiledHeightMapWriter::Private
+{
+  struct Level
+  {
+    ivec2 size = ivec2(0);
+    ivec2 num_tiles = ivec2(0);
+    size_t first_tile = 0;
+    /// the last tile_size + 3 rows, indexed by y modulo the number of rows
+    std::vector<std::vector<float>> rows;
+    /// rows arrive from the top
+    int next_y = 0;
+    /// the even rows, passed on to the next level
+    std::vector<float> downsampled_row;
+  };
+
+  std::string path;
+  std::ofstream file;
+  ivec2 size = ivec2(0);
+  int tile_size = 0;
+  std::vector<Level> levels;
+  std::vector<TileIndexEntry> index;
+  std::vector<float> tile;
+  size_t file_pos = 0;
+  bool finished = false;
+
+  int getNumTileRows() const { return tile_size + 1 + 2 * TiledHeightMap::TILE_BORDER; }
+
+  std::vector<float> &getRow(Level &level, int y)
+  {
+    const int num_rows = level.rows.size();
+    return level.rows[((y % num_rows) + num_rows) % num_rows];
+  }
+
+  void addRow(int level_index, int y, const float *row);
+  void writeTileRow(Level &level, int tile_y);
+};
+
+
+void TiledHeightMapWriter::Private::addRow(int level_index, int y, const float *row)
+{
+  auto &level = levels[level_index];
+
+  assert(y == level.next_y);
+  level.next_y--;
+
+  if (row)
+  {
+    auto &dst = getRow(level, y);
+    std::copy(row, row + level.size.x, dst.begin());
+  }
+
+  // a tile row is complete when its lowest row - in the border - has arrived
+  const int first_y = y + TiledHeightMap::TILE_BORDER;
+  if (first_y % tile_size == 0 && first_y / tile_size < level.num_tiles.y)
+    writeTileRow(level, first_y / tile_size);
+
+  if (y >= 0 && y % 2 == 0 && level_index + 1 < int(levels.size()))
+  {
+    auto &downsampled_row = level.downsampled_row;
+    downsampled_row.resize(levels[level_index + 1].size.x);
+    for (size_t x = 0; x < downsampled_row.size(); x++)
+      downsampled_row[x] = row[x * 2];
+
+    addRow(level_index + 1, y / 2, downsampled_row.data());
+  }
+}
+
+
+void TiledHeightMapWriter::Private::writeTileRow(Level &level, int tile_y)
+{
+  const int stride = getNumTileRows();
+  const int border = TiledHeightMap::TILE_BORDER;
+
+  tile.resize(stride * stride);
+
+  for (int tile_x = 0; tile_x < level.num_tiles.x; tile_x++)
+  {
+    const ivec2 origin = ivec2(tile_x, tile_y) * tile_size - ivec2(border);
+
+    float min_height = std::numeric_limits<float>::max();
+    float max_height = std::numeric_limits<float>::lowest();
+
+    for (int row = 0; row < stride; row++)
+    {
+      const int y = origin.y + row;
+      const bool is_inside = y >= 0 && y < level.size.y;
+      auto src = is_inside ? getRow(level, y).data() : nullptr;
+
+      for (int column = 0; column < stride; column++)
+      {
+        const int x = origin.x + column;
+        float height = (is_inside && x >= 0 && x < level.size.x) ? src[x] : 0.f;
+
+        tile[row * stride + column] = height;
+        min_height = std::min(min_height, height);
+        max_height = std::max(max_height, height);
+      }
+    }
+
+    const size_t offset = align(file_pos);
+    const size_t data_size = tile.size() * sizeof(float);
+
+    static const char padding[TILE_ALIGNMENT] {};
+    file.write(padding, offset - file_pos);
+    file.write(reinterpret_cast<const char*>(tile.data()), data_size);
+    file_pos = offset + data_size;
+
+    auto &entry = index.at(level.first_tile + size_t(tile_y) * level.num_tiles.x + tile_x);
+    entry.offset = offset;
+    entry.min_height = min_height;
+    entry.max_height = max_height;
+  }
+}
+
+
+TiledHeightMapWriter::TiledHeightMapWriter(const std::string &path, ivec2 size, int tile_size) :
+  p(new Private)
+{
+  assert(all(greaterThan(size, ivec2(0))));
+  assert(tile_size > 0);
+
+  p->path = path;
+  p->size = size;
+  p->tile_size = tile_size;
+
+  p->levels.resize(TiledHeightMap::getNumLevels(size, tile_size));
+
+  size_t num_tiles = 0;
+  for (size_t i = 0; i < p->levels.size(); i++)
+  {
+    auto &level = p->levels[i];
+    level.size = TiledHeightMap::getLevelSize(size, i);
+    level.num_tiles = getNumTiles(level.size, tile_size);
+    level.first_tile = num_tiles;
+    level.rows.resize(p->getNumTileRows(), std::vector<float>(level.size.x));
+    level.next_y = level.size.y - 1;
+
+    num_tiles += size_t(level.num_tiles.x) * level.num_tiles.y;
+  }
+
+  p->index.resize(num_tiles);
+
+  // header and index are written by finish() - the tiles follow them
+  p->file.open(path, std::ios::binary | std::ios::trunc);
+  p->file_pos = sizeof(Header) + p->index.size() * sizeof(TileIndexEntry);
+  p->file.seekp(p->file_pos);
+}
+
+
+TiledHeightMapWriter::~TiledHeightMapWriter()
+{
+  delete p;
+}
+
+
+void TiledHeightMapWriter::addRow(const float *row)
+{
+  assert(row);
+  assert(!p->finished);
+  assert(p->levels.at(0).next_y >= 0);
+
+  p->addRow(0, p->levels.at(0).next_y, row);
+}
+
+
+bool TiledHeightMapWriter::finish()
+{
+  assert(!p->finished);
+  p->finished = true;
+
+  if (p->levels.at(0).next_y != -1)
+  {
+    LOG_ERROR << p->path << ": " << p->levels.at(0).next_y + 1 << " rows are missing" << endl;
+    return false;
+  }
+
+  // the border below the lowest tiles
+  for (size_t i = 0; i < p->levels.size(); i++)
+    p->addRow(i, -1, nullptr);
+
+  Header header {};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.tile_size = p->tile_size;
+  header.tile_border = TiledHeightMap::TILE_BORDER;
+  header.num_levels = p->levels.size();
+  header.width = p->size.x;
+  header.height = p->size.y;
+  header.num_tiles = p->index.size();
+  header.index_offset = sizeof(Header);
+
+  p->file.seekp(0);
+  p->file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  p->file.write(reinterpret_cast<const char*>(p->index.data()),
+                p->index.size() * sizeof(TileIndexEntry));
+  p->file.close();
+
+  if (p->file.fail())
+  {
+    LOG_ERROR << "failed to write " << p->path << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool writeTiledHeightMap(const std::string &path, const ElevationMap &map, int tile_size)
+{
+  TiledHeightMapWriter writer(path, map.getSize(), tile_size);
+
+  for (int y = 0; y < map.h(); y++)
+    writer.addRow(reinterpret_cast<const float*>(map.getRow(y)));
+
+  return writer.finish();
+}
+
+
+} // namespace render_util
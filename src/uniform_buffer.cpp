@@ -0,0 +1,97 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <render_util/uniform_buffer.h>
+#include <render_util/globals.h>
+#include <render_util/gl_binding/gl_functions.h>
+
+#include <GL/gl.h>
+
+using namespace render_util::gl_binding;
+
+
+namespace
+{
+
+
+const char *g_uniform_block_names[] =
+{
+  "WaterAnimation",
+};
+
+static_assert(sizeof(g_uniform_block_names) / sizeof(const char*) == render_util::UNIFORM_BLOCK_NUM);
+
+
+} // namespace
+
+
+namespace render_util
+{
+
+
+const char *getUniformBlockName(unsigned int block)
+{
+  assert(block < UNIFORM_BLOCK_NUM);
+  return g_uniform_block_names[block];
+}
+
+
+UniformBuffer::UniformBuffer(size_t size) : m_data(size, 0)
+{
+  assert(size > 0);
+
+  gl::GenBuffers(1, &m_id);
+  assert(m_id > 0);
+
+  getCurrentGLContext()->bindBuffer(GL_UNIFORM_BUFFER, m_id);
+  gl::BufferData(GL_UNIFORM_BUFFER, m_data.size(), m_data.data(), GL_DYNAMIC_DRAW);
+  getCurrentGLContext()->bindBuffer(GL_UNIFORM_BUFFER, 0);
+  m_is_dirty = false;
+
+  CHECK_GL_ERROR();
+}
+
+
+UniformBuffer::~UniformBuffer()
+{
+  gl::DeleteBuffers(1, &m_id);
+  getCurrentGLContext()->forgetBuffer(m_id);
+}
+
+
+void UniformBuffer::upload()
+{
+  if (!m_is_dirty)
+    return;
+
+  getCurrentGLContext()->bindBuffer(GL_UNIFORM_BUFFER, m_id);
+  gl::BufferSubData(GL_UNIFORM_BUFFER, 0, m_data.size(), m_data.data());
+  getCurrentGLContext()->bindBuffer(GL_UNIFORM_BUFFER, 0);
+  m_is_dirty = false;
+
+  CHECK_GL_ERROR();
+}
+
+
+void UniformBuffer::bind(unsigned int binding_point)
+{
+  getCurrentGLContext()->bindBufferBase(GL_UNIFORM_BUFFER, binding_point, m_id);
+}
+
+
+} // namespace render_util
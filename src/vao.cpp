@@ -18,6 +18,7 @@
 
 #include <render_util/vao.h>
 #include <render_util/geometry.h>
+#include <render_util/globals.h>
 #include <render_util/gl_binding/gl_functions.h>
 
 #include <glm/gtc/type_ptr.hpp>
@@ -95,43 +96,45 @@ void VertexArrayObject::create(const void *vertex_data, size_t vertex_data_size,
   gl::GenVertexArrays(1, &m_vao_id);
   assert(m_vao_id > 0);
 
-  gl::BindVertexArray(m_vao_id);
+  auto context = getCurrentGLContext();
 
-  gl::BindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer_id);
+  context->bindVertexArray(m_vao_id);
+
+  context->bindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer_id);
   gl::BufferData(GL_ARRAY_BUFFER, vertex_data_size, vertex_data, GL_STATIC_DRAW);
   gl::VertexPointer(3, GL_FLOAT, 0, 0);
   gl::EnableClientState(GL_VERTEX_ARRAY);
-  gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+  context->bindBuffer(GL_ARRAY_BUFFER, 0);
 
   if (normal_data)
   {
-    gl::BindBuffer(GL_ARRAY_BUFFER, m_normal_buffer_id);
+    context->bindBuffer(GL_ARRAY_BUFFER, m_normal_buffer_id);
     gl::BufferData(GL_ARRAY_BUFFER,
                    normal_data_size,
                    normal_data, GL_STATIC_DRAW);
     gl::NormalPointer(GL_FLOAT, 0, 0);
     gl::EnableClientState(GL_NORMAL_ARRAY);
-    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    context->bindBuffer(GL_ARRAY_BUFFER, 0);
   }
 
   if (texcoord_data)
   {
-    gl::BindBuffer(GL_ARRAY_BUFFER, m_texcoord_buffer_id);
+    context->bindBuffer(GL_ARRAY_BUFFER, m_texcoord_buffer_id);
     gl::BufferData(GL_ARRAY_BUFFER,
                    texcoord_data_size,
                    texcoord_data, GL_STATIC_DRAW);
     gl::TexCoordPointer(texcoord_components, GL_FLOAT, 0, 0);
     gl::EnableClientState(GL_TEXTURE_COORD_ARRAY);
-    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    context->bindBuffer(GL_ARRAY_BUFFER, 0);
   }
 
 
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_id);
+  // stays attached to the vertex array
+  context->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_id);
   gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, index_data_size, index_data, GL_STATIC_DRAW);
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   CHECK_GL_ERROR();
 
-  gl::BindVertexArray(0);
+  context->bindVertexArray(0);
 
   FORCE_CHECK_GL_ERROR();
 }
@@ -190,40 +193,57 @@ VertexArrayObject::VertexArrayObject(const IndexedMesh &mesh, bool enable_normal
 
 VertexArrayObject::~VertexArrayObject()
 {
+  auto context = getCurrentGLContext();
+
   gl::DeleteVertexArrays(1, &m_vao_id);
-  gl::DeleteBuffers(1, &m_vertex_buffer_id);
-  gl::DeleteBuffers(1, &m_index_buffer_id);
-  if (m_normal_buffer_id)
-    gl::DeleteBuffers(1, &m_normal_buffer_id);
-  if (m_texcoord_buffer_id)
-    gl::DeleteBuffers(1, &m_texcoord_buffer_id);
+  context->forgetVertexArray(m_vao_id);
+
+  for (auto id : { m_vertex_buffer_id, m_index_buffer_id, m_normal_buffer_id, m_texcoord_buffer_id })
+  {
+    if (id)
+    {
+      gl::DeleteBuffers(1, &id);
+      context->forgetBuffer(id);
+    }
+  }
 }
 
 
 VertexArrayObjectBinding::VertexArrayObjectBinding(VertexArrayObject &vao)
 {
-  gl::BindVertexArray(vao.getID());
+  auto context = getCurrentGLContext();
+
+  m_previous_binding = context->getVertexArrayBinding();
+  if (m_previous_binding == GLContext::UNKNOWN)
+    m_previous_binding = 0;
+
+  context->bindVertexArray(vao.getID());
   CHECK_GL_ERROR();
 }
 
 
 VertexArrayObjectBinding::~VertexArrayObjectBinding()
 {
-  gl::BindVertexArray(0);
+  getCurrentGLContext()->bindVertexArray(m_previous_binding);
   CHECK_GL_ERROR();
 }
 
 
 IndexBufferBinding::IndexBufferBinding(VertexArrayObject &vao)
 {
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao.getIndexBufferID());
+  auto context = getCurrentGLContext();
+
+  m_previous_binding = context->getBufferBinding(GL_ELEMENT_ARRAY_BUFFER);
+
+  context->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao.getIndexBufferID());
   CHECK_GL_ERROR();
 }
 
 
 IndexBufferBinding::~IndexBufferBinding()
 {
-  gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  if (m_previous_binding != GLContext::UNKNOWN)
+    getCurrentGLContext()->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_previous_binding);
   CHECK_GL_ERROR();
 }
 
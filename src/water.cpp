@@ -21,8 +21,11 @@
 #include <render_util/image_loader.h>
 #include <render_util/map_textures.h>
 #include <render_util/texunits.h>
+#include <render_util/uniform_buffer.h>
+#include <render_util/profiler.h>
 
 #include <vector>
+#include <memory>
 #include <chrono>
 #include <cassert>
 #include <cstdlib>
@@ -74,10 +77,38 @@ namespace render_util
 
 struct WaterAnimation::Private
 {
+  // layout of the WaterAnimation uniform block in water.frag
+  struct UniformLayout
+  {
+    array<size_t, NUM_LAYERS> frame_delta {};
+    array<size_t, NUM_LAYERS> pos {};
+    size_t num_frames = 0;
+    size_t size = 0;
+
+    UniformLayout()
+    {
+      Std140Layout layout;
+
+      for (int i = 0; i < NUM_LAYERS; i++)
+      {
+        layout.beginStruct();
+        frame_delta[i] = layout.add<float>();
+        pos[i] = layout.add<int>();
+        layout.endStruct();
+      }
+
+      num_frames = layout.add<int>();
+      size = layout.getSize();
+    }
+  };
+
   array<Layer, NUM_LAYERS> layers { 2, 6 };
 
   int num_animation_steps = 0;
 
+  const UniformLayout uniform_layout;
+  unique_ptr<UniformBuffer> uniform_buffer;
+
   const Layer &getLayer(size_t index) { return layers.at(index); }
 
   void createTextures(MapTextures *map_textures,
@@ -135,20 +166,31 @@ void WaterAnimation::createTextures(MapTextures *map_textures,
 
 void WaterAnimation::update()
 {
+  RENDER_UTIL_PROFILE_SCOPE("WaterAnimation::update");
   p->update();
 }
 
-void WaterAnimation::updateUniforms(ShaderProgramPtr program)
+void WaterAnimation::updateUniforms(ShaderProgramPtr)
 {
-  program->setUniformi("water_animation_num_frames", p->num_animation_steps);
+  RENDER_UTIL_PROFILE_GPU_SCOPE("WaterAnimation::updateUniforms");
+
+  auto &layout = p->uniform_layout;
+
+  if (!p->uniform_buffer)
+    p->uniform_buffer = make_unique<UniformBuffer>(layout.size);
+
+  auto &buffer = *p->uniform_buffer;
+
+  buffer.set<int>(layout.num_frames, p->num_animation_steps);
 
   for (int i = 0; i < NUM_LAYERS; i++)
   {
-    string prefix = string("water_animation_params[") + to_string(i) + "].";
-
-    program->setUniformi(prefix + "pos", p->getLayer(i).current_step);
-    program->setUniform<float>(prefix + "frame_delta", p->getLayer(i).getFrameDelta());
+    buffer.set<int>(layout.pos[i], p->getLayer(i).current_step);
+    buffer.set<float>(layout.frame_delta[i], p->getLayer(i).getFrameDelta());
   }
+
+  buffer.upload();
+  buffer.bind(UNIFORM_BLOCK_WATER_ANIMATION);
 }
 
 bool WaterAnimation::isEmpty()
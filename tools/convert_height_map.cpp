@@ -0,0 +1,115 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Converts a 16 bit greyscale TIFF height map to a TiledHeightMap file.
+ * The map is read one scanline at a time, so it doesn't need to fit into memory.
+ *
+ * usage: convert_height_map <input.tiff> <output> [tile_size]
+ */
+
+#include <render_util/tiled_height_map.h>
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <tiffio.h>
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 3 || argc > 4)
+  {
+    cerr<<"usage: "<<argv[0]<<" <input.tiff> <output> [tile_size]"<<endl;
+    return 1;
+  }
+
+  const char *input_path = argv[1];
+  const char *output_path = argv[2];
+  const int tile_size = argc > 3 ? atoi(argv[3]) : render_util::TiledHeightMap::DEFAULT_TILE_SIZE;
+
+  if (tile_size < 1)
+  {
+    cerr<<"invalid tile size: "<<argv[3]<<endl;
+    return 1;
+  }
+
+  TIFF *tif = TIFFOpen(input_path, "r");
+  if (!tif)
+  {
+    cerr<<"Can't open "<<input_path<<" for reading"<<endl;
+    return 1;
+  }
+
+  uint16_t spp = 0, bpp = 0;
+  uint32_t width = 0, height = 0;
+  TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+  TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+  TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bpp);
+  TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+
+  cout<<"width: "<<width<<endl;
+  cout<<"height: "<<height<<endl;
+
+  if (bpp != 16 || spp != 1 || TIFFScanlineSize(tif) < 2 * width)
+  {
+    cerr<<"unsupported format - expected 16 bit greyscale"<<endl;
+    TIFFClose(tif);
+    return 1;
+  }
+
+  std::vector<char> line_buf(TIFFScanlineSize(tif));
+  std::vector<int16_t> line(width);
+  std::vector<float> row(width);
+
+  render_util::TiledHeightMapWriter writer(output_path, glm::ivec2(width, height), tile_size);
+
+  cout<<"converting ..."<<endl;
+  for (uint32_t y = 0; y < height; y++)
+  {
+    if (TIFFReadScanline(tif, line_buf.data(), y, 0) < 0)
+    {
+      cerr<<"failed to read scanline "<<y<<endl;
+      TIFFClose(tif);
+      return 1;
+    }
+
+    memcpy(line.data(), line_buf.data(), width * sizeof(int16_t));
+
+    for (uint32_t x = 0; x < width; x++)
+      row[x] = line[x];
+
+    writer.addRow(row.data());
+  }
+
+  TIFFClose(tif);
+
+  if (!writer.finish())
+  {
+    cerr<<"failed to write "<<output_path<<endl;
+    return 1;
+  }
+
+  cout<<"converting done."<<endl;
+
+  return 0;
+}
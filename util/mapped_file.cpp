@@ -0,0 +1,147 @@
+/**
+ *    Rendering utilities
+ *    Copyright (C) 2019  Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <mapped_file.h>
+#include <log.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+  #include <cstring>
+#endif
+
+namespace util
+{
+
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    UnmapViewOfFile(m_data);
+}
+
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path, bool quiet)
+{
+  auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    if (!quiet)
+      LOG_ERROR << "Failed to open " << path << ": error " << GetLastError() << std::endl;
+    return {};
+  }
+
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+
+  LARGE_INTEGER size {};
+  if (!GetFileSizeEx(file, &size))
+  {
+    LOG_ERROR << "Failed to get the size of " << path << ": error " << GetLastError() << std::endl;
+    CloseHandle(file);
+    return {};
+  }
+
+  mapped_file->m_size = size.QuadPart;
+
+  // an empty file can't be mapped
+  if (mapped_file->m_size)
+  {
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping)
+    {
+      mapped_file->m_data =
+        static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+      // the view keeps the mapping alive
+      CloseHandle(mapping);
+    }
+
+    if (!mapped_file->m_data)
+    {
+      LOG_ERROR << "Failed to map " << path << ": error " << GetLastError() << std::endl;
+      CloseHandle(file);
+      return {};
+    }
+  }
+
+  CloseHandle(file);
+
+  return mapped_file;
+}
+
+#else
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    munmap(m_data, m_size);
+}
+
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path, bool quiet)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+  {
+    if (!quiet)
+      LOG_ERROR << "Failed to open " << path << ": " << strerror(errno) << std::endl;
+    return {};
+  }
+
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+
+  struct stat status {};
+  if (fstat(fd, &status) == -1)
+  {
+    LOG_ERROR << "Failed to get the size of " << path << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return {};
+  }
+
+  mapped_file->m_size = status.st_size;
+
+  // an empty file can't be mapped
+  if (mapped_file->m_size)
+  {
+    auto data = mmap(nullptr, mapped_file->m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      LOG_ERROR << "Failed to map " << path << ": " << strerror(errno) << std::endl;
+      close(fd);
+      return {};
+    }
+    mapped_file->m_data = static_cast<unsigned char*>(data);
+  }
+
+  // the mapping stays valid
+  close(fd);
+
+  return mapped_file;
+}
+
+#endif
+
+
+}
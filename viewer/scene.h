@@ -156,7 +156,8 @@ public:
                      render_util::TerrainBase::MaterialMap::ConstPtr material_map,
                      LandTextures &textures,
                      const ShaderSearchPath &shader_search_path,
-                     const ShaderParameters &shader_params)
+                     const ShaderParameters &shader_params,
+                     std::shared_ptr<const render_util::TiledHeightMap> tiled_elevation_map = {})
   {
     m_terrain.m_terrain = render_util::createTerrain(texture_manager, true, shader_search_path);
 
@@ -173,6 +174,7 @@ public:
       .textures_nm = textures.textures_nm,
       .texture_scale = textures.texture_scale,
       .shader_parameters = shader_params,
+      .tiled_map = tiled_elevation_map,
     };
 
     m_terrain.getTerrain()->build(params);
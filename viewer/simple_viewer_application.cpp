@@ -29,6 +29,7 @@
 #include <render_util/gl_context.h>
 #include <render_util/camera.h>
 #include <render_util/gl_binding/gl_binding.h>
+#include <render_util/gl_binding/gl_debug.h>
 #include <log/file_appender.h>
 #include <log/console_appender.h>
 #include <log/txt_formatter.h>
@@ -360,10 +361,17 @@ namespace
       g_text_renderer->DrawText(parameter_text, 0, 30 + offset_y);
     }
 
+    // TextRenderer binds its objects and textures directly
+    render_util::getCurrentGLContext()->invalidate();
+    render_util::invalidateTextureState();
+
     CHECK_GL_ERROR();
 
     glfwSwapBuffers(window);
 
+    render_util::getCurrentGLContext()->nextFrame();
+    gl_binding::processGLDebugMessages();
+
     CHECK_GL_ERROR();
   }
 
@@ -431,6 +439,8 @@ void render_util::viewer::runSimpleApplication(util::Factory<SceneBase> f_create
 #endif
 
   g_text_renderer = make_unique<TextRenderer>();
+  render_util::getCurrentGLContext()->invalidate();
+  render_util::invalidateTextureState();
 
   g_last_frame_time = Clock::now();
 
@@ -464,6 +474,8 @@ void render_util::viewer::runSimpleApplication(util::Factory<SceneBase> f_create
 
   CHECK_GL_ERROR();
 
+  gl_binding::processGLDebugMessages();
+
   gl_binding::GL_Interface::setCurrent(nullptr);
 
   glfwMakeContextCurrent(0);
@@ -191,6 +191,7 @@ void SimpleViewerScene::setup()
 void SimpleViewerScene::render(float frame_delta)
 {
   m_terrain->setBaseMapOrigin(m_base_map_origin);
+  m_terrain->setBaseMapHeight(m_base_map_height);
   drawTerrain();
 }
 
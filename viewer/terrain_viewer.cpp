@@ -27,6 +27,7 @@
 #include <render_util/texture_manager.h>
 #include <render_util/map_textures.h>
 #include <render_util/texture_util.h>
+#include <render_util/texture_upload_queue.h>
 #include <render_util/texunits.h>
 #include <render_util/image_loader.h>
 #include <render_util/image_util.h>
@@ -36,6 +37,7 @@
 #include <render_util/image_util.h>
 #include <render_util/cirrus_clouds.h>
 #include <render_util/state.h>
+#include <render_util/profiler.h>
 #include <render_util/gl_binding/gl_binding.h>
 #include <log.h>
 
@@ -155,6 +157,7 @@ class TerrainViewerScene : public Scene
   render_util::ImageGreyScale::Ptr m_base_map_land;
   render_util::TexturePtr m_base_map_land_texture;
   ElevationMap::Ptr m_elevation_map_base;
+  unique_ptr<render_util::TextureUploadQueue> m_texture_uploads;
 #endif
 
   void updateUniforms(render_util::ShaderProgramPtr program) override;
@@ -254,7 +257,8 @@ void TerrainViewerScene::cursorPos(const glm::dvec2 &pos)
 void TerrainViewerScene::updateBaseWaterMapTexture()
 {
 #if ENABLE_BASE_MAP
-  setTextureImage(m_base_map_land_texture, m_base_map_land);
+  // the map is edited in place - upload a snapshot
+  m_texture_uploads->enqueueImage(m_base_map_land_texture, image::clone(m_base_map_land));
 #endif
 }
 
@@ -293,7 +297,8 @@ void TerrainViewerScene::setup()
 
   m_map = make_unique<terrain_viewer::Map>(getTextureManager());
 
-  auto elevation_map = m_map_loader->createElevationMap();
+  auto tiled_elevation_map = m_map_loader->createTiledElevationMap();
+  auto elevation_map = tiled_elevation_map ? nullptr : m_map_loader->createElevationMap();
 
   m_map_loader->createMapTextures(m_map.get());
 
@@ -303,7 +308,7 @@ void TerrainViewerScene::setup()
   m_elevation_map_base = m_map_loader->createBaseElevationMap(m_base_map_land);
 #endif
 
-  assert(elevation_map);
+  assert(elevation_map || tiled_elevation_map);
   assert(!m_map->getWaterAnimation().isEmpty());
 
   LandTextures land_textures;
@@ -314,9 +319,10 @@ void TerrainViewerScene::setup()
   m_map->getTextures().setTexture(TEXUNIT_TERRAIN_FAR, land_textures.far_texture);
 
   createTerrain(elevation_map, m_map->getMaterialMap(), land_textures,
-                shader_search_path, shader_params);
+                shader_search_path, shader_params, tiled_elevation_map);
 
-  map_size = glm::vec2(elevation_map->getSize() * m_map_loader->getHeightMapMetersPerPixel());
+  auto elevation_map_size = tiled_elevation_map ? tiled_elevation_map->getSize() : elevation_map->getSize();
+  map_size = glm::vec2(elevation_map_size * m_map_loader->getHeightMapMetersPerPixel());
 
   assert(map_size != vec2(0));
 
@@ -331,6 +337,8 @@ void TerrainViewerScene::setup()
       render_util::createTexture<render_util::ImageGreyScale>(m_base_map_land);
   getTextureManager().bind(TEXUNIT_WATER_MAP_BASE, m_base_map_land_texture);
 
+  m_texture_uploads = make_unique<render_util::TextureUploadQueue>();
+
   buildBaseMap();
 #endif
 
@@ -372,6 +380,10 @@ void TerrainViewerScene::updateUniforms(render_util::ShaderProgramPtr program)
 
 void TerrainViewerScene::render(float frame_delta)
 {
+#if ENABLE_BASE_MAP
+  m_texture_uploads->update();
+#endif
+
   gl::Enable(GL_CULL_FACE);
 
   if (!pause_animations)
@@ -388,10 +400,14 @@ void TerrainViewerScene::render(float frame_delta)
 //     gl::DepthMask(GL_FALSE);
   gl::FrontFace(GL_CW);
   gl::PolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  getCurrentGLContext()->setCurrentProgram(sky_program);
-  updateUniforms(sky_program);
+  {
+    RENDER_UTIL_PROFILE_GPU_SCOPE("sky");
+
+    getCurrentGLContext()->setCurrentProgram(sky_program);
+    updateUniforms(sky_program);
 
-  render_util::drawSkyBox();
+    render_util::drawSkyBox();
+  }
 
   gl::Disable(GL_DEPTH_TEST);
   gl::DepthMask(GL_TRUE);
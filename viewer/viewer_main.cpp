@@ -29,7 +29,9 @@
 #include <render_util/image_loader.h>
 #include <render_util/gl_context.h>
 #include <render_util/camera.h>
+#include <render_util/profiler.h>
 #include <render_util/gl_binding/gl_binding.h>
+#include <render_util/gl_binding/gl_debug.h>
 #include <log/file_appender.h>
 #include <log/console_appender.h>
 #include <log/txt_formatter.h>
@@ -160,6 +162,87 @@ namespace
   }
 
 
+  void printProfilerStatistics(ostream &out)
+  {
+    char line[200];
+
+    snprintf(line, sizeof(line), "%-40s %9s %9s %9s %9s %9s",
+             "scope (ms)", "mean", "median", "95%", "99%", "max");
+    out << endl << line << endl;
+
+    for (auto &scope : Profiler::get().getStatistics())
+    {
+      auto name = scope.name + (scope.is_gpu ? " (GPU)" : "");
+      snprintf(line, sizeof(line), "%-40s %9.3f %9.3f %9.3f %9.3f %9.3f",
+               name.c_str(), scope.mean_ms, scope.median_ms, scope.p95_ms,
+               scope.p99_ms, scope.max_ms);
+      out << line << endl;
+    }
+
+    out << endl;
+  }
+
+
+  void printBindingStatistics(ostream &out)
+  {
+    auto &stats = render_util::getCurrentGLContext()->getLastFrameStatistics();
+
+    auto print = [&out] (const char *name, const GLBindingStatistics::Counts &counts)
+    {
+      char line[200];
+      snprintf(line, sizeof(line), "%-40s %9llu %9llu", name, counts.num_issued, counts.num_elided);
+      out << line << endl;
+    };
+
+    char line[200];
+    snprintf(line, sizeof(line), "%-40s %9s %9s", "binds (last frame)", "issued", "elided");
+    out << line << endl;
+
+    print("programs", stats.programs);
+    print("vertex arrays", stats.vertex_arrays);
+    print("array buffers", stats.array_buffers);
+    print("element array buffers", stats.element_array_buffers);
+    print("uniform buffers", stats.uniform_buffers);
+    print("framebuffers", stats.framebuffers);
+
+    out << endl;
+  }
+
+
+  void printTerrainStatistics(ostream &out)
+  {
+    auto terrain = g_scene->m_terrain.getTerrain();
+    if (!terrain)
+      return;
+
+    auto stats = terrain->getStatistics();
+
+    char line[200];
+
+    snprintf(line, sizeof(line), "%-40s %9zu", "terrain nodes", stats.num_nodes);
+    out << line << endl;
+    snprintf(line, sizeof(line), "%-40s %9zu %9zu %9zu", "visited/culled/instances (last frame)",
+             stats.num_nodes_visited, stats.num_nodes_culled, stats.num_instances);
+    out << line << endl;
+    snprintf(line, sizeof(line), "%-40s %9zu", "instance bytes uploaded (last frame)",
+             stats.instance_bytes_uploaded);
+    out << line << endl;
+
+    if (stats.num_tile_requests)
+    {
+      snprintf(line, sizeof(line), "%-40s %8.2f%% %9zu %9zu KiB",
+               "tile cache hit rate/page-ins/memory", 100.0 * stats.num_tile_hits / stats.num_tile_requests, stats.num_tile_page_ins,
+               stats.tile_cache_memory / 1024);
+      out << line << endl;
+      snprintf(line, sizeof(line), "%-40s %9.3f %9.3f", "tile page-in ms (mean/max)",
+               stats.average_tile_page_in_ms, stats.max_tile_page_in_ms);
+      out << line << endl;
+    }
+
+    out << endl;
+  }
+
+
   void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
   {
     if (action == GLFW_PRESS)
@@ -258,6 +341,23 @@ namespace
       g_scene->getActiveParameter().reset();
     }
 
+    else if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+    {
+      printProfilerStatistics(cout);
+      printBindingStatistics(cout);
+      printTerrainStatistics(cout);
+    }
+    else if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+    {
+      if (util::mkdir("il2ge_map_viewer"))
+      {
+        string path = "il2ge_map_viewer/trace_" + util::makeTimeStampString() + ".json";
+        if (Profiler::get().saveChromeTrace(path))
+          cout << "saved trace to " << path << endl;
+        else
+          cerr << "failed to save " << path << endl;
+      }
+    }
     else if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
     {
       auto &out = cout;
@@ -503,6 +603,8 @@ void render_util::viewer::runApplication(util::Factory<Scene> f_create_scene, st
   gl_binding::GL_Interface *gl_interface = new gl_binding::GL_Interface(&getGLProcAddress);
   gl_binding::GL_Interface::setCurrent(gl_interface);
 
+  Profiler::get().setEnabled(true);
+
   auto globals = make_shared<render_util::viewer::Globals>();
 
   g_scene = f_create_scene();
@@ -527,6 +629,10 @@ void render_util::viewer::runApplication(util::Factory<Scene> f_create_scene, st
 
   auto text_renderer = make_unique<TextRenderer>();
 
+  // TextRenderer binds its objects and textures directly
+  render_util::getCurrentGLContext()->invalidate();
+  render_util::invalidateTextureState();
+
   Clock::time_point last_frame_time = Clock::now();
   Clock::time_point last_stats_time = Clock::now();
 
@@ -586,10 +692,17 @@ void render_util::viewer::runApplication(util::Factory<Scene> f_create_scene, st
       text_renderer->DrawText(parameter_text, 0, 30 + offset_y);
     }
 
+    render_util::getCurrentGLContext()->invalidate();
+    render_util::invalidateTextureState();
+
     CHECK_GL_ERROR();
 
     glfwSwapBuffers(window);
 
+    Profiler::get().nextFrame();
+    render_util::getCurrentGLContext()->nextFrame();
+    gl_binding::processGLDebugMessages();
+
     CHECK_GL_ERROR();
   }
 
@@ -599,12 +712,16 @@ void render_util::viewer::runApplication(util::Factory<Scene> f_create_scene, st
 
   text_renderer.reset();
 
+  Profiler::get().reset();
+
   g_scene.reset();
   globals.reset();
   gl::Finish();
 
   CHECK_GL_ERROR();
 
+  gl_binding::processGLDebugMessages();
+
   gl_binding::GL_Interface::setCurrent(nullptr);
 
   glfwMakeContextCurrent(0);